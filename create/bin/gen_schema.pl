@@ -883,9 +883,12 @@ sub close_function($)
 
 sub process_changelog($)
 {
-	my $table_type = shift;
+	my $line = shift;
+	my ($table_type, $flags) = split(/\|/, $line, 2);
 
-	if ($delete_cascade)
+	# rows removed by cascading deletes do not fire triggers in all databases, such tables
+	# must be explicitly marked if the removal of their rows is tracked by parent table changelog
+	if ($delete_cascade && (!defined($flags) || $flags ne "CASCADE"))
 	{
 		die("table '$table_name' foreign keys without RESTRICT flag are not compatible with table CHANGELOG token");
 	}
@@ -28,6 +28,7 @@
 #include "zbxvault.h"
 #include "zbxregexp.h"
 #include "zbxtagfilter.h"
+#include "zbxshmem.h"
 
 #define	ZBX_NO_POLLER			255
 #define	ZBX_POLLER_TYPE_NORMAL		0
@@ -788,6 +789,7 @@ void	zbx_dc_config_history_sync_get_triggers_by_itemids(zbx_hashset_t *trigger_i
 void	zbx_dc_config_clean_history_sync_items(zbx_history_sync_item_t *items, int *errcodes, size_t num);
 void	zbx_dc_config_history_sync_unset_existing_itemids(zbx_vector_uint64_t *itemids);
 int	zbx_dc_config_history_get_trends_sec(const char *trends_period, int trends_global, int hk_trends);
+void	zbx_dc_config_history_get_affinities(zbx_uint64_t *ids, int ids_num);
 
 void	zbx_dc_config_history_recv_get_items_by_keys(zbx_history_recv_item_t *items, const zbx_host_key_t *keys,
 		int *errcodes, size_t num);
@@ -868,8 +870,22 @@ int	zbx_dc_get_host_inventory_value_by_hostid(zbx_uint64_t hostid, char **replac
 #define ZBX_CONFSTATS_BUFFER_FREE	3
 #define ZBX_CONFSTATS_BUFFER_PUSED	4
 #define ZBX_CONFSTATS_BUFFER_PFREE	5
+#define ZBX_CONFSTATS_UMCACHE_HITS	6
+#define ZBX_CONFSTATS_UMCACHE_MISSES	7
 void	*zbx_dc_config_get_stats(int request);
 
+typedef struct
+{
+	zbx_uint64_t	strings_num;
+	zbx_uint64_t	refs_num;
+	zbx_uint64_t	size;
+	zbx_uint64_t	saved;
+}
+zbx_dc_strpool_stats_t;
+
+void	zbx_dc_get_mem_stats(zbx_shmem_stats_t *mem);
+void	zbx_dc_get_strpool_stats(zbx_dc_strpool_stats_t *stats);
+
 int	zbx_dc_config_get_last_sync_time(void);
 int	zbx_dc_config_get_proxypoller_hosts(zbx_dc_proxy_t *proxies, int max_hosts);
 int	zbx_dc_config_get_proxypoller_nextcheck(void);
@@ -54,15 +54,18 @@ zbx_wcache_info_t;
 
 void	zbx_sync_history_cache(const zbx_events_funcs_t *events_cbs, int *values_num, int *triggers_num, int *more);
 void	zbx_log_sync_history_cache_progress(void);
+void	zbx_hc_set_syncer_num(int syncer_num);
+void	zbx_hc_history_writer_start(void);
+void	zbx_hc_history_writer_stop(void);
 
 #define ZBX_SYNC_NONE	0
 #define ZBX_SYNC_ALL	1
 
 typedef void (*zbx_history_sync_f)(int *values_num, int *triggers_num, const zbx_events_funcs_t *events_cbs, int *more);
 
-int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_history_sync_f sync_history,
-		zbx_uint64_t history_cache_size, zbx_uint64_t history_index_cache_size,zbx_uint64_t *trends_cache_size,
-		char **error);
+int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_get_config_forks_f get_config_forks,
+		zbx_history_sync_f sync_history, zbx_uint64_t history_cache_size, zbx_uint64_t history_index_cache_size,
+		const char *spill_file, zbx_uint64_t spill_file_size, zbx_uint64_t *trends_cache_size, char **error);
 
 void	zbx_free_database_cache(int sync, const zbx_events_funcs_t *events_cbs);
 
@@ -122,6 +125,17 @@ void	zbx_dc_update_interfaces_availability(void);
 
 void	zbx_hc_get_diag_stats(zbx_uint64_t *items_num, zbx_uint64_t *values_num);
 void	zbx_hc_get_mem_stats(zbx_shmem_stats_t *data, zbx_shmem_stats_t *index);
+
+typedef struct
+{
+	zbx_uint64_t	size;
+	zbx_uint64_t	slabs;
+	zbx_uint64_t	used;
+	zbx_uint64_t	free;
+}
+zbx_hc_slab_stats_t;
+
+void	zbx_hc_get_slab_stats(zbx_vector_ptr_t *stats);
 void	zbx_hc_get_items(zbx_vector_uint64_pair_t *items);
 
 int	zbx_db_trigger_queue_locked(void);
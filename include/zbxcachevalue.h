@@ -64,6 +64,13 @@
 /* indicates that all values from database are cached */
 #define ZBX_ITEM_STATUS_CACHED_ALL	1
 
+/* the running aggregate functions, see zbx_vc_get_aggregate() */
+#define ZBX_VC_AGGREGATE_SUM	0
+#define ZBX_VC_AGGREGATE_AVG	1
+#define ZBX_VC_AGGREGATE_MIN	2
+#define ZBX_VC_AGGREGATE_MAX	3
+#define ZBX_VC_AGGREGATE_COUNT	4
+
 /* the cache statistics */
 typedef struct
 {
@@ -108,7 +115,11 @@ int	zbx_vc_get_values(zbx_uint64_t itemid, unsigned char value_type, zbx_vector_
 int	zbx_vc_get_value(zbx_uint64_t itemid, unsigned char value_type, const zbx_timespec_t *ts,
 		zbx_history_record_t *value);
 
+int	zbx_vc_get_aggregate(zbx_uint64_t itemid, unsigned char value_type, int func, int seconds, int count,
+		const zbx_timespec_t *ts, zbx_history_value_t *value, int *values_num);
+
 int	zbx_vc_add_values(zbx_vector_ptr_t *history, int *ret_flush);
+void	zbx_vc_cache_values(const zbx_vector_ptr_t *history);
 
 int	zbx_vc_get_statistics(zbx_vc_stats_t *stats);
 
@@ -121,4 +132,9 @@ void	zbx_vc_flush_stats(void);
 
 void	zbx_vc_add_new_items(const zbx_vector_uint64_pair_t *items);
 
+void	zbx_vc_save_items(const char *path);
+void	zbx_vc_warmup(const char *path);
+void	zbx_vc_dump(const char *path);
+void	zbx_vc_restore(const char *path);
+
 #endif
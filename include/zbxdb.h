@@ -82,6 +82,7 @@ void	zbx_db_init_autoincrement_options_basic(void);
 
 int	zbx_db_connect_basic(const zbx_config_dbhigh_t *cfg);
 void	zbx_db_close_basic(void);
+void	zbx_db_thread_deinit_basic(void);
 
 int	zbx_db_begin_basic(void);
 int	zbx_db_commit_basic(void);
@@ -143,6 +144,9 @@ void	zbx_postgresql_escape_bin(const char *src, char **dst, size_t size);
 #endif
 
 int		zbx_db_vexecute(const char *fmt, va_list args);
+#if defined(HAVE_POSTGRESQL)
+int		zbx_db_copy_binary_basic(const char *table, const char *fields, const char *data, size_t size);
+#endif
 zbx_db_result_t	zbx_db_vselect(const char *fmt, va_list args);
 zbx_db_result_t	zbx_db_select_n_basic(const char *query, int n);
 
@@ -253,6 +257,10 @@ struct zbx_db_version_info_t
 };
 
 void	zbx_dbms_version_info_extract(struct zbx_db_version_info_t *version_info);
+zbx_uint32_t	zbx_dbms_version_get(void);
+#ifdef HAVE_MYSQL
+int	zbx_dbms_mariadb_used(void);
+#endif
 #ifdef HAVE_POSTGRESQL
 void	zbx_tsdb_info_extract(struct zbx_db_version_info_t *version_info);
 void	zbx_tsdb_set_compression_availability(int compression_availabile);
@@ -499,6 +499,9 @@ void	zbx_db_statement_prepare(const char *sql);
 void	zbx_db_table_prepare(const char *tablename, struct zbx_json *json);
 int	zbx_db_check_oracle_colum_type(const char *table_name, const char *column_name, int expected_type);
 #endif
+#ifdef HAVE_POSTGRESQL
+int	zbx_db_copy_binary(const char *table, const char *fields, const char *data, size_t size);
+#endif
 int		zbx_db_execute(const char *fmt, ...) __zbx_attr_format_printf(1, 2);
 int		zbx_db_execute_once(const char *fmt, ...) __zbx_attr_format_printf(1, 2);
 zbx_db_result_t	zbx_db_select(const char *fmt, ...) __zbx_attr_format_printf(1, 2);
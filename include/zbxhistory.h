@@ -58,6 +58,8 @@ void	zbx_history_destroy(void);
 int	zbx_history_add_values(const zbx_vector_ptr_t *history, int *ret_flush);
 int	zbx_history_get_values(zbx_uint64_t itemid, int value_type, int start, int count, int end,
 		zbx_vector_history_record_t *values);
+int	zbx_history_get_values_multi(const zbx_vector_uint64_t *itemids, int value_type, int start, int end,
+		zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values);
 
 int	zbx_history_requires_trends(int value_type);
 void	zbx_history_check_version(struct zbx_json *json, int *result, int config_allow_unsupported_db_versions);
@@ -73,6 +75,7 @@ void	zbx_history_check_version(struct zbx_json *json, int *result, int config_al
 #define ZBX_DC_FLAG_NOHISTORY	0x10	/* values should not be kept in history */
 #define ZBX_DC_FLAG_NOTRENDS	0x20	/* values should not be kept in trends */
 #define ZBX_DC_FLAG_HASTRIGGER	0x40	/* value is used in trigger expression */
+#define ZBX_DC_FLAG_TRENDSONLY	0x80	/* item keeps only trends, queued values can be folded into trends */
 
 typedef struct
 {
@@ -57,6 +57,36 @@ typedef enum
 	ZBX_MUTEX_REMOTE_COMMANDS,
 	ZBX_MUTEX_PROXY_BUFFER,
 	ZBX_MUTEX_VPS_MONITOR,
+	ZBX_MUTEX_UM_CACHE,
+	ZBX_MUTEX_ITEM_QUEUE_NORMAL,
+	ZBX_MUTEX_ITEM_QUEUE_IPMI,
+	ZBX_MUTEX_ITEM_QUEUE_PINGER,
+	ZBX_MUTEX_ITEM_QUEUE_HISTORY,
+	ZBX_MUTEX_ITEM_QUEUE_ODBC,
+	ZBX_MUTEX_ITEM_QUEUE_HTTPAGENT,
+	ZBX_MUTEX_ITEM_QUEUE_AGENT,
+	ZBX_MUTEX_ITEM_QUEUE_SNMP,
+	ZBX_MUTEX_ITEM_QUEUE_INTERNAL,
+	ZBX_MUTEX_ITEM_QUEUE_MEM,
+	/* history cache shard locks must be consecutive, see ZBX_HC_SHARDS_MAX */
+	ZBX_MUTEX_CACHE_SHARD_0,
+	ZBX_MUTEX_CACHE_SHARD_1,
+	ZBX_MUTEX_CACHE_SHARD_2,
+	ZBX_MUTEX_CACHE_SHARD_3,
+	ZBX_MUTEX_CACHE_SHARD_4,
+	ZBX_MUTEX_CACHE_SHARD_5,
+	ZBX_MUTEX_CACHE_SHARD_6,
+	ZBX_MUTEX_CACHE_SHARD_7,
+	/* history cache shard ingestion buffer locks must be consecutive, see ZBX_HC_SHARDS_MAX */
+	ZBX_MUTEX_CACHE_INGEST_0,
+	ZBX_MUTEX_CACHE_INGEST_1,
+	ZBX_MUTEX_CACHE_INGEST_2,
+	ZBX_MUTEX_CACHE_INGEST_3,
+	ZBX_MUTEX_CACHE_INGEST_4,
+	ZBX_MUTEX_CACHE_INGEST_5,
+	ZBX_MUTEX_CACHE_INGEST_6,
+	ZBX_MUTEX_CACHE_INGEST_7,
+	ZBX_MUTEX_CACHE_SPILL,
 	/* NOTE: Do not forget to sync changes here with mutex names in diag_add_locks_info()! */
 	ZBX_MUTEX_COUNT
 }
@@ -67,6 +97,16 @@ typedef enum
 	ZBX_RWLOCK_CONFIG = 0,
 	ZBX_RWLOCK_CONFIG_HISTORY,
 	ZBX_RWLOCK_VALUECACHE,
+	/* value cache item locks must be consecutive, see ZBX_VC_ITEM_LOCKS_NUM */
+	ZBX_RWLOCK_VALUECACHE_ITEMS_0,
+	ZBX_RWLOCK_VALUECACHE_ITEMS_1,
+	ZBX_RWLOCK_VALUECACHE_ITEMS_2,
+	ZBX_RWLOCK_VALUECACHE_ITEMS_3,
+	ZBX_RWLOCK_VALUECACHE_ITEMS_4,
+	ZBX_RWLOCK_VALUECACHE_ITEMS_5,
+	ZBX_RWLOCK_VALUECACHE_ITEMS_6,
+	ZBX_RWLOCK_VALUECACHE_ITEMS_7,
+	/* NOTE: Do not forget to sync changes here with read-write lock names in diag_add_locks_info()! */
 	ZBX_RWLOCK_COUNT,
 }
 zbx_rwlock_name_t;
@@ -48,6 +48,7 @@ typedef struct
 	int			num;
 	int			disable_from;
 	unsigned char		value_type;
+	unsigned char		trends_only;	/* values can be folded into trend when added to history cache */
 }
 ZBX_DC_TREND;
 
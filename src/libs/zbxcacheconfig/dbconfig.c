@@ -162,6 +162,135 @@ struct zbx_dc_um_handle_t
 
 static zbx_dc_um_handle_t	*dc_um_handle = NULL;
 
+/* Published user macro cache is never updated in place - configuration syncer  */
+/* builds updated copy and publishes it by replacing config->um_cache pointer.   */
+/* Readers acquire references to the published cache with a short um_cache_lock */
+/* instead of configuration cache lock, so they are not blocked by running sync. */
+static zbx_mutex_t	um_cache_lock = ZBX_MUTEX_NULL;
+
+#define LOCK_UM_CACHE	zbx_mutex_lock(um_cache_lock)
+#define UNLOCK_UM_CACHE	zbx_mutex_unlock(um_cache_lock)
+
+/* Pollers take and return items under configuration cache read lock and protect the */
+/* item queues with per poller type locks instead. Normal, unreachable and Java queues */
+/* share one lock because items are moved between them when host reachability        */
+/* changes. Configuration cache write lock holders exclude the readers, so they can   */
+/* access queues without taking the queue locks.                                      */
+static zbx_mutex_t	item_queue_locks[ZBX_POLLER_TYPE_COUNT];
+
+/* queues are allocated in configuration cache shared memory, serialize allocations */
+/* made by pollers holding different queue locks                                    */
+static zbx_mutex_t	item_queue_mem_lock = ZBX_MUTEX_NULL;
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: acquire reference to the published user macro cache               *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_um_cache_t	*dc_um_cache_acquire(void)
+{
+	zbx_um_cache_t	*cache;
+
+	LOCK_UM_CACHE;
+
+	cache = config->um_cache;
+	cache->refcount++;
+
+	UNLOCK_UM_CACHE;
+
+	return cache;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: release reference to user macro cache acquired with               *
+ *          dc_um_cache_acquire()                                             *
+ *                                                                            *
+ * Comments: Configuration cache is not locked, so caches without references  *
+ *           are freed later by configuration syncer.                         *
+ *           User macro resolving statistics collected by the calling thread  *
+ *           are added to the shared statistics here.                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_um_cache_release(zbx_um_cache_t *cache)
+{
+	zbx_uint64_t	hits, misses;
+
+	um_cache_pop_resolve_stats(&hits, &misses);
+
+	LOCK_UM_CACHE;
+	cache->refcount--;
+	config->um_resolve_hits += hits;
+	config->um_resolve_misses += misses;
+	UNLOCK_UM_CACHE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: free replaced user macro caches that are not referenced anymore   *
+ *                                                                            *
+ * Comments: Must be called with configuration cache write lock.              *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_um_cache_reclaim(void)
+{
+	int	i;
+
+	for (i = 0; i < config->um_cache_retired.values_num;)
+	{
+		zbx_um_cache_t	*cache = (zbx_um_cache_t *)config->um_cache_retired.values[i];
+		zbx_uint32_t	refcount;
+
+		LOCK_UM_CACHE;
+		refcount = cache->refcount;
+		UNLOCK_UM_CACHE;
+
+		/* cache is not published, so it cannot be acquired again */
+		if (0 != refcount)
+		{
+			i++;
+			continue;
+		}
+
+		zbx_vector_ptr_remove_noorder(&config->um_cache_retired, i);
+		um_cache_free(cache);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: replace published user macro cache with its updated copy and     *
+ *          free replaced caches that are not referenced anymore              *
+ *                                                                            *
+ * Parameters: cache - [IN] the user macro cache to publish                   *
+ *                                                                            *
+ * Comments: Must be called with configuration cache write lock.              *
+ *                                                                            *
+ ******************************************************************************/
+void	dc_um_cache_publish(zbx_um_cache_t *cache)
+{
+	zbx_um_cache_t	*old_cache = config->um_cache;
+
+	if (cache != old_cache)
+	{
+		zbx_uint32_t	refcount;
+
+		LOCK_UM_CACHE;
+
+		config->um_cache = cache;
+		refcount = --old_cache->refcount;
+
+		UNLOCK_UM_CACHE;
+
+		if (0 == refcount)
+			um_cache_free(old_cache);
+		else
+			zbx_vector_ptr_append(&config->um_cache_retired, old_cache);
+	}
+
+	dc_um_cache_reclaim();
+}
+
 /******************************************************************************
  *                                                                            *
  * Parameters: type - [IN] item type [ITEM_TYPE_* flag]                       *
@@ -563,17 +692,10 @@ int	DCitem_nextcheck_update(ZBX_DC_ITEM *item, const ZBX_DC_INTERFACE *interface
 	return SUCCEED;
 }
 
-static void	DCitem_poller_type_update(ZBX_DC_ITEM *dc_item, const ZBX_DC_HOST *dc_host, int flags)
+static unsigned char	dc_item_poller_type(const ZBX_DC_ITEM *dc_item)
 {
-	unsigned char	poller_type;
 	unsigned char	snmp_oid_type = ZBX_SNMP_OID_TYPE_MACRO; /* oid type is only used by ITEM_TYPE_SNMP*/
 
-	if (0 != dc_host->proxyid && SUCCEED != zbx_is_item_processed_by_server(dc_item->type, dc_item->key))
-	{
-		dc_item->poller_type = ZBX_NO_POLLER;
-		return;
-	}
-
 	if (ITEM_TYPE_SNMP == dc_item->type)
 	{
 		ZBX_DC_SNMPITEM	*snmpitem;
@@ -582,7 +704,20 @@ static void	DCitem_poller_type_update(ZBX_DC_ITEM *dc_item, const ZBX_DC_HOST *d
 			snmp_oid_type = snmpitem->snmp_oid_type;
 	}
 
-	poller_type = poller_by_item(dc_item->type, dc_item->key, snmp_oid_type);
+	return poller_by_item(dc_item->type, dc_item->key, snmp_oid_type);
+}
+
+static void	DCitem_poller_type_update(ZBX_DC_ITEM *dc_item, const ZBX_DC_HOST *dc_host, int flags)
+{
+	unsigned char	poller_type;
+
+	if (0 != dc_host->proxyid && SUCCEED != zbx_is_item_processed_by_server(dc_item->type, dc_item->key))
+	{
+		dc_item->poller_type = ZBX_NO_POLLER;
+		return;
+	}
+
+	poller_type = dc_item_poller_type(dc_item);
 
 	if (0 != (flags & ZBX_HOST_UNREACHABLE))
 	{
@@ -606,8 +741,116 @@ static void	DCitem_poller_type_update(ZBX_DC_ITEM *dc_item, const ZBX_DC_HOST *d
 	}
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: gets lock protecting queue of the specified poller type           *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_mutex_t	dc_queue_lock(unsigned char poller_type)
+{
+	if (ZBX_NO_POLLER == poller_type)
+		return ZBX_MUTEX_NULL;
+
+	return item_queue_locks[poller_type];
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: gets lock protecting queues the item can be placed in by pollers  *
+ *                                                                            *
+ * Comments: Pollers can move items only between queues sharing the same      *
+ *           lock, the queues of other types are assigned during              *
+ *           configuration sync. Items that are not processed by pollers      *
+ *           (ZBX_NO_POLLER) are not protected by queue locks.                *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_mutex_t	dc_item_queue_lock(const ZBX_DC_ITEM *dc_item)
+{
+	return dc_queue_lock(dc_item_poller_type(dc_item));
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: switches to the queue lock required by the next item              *
+ *                                                                            *
+ * Parameters: locked - [IN/OUT] currently held queue lock                    *
+ *             lock   - [IN] the required queue lock                          *
+ *                                                                            *
+ * Comments: Items returned by pollers usually belong to the same queue, so   *
+ *           the lock is kept while processing consecutive items.             *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_queue_relock(zbx_mutex_t *locked, zbx_mutex_t lock)
+{
+	if (*locked == lock)
+		return;
+
+	if (ZBX_MUTEX_NULL != *locked)
+		zbx_mutex_unlock(*locked);
+
+	if (ZBX_MUTEX_NULL != (*locked = lock))
+		zbx_mutex_lock(lock);
+}
+
+static zbx_mutex_name_t	dc_queue_mutex_name(int poller_type)
+{
+	switch (poller_type)
+	{
+		case ZBX_POLLER_TYPE_IPMI:
+			return ZBX_MUTEX_ITEM_QUEUE_IPMI;
+		case ZBX_POLLER_TYPE_PINGER:
+			return ZBX_MUTEX_ITEM_QUEUE_PINGER;
+		case ZBX_POLLER_TYPE_HISTORY:
+			return ZBX_MUTEX_ITEM_QUEUE_HISTORY;
+		case ZBX_POLLER_TYPE_ODBC:
+			return ZBX_MUTEX_ITEM_QUEUE_ODBC;
+		case ZBX_POLLER_TYPE_HTTPAGENT:
+			return ZBX_MUTEX_ITEM_QUEUE_HTTPAGENT;
+		case ZBX_POLLER_TYPE_AGENT:
+			return ZBX_MUTEX_ITEM_QUEUE_AGENT;
+		case ZBX_POLLER_TYPE_SNMP:
+			return ZBX_MUTEX_ITEM_QUEUE_SNMP;
+		case ZBX_POLLER_TYPE_INTERNAL:
+			return ZBX_MUTEX_ITEM_QUEUE_INTERNAL;
+		default:
+			/* normal, unreachable and Java pollers */
+			return ZBX_MUTEX_ITEM_QUEUE_NORMAL;
+	}
+}
+
+static void	*dc_queue_shmem_malloc_func(void *old, size_t size)
+{
+	void	*ptr;
+
+	zbx_mutex_lock(item_queue_mem_lock);
+	ptr = __config_shmem_malloc_func(old, size);
+	zbx_mutex_unlock(item_queue_mem_lock);
+
+	return ptr;
+}
+
+static void	*dc_queue_shmem_realloc_func(void *old, size_t size)
+{
+	void	*ptr;
+
+	zbx_mutex_lock(item_queue_mem_lock);
+	ptr = __config_shmem_realloc_func(old, size);
+	zbx_mutex_unlock(item_queue_mem_lock);
+
+	return ptr;
+}
+
+static void	dc_queue_shmem_free_func(void *ptr)
+{
+	zbx_mutex_lock(item_queue_mem_lock);
+	__config_shmem_free_func(ptr);
+	zbx_mutex_unlock(item_queue_mem_lock);
+}
+
 static void	DCincrease_disable_until(ZBX_DC_INTERFACE *interface, int now, int config_timeout)
 {
+	/* interface can be shared by pollers of different types holding only their queue */
+	/* locks, but all of them would set the same value                                 */
 	if (NULL != interface && 0 != interface->errors_from)
 		interface->disable_until = now + config_timeout;
 }
@@ -721,18 +964,20 @@ const char	*dc_strpool_intern(const char *str)
 {
 	void		*record;
 	zbx_uint32_t	*refcount;
+	int		num_data;
 
 	if (NULL == str)
 		return NULL;
 
-	record = zbx_hashset_search(&config->strpool, str - REFCOUNT_FIELD_SIZE);
+	/* insert returns the existing record if the string is already interned, so the */
+	/* string is hashed only once - new records are detected by changed pool size   */
+	num_data = config->strpool.num_data;
 
-	if (NULL == record)
-	{
-		record = zbx_hashset_insert_ext(&config->strpool, str - REFCOUNT_FIELD_SIZE,
-				REFCOUNT_FIELD_SIZE + strlen(str) + 1, REFCOUNT_FIELD_SIZE);
+	record = zbx_hashset_insert_ext(&config->strpool, str - REFCOUNT_FIELD_SIZE,
+			REFCOUNT_FIELD_SIZE + strlen(str) + 1, REFCOUNT_FIELD_SIZE);
+
+	if (num_data != config->strpool.num_data)
 		*(zbx_uint32_t *)record = 0;
-	}
 
 	refcount = (zbx_uint32_t *)record;
 	(*refcount)++;
@@ -746,7 +991,7 @@ void	dc_strpool_release(const char *str)
 
 	refcount = (zbx_uint32_t *)(str - REFCOUNT_FIELD_SIZE);
 	if (0 == --(*refcount))
-		zbx_hashset_remove(&config->strpool, str - REFCOUNT_FIELD_SIZE);
+		zbx_hashset_remove_direct(&config->strpool, refcount);
 }
 
 const char	*dc_strpool_acquire(const char *str)
@@ -2011,8 +2256,12 @@ void	zbx_dc_sync_kvs_paths(const struct zbx_json_parse *jp_kvs_paths, const zbx_
 
 		if (0 != diff.values_num)
 		{
+			zbx_um_cache_t	*um_cache;
+
 			START_SYNC;
 
+			um_cache = config->um_cache;
+
 			config->revision.config++;
 
 			for (j = 0; j < diff.values_num; j++)
@@ -2032,12 +2281,14 @@ void	zbx_dc_sync_kvs_paths(const struct zbx_json_parse *jp_kvs_paths, const zbx_
 					dc_kv->value = NULL;
 				}
 
-				config->um_cache = um_cache_set_value_to_macros(config->um_cache,
-						config->revision.config, &dc_kv->macros, dc_kv->value);
+				um_cache = um_cache_set_value_to_macros(um_cache, config->revision.config,
+						&dc_kv->macros, dc_kv->value);
 
 				dc_kv->update = 0;
 			}
 
+			dc_um_cache_publish(um_cache);
+
 			FINISH_SYNC;
 		}
 
@@ -2960,6 +3211,7 @@ static void	DCsync_items(zbx_dbsync_t *sync, zbx_uint64_t revision, int flags, z
 		if (0 == found)
 		{
 			item->triggers = NULL;
+			item->history_affinity = 0;
 			item->update_triggers = 0;
 			item->nextcheck = 0;
 			item->state = (unsigned char)atoi(row[12]);
@@ -4008,7 +4260,7 @@ static void	DCsync_triggers(zbx_dbsync_t *sync, zbx_uint64_t revision)
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
-static void	DCconfig_sort_triggers_topologically(void);
+static void	DCconfig_sort_triggers_topologically(const zbx_vector_ptr_t *trigdeps);
 
 /******************************************************************************
  *                                                                            *
@@ -4020,6 +4272,7 @@ static int	dc_trigger_deplist_release(ZBX_DC_TRIGGER_DEPLIST *trigdep)
 	if (0 == --trigdep->refcount)
 	{
 		zbx_vector_ptr_destroy(&trigdep->dependencies);
+		zbx_vector_ptr_destroy(&trigdep->dependents);
 		zbx_hashset_remove_direct(&config->trigdeps, trigdep);
 		return SUCCEED;
 	}
@@ -4038,6 +4291,8 @@ static void	dc_trigger_deplist_init(ZBX_DC_TRIGGER_DEPLIST *trigdep, ZBX_DC_TRIG
 	trigdep->trigger = trigger;
 	zbx_vector_ptr_create_ext(&trigdep->dependencies, __config_shmem_malloc_func, __config_shmem_realloc_func,
 			__config_shmem_free_func);
+	zbx_vector_ptr_create_ext(&trigdep->dependents, __config_shmem_malloc_func, __config_shmem_realloc_func,
+			__config_shmem_free_func);
 }
 
 /******************************************************************************
@@ -4053,7 +4308,15 @@ static void	dc_trigger_deplist_reset(ZBX_DC_TRIGGER_DEPLIST *trigdep)
 			__config_shmem_free_func);
 }
 
-static void	DCsync_trigdeps(zbx_dbsync_t *sync)
+/******************************************************************************
+ *                                                                            *
+ * Purpose: synchronizes trigger dependencies                                 *
+ *                                                                            *
+ * Parameters: sync       - [IN] the db synchronization data                  *
+ *             triggerids - [OUT] the triggers with changed dependencies      *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCsync_trigdeps(zbx_dbsync_t *sync, zbx_vector_uint64_t *triggerids)
 {
 	char			**row;
 	zbx_uint64_t		rowid;
@@ -4100,6 +4363,8 @@ static void	DCsync_trigdeps(zbx_dbsync_t *sync)
 			trigdep_up->refcount++;
 
 		zbx_vector_ptr_append(&trigdep_down->dependencies, trigdep_up);
+		zbx_vector_ptr_append(&trigdep_up->dependents, trigdep_down);
+		zbx_vector_uint64_append(triggerids, triggerid_down);
 	}
 
 	/* remove deleted trigger dependencies from buffer */
@@ -4112,10 +4377,18 @@ static void	DCsync_trigdeps(zbx_dbsync_t *sync)
 			continue;
 		}
 
+		zbx_vector_uint64_append(triggerids, triggerid_down);
+
 		ZBX_STR2UINT64(triggerid_up, row[1]);
 		if (NULL != (trigdep_up = (ZBX_DC_TRIGGER_DEPLIST *)zbx_hashset_search(&config->trigdeps,
 				&triggerid_up)))
 		{
+			if (FAIL != (index = zbx_vector_ptr_search(&trigdep_up->dependents, &triggerid_down,
+					ZBX_DEFAULT_UINT64_PTR_COMPARE_FUNC)))
+			{
+				zbx_vector_ptr_remove_noorder(&trigdep_up->dependents, index);
+			}
+
 			dc_trigger_deplist_release(trigdep_up);
 		}
 
@@ -6609,26 +6882,86 @@ static void	dc_sync_httpstep_fields(zbx_dbsync_t *sync, zbx_uint64_t revision)
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds trigger dependency list to topology update if it was not     *
+ *          added already                                                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_trigger_topology_add(zbx_hashset_t *added, zbx_vector_ptr_t *trigdeps,
+		ZBX_DC_TRIGGER_DEPLIST *trigdep)
+{
+	int	num_data = added->num_data;
+
+	zbx_hashset_insert(added, &trigdep->triggerid, sizeof(trigdep->triggerid));
+
+	if (num_data != added->num_data)
+		zbx_vector_ptr_append(trigdeps, trigdep);
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: updates trigger topology after trigger dependency changes         *
  *                                                                            *
+ * Parameters: triggerids - [IN] the triggers with changed dependencies       *
+ *                                                                            *
+ * Comments: Topology indexes are recalculated only for the triggers with     *
+ *           changed dependencies and the triggers directly or indirectly     *
+ *           depending on them.                                               *
+ *                                                                            *
  ******************************************************************************/
-static void	dc_trigger_update_topology(void)
+static void	dc_trigger_update_topology(zbx_vector_uint64_t *triggerids)
 {
-	zbx_hashset_iter_t	iter;
+	int			i, j;
 	ZBX_DC_TRIGGER		*trigger;
+	ZBX_DC_TRIGGER_DEPLIST	*trigdep;
+	zbx_vector_ptr_t	trigdeps;
+	zbx_hashset_t		added;
 
-	zbx_hashset_iter_reset(&config->triggers, &iter);
-	while (NULL != (trigger = (ZBX_DC_TRIGGER *)zbx_hashset_iter_next(&iter)))
+	zbx_vector_uint64_sort(triggerids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_vector_uint64_uniq(triggerids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	zbx_vector_ptr_create(&trigdeps);
+	zbx_hashset_create(&added, (size_t)triggerids->values_num, ZBX_DEFAULT_UINT64_HASH_FUNC,
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	for (i = 0; i < triggerids->values_num; i++)
 	{
-		if (ZBX_FLAG_DISCOVERY_PROTOTYPE == trigger->flags)
-			continue;
+		/* trigger dependency list is removed together with the last dependency */
+		if (NULL != (trigger = (ZBX_DC_TRIGGER *)zbx_hashset_search(&config->triggers,
+				&triggerids->values[i])) && ZBX_FLAG_DISCOVERY_PROTOTYPE != trigger->flags)
+		{
+			trigger->topoindex = 1;
+		}
 
-		trigger->topoindex = 1;
+		if (NULL != (trigdep = (ZBX_DC_TRIGGER_DEPLIST *)zbx_hashset_search(&config->trigdeps,
+				&triggerids->values[i])))
+		{
+			dc_trigger_topology_add(&added, &trigdeps, trigdep);
+		}
 	}
 
-	DCconfig_sort_triggers_topologically();
+	for (i = 0; i < trigdeps.values_num; i++)
+	{
+		trigdep = (ZBX_DC_TRIGGER_DEPLIST *)trigdeps.values[i];
+
+		for (j = 0; j < trigdep->dependents.values_num; j++)
+		{
+			dc_trigger_topology_add(&added, &trigdeps,
+					(ZBX_DC_TRIGGER_DEPLIST *)trigdep->dependents.values[j]);
+		}
+
+		if (NULL != (trigger = trigdep->trigger) && ZBX_FLAG_DISCOVERY_PROTOTYPE != trigger->flags)
+			trigger->topoindex = 1;
+	}
+
+	DCconfig_sort_triggers_topologically(&trigdeps);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() changed:%d updated:%d", __func__, triggerids->values_num,
+			trigdeps.values_num);
+
+	zbx_hashset_destroy(&added);
+	zbx_vector_ptr_destroy(&trigdeps);
 }
 
 static int	zbx_default_ptr_pair_ptr_compare_func(const void *d1, const void *d2)
@@ -6739,6 +7072,97 @@ static void	dc_item_reset_triggers(ZBX_DC_ITEM *item, ZBX_DC_TRIGGER *trigger_ex
 	item->triggers = NULL;
 }
 
+typedef struct
+{
+	zbx_uint64_t	itemid;
+	zbx_uint64_t	rootid;
+}
+zbx_dc_item_affinity_t;
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: finds the root of item affinity group                             *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_dc_item_affinity_t	*dc_item_affinity_find(zbx_hashset_t *affinities, zbx_uint64_t itemid)
+{
+	zbx_dc_item_affinity_t	*node, *root, local = {itemid, itemid};
+
+	if (NULL == (node = (zbx_dc_item_affinity_t *)zbx_hashset_search(affinities, &itemid)))
+		return (zbx_dc_item_affinity_t *)zbx_hashset_insert(affinities, &local, sizeof(local));
+
+	for (root = node; root->rootid != root->itemid;)
+		root = (zbx_dc_item_affinity_t *)zbx_hashset_search(affinities, &root->rootid);
+
+	/* compress the path */
+	while (node->rootid != root->itemid)
+	{
+		zbx_uint64_t	rootid = node->rootid;
+
+		node->rootid = root->itemid;
+		node = (zbx_dc_item_affinity_t *)zbx_hashset_search(affinities, &rootid);
+	}
+
+	return root;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: updates history syncer affinity of items                          *
+ *                                                                            *
+ * Comments: Items used by the same enabled triggers, directly or through     *
+ *           other items, form an affinity group identified by the smallest   *
+ *           itemid of the group. Values of items in the same group are       *
+ *           processed by the same history syncer, so syncers do not skip     *
+ *           items because of triggers locked by other syncers.               *
+ *           Items without triggers have no affinity (0).                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_item_update_history_affinity(void)
+{
+	zbx_hashset_iter_t	iter;
+	zbx_hashset_t		affinities;
+	ZBX_DC_TRIGGER		*trigger;
+	ZBX_DC_ITEM		*item;
+	zbx_dc_item_affinity_t	*root, *root_next, *node;
+	zbx_uint64_t		*itemid;
+
+	zbx_hashset_create(&affinities, (size_t)config->triggers.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	zbx_hashset_iter_reset(&config->triggers, &iter);
+	while (NULL != (trigger = (ZBX_DC_TRIGGER *)zbx_hashset_iter_next(&iter)))
+	{
+		if (TRIGGER_STATUS_ENABLED != trigger->status || NULL == trigger->itemids || 0 == trigger->itemids[0] ||
+				0 == trigger->itemids[1])
+		{
+			continue;
+		}
+
+		for (itemid = trigger->itemids + 1; 0 != *itemid; itemid++)
+		{
+			root = dc_item_affinity_find(&affinities, trigger->itemids[0]);
+			root_next = dc_item_affinity_find(&affinities, *itemid);
+
+			if (root->itemid < root_next->itemid)
+				root_next->rootid = root->itemid;
+			else
+				root->rootid = root_next->itemid;
+		}
+	}
+
+	zbx_hashset_iter_reset(&config->items, &iter);
+	while (NULL != (item = (ZBX_DC_ITEM *)zbx_hashset_iter_next(&iter)))
+	{
+		if (NULL == (node = (zbx_dc_item_affinity_t *)zbx_hashset_search(&affinities, &item->itemid)))
+			item->history_affinity = 0;
+		else
+			item->history_affinity = dc_item_affinity_find(&affinities, node->itemid)->itemid;
+	}
+
+	zbx_hashset_destroy(&affinities);
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: updates trigger related cache data;                               *
@@ -6746,6 +7170,7 @@ static void	dc_item_reset_triggers(ZBX_DC_ITEM *item, ZBX_DC_TRIGGER *trigger_ex
  *              2) trigger functionality (if it uses contain disabled         *
  *                 items/hosts)                                               *
  *              3) list of triggers each item is used by                      *
+ *              4) history syncer affinity of items                           *
  *                                                                            *
  ******************************************************************************/
 static void	dc_trigger_update_cache(void)
@@ -6857,6 +7282,9 @@ static void	dc_trigger_update_cache(void)
 	}
 
 	zbx_vector_ptr_pair_destroy(&itemtrigs);
+
+	if (0 != (get_program_type_cb() & ZBX_PROGRAM_TYPE_SERVER))
+		dc_item_update_history_affinity();
 }
 
 /******************************************************************************
@@ -7460,10 +7888,14 @@ zbx_uint64_t	zbx_dc_sync_configuration(unsigned char mode, zbx_synced_new_config
 	int				connectors_num = 0;
 	zbx_hashset_t			psk_owners;
 	zbx_vector_dc_item_ptr_t	new_items, *pnew_items = NULL;
+	zbx_vector_dbsync_compare_t	compares;
+	zbx_vector_uint64_t		trigdep_triggerids;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
 	zbx_hashset_create(&activated_hosts, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_vector_dbsync_compare_create(&compares);
+	zbx_vector_uint64_create(&trigdep_triggerids);
 
 	sec = zbx_time();
 	changelog_num = zbx_dbsync_env_prepare(mode);
@@ -7582,30 +8014,19 @@ zbx_uint64_t	zbx_dc_sync_configuration(unsigned char mode, zbx_synced_new_config
 
 	/* sync macro related data, to support macro resolving during configuration sync */
 
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_host_templates(&htmpl_sync))
-		goto out;
-	htsec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_global_macros(&gmacro_sync))
-		goto out;
-	gmsec = zbx_time() - sec;
+	zbx_vector_dbsync_compare_clear(&compares);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_host_templates, &htmpl_sync, &htsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_global_macros, &gmacro_sync, &gmsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_host_macros, &hmacro_sync, &hmsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_host_tags, &host_tag_sync, &host_tag_sec, 0);
 
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_host_macros(&hmacro_sync))
+	if (FAIL == zbx_dbsync_compare_parallel(&compares))
 		goto out;
-	hmsec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_host_tags(&host_tag_sync))
-		goto out;
-	host_tag_sec = zbx_time() - sec;
 
 	START_SYNC;
 	sec = zbx_time();
-	config->um_cache = um_cache_sync(config->um_cache, new_revision, &gmacro_sync, &hmacro_sync, &htmpl_sync,
-			config_vault, get_program_type_cb());
+	dc_um_cache_publish(um_cache_sync(config->um_cache, new_revision, &gmacro_sync, &hmacro_sync, &htmpl_sync,
+			config_vault, get_program_type_cb()));
 	um_cache_sec = zbx_time() - sec;
 
 	sec = zbx_time();
@@ -7623,65 +8044,34 @@ zbx_uint64_t	zbx_dc_sync_configuration(unsigned char mode, zbx_synced_new_config
 
 	/* sync host data to support host lookups when resolving macros during configuration sync */
 
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_hosts(&hosts_sync))
-		goto out;
-	hsec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_proxies(&proxy_sync))
-		goto out;
-	proxy_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_host_inventory(&hi_sync))
-		goto out;
-	hisec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_host_groups(&hgroups_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_compare_host_group_hosts(&hgroup_host_sync))
-		goto out;
-	hgroups_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_maintenances(&maintenance_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_compare_maintenance_tags(&maintenance_tag_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_compare_maintenance_periods(&maintenance_period_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_compare_maintenance_groups(&maintenance_group_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_compare_maintenance_hosts(&maintenance_host_sync))
-		goto out;
-	maintenance_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_prepare_drules(&drules_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_prepare_dchecks(&dchecks_sync))
-		goto out;
-	drules_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_prepare_httptests(&httptest_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_prepare_httptest_fields(&httptest_field_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_prepare_httpsteps(&httpstep_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_prepare_httpstep_fields(&httpstep_field_sync))
-		goto out;
-	httptest_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_connectors(&connector_sync))
-		goto out;
-	if (FAIL == zbx_dbsync_compare_connector_tags(&connector_tag_sync))
+	zbx_vector_dbsync_compare_clear(&compares);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_hosts, &hosts_sync, &hsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_proxies, &proxy_sync, &proxy_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_host_inventory, &hi_sync, &hisec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_host_groups, &hgroups_sync, &hgroups_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_host_group_hosts, &hgroup_host_sync, &hgroups_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_maintenances, &maintenance_sync, &maintenance_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_maintenance_tags, &maintenance_tag_sync,
+			&maintenance_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_maintenance_periods, &maintenance_period_sync,
+			&maintenance_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_maintenance_groups, &maintenance_group_sync,
+			&maintenance_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_maintenance_hosts, &maintenance_host_sync,
+			&maintenance_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_prepare_drules, &drules_sync, &drules_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_prepare_dchecks, &dchecks_sync, &drules_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_prepare_httptests, &httptest_sync, &httptest_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_prepare_httptest_fields, &httptest_field_sync,
+			&httptest_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_prepare_httpsteps, &httpstep_sync, &httptest_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_prepare_httpstep_fields, &httpstep_field_sync,
+			&httptest_sec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_connectors, &connector_sync, &connector_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_connector_tags, &connector_tag_sync, &connector_sec, 1);
+
+	if (FAIL == zbx_dbsync_compare_parallel(&compares))
 		goto out;
-	connector_sec = zbx_time() - sec;
 
 	zbx_hashset_create(&psk_owners, 0, ZBX_DEFAULT_PTR_HASH_FUNC, ZBX_DEFAULT_PTR_COMPARE_FUNC);
 
@@ -7742,45 +8132,18 @@ zbx_uint64_t	zbx_dc_sync_configuration(unsigned char mode, zbx_synced_new_config
 
 	/* sync item data to support item lookups when resolving macros during configuration sync */
 
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_interfaces(&if_sync))
-		goto out;
-	ifsec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_items(&items_sync))
-		goto out;
-	isec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_template_items(&template_items_sync))
-		goto out;
-	tisec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_prototype_items(&prototype_items_sync))
-		goto out;
-	pisec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_item_discovery(&item_discovery_sync))
-		goto out;
-	idsec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_item_preprocs(&itempp_sync))
-		goto out;
-	itempp_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_item_script_param(&itemscrp_sync))
-		goto out;
-	itemscrp_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_functions(&func_sync))
+	zbx_vector_dbsync_compare_clear(&compares);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_interfaces, &if_sync, &ifsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_items, &items_sync, &isec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_prototype_items, &prototype_items_sync, &pisec, 1);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_template_items, &template_items_sync, &tisec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_item_discovery, &item_discovery_sync, &idsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_item_preprocs, &itempp_sync, &itempp_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_item_script_param, &itemscrp_sync, &itemscrp_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_functions, &func_sync, &fsec, 0);
+
+	if (FAIL == zbx_dbsync_compare_parallel(&compares))
 		goto out;
-	fsec = zbx_time() - sec;
 
 	START_SYNC;
 
@@ -7832,61 +8195,25 @@ zbx_uint64_t	zbx_dc_sync_configuration(unsigned char mode, zbx_synced_new_config
 	zbx_dc_flush_history();	/* misconfigured items generate pseudo-historic values to become notsupported */
 
 	/* sync rest of the data */
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_triggers(&triggers_sync))
-		goto out;
-	tsec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_trigger_dependency(&tdep_sync))
-		goto out;
-	dsec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_expressions(&expr_sync))
-		goto out;
-	expr_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_actions(&action_sync))
-		goto out;
-	action_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_action_ops(&action_op_sync))
-		goto out;
-	action_op_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_action_conditions(&action_condition_sync))
-		goto out;
-	action_condition_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_trigger_tags(&trigger_tag_sync))
-		goto out;
-	trigger_tag_sec = zbx_time() - sec;
-
+	zbx_vector_dbsync_compare_clear(&compares);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_triggers, &triggers_sync, &tsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_trigger_dependency, &tdep_sync, &dsec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_expressions, &expr_sync, &expr_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_actions, &action_sync, &action_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_action_ops, &action_op_sync, &action_op_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_action_conditions, &action_condition_sync,
+			&action_condition_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_trigger_tags, &trigger_tag_sync, &trigger_tag_sec, 0);
 	/* relies on items, must be after DCsync_items() */
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_item_tags(&item_tag_sync))
-		goto out;
-	item_tag_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_correlations(&correlation_sync))
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_item_tags, &item_tag_sync, &item_tag_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_correlations, &correlation_sync, &correlation_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_corr_conditions, &corr_condition_sync,
+			&corr_condition_sec, 0);
+	zbx_dbsync_compare_append(&compares, zbx_dbsync_compare_corr_operations, &corr_operation_sync,
+			&corr_operation_sec, 0);
+
+	if (FAIL == zbx_dbsync_compare_parallel(&compares))
 		goto out;
-	correlation_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_corr_conditions(&corr_condition_sync))
-		goto out;
-	corr_condition_sec = zbx_time() - sec;
-
-	sec = zbx_time();
-	if (FAIL == zbx_dbsync_compare_corr_operations(&corr_operation_sync))
-		goto out;
-	corr_operation_sec = zbx_time() - sec;
 
 	START_SYNC;
 
@@ -7895,7 +8222,7 @@ zbx_uint64_t	zbx_dc_sync_configuration(unsigned char mode, zbx_synced_new_config
 	tsec2 = zbx_time() - sec;
 
 	sec = zbx_time();
-	DCsync_trigdeps(&tdep_sync);
+	DCsync_trigdeps(&tdep_sync, &trigdep_triggerids);
 	dsec2 = zbx_time() - sec;
 
 	sec = zbx_time();
@@ -7983,7 +8310,7 @@ zbx_uint64_t	zbx_dc_sync_configuration(unsigned char mode, zbx_synced_new_config
 
 	/* update trigger topology if trigger dependency was changed */
 	if (0 != (update_flags & ZBX_DBSYNC_UPDATE_TRIGGER_DEPENDENCY))
-		dc_trigger_update_topology();
+		dc_trigger_update_topology(&trigdep_triggerids);
 
 	/* update various trigger related links in cache */
 	if (0 != (update_flags & (ZBX_DBSYNC_UPDATE_HOSTS | ZBX_DBSYNC_UPDATE_ITEMS | ZBX_DBSYNC_UPDATE_FUNCTIONS |
@@ -8428,6 +8755,9 @@ clean:
 	if (NULL != pnew_items)
 		zbx_vector_dc_item_ptr_destroy(pnew_items);
 
+	zbx_vector_uint64_destroy(&trigdep_triggerids);
+	zbx_vector_dbsync_compare_destroy(&compares);
+
 	zbx_dbsync_env_clear();
 
 	zbx_hashset_destroy(&activated_hosts);
@@ -8796,6 +9126,18 @@ int	zbx_init_configuration_cache(zbx_get_program_type_f get_program_type, zbx_ge
 	if (SUCCEED != (ret = zbx_rwlock_create(&config_history_lock, ZBX_RWLOCK_CONFIG_HISTORY, error)))
 		goto out;
 
+	if (SUCCEED != (ret = zbx_mutex_create(&um_cache_lock, ZBX_MUTEX_UM_CACHE, error)))
+		goto out;
+
+	if (SUCCEED != (ret = zbx_mutex_create(&item_queue_mem_lock, ZBX_MUTEX_ITEM_QUEUE_MEM, error)))
+		goto out;
+
+	for (i = 0; i < ZBX_POLLER_TYPE_COUNT; i++)
+	{
+		if (SUCCEED != (ret = zbx_mutex_create(&item_queue_locks[i], dc_queue_mutex_name(i), error)))
+			goto out;
+	}
+
 	if (SUCCEED != (ret = zbx_shmem_create(&config_mem, conf_cache_size, "configuration cache",
 			"CacheSize", 0, error)))
 	{
@@ -8902,25 +9244,25 @@ int	zbx_init_configuration_cache(zbx_get_program_type_f get_program_type, zbx_ge
 				zbx_binary_heap_create_ext(&config->queues[i],
 						__config_java_elem_compare,
 						ZBX_BINARY_HEAP_OPTION_DIRECT,
-						__config_shmem_malloc_func,
-						__config_shmem_realloc_func,
-						__config_shmem_free_func);
+						dc_queue_shmem_malloc_func,
+						dc_queue_shmem_realloc_func,
+						dc_queue_shmem_free_func);
 				break;
 			case ZBX_POLLER_TYPE_PINGER:
 				zbx_binary_heap_create_ext(&config->queues[i],
 						__config_pinger_elem_compare,
 						ZBX_BINARY_HEAP_OPTION_DIRECT,
-						__config_shmem_malloc_func,
-						__config_shmem_realloc_func,
-						__config_shmem_free_func);
+						dc_queue_shmem_malloc_func,
+						dc_queue_shmem_realloc_func,
+						dc_queue_shmem_free_func);
 				break;
 			default:
 				zbx_binary_heap_create_ext(&config->queues[i],
 						__config_heap_elem_compare,
 						ZBX_BINARY_HEAP_OPTION_DIRECT,
-						__config_shmem_malloc_func,
-						__config_shmem_realloc_func,
-						__config_shmem_free_func);
+						dc_queue_shmem_malloc_func,
+						dc_queue_shmem_realloc_func,
+						dc_queue_shmem_free_func);
 				break;
 		}
 	}
@@ -8977,7 +9319,12 @@ int	zbx_init_configuration_cache(zbx_get_program_type_f get_program_type, zbx_ge
 
 	memset(&config->revision, 0, sizeof(config->revision));
 
+	config->um_cache_serial = 0;
+	config->um_resolve_hits = 0;
+	config->um_resolve_misses = 0;
 	config->um_cache = um_cache_create();
+	zbx_vector_ptr_create_ext(&config->um_cache_retired, __config_shmem_malloc_func, __config_shmem_realloc_func,
+			__config_shmem_free_func);
 
 	/* maintenance data are used only when timers are defined (server) */
 	if (0 != get_config_forks_cb(ZBX_PROCESS_TYPE_TIMER))
@@ -9019,6 +9366,8 @@ out:
  ******************************************************************************/
 void	zbx_free_configuration_cache(void)
 {
+	int	i;
+
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
 	WRLOCK_CACHE;
@@ -9031,6 +9380,11 @@ void	zbx_free_configuration_cache(void)
 
 	zbx_shmem_destroy(config_mem);
 	config_mem = NULL;
+	for (i = 0; i < ZBX_POLLER_TYPE_COUNT; i++)
+		zbx_mutex_destroy(&item_queue_locks[i]);
+
+	zbx_mutex_destroy(&item_queue_mem_lock);
+	zbx_mutex_destroy(&um_cache_lock);
 	zbx_rwlock_destroy(&config_history_lock);
 	zbx_rwlock_destroy(&config_lock);
 
@@ -9484,7 +9838,28 @@ void	DCget_interface(zbx_dc_interface_t *dst_interface, const ZBX_DC_INTERFACE *
 	dst_interface->port = 0;
 }
 
-static void	DCget_item(zbx_dc_item_t *dst_item, const ZBX_DC_ITEM *src_item)
+/* item fields that are not needed by pollers and are copied only on request */
+#define ZBX_DC_ITEM_GET_DELAY	0x0001
+#define ZBX_DC_ITEM_GET_ERROR	0x0002
+
+#define ZBX_DC_ITEM_GET_POLLER	0
+#define ZBX_DC_ITEM_GET_ALL	(ZBX_DC_ITEM_GET_DELAY | ZBX_DC_ITEM_GET_ERROR)
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: copies configuration cache item into local item structure         *
+ *                                                                            *
+ * Parameters: dst_item - [OUT] local item                                    *
+ *             src_item - [IN] configuration cache item                       *
+ *             flags    - [IN] ZBX_DC_ITEM_GET_* flags specifying which       *
+ *                             optional dynamically allocated fields to copy  *
+ *                                                                            *
+ * Comments: Fields not requested by flags are set to NULL. Pollers fetch     *
+ *           items every poll cycle and do not use item delay and error, so   *
+ *           skipping them saves heap allocations per polled item.            *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCget_item(zbx_dc_item_t *dst_item, const ZBX_DC_ITEM *src_item, unsigned int flags)
 {
 	const ZBX_DC_LOGITEM		*logitem;
 	const ZBX_DC_SNMPITEM		*snmpitem;
@@ -9517,9 +9892,12 @@ static void	DCget_item(zbx_dc_item_t *dst_item, const ZBX_DC_ITEM *src_item)
 	dst_item->key = NULL;
 	dst_item->timeout = 0;
 
-	dst_item->delay = zbx_strdup(NULL, src_item->delay);	/* not used, should be initialized */
+	if (0 != (flags & ZBX_DC_ITEM_GET_DELAY))
+		dst_item->delay = zbx_strdup(NULL, src_item->delay);
+	else
+		dst_item->delay = NULL;
 
-	if ('\0' != *src_item->error)
+	if (0 != (flags & ZBX_DC_ITEM_GET_ERROR) && '\0' != *src_item->error)
 		dst_item->error = zbx_strdup(NULL, src_item->error);
 	else
 		dst_item->error = NULL;
@@ -10018,7 +10396,7 @@ void	zbx_dc_config_get_items_by_keys(zbx_dc_item_t *items, zbx_host_key_t *keys,
 		}
 
 		DCget_host(&items[i].host, dc_host);
-		DCget_item(&items[i], dc_item);
+		DCget_item(&items[i], dc_item, ZBX_DC_ITEM_GET_ALL);
 		errcodes[i] = SUCCEED;
 	}
 
@@ -10073,7 +10451,7 @@ void	zbx_dc_config_get_items_by_itemids(zbx_dc_item_t *items, const zbx_uint64_t
 		}
 
 		DCget_host(&items[i].host, dc_host);
-		DCget_item(&items[i], dc_item);
+		DCget_item(&items[i], dc_item, ZBX_DC_ITEM_GET_ALL);
 		errcodes[i] = SUCCEED;
 	}
 
@@ -10120,7 +10498,7 @@ void	zbx_dc_config_get_active_items_by_hostid(zbx_dc_item_t *items, zbx_uint64_t
 			if (ITEM_TYPE_ZABBIX_ACTIVE != dc_item->type)
 				continue;
 
-			DCget_item(&items[j], dc_item);
+			DCget_item(&items[j], dc_item, ZBX_DC_ITEM_GET_ALL);
 			errcodes[j++] = SUCCEED;
 		}
 
@@ -11282,15 +11660,19 @@ int	zbx_dc_config_get_poller_nextcheck(unsigned char poller_type)
 {
 	int			nextcheck;
 	zbx_binary_heap_t	*queue;
+	zbx_mutex_t		lock;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() poller_type:%d", __func__, (int)poller_type);
 
 	queue = &config->queues[poller_type];
+	lock = dc_queue_lock(poller_type);
 
 	RDLOCK_CACHE;
+	zbx_mutex_lock(lock);
 
 	nextcheck = dc_config_get_queue_nextcheck(queue);
 
+	zbx_mutex_unlock(lock);
 	UNLOCK_CACHE;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __func__, nextcheck);
@@ -11367,12 +11749,14 @@ int	zbx_dc_config_get_poller_items(unsigned char poller_type, int config_timeout
 {
 	int			now, num = 0, max_items, items_alloc = 0;
 	zbx_binary_heap_t	*queue;
+	zbx_mutex_t		lock;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() poller_type:%d", __func__, (int)poller_type);
 
 	now = time(NULL);
 
 	queue = &config->queues[poller_type];
+	lock = dc_queue_lock(poller_type);
 
 	switch (poller_type)
 	{
@@ -11395,7 +11779,8 @@ int	zbx_dc_config_get_poller_items(unsigned char poller_type, int config_timeout
 			max_items = 1;
 	}
 
-	WRLOCK_CACHE;
+	RDLOCK_CACHE;
+	zbx_mutex_lock(lock);
 
 	while (num < max_items && FAIL == zbx_binary_heap_empty(queue))
 	{
@@ -11502,10 +11887,11 @@ int	zbx_dc_config_get_poller_items(unsigned char poller_type, int config_timeout
 		dc_item_prev = dc_item;
 		dc_item->location = ZBX_LOC_POLLER;
 		DCget_host(&(*items)[num].host, dc_host);
-		DCget_item(&(*items)[num], dc_item);
+		DCget_item(&(*items)[num], dc_item, ZBX_DC_ITEM_GET_POLLER);
 		num++;
 	}
 
+	zbx_mutex_unlock(lock);
 	UNLOCK_CACHE;
 out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __func__, num);
@@ -11536,12 +11922,15 @@ int	zbx_dc_config_get_ipmi_poller_items(int now, int items_num, int config_timeo
 {
 	int			num = 0;
 	zbx_binary_heap_t	*queue;
+	zbx_mutex_t		lock;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
 	queue = &config->queues[ZBX_POLLER_TYPE_IPMI];
+	lock = dc_queue_lock(ZBX_POLLER_TYPE_IPMI);
 
-	WRLOCK_CACHE;
+	RDLOCK_CACHE;
+	zbx_mutex_lock(lock);
 
 	while (num < items_num && FAIL == zbx_binary_heap_empty(queue))
 	{
@@ -11596,12 +11985,13 @@ int	zbx_dc_config_get_ipmi_poller_items(int now, int items_num, int config_timeo
 
 		dc_item->location = ZBX_LOC_POLLER;
 		DCget_host(&items[num].host, dc_host);
-		DCget_item(&items[num], dc_item);
+		DCget_item(&items[num], dc_item, ZBX_DC_ITEM_GET_POLLER);
 		num++;
 	}
 
 	*nextcheck = dc_config_get_queue_nextcheck(&config->queues[ZBX_POLLER_TYPE_IPMI]);
 
+	zbx_mutex_unlock(lock);
 	UNLOCK_CACHE;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __func__, num);
@@ -11708,7 +12098,7 @@ size_t	zbx_dc_config_get_snmp_items_by_interfaceid(zbx_uint64_t interfaceid, zbx
 		}
 
 		DCget_host(&(*items)[items_num].host, dc_host);
-		DCget_item(&(*items)[items_num], dc_item);
+		DCget_item(&(*items)[items_num], dc_item, ZBX_DC_ITEM_GET_ALL);
 		items_num++;
 	}
 unlock:
@@ -11719,12 +12109,21 @@ unlock:
 	return items_num;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: requeues items returned by pollers                                *
+ *                                                                            *
+ * Comments: Must be called with configuration cache read lock. Queue locks   *
+ *           are taken by this function.                                      *
+ *                                                                            *
+ ******************************************************************************/
 static void	dc_requeue_items(const zbx_uint64_t *itemids, const int *lastclocks, const int *errcodes, size_t num)
 {
 	size_t			i;
 	ZBX_DC_ITEM		*dc_item;
 	ZBX_DC_HOST		*dc_host;
 	ZBX_DC_INTERFACE	*dc_interface;
+	zbx_mutex_t		lock = ZBX_MUTEX_NULL;
 
 	for (i = 0; i < num; i++)
 	{
@@ -11734,6 +12133,8 @@ static void	dc_requeue_items(const zbx_uint64_t *itemids, const int *lastclocks,
 		if (NULL == (dc_item = (ZBX_DC_ITEM *)zbx_hashset_search(&config->items, &itemids[i])))
 			continue;
 
+		dc_queue_relock(&lock, dc_item_queue_lock(dc_item));
+
 		if (ZBX_LOC_POLLER == dc_item->location)
 			dc_item->location = ZBX_LOC_NOWHERE;
 
@@ -11772,11 +12173,13 @@ static void	dc_requeue_items(const zbx_uint64_t *itemids, const int *lastclocks,
 				THIS_SHOULD_NEVER_HAPPEN;
 		}
 	}
+
+	dc_queue_relock(&lock, ZBX_MUTEX_NULL);
 }
 
 void	zbx_dc_requeue_items(const zbx_uint64_t *itemids, const int *lastclocks, const int *errcodes, size_t num)
 {
-	WRLOCK_CACHE;
+	RDLOCK_CACHE;
 
 	dc_requeue_items(itemids, lastclocks, errcodes, num);
 
@@ -11786,10 +12189,17 @@ void	zbx_dc_requeue_items(const zbx_uint64_t *itemids, const int *lastclocks, co
 void	zbx_dc_poller_requeue_items(const zbx_uint64_t *itemids, const int *lastclocks,
 		const int *errcodes, size_t num, unsigned char poller_type, int *nextcheck)
 {
-	WRLOCK_CACHE;
+	zbx_mutex_t	lock;
+
+	lock = dc_queue_lock(poller_type);
+
+	RDLOCK_CACHE;
 
 	dc_requeue_items(itemids, lastclocks, errcodes, num);
+
+	zbx_mutex_lock(lock);
 	*nextcheck = dc_config_get_queue_nextcheck(&config->queues[poller_type]);
+	zbx_mutex_unlock(lock);
 
 	UNLOCK_CACHE;
 }
@@ -11815,14 +12225,17 @@ void	zbx_dc_requeue_unreachable_items(zbx_uint64_t *itemids, size_t itemids_num)
 	ZBX_DC_ITEM		*dc_item;
 	ZBX_DC_HOST		*dc_host;
 	ZBX_DC_INTERFACE	*dc_interface;
+	zbx_mutex_t		lock = ZBX_MUTEX_NULL;
 
-	WRLOCK_CACHE;
+	RDLOCK_CACHE;
 
 	for (i = 0; i < itemids_num; i++)
 	{
 		if (NULL == (dc_item = (ZBX_DC_ITEM *)zbx_hashset_search(&config->items, &itemids[i])))
 			continue;
 
+		dc_queue_relock(&lock, dc_item_queue_lock(dc_item));
+
 		if (ZBX_LOC_POLLER == dc_item->location)
 			dc_item->location = ZBX_LOC_NOWHERE;
 
@@ -11841,6 +12254,8 @@ void	zbx_dc_requeue_unreachable_items(zbx_uint64_t *itemids, size_t itemids_num)
 				time(NULL));
 	}
 
+	dc_queue_relock(&lock, ZBX_MUTEX_NULL);
+
 	UNLOCK_CACHE;
 }
 #endif /* HAVE_OPENIPMI */
@@ -12381,17 +12796,21 @@ exit:
  *                                                                            *
  * Purpose: assign each trigger an index based on trigger dependency topology *
  *                                                                            *
+ * Parameters: trigdeps - [IN] the dependency lists of triggers to index      *
+ *                                                                            *
+ * Comments: The topology indexes of the specified triggers must be reset     *
+ *           to 1 before calling this function.                               *
+ *                                                                            *
  ******************************************************************************/
-static void	DCconfig_sort_triggers_topologically(void)
+static void	DCconfig_sort_triggers_topologically(const zbx_vector_ptr_t *trigdeps)
 {
-	zbx_hashset_iter_t		iter;
+	int				i;
 	ZBX_DC_TRIGGER			*trigger;
 	const ZBX_DC_TRIGGER_DEPLIST	*trigdep;
 
-	zbx_hashset_iter_reset(&config->trigdeps, &iter);
-
-	while (NULL != (trigdep = (ZBX_DC_TRIGGER_DEPLIST *)zbx_hashset_iter_next(&iter)))
+	for (i = 0; i < trigdeps->values_num; i++)
 	{
+		trigdep = (const ZBX_DC_TRIGGER_DEPLIST *)trigdeps->values[i];
 		trigger = trigdep->trigger;
 
 		if (NULL == trigger || ZBX_FLAG_DISCOVERY_PROTOTYPE == trigger->flags || 1 < trigger->topoindex ||
@@ -12472,11 +12891,69 @@ void	*zbx_dc_config_get_stats(int request)
 		case ZBX_CONFSTATS_BUFFER_PFREE:
 			value_double = 100 * (double)config_mem->free_size / config_mem->orig_size;
 			return &value_double;
+		case ZBX_CONFSTATS_UMCACHE_HITS:
+			LOCK_UM_CACHE;
+			value_uint = config->um_resolve_hits;
+			UNLOCK_UM_CACHE;
+			return &value_uint;
+		case ZBX_CONFSTATS_UMCACHE_MISSES:
+			LOCK_UM_CACHE;
+			value_uint = config->um_resolve_misses;
+			UNLOCK_UM_CACHE;
+			return &value_uint;
 		default:
 			return NULL;
 	}
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get configuration cache shared memory statistics                  *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dc_get_mem_stats(zbx_shmem_stats_t *mem)
+{
+	RDLOCK_CACHE;
+	zbx_shmem_get_stats(config_mem, mem);
+	UNLOCK_CACHE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get statistics of the configuration cache string pool             *
+ *                                                                            *
+ * Parameters: stats - [OUT] the string pool statistics                       *
+ *                                                                            *
+ * Comments: The saved size is the size of string copies that would be        *
+ *           stored without interning.                                        *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dc_get_strpool_stats(zbx_dc_strpool_stats_t *stats)
+{
+	zbx_hashset_iter_t	iter;
+	const zbx_uint32_t	*refcount;
+
+	memset(stats, 0, sizeof(zbx_dc_strpool_stats_t));
+
+	RDLOCK_CACHE;
+
+	zbx_hashset_iter_reset(&config->strpool, &iter);
+
+	while (NULL != (refcount = (const zbx_uint32_t *)zbx_hashset_iter_next(&iter)))
+	{
+		size_t	size;
+
+		size = strlen((const char *)refcount + REFCOUNT_FIELD_SIZE) + 1;
+
+		stats->strings_num++;
+		stats->refs_num += *refcount;
+		stats->size += size;
+		stats->saved += (*refcount - 1) * size;
+	}
+
+	UNLOCK_CACHE;
+}
+
 static void	DCget_proxy(zbx_dc_proxy_t *dst_proxy, const ZBX_DC_PROXY *src_proxy)
 {
 	dst_proxy->proxyid = src_proxy->proxyid;
@@ -15727,12 +16204,7 @@ zbx_dc_um_handle_t	*zbx_dc_open_user_macros_masked(void)
 static const zbx_um_cache_t	*dc_um_get_cache(const zbx_dc_um_handle_t *um_handle)
 {
 	if (NULL == *um_handle->cache)
-	{
-		WRLOCK_CACHE;
-		*um_handle->cache = config->um_cache;
-		config->um_cache->refcount++;
-		UNLOCK_CACHE;
-	}
+		*um_handle->cache = dc_um_cache_acquire();
 
 	return *um_handle->cache;
 }
@@ -15749,10 +16221,7 @@ void	zbx_dc_close_user_macros(zbx_dc_um_handle_t *um_handle)
 {
 	if (NULL == um_handle->prev && NULL != *um_handle->cache)
 	{
-		WRLOCK_CACHE;
-		um_cache_release(*um_handle->cache);
-		UNLOCK_CACHE;
-
+		dc_um_cache_release(*um_handle->cache);
 		*um_handle->cache = NULL;
 	}
 
@@ -16624,21 +17093,16 @@ int	zbx_dc_um_shared_handle_reacquire(zbx_dc_um_shared_handle_t *old_handle, zbx
 	if (old_handle == new_handle)
 		return FAIL;
 
-	WRLOCK_CACHE;
-
 	if (NULL != old_handle)
 	{
 		if (0 == --old_handle->refcount)
 		{
-			um_cache_release(old_handle->um_cache);
+			dc_um_cache_release(old_handle->um_cache);
 			zbx_free(old_handle);
 		}
 	}
 
-	config->um_cache->refcount++;
-	new_handle->um_cache = config->um_cache;
-
-	UNLOCK_CACHE;
+	new_handle->um_cache = dc_um_cache_acquire();
 
 	return SUCCEED;
 }
@@ -16654,12 +17118,8 @@ void	zbx_dc_um_shared_handle_release(zbx_dc_um_shared_handle_t *handle)
 	{
 		if (0 == --handle->refcount)
 		{
-			WRLOCK_CACHE;
-
-			um_cache_release(handle->um_cache);
+			dc_um_cache_release(handle->um_cache);
 			zbx_free(handle);
-
-			UNLOCK_CACHE;
 		}
 	}
 }
@@ -89,6 +89,7 @@ typedef struct zbx_dc_trigger_deplist
 	int			refcount;
 	ZBX_DC_TRIGGER		*trigger;
 	zbx_vector_ptr_t	dependencies;
+	zbx_vector_ptr_t	dependents;	/* reverse dependencies, used to update topology */
 }
 ZBX_DC_TRIGGER_DEPLIST;
 
@@ -119,32 +120,37 @@ ZBX_DC_PREPROCITEM;
 
 typedef struct
 {
+	/* Scheduling data used by poller queue heap operations and item requeuing. It is kept */
+	/* at the start of the structure so that, together with hashset entry header, it fits */
+	/* into the first cache line (48 bytes on 64-bit platforms).                          */
 	zbx_uint64_t		itemid;
 	zbx_uint64_t		hostid;
 	zbx_uint64_t		interfaceid;
+	int			nextcheck;
+	unsigned char		type;
+	unsigned char		poller_type;
+	unsigned char		queue_priority;
+	unsigned char		location;
+	unsigned char		status;
+	unsigned char		state;
+	unsigned char		flags;
+	unsigned char		value_type;
+	const char		*key;
+
 	zbx_uint64_t		lastlogsize;
 	zbx_uint64_t		valuemapid;
-	const char		*key;
 	const char		*port;
 	const char		*error;
 	const char		*delay;
 	const char		*delay_ex;
 	const char		*history_period;
 	ZBX_DC_TRIGGER		**triggers;
-	int			nextcheck;
+	zbx_uint64_t		history_affinity;	/* the smallest itemid of items sharing triggers */
 	int			mtime;
 	int			data_expected_from;
 	zbx_uint64_t		revision;
-	unsigned char		type;
-	unsigned char		value_type;
-	unsigned char		poller_type;
-	unsigned char		state;
 	unsigned char		db_state;
 	unsigned char		inventory_link;
-	unsigned char		location;
-	unsigned char		flags;
-	unsigned char		status;
-	unsigned char		queue_priority;
 	unsigned char		update_triggers;
 	zbx_uint64_t		templateid;
 	ZBX_DC_PREPROCITEM	*preproc_item;
@@ -1009,6 +1015,10 @@ typedef struct
 	ZBX_DC_STATUS		*status;
 	zbx_hashset_t		strpool;
 	zbx_um_cache_t		*um_cache;
+	zbx_vector_ptr_t	um_cache_retired;	/* replaced user macro caches still referenced by readers */
+	zbx_uint64_t		um_cache_serial;	/* last assigned user macro cache serial number */
+	zbx_uint64_t		um_resolve_hits;	/* user macros found in process resolved macro caches */
+	zbx_uint64_t		um_resolve_misses;	/* user macros resolved from user macro cache */
 	char			autoreg_psk_identity[HOST_TLS_PSK_IDENTITY_LEN_MAX];	/* autoregistration PSK */
 	char			autoreg_psk[HOST_TLS_PSK_LEN_MAX];
 	zbx_vps_monitor_t	vps_monitor;
@@ -1046,6 +1056,9 @@ const char	*dc_strpool_acquire(const char *str);
 void	dc_strpool_release(const char *str);
 int	dc_strpool_replace(int found, const char **curr, const char *new_str);
 
+/* user macro cache snapshots */
+void	dc_um_cache_publish(zbx_um_cache_t *cache);
+
 /* host groups */
 void	dc_get_nested_hostgroupids(zbx_uint64_t groupid, zbx_vector_uint64_t *nested_groupids);
 void	dc_hostgroup_cache_nested_groupids(zbx_dc_hostgroup_t *parent_group);
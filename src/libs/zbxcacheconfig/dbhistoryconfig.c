@@ -245,6 +245,36 @@ int	zbx_dc_config_history_get_trends_sec(const char *trends_period, int trends_g
 	return trends_sec;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: gets history syncer affinity of items                             *
+ *                                                                            *
+ * Parameters: ids     - [IN/OUT] item identifiers, replaced by affinity of   *
+ *                                the corresponding items                     *
+ *             ids_num - [IN] number of elements                              *
+ *                                                                            *
+ * Comments: Items without affinity keep their own identifiers.               *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dc_config_history_get_affinities(zbx_uint64_t *ids, int ids_num)
+{
+	int			i;
+	const ZBX_DC_ITEM	*dc_item;
+
+	RDLOCK_CACHE_CONFIG_HISTORY;
+
+	for (i = 0; i < ids_num; i++)
+	{
+		if (NULL != (dc_item = (ZBX_DC_ITEM *)zbx_hashset_search(&config->items, &ids[i])) &&
+				0 != dc_item->history_affinity)
+		{
+			ids[i] = dc_item->history_affinity;
+		}
+	}
+
+	UNLOCK_CACHE_CONFIG_HISTORY;
+}
+
 void	zbx_dc_config_history_sync_unset_existing_itemids(zbx_vector_uint64_t *itemids)
 {
 	int	i;
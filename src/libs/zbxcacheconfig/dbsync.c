@@ -29,6 +29,8 @@
 #include "zbxdbhigh.h"
 #include "zbxexpr.h"
 #include "zbxstr.h"
+#include "zbxregexp.h"
+#include "zbxthreads.h"
 
 /* global correlation constants */
 #define ZBX_CORRELATION_ENABLED				0
@@ -53,8 +55,10 @@
 #define ZBX_DBSYNC_OBJ_CONNECTOR	17
 #define ZBX_DBSYNC_OBJ_CONNECTOR_TAG	18
 #define ZBX_DBSYNC_OBJ_PROXY		19
+#define ZBX_DBSYNC_OBJ_GLOBALMACRO	20
+#define ZBX_DBSYNC_OBJ_HOSTMACRO	21
 /* number of dbsync objects - keep in sync with above defines */
-#define ZBX_DBSYNC_OBJ_COUNT		19
+#define ZBX_DBSYNC_OBJ_COUNT		21
 
 #define ZBX_DBSYNC_JOURNAL(X)		(X - 1)
 
@@ -63,6 +67,9 @@
 
 #define ZBX_DBSYNC_BATCH_SIZE			1000
 
+/* number of helper threads comparing tables together with configuration syncer */
+#define ZBX_DBSYNC_COMPARE_THREADS_NUM		3
+
 typedef struct
 {
 	zbx_uint64_t	changelogid;
@@ -86,6 +93,8 @@ ZBX_VECTOR_IMPL(dbsync_obj_changelog, zbx_dbsync_obj_changelog_t)
 ZBX_PTR_VECTOR_DECL(dbsync, zbx_dbsync_t *)
 ZBX_PTR_VECTOR_IMPL(dbsync, zbx_dbsync_t *)
 
+ZBX_VECTOR_IMPL(dbsync_compare, zbx_dbsync_compare_t)
+
 typedef struct
 {
 	zbx_vector_uint64_t			inserts;
@@ -97,6 +106,28 @@ typedef struct
 }
 zbx_dbsync_journal_t;
 
+typedef struct
+{
+	pthread_t		threads[ZBX_DBSYNC_COMPARE_THREADS_NUM];
+	int			threads_num;
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		event;		/* signalled when compares are queued */
+	pthread_cond_t		done;		/* signalled when a compare chain is finished */
+
+	zbx_dbsync_compare_t	*compares;
+	int			compares_num;
+	int			compares_next;	/* the first compare of the next chain to be started */
+	int			compares_running;
+
+	int			ret;
+	int			started;
+
+	/* protects string pool while compare threads are running */
+	pthread_mutex_t		strpool_lock;
+}
+zbx_dbsync_workers_t;
+
 typedef struct
 {
 	zbx_hashset_t			strpool;
@@ -105,6 +136,8 @@ typedef struct
 	zbx_hashset_t			changelog;
 
 	zbx_dbsync_journal_t		journals[ZBX_DBSYNC_OBJ_COUNT];
+
+	zbx_dbsync_workers_t		workers;
 }
 zbx_dbsync_env_t;
 
@@ -124,10 +157,15 @@ static int	dbsync_strpool_compare_func(const void *d1, const void *d2)
 	return strcmp((char *)d1 + REFCOUNT_FIELD_SIZE, (char *)d2 + REFCOUNT_FIELD_SIZE);
 }
 
+#define LOCK_STRPOOL	if (0 != dbsync_env.workers.threads_num) pthread_mutex_lock(&dbsync_env.workers.strpool_lock)
+#define UNLOCK_STRPOOL	if (0 != dbsync_env.workers.threads_num) pthread_mutex_unlock(&dbsync_env.workers.strpool_lock)
+
 static char	*dbsync_strdup(const char *str)
 {
 	void	*ptr;
 
+	LOCK_STRPOOL;
+
 	ptr = zbx_hashset_search(&dbsync_env.strpool, str - REFCOUNT_FIELD_SIZE);
 
 	if (NULL == ptr)
@@ -140,6 +178,8 @@ static char	*dbsync_strdup(const char *str)
 
 	(*(zbx_uint32_t *)ptr)++;
 
+	UNLOCK_STRPOOL;
+
 	return (char *)ptr + REFCOUNT_FIELD_SIZE;
 }
 
@@ -149,9 +189,286 @@ static void	dbsync_strfree(char *str)
 	{
 		void	*ptr = str - REFCOUNT_FIELD_SIZE;
 
+		LOCK_STRPOOL;
+
 		if (0 == --(*(zbx_uint32_t *)ptr))
 			zbx_hashset_remove_direct(&dbsync_env.strpool, ptr);
+
+		UNLOCK_STRPOOL;
+	}
+}
+
+#undef LOCK_STRPOOL
+#undef UNLOCK_STRPOOL
+
+/* parallel compare support */
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: performs compare chain starting with the specified compare        *
+ *                                                                            *
+ * Parameters: compares     - [IN] the compares                               *
+ *             compares_num - [IN] the number of compares                     *
+ *             index        - [IN] the first compare of the chain             *
+ *                                                                            *
+ * Return value: SUCCEED - all changesets of the chain were calculated        *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_compare_chain(zbx_dbsync_compare_t *compares, int compares_num, int index)
+{
+	do
+	{
+		double	sec = zbx_time();
+
+		if (FAIL == compares[index].compare_func(compares[index].sync))
+			return FAIL;
+
+		*compares[index].sec += zbx_time() - sec;
 	}
+	while (++index < compares_num && 0 != compares[index].chained);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: takes the next queued compare chain                               *
+ *                                                                            *
+ * Parameters: workers - [IN] the compare workers, must be locked             *
+ *                                                                            *
+ * Return value: index of the first compare in chain or FAIL if there are no  *
+ *               queued chains                                                *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_workers_pop_chain(zbx_dbsync_workers_t *workers)
+{
+	int	index;
+
+	if (SUCCEED != workers->ret || workers->compares_next >= workers->compares_num)
+		return FAIL;
+
+	index = workers->compares_next++;
+
+	while (workers->compares_next < workers->compares_num &&
+			0 != workers->compares[workers->compares_next].chained)
+	{
+		workers->compares_next++;
+	}
+
+	workers->compares_running++;
+
+	return index;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: performs queued compare chains until the queue is empty           *
+ *                                                                            *
+ * Parameters: workers - [IN] the compare workers, must be locked             *
+ *                                                                            *
+ * Comments: The lock is released while compare is being done.                *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_workers_process(zbx_dbsync_workers_t *workers)
+{
+	int	index;
+
+	while (FAIL != (index = dbsync_workers_pop_chain(workers)))
+	{
+		zbx_dbsync_compare_t	*compares = workers->compares;
+		int			compares_num = workers->compares_num, ret;
+
+		pthread_mutex_unlock(&workers->lock);
+		ret = dbsync_compare_chain(compares, compares_num, index);
+		pthread_mutex_lock(&workers->lock);
+
+		if (SUCCEED != ret)
+			workers->ret = FAIL;
+
+		if (0 == --workers->compares_running)
+			pthread_cond_signal(&workers->done);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compare helper thread entry                                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	*dbsync_worker_entry(void *args)
+{
+	zbx_dbsync_workers_t	*workers = (zbx_dbsync_workers_t *)args;
+	sigset_t		mask;
+	int			err;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGINT);
+
+	if (0 != (err = pthread_sigmask(SIG_BLOCK, &mask, NULL)))
+		zabbix_log(LOG_LEVEL_WARNING, "cannot block signals: %s", zbx_strerror(err));
+
+	zbx_init_regexp_env();
+
+	/* without own connection the thread is useless, compares will be done by other threads */
+	if (ZBX_DB_OK != zbx_db_connect(ZBX_DB_CONNECT_ONCE))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot connect to database for parallel configuration sync");
+		goto out;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+
+	for (;;)
+	{
+		dbsync_workers_process(workers);
+		pthread_cond_wait(&workers->event, &workers->lock);
+	}
+out:
+	zbx_db_thread_deinit_basic();
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: starts compare helper threads                                     *
+ *                                                                            *
+ * Comments: Parallel compare is supported only by databases allowing         *
+ *           multiple connections without single sync transaction.           *
+ *           The threads and their database connections are kept for the     *
+ *           configuration syncer lifetime and are used by all the following  *
+ *           syncs. Lost connections are re-established by database layer     *
+ *           when the next query is made.                                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_workers_start(zbx_dbsync_workers_t *workers)
+{
+#if defined(HAVE_MYSQL) || defined(HAVE_POSTGRESQL)
+	pthread_attr_t	attr;
+	int		i, err;
+
+	memset(workers, 0, sizeof(zbx_dbsync_workers_t));
+	workers->ret = SUCCEED;
+	workers->started = 1;
+
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_mutex_init(&workers->strpool_lock, NULL);
+	pthread_cond_init(&workers->event, NULL);
+	pthread_cond_init(&workers->done, NULL);
+
+	zbx_pthread_init_attr(&attr);
+
+	for (i = 0; i < ZBX_DBSYNC_COMPARE_THREADS_NUM; i++)
+	{
+		if (0 != (err = pthread_create(&workers->threads[workers->threads_num], &attr, dbsync_worker_entry,
+				(void *)workers)))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot create configuration sync thread: %s",
+					zbx_strerror(err));
+			break;
+		}
+
+		workers->threads_num++;
+	}
+
+	pthread_attr_destroy(&attr);
+#else
+	workers->started = 1;
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds table compare to compare list                                *
+ *                                                                            *
+ * Parameters: compares     - [IN/OUT] the compare list                       *
+ *             compare_func - [IN] the compare function                       *
+ *             sync         - [IN] the changeset to calculate                 *
+ *             sec          - [OUT] the compare time, reset by this function  *
+ *             chained      - [IN] 1 - compare must be done right after the   *
+ *                                     previous compare by the same thread    *
+ *                                 0 - otherwise                              *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_compare_append(zbx_vector_dbsync_compare_t *compares, zbx_dbsync_compare_func_t compare_func,
+		zbx_dbsync_t *sync, double *sec, unsigned char chained)
+{
+	zbx_dbsync_compare_t	compare;
+
+	compare.compare_func = compare_func;
+	compare.sync = sync;
+	compare.sec = sec;
+	compare.chained = chained;
+
+	*sec = 0;
+	zbx_vector_dbsync_compare_append(compares, compare);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compares multiple tables with cached configuration data           *
+ *                                                                            *
+ * Parameters: compares - [IN] the compares to perform                        *
+ *                                                                            *
+ * Return value: SUCCEED - the changesets were successfully calculated        *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: Compares only read configuration cache, so independent compares  *
+ *           are distributed between configuration syncer and helper threads, *
+ *           each using its own database connection. Chained compares are     *
+ *           done in order by the same thread.                                *
+ *           Helper threads are started when sync environment is prepared     *
+ *           for the first time and are kept for incremental syncs.           *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbsync_compare_parallel(zbx_vector_dbsync_compare_t *compares)
+{
+	zbx_dbsync_workers_t	*workers = &dbsync_env.workers;
+	int			ret, i;
+
+	if (0 == workers->threads_num)
+	{
+		for (i = 0; i < compares->values_num; i++)
+		{
+			if (0 != compares->values[i].chained)
+				continue;
+
+			if (SUCCEED != dbsync_compare_chain(compares->values, compares->values_num, i))
+				return FAIL;
+		}
+
+		return SUCCEED;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+
+	workers->compares = compares->values;
+	workers->compares_num = compares->values_num;
+	workers->compares_next = 0;
+	workers->ret = SUCCEED;
+
+	pthread_cond_broadcast(&workers->event);
+
+	dbsync_workers_process(workers);
+
+	while (0 != workers->compares_running)
+		pthread_cond_wait(&workers->done, &workers->lock);
+
+	ret = workers->ret;
+
+	workers->compares = NULL;
+	workers->compares_num = 0;
+	workers->compares_next = 0;
+
+	pthread_mutex_unlock(&workers->lock);
+
+	return ret;
 }
 
 /* macro value validators */
@@ -456,6 +773,9 @@ int	zbx_dbsync_env_prepare(unsigned char mode)
 	for (i = 0; i < ARRSIZE(dbsync_env.journals); i++)
 		dbsync_journal_init(&dbsync_env.journals[i]);
 
+	if (0 == dbsync_env.workers.started)
+		dbsync_workers_start(&dbsync_env.workers);
+
 	if (ZBX_DBSYNC_INIT == mode)
 	{
 		result = zbx_db_select("select changelogid,clock from changelog");
@@ -1223,67 +1543,6 @@ int	zbx_dbsync_compare_host_templates(zbx_dbsync_t *sync)
 	return SUCCEED;
 }
 
-/******************************************************************************
- *                                                                            *
- * Purpose: compares global macro table row with cached configuration data    *
- *                                                                            *
- * Parameter: gmacro - [IN] the cached global macro data                      *
- *            dbrow    - [IN] the database row                                *
- *                                                                            *
- * Return value: SUCCEED - the row matches configuration data                 *
- *               FAIL    - otherwise                                          *
- *                                                                            *
- ******************************************************************************/
-static int	dbsync_compare_global_macro(const zbx_um_macro_t *gmacro, const zbx_db_row_t dbrow)
-{
-	char	*macro = NULL, *context = NULL;
-	int	ret = FAIL;
-	unsigned char	context_op;
-
-	if (FAIL == dbsync_compare_uchar(dbrow[3], gmacro->type))
-		return FAIL;
-
-	if (ZBX_MACRO_VALUE_VAULT == atoi(dbrow[3]))
-	{
-		if (FAIL == um_macro_check_vault_location(gmacro, dbrow[2]))
-			return FAIL;
-	}
-	else
-	{
-		if (FAIL == dbsync_compare_str(dbrow[2], gmacro->value))
-			return FAIL;
-	}
-
-	if (SUCCEED != zbx_user_macro_parse_dyn(dbrow[1], &macro, &context, NULL, &context_op))
-		return FAIL;
-
-	if (0 != strcmp(gmacro->name, macro))
-		goto out;
-
-	if (NULL == context)
-	{
-		if (NULL != gmacro->context)
-			goto out;
-
-		ret = SUCCEED;
-		goto out;
-	}
-
-	if (NULL == gmacro->context)
-		goto out;
-
-	if (gmacro->context_op != context_op)
-		goto out;
-
-	if (0 == strcmp(gmacro->context, context))
-		ret = SUCCEED;
-out:
-	zbx_free(macro);
-	zbx_free(context);
-
-	return ret;
-}
-
 /******************************************************************************
  *                                                                            *
  * Purpose: compares global macros table with cached configuration data       *
@@ -1296,127 +1555,75 @@ out:
  ******************************************************************************/
 int	zbx_dbsync_compare_global_macros(zbx_dbsync_t *sync)
 {
-	zbx_db_row_t		dbrow;
-	zbx_db_result_t		result;
-	zbx_hashset_t		ids;
-	zbx_hashset_iter_t	iter;
-	zbx_uint64_t		rowid, *prowid = &rowid;
-	zbx_um_macro_t		**pmacro;
+	char	*sql = NULL;
+	size_t	sql_alloc = 0, sql_offset = 0;
+	int	ret = SUCCEED;
 
-	if (NULL == (result = zbx_db_select(
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset,
 			"select globalmacroid,macro,value,type"
-			" from globalmacro")))
-	{
-		return FAIL;
-	}
+			" from globalmacro");
 
 	dbsync_prepare(sync, 4, NULL);
 
 	if (ZBX_DBSYNC_INIT == sync->mode)
 	{
-		sync->dbresult = result;
-		return SUCCEED;
-	}
-
-	zbx_hashset_create(&ids, (size_t)dbsync_env.cache->gmacros.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
-			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
-
-	while (NULL != (dbrow = zbx_db_fetch(result)))
-	{
-		unsigned char	tag = ZBX_DBSYNC_ROW_NONE;
-
-		ZBX_STR2UINT64(rowid, dbrow[0]);
-		zbx_hashset_insert(&ids, &rowid, sizeof(rowid));
-
-		if (NULL == (pmacro = (zbx_um_macro_t **)zbx_hashset_search(&dbsync_env.cache->gmacros, &prowid)))
-			tag = ZBX_DBSYNC_ROW_ADD;
-		else if (FAIL == dbsync_compare_global_macro(*pmacro, dbrow))
-			tag = ZBX_DBSYNC_ROW_UPDATE;
-
-		if (ZBX_DBSYNC_ROW_NONE != tag)
-			dbsync_add_row(sync, rowid, tag, dbrow);
-	}
-
-	zbx_hashset_iter_reset(&dbsync_env.cache->gmacros, &iter);
-	while (NULL != (pmacro = (zbx_um_macro_t **)zbx_hashset_iter_next(&iter)))
-	{
-		if (NULL == zbx_hashset_search(&ids, &(*pmacro)->macroid))
-			dbsync_add_row(sync, (*pmacro)->macroid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		if (NULL == (sync->dbresult = zbx_db_select("%s", sql)))
+			ret = FAIL;
+		goto out;
 	}
 
-	zbx_hashset_destroy(&ids);
-	zbx_db_free_result(result);
+	ret = dbsync_read_journal(sync, &sql, &sql_alloc, &sql_offset, "globalmacroid", "where", NULL,
+			&dbsync_env.journals[ZBX_DBSYNC_JOURNAL(ZBX_DBSYNC_OBJ_GLOBALMACRO)]);
+out:
+	zbx_free(sql);
 
-	return SUCCEED;
+	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: compares host macro table row with cached configuration data      *
+ * Purpose: add macros of removed hosts to changeset                          *
  *                                                                            *
- * Parameter: hmacro - [IN] the cached host macro data                        *
- *            dbrow  - [IN] the database row                                  *
+ * Parameter: sync    - [OUT] the changeset                                   *
+ *            hostids - [IN] the removed host identifiers                     *
+ *            deletes - [IN] the removed macro identifiers already added to   *
+ *                           changeset (sorted)                               *
  *                                                                            *
- * Return value: SUCCEED - the row matches configuration data                 *
- *               FAIL    - otherwise                                          *
+ * Comments: Host macros are removed together with hosts by cascading deletes *
+ *           that do not fire changelog triggers in all databases.            *
  *                                                                            *
  ******************************************************************************/
-static int	dbsync_compare_host_macro(const zbx_um_macro_t *hmacro, const zbx_db_row_t dbrow)
+static void	dbsync_add_removed_host_macros(zbx_dbsync_t *sync, const zbx_vector_uint64_t *hostids,
+		const zbx_vector_uint64_t *deletes)
 {
-	char		*macro = NULL, *context = NULL;
-	int		ret = FAIL;
-	unsigned char	context_op;
+	int	i, j;
 
-	if (FAIL == dbsync_compare_uchar(dbrow[4], hmacro->type))
-		return FAIL;
-
-	if (ZBX_MACRO_VALUE_VAULT == atoi(dbrow[4]))
-	{
-		if (FAIL == um_macro_check_vault_location(hmacro, dbrow[3]))
-			return FAIL;
-	}
-	else
+	for (i = 0; i < hostids->values_num; i++)
 	{
-		if (FAIL == dbsync_compare_str(dbrow[3], hmacro->value))
-			return FAIL;
-	}
-
-	if (FAIL == dbsync_compare_uint64(dbrow[1], hmacro->hostid))
-		return FAIL;
+		const zbx_uint64_t	*phostid = &hostids->values[i];
+		zbx_um_host_t		**phost;
 
-	if (SUCCEED != zbx_user_macro_parse_dyn(dbrow[2], &macro, &context, NULL, &context_op))
-		return FAIL;
+		if (NULL == (phost = (zbx_um_host_t **)zbx_hashset_search(&dbsync_env.cache->um_cache->hosts,
+				&phostid)))
+		{
+			continue;
+		}
 
-	if (0 != strcmp(hmacro->name, macro))
-		goto out;
+		for (j = 0; j < (*phost)->macros.values_num; j++)
+		{
+			zbx_uint64_t	macroid = (*phost)->macros.values[j]->macroid;
 
-	if (NULL == context)
-	{
-		if (NULL != hmacro->context)
-			goto out;
+			if (FAIL != zbx_vector_uint64_bsearch(deletes, macroid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+				continue;
 
-		ret = SUCCEED;
-		goto out;
+			dbsync_add_row(sync, macroid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		}
 	}
-
-	if (NULL == hmacro->context)
-		goto out;
-
-	if (context_op != hmacro->context_op)
-		goto  out;
-
-	if (0 == strcmp(hmacro->context, context))
-		ret = SUCCEED;
-out:
-	zbx_free(macro);
-	zbx_free(context);
-
-	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: compares global macros table with cached configuration data       *
+ * Purpose: compares host macros table with cached configuration data         *
  *                                                                            *
  * Parameter: sync - [OUT] the changeset                                      *
  *                                                                            *
@@ -1426,60 +1633,37 @@ out:
  ******************************************************************************/
 int	zbx_dbsync_compare_host_macros(zbx_dbsync_t *sync)
 {
-	zbx_db_row_t		dbrow;
-	zbx_db_result_t		result;
-	zbx_hashset_t		ids;
-	zbx_hashset_iter_t	iter;
-	zbx_uint64_t		rowid, *prowid = &rowid;
-	zbx_um_macro_t		**pmacro;
+	char			*sql = NULL;
+	size_t			sql_alloc = 0, sql_offset = 0;
+	int			ret = SUCCEED;
+	zbx_dbsync_journal_t	*journal = &dbsync_env.journals[ZBX_DBSYNC_JOURNAL(ZBX_DBSYNC_OBJ_HOSTMACRO)];
 
-	if (NULL == (result = zbx_db_select(
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset,
 			"select m.hostmacroid,m.hostid,m.macro,m.value,m.type"
 			" from hostmacro m"
 			" inner join hosts h on m.hostid=h.hostid"
-			" where h.flags<>%d", ZBX_FLAG_DISCOVERY_PROTOTYPE)))
-	{
-		return FAIL;
-	}
+			" where h.flags<>%d", ZBX_FLAG_DISCOVERY_PROTOTYPE);
 
 	dbsync_prepare(sync, 5, NULL);
 
 	if (ZBX_DBSYNC_INIT == sync->mode)
 	{
-		sync->dbresult = result;
-		return SUCCEED;
-	}
-
-	zbx_hashset_create(&ids, (size_t)dbsync_env.cache->hmacros.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
-			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
-
-	while (NULL != (dbrow = zbx_db_fetch(result)))
-	{
-		unsigned char	tag = ZBX_DBSYNC_ROW_NONE;
-
-		ZBX_STR2UINT64(rowid, dbrow[0]);
-		zbx_hashset_insert(&ids, &rowid, sizeof(rowid));
-
-		if (NULL == (pmacro = (zbx_um_macro_t **)zbx_hashset_search(&dbsync_env.cache->hmacros, &prowid)))
-			tag = ZBX_DBSYNC_ROW_ADD;
-		else if (FAIL == dbsync_compare_host_macro(*pmacro, dbrow))
-			tag = ZBX_DBSYNC_ROW_UPDATE;
-
-		if (ZBX_DBSYNC_ROW_NONE != tag)
-			dbsync_add_row(sync, rowid, tag, dbrow);
+		if (NULL == (sync->dbresult = zbx_db_select("%s", sql)))
+			ret = FAIL;
+		goto out;
 	}
 
-	zbx_hashset_iter_reset(&dbsync_env.cache->hmacros, &iter);
-	while (NULL != (pmacro = (zbx_um_macro_t **)zbx_hashset_iter_next(&iter)))
+	if (SUCCEED == (ret = dbsync_read_journal(sync, &sql, &sql_alloc, &sql_offset, "m.hostmacroid", "and", NULL,
+			journal)))
 	{
-		if (NULL == zbx_hashset_search(&ids, &(*pmacro)->macroid))
-			dbsync_add_row(sync, (*pmacro)->macroid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		dbsync_add_removed_host_macros(sync,
+				&dbsync_env.journals[ZBX_DBSYNC_JOURNAL(ZBX_DBSYNC_OBJ_HOST)].deletes,
+				&journal->deletes);
 	}
+out:
+	zbx_free(sql);
 
-	zbx_hashset_destroy(&ids);
-	zbx_db_free_result(result);
-
-	return SUCCEED;
+	return ret;
 }
 
 /******************************************************************************
@@ -4024,7 +4208,8 @@ out:
  ******************************************************************************/
 void	zbx_dbsync_clear_user_macros(void)
 {
-	um_cache_remove_hosts(config->um_cache, &dbsync_env.journals[ZBX_DBSYNC_JOURNAL(ZBX_DBSYNC_OBJ_HOST)].deletes);
+	dc_um_cache_publish(um_cache_remove_hosts(config->um_cache,
+			&dbsync_env.journals[ZBX_DBSYNC_JOURNAL(ZBX_DBSYNC_OBJ_HOST)].deletes));
 }
 
 int	zbx_dbsync_compare_connectors(zbx_dbsync_t *sync)
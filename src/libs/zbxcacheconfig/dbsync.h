@@ -104,6 +104,35 @@ struct zbx_dbsync
 	zbx_uint64_t	remove_num;
 };
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compares database table with cached configuration data            *
+ *                                                                            *
+ * Parameter: sync - [OUT] the changeset                                      *
+ *                                                                            *
+ * Return value: SUCCEED - the changeset was successfully calculated          *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+typedef int (*zbx_dbsync_compare_func_t)(zbx_dbsync_t *sync);
+
+typedef struct
+{
+	/* the compare function and the changeset it calculates */
+	zbx_dbsync_compare_func_t	compare_func;
+	zbx_dbsync_t			*sync;
+
+	/* the compare time is added to this value */
+	double				*sec;
+
+	/* 1 - must be done by the same thread right after the previous compare, */
+	/*     used when compares share changelog journal or timing value        */
+	unsigned char			chained;
+}
+zbx_dbsync_compare_t;
+
+ZBX_VECTOR_DECL(dbsync_compare, zbx_dbsync_compare_t)
+
 void	zbx_dbsync_env_init(ZBX_DC_CONFIG *cache);
 int	zbx_dbsync_env_prepare(unsigned char mode);
 void	zbx_dbsync_env_flush_changelog(void);
@@ -113,6 +142,9 @@ int	zbx_dbsync_env_changelog_num(void);
 void	zbx_dbsync_init(zbx_dbsync_t *sync, unsigned char mode);
 void	zbx_dbsync_clear(zbx_dbsync_t *sync);
 int	zbx_dbsync_next(zbx_dbsync_t *sync, zbx_uint64_t *rowid, char ***row, unsigned char *tag);
+void	zbx_dbsync_compare_append(zbx_vector_dbsync_compare_t *compares, zbx_dbsync_compare_func_t compare_func,
+		zbx_dbsync_t *sync, double *sec, unsigned char chained);
+int	zbx_dbsync_compare_parallel(zbx_vector_dbsync_compare_t *compares);
 
 int	zbx_dbsync_compare_config(zbx_dbsync_t *sync);
 int	zbx_dbsync_compare_autoreg_psk(zbx_dbsync_t *sync);
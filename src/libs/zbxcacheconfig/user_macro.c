@@ -65,6 +65,7 @@ static zbx_um_cache_t	*um_cache_dup(zbx_um_cache_t *cache)
 
 	dup = (zbx_um_cache_t *)__config_shmem_malloc_func(NULL, sizeof(zbx_um_cache_t));
 	dup->refcount = 1;
+	dup->serial = ++config->um_cache_serial;
 
 	zbx_hashset_copy(&dup->hosts, &cache->hosts, sizeof(zbx_um_host_t *));
 	zbx_hashset_iter_reset(&dup->hosts, &iter);
@@ -141,6 +142,7 @@ zbx_um_cache_t	*um_cache_create(void)
 	cache = (zbx_um_cache_t *)__config_shmem_malloc_func(NULL, sizeof(zbx_um_cache_t));
 	cache->refcount = 1;
 	cache->revision = 0;
+	cache->serial = ++config->um_cache_serial;
 	zbx_hashset_create_ext(&cache->hosts, 10, um_host_hash, um_host_compare, NULL,
 			__config_shmem_malloc_func, __config_shmem_realloc_func, __config_shmem_free_func);
 
@@ -193,12 +195,22 @@ static void	um_host_release(zbx_um_host_t *host)
  *********************************************************************************/
 void	um_cache_release(zbx_um_cache_t *cache)
 {
-	zbx_um_host_t		**host;
-	zbx_hashset_iter_t	iter;
-
 	if (0 != --cache->refcount)
 		return;
 
+	um_cache_free(cache);
+}
+
+/*********************************************************************************
+ *                                                                               *
+ * Purpose: free user macro cache regardless of its reference counter            *
+ *                                                                               *
+ *********************************************************************************/
+void	um_cache_free(zbx_um_cache_t *cache)
+{
+	zbx_um_host_t		**host;
+	zbx_hashset_iter_t	iter;
+
 	zbx_hashset_iter_reset(&cache->hosts, &iter);
 	while (NULL != (host = (zbx_um_host_t **)zbx_hashset_iter_next(&iter)))
 		um_host_release(*host);
@@ -289,9 +301,37 @@ static int	um_host_is_locked(const zbx_um_host_t *host)
 
 static int	um_cache_is_locked(const zbx_um_cache_t *cache)
 {
+	/* published cache can be acquired by readers without configuration cache lock */
+	if (cache == config->um_cache)
+		return SUCCEED;
+
 	return 1 != cache->refcount ? SUCCEED : FAIL;
 }
 
+/*********************************************************************************
+ *                                                                               *
+ * Purpose: get user macro cache copy that can be updated                        *
+ *                                                                               *
+ * Parameters:  cache - [IN] the locked user macro cache                         *
+ *                                                                               *
+ * Return value: The duplicated user macro cache.                                *
+ *                                                                               *
+ * Comments: Reference to the published cache is kept until the updated copy is *
+ *           published with dc_um_cache_publish().                               *
+ *                                                                               *
+ *********************************************************************************/
+static zbx_um_cache_t	*um_cache_copy_on_write(zbx_um_cache_t *cache)
+{
+	zbx_um_cache_t	*dup;
+
+	dup = um_cache_dup(cache);
+
+	if (cache != config->um_cache)
+		um_cache_release(cache);
+
+	return dup;
+}
+
 /*********************************************************************************
  *                                                                               *
  * Purpose: create user macro host                                               *
@@ -573,42 +613,6 @@ static void	um_macro_deregister_kvs(zbx_um_macro_t *macro)
 	}
 }
 
-/*********************************************************************************
- *                                                                               *
- * Purpose: check if the macro vault location has not changed                    *
- *                                                                               *
- *********************************************************************************/
-int	um_macro_check_vault_location(const zbx_um_macro_t *macro, const char *location)
-{
-	zbx_hashset_t		*macro_kv = (0 == macro->hostid ? &config->gmacro_kv : &config->hmacro_kv);
-	zbx_dc_macro_kv_t	*mkv;
-	char			*path, *key;
-	int			i, ret = FAIL;
-	zbx_dc_kvs_path_t	*kvs_path, kvs_path_local;
-	zbx_dc_kv_t		*kv, kv_local;
-
-	if (NULL == (mkv = zbx_hashset_search(macro_kv, &macro->macroid)))
-		return FAIL;
-
-	zbx_strsplit_first(location, ':', &path, &key);
-
-	kvs_path_local.path = path;
-	if (FAIL == (i = zbx_vector_ptr_search(&config->kvs_paths, &kvs_path_local, dc_compare_kvs_path)))
-		goto out;
-
-	kvs_path = (zbx_dc_kvs_path_t *)config->kvs_paths.values[i];
-	kv_local.key = key;
-
-	kv = (zbx_dc_kv_t *)zbx_hashset_search(&kvs_path->kvs, &kv_local);
-	if (kv == mkv->kv)
-		ret = SUCCEED;
-out:
-	zbx_free(path);
-	zbx_free(key);
-
-	return ret;
-}
-
 /*********************************************************************************
  *                                                                               *
  * Purpose: sync global/host user macros                                         *
@@ -867,10 +871,7 @@ zbx_um_cache_t	*um_cache_sync(zbx_um_cache_t *cache, zbx_uint64_t revision, zbx_
 	}
 
 	if (SUCCEED == um_cache_is_locked(cache))
-	{
-		um_cache_release(cache);
-		cache = um_cache_dup(cache);
-	}
+		cache = um_cache_copy_on_write(cache);
 
 	cache->revision = revision;
 
@@ -1013,6 +1014,165 @@ out:
 	return ret;
 }
 
+/* Resolved user macros are cached locally by each process (thread) to avoid       */
+/* walking host and template hierarchy when the same macros are resolved again.     */
+/* Only references to the cached macros are stored, so secret macro values are      */
+/* never copied and masking is applied when the value is read. Published user macro */
+/* caches are never modified, so resolved macros stay valid while the cache with    */
+/* the same serial number is used.                                                  */
+
+#define ZBX_UM_RESOLVE_CACHE_MAX	100000
+
+typedef struct
+{
+	zbx_uint64_t		*hostids;
+	int			hostids_num;
+	char			*name;
+	char			*context;
+	const zbx_um_macro_t	*macro;
+}
+zbx_um_resolved_t;
+
+static ZBX_THREAD_LOCAL zbx_hashset_t	um_resolved;
+static ZBX_THREAD_LOCAL int		um_resolved_init;
+static ZBX_THREAD_LOCAL zbx_uint64_t	um_resolved_serial;
+static ZBX_THREAD_LOCAL zbx_uint64_t	um_resolved_hits;
+static ZBX_THREAD_LOCAL zbx_uint64_t	um_resolved_misses;
+
+static zbx_hash_t	um_resolved_hash(const void *d)
+{
+	const zbx_um_resolved_t	*resolved = (const zbx_um_resolved_t *)d;
+	zbx_hash_t		hash;
+
+	hash = ZBX_DEFAULT_STRING_HASH_FUNC(resolved->name);
+
+	if (NULL != resolved->context)
+		hash = ZBX_DEFAULT_STRING_HASH_ALGO(resolved->context, strlen(resolved->context), hash);
+
+	return ZBX_DEFAULT_HASH_ALGO(resolved->hostids, sizeof(zbx_uint64_t) * (size_t)resolved->hostids_num,
+			hash);
+}
+
+static int	um_resolved_compare(const void *d1, const void *d2)
+{
+	const zbx_um_resolved_t	*r1 = (const zbx_um_resolved_t *)d1;
+	const zbx_um_resolved_t	*r2 = (const zbx_um_resolved_t *)d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(r1->hostids_num, r2->hostids_num);
+
+	if (0 != memcmp(r1->hostids, r2->hostids, sizeof(zbx_uint64_t) * (size_t)r1->hostids_num))
+		return 1;
+
+	if (0 != strcmp(r1->name, r2->name))
+		return 1;
+
+	if (NULL == r1->context || NULL == r2->context)
+		return r1->context == r2->context ? 0 : 1;
+
+	return strcmp(r1->context, r2->context);
+}
+
+static void	um_resolved_clean(void *d)
+{
+	zbx_um_resolved_t	*resolved = (zbx_um_resolved_t *)d;
+
+	zbx_free(resolved->hostids);
+	zbx_free(resolved->name);
+	zbx_free(resolved->context);
+}
+
+/*********************************************************************************
+ *                                                                               *
+ * Purpose: get previously resolved user macro                                   *
+ *                                                                               *
+ * Parameters: cache       - [IN] the user macro cache                           *
+ *             hostids     - [IN] the host identifiers                           *
+ *             hostids_num - [IN] the number of host identifiers                 *
+ *             name        - [IN] the macro name                                 *
+ *             context     - [IN] the macro context (optional)                   *
+ *             um_macro    - [OUT] the cached macro, NULL if macro was not found *
+ *                                                                               *
+ * Return value: SUCCEED - the macro was resolved previously                     *
+ *               FAIL    - otherwise                                             *
+ *                                                                               *
+ *********************************************************************************/
+static int	um_resolved_get(const zbx_um_cache_t *cache, const zbx_uint64_t *hostids, int hostids_num,
+		const char *name, const char *context, const zbx_um_macro_t **um_macro)
+{
+	zbx_um_resolved_t	local, *resolved;
+
+	if (0 == um_resolved_init)
+	{
+		zbx_hashset_create_ext(&um_resolved, 100, um_resolved_hash, um_resolved_compare, um_resolved_clean,
+				ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+		um_resolved_serial = cache->serial;
+		um_resolved_init = 1;
+	}
+	else if (um_resolved_serial != cache->serial || ZBX_UM_RESOLVE_CACHE_MAX <= um_resolved.num_data)
+	{
+		zbx_hashset_clear(&um_resolved);
+		um_resolved_serial = cache->serial;
+	}
+
+	local.hostids = (zbx_uint64_t *)hostids;
+	local.hostids_num = hostids_num;
+	local.name = (char *)name;
+	local.context = (char *)context;
+
+	if (NULL == (resolved = (zbx_um_resolved_t *)zbx_hashset_search(&um_resolved, &local)))
+	{
+		um_resolved_misses++;
+		return FAIL;
+	}
+
+	um_resolved_hits++;
+	*um_macro = resolved->macro;
+
+	return SUCCEED;
+}
+
+/*********************************************************************************
+ *                                                                               *
+ * Purpose: remember resolved user macro                                         *
+ *                                                                               *
+ * Comments: The macro must be resolved with um_resolved_get() failing first.    *
+ *                                                                               *
+ *********************************************************************************/
+static void	um_resolved_add(const zbx_uint64_t *hostids, int hostids_num, const char *name, const char *context,
+		const zbx_um_macro_t *um_macro)
+{
+	zbx_um_resolved_t	resolved;
+	size_t			hostids_size;
+
+	hostids_size = sizeof(zbx_uint64_t) * (size_t)hostids_num;
+	resolved.hostids = (zbx_uint64_t *)zbx_malloc(NULL, 0 != hostids_size ? hostids_size : 1);
+	memcpy(resolved.hostids, hostids, hostids_size);
+	resolved.hostids_num = hostids_num;
+	resolved.name = zbx_strdup(NULL, name);
+	resolved.context = (NULL != context ? zbx_strdup(NULL, context) : NULL);
+	resolved.macro = um_macro;
+
+	zbx_hashset_insert(&um_resolved, &resolved, sizeof(resolved));
+}
+
+/*********************************************************************************
+ *                                                                               *
+ * Purpose: get and reset user macro resolving statistics of the calling thread  *
+ *                                                                               *
+ * Parameters: hits   - [OUT] the number of macros found in resolved macro cache *
+ *             misses - [OUT] the number of macros resolved from user macro      *
+ *                            cache                                              *
+ *                                                                               *
+ *********************************************************************************/
+void	um_cache_pop_resolve_stats(zbx_uint64_t *hits, zbx_uint64_t *misses)
+{
+	*hits = um_resolved_hits;
+	*misses = um_resolved_misses;
+
+	um_resolved_hits = 0;
+	um_resolved_misses = 0;
+}
+
 /*********************************************************************************
  *                                                                               *
  * Purpose: get user macro (host/global)                                         *
@@ -1033,6 +1193,9 @@ static void	um_cache_get_macro(const zbx_um_cache_t *cache, const zbx_uint64_t *
 	if (SUCCEED != zbx_user_macro_parse_dyn(macro, &name, &context, NULL, &context_op))
 		return;
 
+	if (SUCCEED == um_resolved_get(cache, hostids, hostids_num, name, context, um_macro))
+		goto out;
+
 	/* User macros should be expanded according to the following priority: */
 	/*                                                                     */
 	/*  1) host context macro                                              */
@@ -1051,6 +1214,8 @@ static void	um_cache_get_macro(const zbx_um_cache_t *cache, const zbx_uint64_t *
 		um_cache_get_host_macro(cache, &hostid, 1, name, context, um_macro);
 	}
 
+	um_resolved_add(hostids, hostids_num, name, context, *um_macro);
+out:
 	zbx_free(name);
 	zbx_free(context);
 }
@@ -1153,10 +1318,7 @@ zbx_um_cache_t	*um_cache_set_value_to_macros(zbx_um_cache_t *cache, zbx_uint64_t
 	zbx_vector_um_host_create(&hosts);
 
 	if (SUCCEED == um_cache_is_locked(cache))
-	{
-		um_cache_release(cache);
-		cache = um_cache_dup(cache);
-	}
+		cache = um_cache_copy_on_write(cache);
 
 	cache->revision = revision;
 
@@ -1411,8 +1573,10 @@ void	um_cache_get_unused_templates(zbx_um_cache_t *cache, zbx_hashset_t *templat
  * Parameters: cache   - [IN] the user macro cache                               *
  *             hostids - [IN] the deleted host/template identifiers              *
  *                                                                               *
+ * Return value: The updated user macro cache.                                   *
+ *                                                                               *
  *********************************************************************************/
-void	um_cache_remove_hosts(zbx_um_cache_t *cache, const zbx_vector_uint64_t *hostids)
+zbx_um_cache_t	*um_cache_remove_hosts(zbx_um_cache_t *cache, const zbx_vector_uint64_t *hostids)
 {
 	zbx_um_host_t	**phost;
 	int		i;
@@ -1421,10 +1585,18 @@ void	um_cache_remove_hosts(zbx_um_cache_t *cache, const zbx_vector_uint64_t *hos
 	{
 		zbx_uint64_t	*phostid = &hostids->values[i];
 
-		if (NULL != (phost = (zbx_um_host_t **)zbx_hashset_search(&cache->hosts, &phostid)))
+		if (NULL == (phost = (zbx_um_host_t **)zbx_hashset_search(&cache->hosts, &phostid)))
+			continue;
+
+		if (SUCCEED == um_cache_is_locked(cache))
 		{
-			zbx_hashset_remove_direct(&cache->hosts, phost);
-			um_host_release(*phost);
+			cache = um_cache_copy_on_write(cache);
+			phost = (zbx_um_host_t **)zbx_hashset_search(&cache->hosts, &phostid);
 		}
+
+		zbx_hashset_remove_direct(&cache->hosts, phost);
+		um_host_release(*phost);
 	}
+
+	return cache;
 }
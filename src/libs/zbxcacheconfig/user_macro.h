@@ -58,6 +58,7 @@ struct zbx_um_cache
 	zbx_hashset_t	hosts;
 	zbx_uint32_t	refcount;
 	zbx_uint64_t	revision;
+	zbx_uint64_t	serial;		/* unique cache instance identifier */
 };
 
 zbx_hash_t	um_macro_hash(const void *d);
@@ -65,24 +66,24 @@ int	um_macro_compare(const void *d1, const void *d2);
 
 zbx_um_cache_t	*um_cache_create(void);
 void	um_cache_release(zbx_um_cache_t *cache);
+void	um_cache_free(zbx_um_cache_t *cache);
 void	um_macro_release(zbx_um_macro_t *macro);
 
 zbx_um_cache_t	*um_cache_set_value_to_macros(zbx_um_cache_t *cache, zbx_uint64_t revision,
 		const zbx_vector_uint64_pair_t *host_macro_ids, const char *value);
 
-int	um_macro_check_vault_location(const zbx_um_macro_t *macro, const char *location);
-
 void	um_cache_resolve_const(const zbx_um_cache_t *cache, const zbx_uint64_t *hostids, int hostids_num,
 		const char *macro, int env, const char **value);
 void	um_cache_resolve(const zbx_um_cache_t *cache, const zbx_uint64_t *hostids, int hostids_num, const char *macro,
 		int env, char **value);
+void	um_cache_pop_resolve_stats(zbx_uint64_t *hits, zbx_uint64_t *misses);
 int	um_cache_get_host_revision(const zbx_um_cache_t *cache, zbx_uint64_t hostid, zbx_uint64_t *revision);
 void	um_cache_get_macro_updates(const zbx_um_cache_t *cache, const zbx_uint64_t *hostids, int hostids_num,
 		zbx_uint64_t revision, zbx_vector_uint64_t *macro_hostids, zbx_vector_uint64_t *del_macro_hostids);
 
 void	um_cache_get_unused_templates(zbx_um_cache_t *cache, zbx_hashset_t *templates,
 		const zbx_vector_uint64_t *hostids, zbx_vector_uint64_t *templateids);
-void	um_cache_remove_hosts(zbx_um_cache_t *cache, const zbx_vector_uint64_t *hostids);
+zbx_um_cache_t	*um_cache_remove_hosts(zbx_um_cache_t *cache, const zbx_vector_uint64_t *hostids);
 
 void	um_cache_dump(zbx_um_cache_t *cache);
 
@@ -37,6 +37,8 @@
 #include "zbxtagfilter.h"
 #include "zbxcrypto.h"
 #include "zbxeval.h"
+#include "zbxthreads.h"
+#include "zbxfile.h"
 
 static zbx_shmem_info_t	*hc_index_mem = NULL;
 static zbx_shmem_info_t	*hc_mem = NULL;
@@ -48,11 +50,43 @@ static zbx_shmem_info_t	*trend_mem = NULL;
 #define	UNLOCK_TRENDS	zbx_mutex_unlock(trends_lock)
 #define	LOCK_CACHE_IDS		zbx_mutex_lock(cache_ids_lock)
 #define	UNLOCK_CACHE_IDS	zbx_mutex_unlock(cache_ids_lock)
+#define	LOCK_SHARD(shardid)	zbx_mutex_lock(shard_locks[shardid])
+#define	UNLOCK_SHARD(shardid)	zbx_mutex_unlock(shard_locks[shardid])
+#define	LOCK_INGEST(shardid)	zbx_mutex_lock(ingest_locks[shardid])
+#define	UNLOCK_INGEST(shardid)	zbx_mutex_unlock(ingest_locks[shardid])
+#define	LOCK_SPILL	zbx_mutex_lock(spill_lock)
+#define	UNLOCK_SPILL	zbx_mutex_unlock(spill_lock)
+
+/* the maximum number of history cache shards, must match ZBX_MUTEX_CACHE_SHARD_* locks */
+#define ZBX_HC_SHARDS_MAX	8
 
 static zbx_mutex_t	cache_lock = ZBX_MUTEX_NULL;
 static zbx_mutex_t	trends_lock = ZBX_MUTEX_NULL;
 static zbx_mutex_t	cache_ids_lock = ZBX_MUTEX_NULL;
 
+/* History items are partitioned by history syncer affinity into shards. Each shard has */
+/* its own index, queue and lock, so values of different shards can be added and synced */
+/* in parallel. The cache lock serializes history cache shared memory allocations and   */
+/* protects the data shared by all shards, including the item shard placement.          */
+static zbx_mutex_t	shard_locks[ZBX_HC_SHARDS_MAX];
+
+/* Value producers stage values in shard ingestion buffers under a short ingestion lock, */
+/* so they do not wait for the shard lock held by history syncers. The staged values   */
+/* are merged into shard queues by history syncers, or by producers when the buffer is */
+/* full. The ingestion lock is taken after the shard lock when both are needed.        */
+static zbx_mutex_t	ingest_locks[ZBX_HC_SHARDS_MAX];
+
+/* When history cache usage passes the spill threshold, flushed values are appended to the */
+/* spill file instead, until the spilled values are replayed into history cache by the    */
+/* first history syncer. The spill lock is taken before any other history cache lock.     */
+static zbx_mutex_t	spill_lock = ZBX_MUTEX_NULL;
+static int		spill_fd = -1;
+static zbx_uint64_t	spill_size = 0;
+
+/* the shard drained first by this history syncer */
+static int		hc_syncer_shardid = 0;
+static int		hc_syncer_num = 0;
+
 static char		*sql = NULL;
 static size_t		sql_alloc = 4 * ZBX_KIBIBYTE;
 
@@ -102,15 +136,92 @@ typedef struct
 }
 zbx_hc_proxyqueue_t;
 
+/* the ingestion buffer size limits, per buffer */
+#define ZBX_HC_INGEST_SIZE_MIN	(16 * ZBX_KIBIBYTE)
+#define ZBX_HC_INGEST_SIZE_MAX	ZBX_MEBIBYTE
+
+/* Staged values are stored from the start of ingestion buffer and their strings from */
+/* the end. String offsets of staged values are relative to the buffer data.          */
 typedef struct
 {
-	zbx_hashset_t		trends;
-	zbx_dc_stats_t		stats;
+	char	*data;
+	size_t	size;
+	size_t	strings_size;
+	int	values_num;
+	int	values_merged;
+}
+zbx_hc_ingest_buffer_t;
+
+/* Producers append values to the active buffer, while the other buffer is merged into */
+/* shard queues. The buffers are swapped when the merged buffer has been emptied.      */
+typedef struct
+{
+	zbx_hc_ingest_buffer_t	buffers[2];
+	int			active;
+}
+zbx_hc_ingest_t;
+
+/* item placement in history cache shards, kept while the item has values in the shard */
+typedef struct
+{
+	zbx_uint64_t	itemid;
+	int		shardid;
+	int		values_num;	/* the number of values placed in the shard and not yet added to item */
+}
+zbx_hc_item_shard_t;
 
+typedef struct
+{
 	zbx_hashset_t		history_items;
 	zbx_binary_heap_t	history_queue;
-
+	zbx_dc_stats_t		stats;
 	int			history_num;
+	zbx_hc_ingest_t		ingest;
+}
+zbx_hc_shard_t;
+
+/* History values, their strings and log structures are allocated from slabs - blocks of equally sized */
+/* slots carved out of history cache memory. Each slot is prefixed by a reference to its slab, which   */
+/* is NULL for blocks too large for slabs and allocated directly from history cache memory.          */
+
+#define ZBX_HC_SLAB_SIZE		(16 * ZBX_KIBIBYTE)
+#define ZBX_HC_SLAB_CLASSES_NUM		11
+
+static const size_t	hc_slab_sizes[ZBX_HC_SLAB_CLASSES_NUM] = {16, 24, 32, 40, 48, 56, 64, 96, 128, 192, 256};
+
+typedef struct zbx_hc_slab
+{
+	struct zbx_hc_slab	*prev;
+	struct zbx_hc_slab	*next;
+	void			*free_slots;	/* the list of released slots */
+	int			slots_used;
+	int			slots_init;	/* the number of slots taken from slab memory at least once */
+	int			classid;
+}
+zbx_hc_slab_t;
+
+#define ZBX_HC_SLAB_HEADER_SIZE	((sizeof(zbx_hc_slab_t) + 7) & ~(size_t)7)
+
+typedef struct
+{
+	zbx_hc_slab_t	*partial;	/* the slabs having free slots */
+	zbx_uint64_t	slabs_num;
+	zbx_uint64_t	slots_used;
+}
+zbx_hc_slab_class_t;
+
+typedef struct
+{
+	zbx_hashset_t		trends;
+
+	zbx_hc_shard_t		shards[ZBX_HC_SHARDS_MAX];
+	int			shards_num;
+
+	/* the shards of items having values in history cache, see hc_place_values() */
+	zbx_hashset_t		item_shards;
+
+	zbx_hc_slab_class_t	slab_classes[ZBX_HC_SLAB_CLASSES_NUM];
+
 	int			trends_num;
 	int			trends_last_cleanup_hour;
 	int			history_num_total;
@@ -119,6 +230,19 @@ typedef struct
 	unsigned char		db_trigger_queue_lock;
 
 	zbx_hc_proxyqueue_t	proxyqueue;
+
+	/* the spill file range of values not yet replayed into history cache */
+	zbx_uint64_t		spill_read_offset;
+	zbx_uint64_t		spill_write_offset;
+	/* the end of records before the writer wrapped to the start of spill file, 0 if not wrapped */
+	zbx_uint64_t		spill_wrap_offset;
+	/* the write offset saved by the last spill file sync, only synced values are replayed */
+	zbx_uint64_t		spill_synced_offset;
+	time_t			spill_sync_time;
+	/* the spill file is being synced without spill lock */
+	int			spill_syncing;
+	/* the values read from spill file are being added to history cache without spill lock */
+	int			spill_replaying;
 }
 ZBX_DC_CACHE;
 
@@ -167,8 +291,17 @@ static size_t		string_values_alloc = 0, string_values_offset = 0;
 static dc_item_value_t	*item_values = NULL;
 static size_t		item_values_alloc = 0, item_values_num = 0;
 
-static void	hc_add_item_values(dc_item_value_t *values, int values_num);
-static void	hc_queue_item(zbx_hc_item_t *item);
+/* history syncer affinity and shard of local item values, see hc_place_values() */
+static zbx_uint64_t	*item_affinities = NULL;
+static int		*item_shardids = NULL;
+
+static void	hc_add_item_values(dc_item_value_t *values, const int *shardids, int values_num,
+		const char *strings);
+static int	hc_spill_values(dc_item_value_t *values, int values_num, const char *strings);
+static int	hc_spill_replay(void);
+static void	hc_place_values(const dc_item_value_t *values, int values_num, zbx_uint64_t *affinities,
+		int *shardids);
+static void	hc_queue_item(zbx_hc_shard_t *shard, zbx_hc_item_t *item);
 static int	hc_queue_elem_compare_func(const void *d1, const void *d2);
 static int	hc_get_history_compression_age(void);
 
@@ -178,6 +311,52 @@ void	zbx_pp_value_opt_clear(zbx_pp_value_opt_t *opt)
 		zbx_free(opt->source);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: sums statistics and number of cached values of all shards         *
+ *                                                                            *
+ * Parameters: stats       - [OUT] the history cache statistics (optional)    *
+ *             history_num - [OUT] the number of cached values (optional)     *
+ *                                                                            *
+ * Comments: Shard locks are taken one at a time, so the caller must not hold *
+ *           any shard lock.                                                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_get_shards_stats(zbx_dc_stats_t *stats, int *history_num)
+{
+	int	i;
+
+	if (NULL != stats)
+		memset(stats, 0, sizeof(zbx_dc_stats_t));
+
+	if (NULL != history_num)
+		*history_num = 0;
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		const zbx_hc_shard_t	*shard = &cache->shards[i];
+
+		LOCK_SHARD(i);
+
+		if (NULL != stats)
+		{
+			stats->history_counter += shard->stats.history_counter;
+			stats->history_float_counter += shard->stats.history_float_counter;
+			stats->history_uint_counter += shard->stats.history_uint_counter;
+			stats->history_str_counter += shard->stats.history_str_counter;
+			stats->history_log_counter += shard->stats.history_log_counter;
+			stats->history_text_counter += shard->stats.history_text_counter;
+			stats->history_bin_counter += shard->stats.history_bin_counter;
+			stats->notsupported_counter += shard->stats.notsupported_counter;
+		}
+
+		if (NULL != history_num)
+			*history_num += shard->history_num;
+
+		UNLOCK_SHARD(i);
+	}
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: retrieves all internal metrics of the database cache              *
@@ -187,9 +366,10 @@ void	zbx_pp_value_opt_clear(zbx_pp_value_opt_t *opt)
  ******************************************************************************/
 void	zbx_dc_get_stats_all(zbx_wcache_info_t *wcache_info)
 {
+	hc_get_shards_stats(&wcache_info->stats, NULL);
+
 	LOCK_CACHE;
 
-	wcache_info->stats = cache->stats;
 	wcache_info->history_free = hc_mem->free_size;
 	wcache_info->history_total = hc_mem->total_size;
 	wcache_info->index_free = hc_index_mem->free_size;
@@ -214,37 +394,40 @@ void	*zbx_dc_get_stats(int request)
 	static zbx_uint64_t	value_uint;
 	static double		value_double;
 	void			*ret;
+	zbx_dc_stats_t		stats;
+
+	hc_get_shards_stats(&stats, NULL);
 
 	LOCK_CACHE;
 
 	switch (request)
 	{
 		case ZBX_STATS_HISTORY_COUNTER:
-			value_uint = cache->stats.history_counter;
+			value_uint = stats.history_counter;
 			ret = (void *)&value_uint;
 			break;
 		case ZBX_STATS_HISTORY_FLOAT_COUNTER:
-			value_uint = cache->stats.history_float_counter;
+			value_uint = stats.history_float_counter;
 			ret = (void *)&value_uint;
 			break;
 		case ZBX_STATS_HISTORY_UINT_COUNTER:
-			value_uint = cache->stats.history_uint_counter;
+			value_uint = stats.history_uint_counter;
 			ret = (void *)&value_uint;
 			break;
 		case ZBX_STATS_HISTORY_STR_COUNTER:
-			value_uint = cache->stats.history_str_counter;
+			value_uint = stats.history_str_counter;
 			ret = (void *)&value_uint;
 			break;
 		case ZBX_STATS_HISTORY_LOG_COUNTER:
-			value_uint = cache->stats.history_log_counter;
+			value_uint = stats.history_log_counter;
 			ret = (void *)&value_uint;
 			break;
 		case ZBX_STATS_HISTORY_TEXT_COUNTER:
-			value_uint = cache->stats.history_text_counter;
+			value_uint = stats.history_text_counter;
 			ret = (void *)&value_uint;
 			break;
 		case ZBX_STATS_NOTSUPPORTED_COUNTER:
-			value_uint = cache->stats.notsupported_counter;
+			value_uint = stats.notsupported_counter;
 			ret = (void *)&value_uint;
 			break;
 		case ZBX_STATS_HISTORY_TOTAL:
@@ -310,7 +493,7 @@ void	*zbx_dc_get_stats(int request)
 			ret = (void *)&value_double;
 			break;
 		case ZBX_STATS_HISTORY_BIN_COUNTER:
-			value_uint = cache->stats.history_bin_counter;
+			value_uint = stats.history_bin_counter;
 			ret = (void *)&value_uint;
 			break;
 		default:
@@ -386,6 +569,7 @@ static void	DCupdate_trends(zbx_vector_uint64_pair_t *trends_diff)
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
+#if !defined(HAVE_POSTGRESQL) && !defined(HAVE_MYSQL)
 /******************************************************************************
  *                                                                            *
  * Purpose: helper function for DCflush trends                                *
@@ -649,6 +833,185 @@ static void	dc_trends_fetch_and_update(ZBX_DC_TREND *trends, int trends_num, zbx
 	if (sql_offset > 16)	/* In ORACLE always present begin..end; */
 		zbx_db_execute("%s", sql);
 }
+#endif
+
+#if defined(HAVE_POSTGRESQL) || defined(HAVE_MYSQL)
+/******************************************************************************
+ *                                                                            *
+ * Purpose: appends upsert clause merging the new trend with existing one     *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_trends_upsert_clause(char **sql_upsert, size_t *sql_alloc_upsert, size_t *sql_offset,
+		unsigned char value_type, const char *table_name)
+{
+#if defined(HAVE_POSTGRESQL)
+	zbx_snprintf_alloc(sql_upsert, sql_alloc_upsert, sql_offset,
+			" on conflict (itemid,clock) do update set"
+			" num=%s.num+excluded.num,"
+			"value_min=least(%s.value_min,excluded.value_min),"
+			"value_max=greatest(%s.value_max,excluded.value_max),",
+			table_name, table_name, table_name);
+
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+	{
+		zbx_snprintf_alloc(sql_upsert, sql_alloc_upsert, sql_offset,
+				"value_avg=%s.value_avg/(%s.num+excluded.num)*%s.num+"
+				"excluded.value_avg/(%s.num+excluded.num)*excluded.num;\n",
+				table_name, table_name, table_name, table_name);
+	}
+	else
+	{
+		zbx_snprintf_alloc(sql_upsert, sql_alloc_upsert, sql_offset,
+				"value_avg=floor((%s.value_avg*%s.num+excluded.value_avg*excluded.num)/"
+				"(%s.num+excluded.num));\n",
+				table_name, table_name, table_name);
+	}
+#else
+#define ZBX_MYSQL_ROW_ALIAS_VERSION	80019
+	const char	*num, *value_min, *value_avg, *value_max;
+
+	ZBX_UNUSED(table_name);
+
+	/* VALUES() function is deprecated since MySQL 8.0.20, row alias is used instead when supported */
+	if (OFF == zbx_dbms_mariadb_used() && ZBX_MYSQL_ROW_ALIAS_VERSION <= zbx_dbms_version_get())
+	{
+		zbx_strcpy_alloc(sql_upsert, sql_alloc_upsert, sql_offset, " as new");
+
+		num = "new.num";
+		value_min = "new.value_min";
+		value_avg = "new.value_avg";
+		value_max = "new.value_max";
+	}
+	else
+	{
+		num = "values(num)";
+		value_min = "values(value_min)";
+		value_avg = "values(value_avg)";
+		value_max = "values(value_max)";
+	}
+
+	/* MySQL evaluates assignments from left to right, so the old num must be used before it is updated */
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+	{
+		zbx_snprintf_alloc(sql_upsert, sql_alloc_upsert, sql_offset,
+				" on duplicate key update"
+				" value_avg=value_avg/(num+%s)*num+%s/(num+%s)*%s,",
+				num, value_avg, num, num);
+	}
+	else
+	{
+		zbx_snprintf_alloc(sql_upsert, sql_alloc_upsert, sql_offset,
+				" on duplicate key update"
+				" value_avg=floor((cast(value_avg as decimal(65,0))*num+"
+				"cast(%s as decimal(65,0))*%s)/(num+%s)),",
+				value_avg, num, num);
+	}
+
+	zbx_snprintf_alloc(sql_upsert, sql_alloc_upsert, sql_offset,
+			"value_min=least(value_min,%s),"
+			"value_max=greatest(value_max,%s),"
+			"num=num+%s;\n",
+			value_min, value_max, num);
+#undef ZBX_MYSQL_ROW_ALIAS_VERSION
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes trends of the specified clock and value type to database,  *
+ *          merging them with already existing trends                         *
+ *                                                                            *
+ * Parameters: trends      - [IN/OUT] the trends, sorted by itemid and clock  *
+ *             trends_num  - [IN] the number of trends                        *
+ *             value_type  - [IN] the trend value type                        *
+ *             table_name  - [IN] the trend table name                        *
+ *             clock       - [IN] the trend clock                             *
+ *             trends_diff - [OUT] disable_from updates (optional)            *
+ *                                                                            *
+ * Comments: Trends are written with multi-row upsert statements instead of   *
+ *           selecting existing trends and updating them one by one.          *
+ *           The written trends are marked by resetting itemid. Duplicate     *
+ *           trends are left for the next call, because a row cannot be       *
+ *           upserted twice by the same statement.                            *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_upsert_trends_in_db(ZBX_DC_TREND *trends, int trends_num, unsigned char value_type,
+		const char *table_name, int clock, zbx_vector_uint64_pair_t *trends_diff)
+{
+	char		*sql_upsert = NULL;
+	size_t		sql_alloc_upsert = 0, sql_offset = 0;
+	int		i, rows_num = 0;
+	zbx_uint64_t	last_itemid = 0;
+
+	for (i = 0; i < trends_num; i++)
+	{
+		ZBX_DC_TREND	*trend = &trends[i];
+
+		if (0 == trend->itemid || clock != trend->clock || value_type != trend->value_type)
+			continue;
+
+		if (trend->itemid == last_itemid)
+			continue;
+
+		if (0 == rows_num)
+		{
+			sql_offset = 0;
+			zbx_snprintf_alloc(&sql_upsert, &sql_alloc_upsert, &sql_offset, "insert into %s"
+					" (itemid,clock,num,value_min,value_avg,value_max) values ", table_name);
+		}
+		else
+			zbx_chrcpy_alloc(&sql_upsert, &sql_alloc_upsert, &sql_offset, ',');
+
+		if (ITEM_VALUE_TYPE_FLOAT == value_type)
+		{
+			zbx_snprintf_alloc(&sql_upsert, &sql_alloc_upsert, &sql_offset, "(" ZBX_FS_UI64 ",%d,%d,"
+					ZBX_FS_DBL64_SQL "," ZBX_FS_DBL64_SQL "," ZBX_FS_DBL64_SQL ")",
+					trend->itemid, trend->clock, trend->num, trend->value_min.dbl,
+					trend->value_avg.dbl, trend->value_max.dbl);
+		}
+		else
+		{
+			zbx_uint128_t	avg;
+
+			/* calculate the trend average value */
+			zbx_udiv128_64(&avg, &trend->value_avg.ui64, trend->num);
+
+			zbx_snprintf_alloc(&sql_upsert, &sql_alloc_upsert, &sql_offset, "(" ZBX_FS_UI64 ",%d,%d,"
+					ZBX_FS_UI64 "," ZBX_FS_UI64 "," ZBX_FS_UI64 ")",
+					trend->itemid, trend->clock, trend->num, trend->value_min.ui64, avg.lo,
+					trend->value_max.ui64);
+		}
+
+		/* Trends are not selected before writing, so there is no information if the item has */
+		/* data after the written clock. Still disable_from must be set for trend cache cleanup */
+		/* to check if the item was removed.                                                    */
+		if (NULL != trends_diff)
+		{
+			zbx_uint64_pair_t	pair = {trend->itemid, clock + SEC_PER_HOUR};
+
+			zbx_vector_uint64_pair_append(trends_diff, pair);
+		}
+
+		last_itemid = trend->itemid;
+		trend->itemid = 0;
+
+		if (ZBX_HC_SYNC_MAX == ++rows_num)
+		{
+			dc_trends_upsert_clause(&sql_upsert, &sql_alloc_upsert, &sql_offset, value_type, table_name);
+			zbx_db_execute("%s", sql_upsert);
+			rows_num = 0;
+		}
+	}
+
+	if (0 != rows_num)
+	{
+		dc_trends_upsert_clause(&sql_upsert, &sql_alloc_upsert, &sql_offset, value_type, table_name);
+		zbx_db_execute("%s", sql_upsert);
+	}
+
+	zbx_free(sql_upsert);
+}
+#endif
 
 /******************************************************************************
  *                                                                            *
@@ -657,11 +1020,14 @@ static void	dc_trends_fetch_and_update(ZBX_DC_TREND *trends, int trends_num, zbx
  ******************************************************************************/
 static void	DBflush_trends(ZBX_DC_TREND *trends, int *trends_num, zbx_vector_uint64_pair_t *trends_diff)
 {
-	int		num, i, clock, inserts_num = 0, itemids_alloc, itemids_num = 0, trends_to = *trends_num;
+	int		num, i, clock;
 	unsigned char	value_type;
+	const char	*table_name;
+#if !defined(HAVE_POSTGRESQL) && !defined(HAVE_MYSQL)
+	int		inserts_num = 0, itemids_alloc, itemids_num = 0, trends_to = *trends_num;
 	zbx_uint64_t	*itemids = NULL;
 	ZBX_DC_TREND	*trend = NULL;
-	const char	*table_name;
+#endif
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() trends_num:%d", __func__, *trends_num);
 
@@ -680,6 +1046,9 @@ static void	DBflush_trends(ZBX_DC_TREND *trends, int *trends_num, zbx_vector_uin
 			assert(0);
 	}
 
+#if defined(HAVE_POSTGRESQL) || defined(HAVE_MYSQL)
+	dc_upsert_trends_in_db(trends, *trends_num, value_type, table_name, clock, trends_diff);
+#else
 	itemids_alloc = MIN(ZBX_HC_SYNC_MAX, *trends_num);
 	itemids = (zbx_uint64_t *)zbx_malloc(itemids, itemids_alloc * sizeof(zbx_uint64_t));
 
@@ -756,7 +1125,7 @@ static void	DBflush_trends(ZBX_DC_TREND *trends, int *trends_num, zbx_vector_uin
 
 	if (0 != inserts_num)
 		dc_insert_trends_in_db(trends, trends_to, value_type, table_name, clock);
-
+#endif
 	/* clean trends */
 	for (i = 0, num = 0; i < *trends_num; i++)
 	{
@@ -793,15 +1162,106 @@ static void	DCflush_trend(ZBX_DC_TREND *trend, ZBX_DC_TREND **trends, int *trend
 	memset(&trend->value_max, 0, sizeof(zbx_history_value_t));
 }
 
+typedef struct
+{
+	zbx_history_value_t	value_min;
+	zbx_value_avg_t		value_avg;
+	zbx_history_value_t	value_max;
+	int			num;
+}
+zbx_trend_group_t;
+
 /******************************************************************************
  *                                                                            *
- * Purpose: add new value to the trends                                       *
+ * Purpose: add value to trend value group                                    *
+ *                                                                            *
+ * Parameters: group      - [IN/OUT] the value group                          *
+ *             value_type - [IN] the value type (float or unsigned)           *
+ *             value      - [IN] the value to add                             *
+ *                                                                            *
+ * Comments: The group average is the running mean for floating point values  *
+ *           and the sum for unsigned values, same as in trend cache.         *
  *                                                                            *
  ******************************************************************************/
-static void	DCadd_trend(const zbx_dc_history_t *history, ZBX_DC_TREND **trends, int *trends_alloc, int *trends_num)
+static void	dc_trend_group_add(zbx_trend_group_t *group, unsigned char value_type, const zbx_history_value_t *value)
 {
-	ZBX_DC_TREND	*trend = NULL;
-	int		hour;
+	switch (value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+			if (0 == group->num || value->dbl < group->value_min.dbl)
+				group->value_min.dbl = value->dbl;
+			if (0 == group->num || value->dbl > group->value_max.dbl)
+				group->value_max.dbl = value->dbl;
+			group->value_avg.dbl += value->dbl / (group->num + 1) - group->value_avg.dbl / (group->num + 1);
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			if (0 == group->num || value->ui64 < group->value_min.ui64)
+				group->value_min.ui64 = value->ui64;
+			if (0 == group->num || value->ui64 > group->value_max.ui64)
+				group->value_max.ui64 = value->ui64;
+			zbx_uinc128_64(&group->value_avg.ui64, value->ui64);
+			break;
+	}
+	group->num++;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: merge trend value group into trend                                *
+ *                                                                            *
+ * Parameters: trend - [IN/OUT] the trend                                     *
+ *             group - [IN] the value group of trend value type               *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_trend_add_group(ZBX_DC_TREND *trend, const zbx_trend_group_t *group)
+{
+	switch (trend->value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+			if (0 == trend->num || group->value_min.dbl < trend->value_min.dbl)
+				trend->value_min.dbl = group->value_min.dbl;
+			if (0 == trend->num || group->value_max.dbl > trend->value_max.dbl)
+				trend->value_max.dbl = group->value_max.dbl;
+			trend->value_avg.dbl = trend->value_avg.dbl / (trend->num + group->num) * trend->num +
+					group->value_avg.dbl / (trend->num + group->num) * group->num;
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			if (0 == trend->num || group->value_min.ui64 < trend->value_min.ui64)
+				trend->value_min.ui64 = group->value_min.ui64;
+			if (0 == trend->num || group->value_max.ui64 > trend->value_max.ui64)
+				trend->value_max.ui64 = group->value_max.ui64;
+			zbx_uinc128_128(&trend->value_avg.ui64, &group->value_avg.ui64);
+			break;
+	}
+	trend->num += group->num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: add new values to the trends                                      *
+ *                                                                            *
+ * Parameters: history      - [IN] the values of the same item, hour and      *
+ *                                 value type                                 *
+ *             history_num  - [IN] the number of values                       *
+ *             trends       - [IN/OUT] the trends to flush                    *
+ *             trends_alloc - [IN/OUT] the allocated trends size              *
+ *             trends_num   - [IN/OUT] the number of trends to flush          *
+ *                                                                            *
+ * Comments: The values are aggregated before updating trend cache, so the    *
+ *           trend is looked up only once per group.                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCadd_trend(const zbx_dc_history_t *history, int history_num, ZBX_DC_TREND **trends, int *trends_alloc,
+		int *trends_num)
+{
+	ZBX_DC_TREND		*trend = NULL;
+	zbx_trend_group_t	group;
+	int			hour, i;
+
+	memset(&group, 0, sizeof(group));
+
+	for (i = 0; i < history_num; i++)
+		dc_trend_group_add(&group, history->value_type, &history[i].value);
 
 	hour = history->ts.sec - history->ts.sec % SEC_PER_HOUR;
 
@@ -815,26 +1275,9 @@ static void	DCadd_trend(const zbx_dc_history_t *history, ZBX_DC_TREND **trends,
 
 	trend->value_type = history->value_type;
 	trend->clock = hour;
+	trend->trends_only = (0 != (history->flags & ZBX_DC_FLAG_TRENDSONLY) ? 1 : 0);
 
-	switch (trend->value_type)
-	{
-		case ITEM_VALUE_TYPE_FLOAT:
-			if (trend->num == 0 || history->value.dbl < trend->value_min.dbl)
-				trend->value_min.dbl = history->value.dbl;
-			if (trend->num == 0 || history->value.dbl > trend->value_max.dbl)
-				trend->value_max.dbl = history->value.dbl;
-			trend->value_avg.dbl += history->value.dbl / (trend->num + 1) -
-					trend->value_avg.dbl / (trend->num + 1);
-			break;
-		case ITEM_VALUE_TYPE_UINT64:
-			if (trend->num == 0 || history->value.ui64 < trend->value_min.ui64)
-				trend->value_min.ui64 = history->value.ui64;
-			if (trend->num == 0 || history->value.ui64 > trend->value_max.ui64)
-				trend->value_max.ui64 = history->value.ui64;
-			zbx_uinc128_64(&trend->value_avg.ui64, history->value.ui64);
-			break;
-	}
-	trend->num++;
+	dc_trend_add_group(trend, &group);
 }
 
 /******************************************************************************
@@ -853,7 +1296,7 @@ static void	DCmass_update_trends(const zbx_dc_history_t *history, int history_nu
 {
 	static int		last_trend_discard = 0;
 	zbx_timespec_t		ts;
-	int			trends_alloc = 0, i, hour, seconds;
+	int			trends_alloc = 0, i, j, hour, seconds;
 	zbx_vector_uint64_t	del_itemids;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
@@ -866,14 +1309,24 @@ static void	DCmass_update_trends(const zbx_dc_history_t *history, int history_nu
 
 	LOCK_TRENDS;
 
-	for (i = 0; i < history_num; i++)
+	for (i = 0; i < history_num; i = j)
 	{
 		const zbx_dc_history_t	*h = &history[i];
 
+		j = i + 1;
+
 		if (0 != (ZBX_DC_FLAGS_NOT_FOR_TRENDS & h->flags))
 			continue;
 
-		DCadd_trend(h, trends, &trends_alloc, trends_num);
+		/* group consecutive values of the same item, hour and value type */
+		while (j < history_num && history[j].itemid == h->itemid && history[j].value_type == h->value_type &&
+				0 == (ZBX_DC_FLAGS_NOT_FOR_TRENDS & history[j].flags) &&
+				history[j].ts.sec - history[j].ts.sec % SEC_PER_HOUR == h->ts.sec - h->ts.sec % SEC_PER_HOUR)
+		{
+			j++;
+		}
+
+		DCadd_trend(h, j - i, trends, &trends_alloc, trends_num);
 	}
 
 	if (cache->trends_last_cleanup_hour < hour && ZBX_TRENDS_CLEANUP_TIME < seconds)
@@ -2271,17 +2724,16 @@ static void	normalize_item_value(const zbx_history_sync_item_t *item, zbx_dc_his
  *                                                                            *
  * Purpose: calculates what item fields must be updated                       *
  *                                                                            *
- * Parameters: item         - [IN/OUT]                                        *
- *             h            - [IN] historical data to process                 *
- *             add_event_cb - [IN]                                            *
+ * Parameters: item - [IN/OUT]                                                *
+ *             h    - [IN] historical data to process                         *
  *                                                                            *
  * Return value: The update data. This data must be freed by the caller.      *
  *                                                                            *
- * Comments: Will generate internal events when item state switches.          *
+ * Comments: Internal events for item state switches are generated later by   *
+ *           DCmass_add_item_events(), after history values are written.      *
  *                                                                            *
  ******************************************************************************/
-static zbx_item_diff_t	*calculate_item_update(zbx_history_sync_item_t *item, const zbx_dc_history_t *h,
-		zbx_add_event_func_t add_event_cb)
+static zbx_item_diff_t	*calculate_item_update(zbx_history_sync_item_t *item, const zbx_dc_history_t *h)
 {
 	zbx_uint64_t	flags = 0;
 	const char	*item_error = NULL;
@@ -2305,12 +2757,6 @@ static zbx_item_diff_t	*calculate_item_update(zbx_history_sync_item_t *item, con
 			zabbix_log(LOG_LEVEL_WARNING, "item \"%s:%s\" became not supported: %s",
 					item->host.host, item->key_orig, h->value.str);
 
-			if (NULL != add_event_cb)
-			{
-				add_event_cb(EVENT_SOURCE_INTERNAL, EVENT_OBJECT_ITEM, item->itemid, &h->ts, h->state,
-						NULL, NULL, NULL, 0, 0, NULL, 0, NULL, 0, NULL, NULL, h->value.err);
-			}
-
 			if (0 != strcmp(ZBX_NULL2EMPTY_STR(item->error), h->value.err))
 				item_error = h->value.err;
 		}
@@ -2319,14 +2765,6 @@ static zbx_item_diff_t	*calculate_item_update(zbx_history_sync_item_t *item, con
 			zabbix_log(LOG_LEVEL_WARNING, "item \"%s:%s\" became supported",
 					item->host.host, item->key_orig);
 
-			if (NULL != add_event_cb)
-			{
-				/* we know it's EVENT_OBJECT_ITEM because LLDRULE that becomes */
-				/* supported is handled in lld_process_discovery_rule()        */
-				add_event_cb(EVENT_SOURCE_INTERNAL, EVENT_OBJECT_ITEM, item->itemid, &h->ts, h->state,
-						NULL, NULL, NULL, 0, 0, NULL, 0, NULL, 0, NULL, NULL, NULL);
-			}
-
 			item_error = "";
 		}
 	}
@@ -2366,6 +2804,48 @@ static zbx_item_diff_t	*calculate_item_update(zbx_history_sync_item_t *item, con
 	return diff;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: generates internal events for items that switched state           *
+ *                                                                            *
+ * Parameters: history      - [IN] history data                               *
+ *             itemids      - [IN] sorted item identifiers of history data    *
+ *             item_diff    - [IN] the changes in item data                   *
+ *             add_event_cb - [IN]                                            *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCmass_add_item_events(const zbx_dc_history_t *history, const zbx_vector_uint64_t *itemids,
+		const zbx_vector_ptr_t *item_diff, zbx_add_event_func_t add_event_cb)
+{
+	int	i, index;
+
+	if (NULL == add_event_cb)
+		return;
+
+	for (i = 0; i < item_diff->values_num; i++)
+	{
+		const zbx_item_diff_t	*diff = (const zbx_item_diff_t *)item_diff->values[i];
+		const zbx_dc_history_t	*h;
+
+		if (0 == (ZBX_FLAGS_ITEM_DIFF_UPDATE_STATE & diff->flags))
+			continue;
+
+		if (FAIL == (index = zbx_vector_uint64_bsearch(itemids, diff->itemid, ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
+		{
+			THIS_SHOULD_NEVER_HAPPEN;
+			continue;
+		}
+
+		h = &history[index];
+
+		/* we know it's EVENT_OBJECT_ITEM because LLDRULE that becomes */
+		/* supported is handled in lld_process_discovery_rule()        */
+		add_event_cb(EVENT_SOURCE_INTERNAL, EVENT_OBJECT_ITEM, diff->itemid, &h->ts, h->state, NULL, NULL, NULL,
+				0, 0, NULL, 0, NULL, 0, NULL, NULL,
+				ITEM_STATE_NOTSUPPORTED == h->state ? h->value.err : NULL);
+	}
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: update item data and inventory in database                        *
@@ -2571,7 +3051,7 @@ static int	add_history(zbx_dc_history_t *history, int history_num, zbx_vector_pt
 	}
 
 	if (0 != history_values->values_num)
-		ret = zbx_vc_add_values(history_values, ret_flush);
+		ret = zbx_history_add_values(history_values, ret_flush);
 
 	return ret;
 }
@@ -2580,34 +3060,35 @@ static int	add_history(zbx_dc_history_t *history, int history_num, zbx_vector_pt
  *                                                                            *
  * Purpose: inserting new history data after new value is received            *
  *                                                                            *
- * Parameters: history     - array of history data                            *
- *             history_num - number of history structures                     *
+ * Parameters: history        - [IN/OUT] array of history data                *
+ *             history_num    - [IN] number of history structures             *
+ *             history_values - [OUT] the values written to history storage   *
+ *                                                                            *
+ * Comments: The written values must be added to value cache by the caller.   *
+ *           This function can be called by history writer thread, so it      *
+ *           must not access anything but the history data and database.      *
  *                                                                            *
  ******************************************************************************/
-static int	DBmass_add_history(zbx_dc_history_t *history, int history_num)
+static int	DBmass_add_history(zbx_dc_history_t *history, int history_num, zbx_vector_ptr_t *history_values)
 {
-	int			ret, ret_flush = FLUSH_SUCCEED, num;
-	zbx_vector_ptr_t	history_values;
+	int	ret, ret_flush = FLUSH_SUCCEED, num;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	zbx_vector_ptr_create(&history_values);
-	zbx_vector_ptr_reserve(&history_values, history_num);
+	zbx_vector_ptr_reserve(history_values, (size_t)history_num);
 
-	if (FAIL == (ret = add_history(history, history_num, &history_values, &ret_flush)) &&
+	if (FAIL == (ret = add_history(history, history_num, history_values, &ret_flush)) &&
 			FLUSH_DUPL_REJECTED == ret_flush)
 	{
-		num = history_values.values_num;
-		remove_history_duplicates(&history_values);
-		zbx_vector_ptr_clear(&history_values);
+		num = history_values->values_num;
+		remove_history_duplicates(history_values);
+		zbx_vector_ptr_clear(history_values);
 
-		if (SUCCEED == (ret = add_history(history, history_num, &history_values, &ret_flush)))
-			zabbix_log(LOG_LEVEL_WARNING, "skipped %d duplicates", num - history_values.values_num);
+		if (SUCCEED == (ret = add_history(history, history_num, history_values, &ret_flush)))
+			zabbix_log(LOG_LEVEL_WARNING, "skipped %d duplicates", num - history_values->values_num);
 	}
 
-	zbx_vps_monitor_add_written((zbx_uint64_t)history_values.values_num);
-
-	zbx_vector_ptr_destroy(&history_values);
+	zbx_vps_monitor_add_written((zbx_uint64_t)history_values->values_num);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 
@@ -2621,21 +3102,21 @@ static int	DBmass_add_history(zbx_dc_history_t *history, int history_num)
  *          be added                                                          *
  *                                                                            *
  * Parameters: history             - [IN/OUT] array of history data           *
- *             itemids             - [IN] the item identifiers                *
- *                                        (used for item lookup)              *
  *             items               - [IN]                                     *
  *             errcodes            - [IN] item error codes                    *
  *             history_num         - [IN] number of history structures        *
- *             add_event_cb        - [IN]                                     *
  *             item_diff           - [OUT] the changes in item data           *
  *             inventory_values    - [OUT] the inventory values to add        *
  *             compression_age     - [IN] history compression age             *
  *             proxy_subscriptions - [IN]                                     *
+ *             coalesce_trends     - [IN] SUCCEED - values of items without   *
+ *                                              history can be folded into    *
+ *                                              trends by history cache       *
  *                                                                            *
  ******************************************************************************/
 static void	DCmass_prepare_history(zbx_dc_history_t *history, zbx_history_sync_item_t *items, const int *errcodes,
-		int history_num, zbx_add_event_func_t add_event_cb, zbx_vector_ptr_t *item_diff,
-		zbx_vector_ptr_t *inventory_values, int compression_age, zbx_vector_uint64_pair_t *proxy_subscriptions)
+		int history_num, zbx_vector_ptr_t *item_diff, zbx_vector_ptr_t *inventory_values, int compression_age,
+		zbx_vector_uint64_pair_t *proxy_subscriptions, int coalesce_trends)
 {
 	static time_t	last_history_discard = 0;
 	time_t		now;
@@ -2708,10 +3189,13 @@ static void	DCmass_prepare_history(zbx_dc_history_t *history, zbx_history_sync_i
 		else
 			h->flags |= ZBX_DC_FLAG_NOTRENDS;
 
+		if (SUCCEED == coalesce_trends && 0 == item->history && 0 == (h->flags & ZBX_DC_FLAG_NOTRENDS))
+			h->flags |= ZBX_DC_FLAG_TRENDSONLY;
+
 		normalize_item_value(item, h);
 
 		/* calculate item update and update already retrieved item status for trigger calculation */
-		if (NULL != (diff = calculate_item_update(item, h, add_event_cb)))
+		if (NULL != (diff = calculate_item_update(item, h)))
 			zbx_vector_ptr_append(item_diff, diff);
 
 		DCinventory_value_add(inventory_values, item, h);
@@ -2923,28 +3407,13 @@ static void	DCmodule_sync_history(int history_float_num, int history_integer_num
 
 /******************************************************************************
  *                                                                            *
- * Purpose: flush history cache to database, process triggers of flushed      *
- *          and timer triggers from timer queue                               *
- *                                                                            *
- * Parameters:                                                                *
- *             values_num   - [IN/OUT] the number of synced values            *
- *             triggers_num - [IN/OUT] the number of processed timers         *
- *             events_cbs   - [IN]                                            *
- *             more         - [OUT] a flag indicating the cache emptiness:    *
- *                               ZBX_SYNC_DONE - nothing to sync, go idle     *
- *                               ZBX_SYNC_MORE - more data to sync            *
+ * Purpose: passes history data to loadable modules                           *
  *                                                                            *
- * Comments: This function loops syncing history values by 1k batches and     *
- *           processing timer triggers by batches of 500 triggers.            *
- *           Unless full sync is being done the loop is aborted if either     *
- *           timeout has passed or there are no more data to process.         *
- *           The last is assumed when the following is true:                  *
- *            a) history cache is empty or less than 10% of batch values were *
- *               processed (the other items were locked by triggers)          *
- *            b) less than 500 (full batch) timer triggers were processed     *
+ * Parameters: history     - [IN] array of history data                       *
+ *             history_num - [IN] number of history structures                *
  *                                                                            *
  ******************************************************************************/
-void	zbx_sync_server_history(int *values_num, int *triggers_num, const zbx_events_funcs_t *events_cbs, int *more)
+static void	DCmodule_process_history(zbx_dc_history_t *history, int history_num)
 {
 	static ZBX_HISTORY_FLOAT	*history_float;
 	static ZBX_HISTORY_INTEGER	*history_integer;
@@ -2952,25 +3421,8 @@ void	zbx_sync_server_history(int *values_num, int *triggers_num, const zbx_event
 	static ZBX_HISTORY_TEXT		*history_text;
 	static ZBX_HISTORY_LOG		*history_log;
 	static int			module_enabled = FAIL;
-	int				i, history_num, history_float_num, history_integer_num, history_string_num,
-					history_text_num, history_log_num, txn_error, compression_age,
-					connectors_retrieved = FAIL;
-	unsigned int			item_retrieve_mode;
-	time_t				sync_start;
-	zbx_vector_uint64_t		triggerids ;
-	zbx_vector_ptr_t		history_items, trigger_diff, item_diff, inventory_values, trigger_timers;
-	zbx_vector_dc_trigger_t		trigger_order;
-	zbx_vector_uint64_pair_t	trends_diff, proxy_subscriptions;
-	zbx_dc_history_t		history[ZBX_HC_SYNC_MAX];
-	zbx_uint64_t			trigger_itemids[ZBX_HC_SYNC_MAX];
-	zbx_timespec_t			trigger_timespecs[ZBX_HC_SYNC_MAX];
-	zbx_history_sync_item_t		*items = NULL;
-	int				*errcodes = NULL;
-	zbx_vector_uint64_t		itemids;
-	zbx_hashset_t			trigger_info;
-	unsigned char			*data = NULL;
-	size_t				data_alloc = 0, data_offset;
-	zbx_vector_connector_filter_t	connector_filters_history, connector_filters_events;
+	int				history_float_num, history_integer_num, history_string_num,
+					history_text_num, history_log_num;
 
 	if (NULL == history_float && NULL != history_float_cbs)
 	{
@@ -3007,465 +3459,973 @@ void	zbx_sync_server_history(int *values_num, int *triggers_num, const zbx_event
 				ZBX_HC_SYNC_MAX * sizeof(ZBX_HISTORY_LOG));
 	}
 
-	compression_age = hc_get_history_compression_age();
-
-	zbx_vector_connector_filter_create(&connector_filters_history);
-	zbx_vector_connector_filter_create(&connector_filters_events);
-	zbx_vector_ptr_create(&inventory_values);
-	zbx_vector_ptr_create(&item_diff);
-	zbx_vector_ptr_create(&trigger_diff);
-	zbx_vector_uint64_pair_create(&trends_diff);
-	zbx_vector_uint64_pair_create(&proxy_subscriptions);
-
-	zbx_vector_uint64_create(&triggerids);
-	zbx_vector_uint64_reserve(&triggerids, ZBX_HC_SYNC_MAX);
-
-	zbx_vector_ptr_create(&trigger_timers);
-	zbx_vector_ptr_reserve(&trigger_timers, ZBX_HC_TIMER_MAX);
+	if (SUCCEED != module_enabled)
+		return;
 
-	zbx_vector_ptr_create(&history_items);
-	zbx_vector_ptr_reserve(&history_items, ZBX_HC_SYNC_MAX);
+	DCmodule_prepare_history(history, history_num, history_float, &history_float_num, history_integer,
+			&history_integer_num, history_string, &history_string_num, history_text, &history_text_num,
+			history_log, &history_log_num);
 
-	zbx_vector_dc_trigger_create(&trigger_order);
-	zbx_hashset_create(&trigger_info, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	DCmodule_sync_history(history_float_num, history_integer_num, history_string_num, history_text_num,
+			history_log_num, history_float, history_integer, history_string, history_text, history_log);
+}
 
-	zbx_vector_uint64_create(&itemids);
+/* history values taken out of history cache to be synced by history syncer */
+typedef struct
+{
+	zbx_dc_history_t	*history;
+	zbx_history_sync_item_t	*items;
+	int			*errcodes;
+	int			history_num;
+	int			shardid;
+	int			ret;		/* the result of writing history values */
+	zbx_vector_ptr_t	history_items;
+	zbx_vector_ptr_t	history_values;	/* the values written to history storage */
+	zbx_vector_uint64_t	itemids;
+	zbx_vector_uint64_t	triggerids;
+	zbx_vector_ptr_t	item_diff;
+	zbx_vector_ptr_t	inventory_values;
+}
+zbx_hc_sync_batch_t;
 
-	sync_start = time(NULL);
+/* the data shared by all batches synced by single zbx_sync_server_history() call */
+typedef struct
+{
+	const zbx_events_funcs_t	*events_cbs;
+	int				compression_age;
+	int				connectors_retrieved;
+	unsigned int			item_retrieve_mode;
+	zbx_vector_connector_filter_t	connector_filters_history;
+	zbx_vector_connector_filter_t	connector_filters_events;
+	zbx_vector_ptr_t		trigger_diff;
+	zbx_vector_ptr_t		trigger_timers;
+	zbx_vector_dc_trigger_t		trigger_order;
+	zbx_vector_uint64_pair_t	trends_diff;
+	zbx_vector_uint64_pair_t	proxy_subscriptions;
+	zbx_hashset_t			trigger_info;
+	zbx_uint64_t			trigger_itemids[ZBX_HC_SYNC_MAX];
+	zbx_timespec_t			trigger_timespecs[ZBX_HC_SYNC_MAX];
+	unsigned char			*data;
+	size_t				data_alloc;
+}
+zbx_hc_sync_t;
 
-	item_retrieve_mode = 0 == zbx_has_export_dir() ? ZBX_ITEM_GET_SYNC : ZBX_ITEM_GET_SYNC_EXPORT;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes trends to database and applies disable_from changes to     *
+ *          trend cache                                                       *
+ *                                                                            *
+ * Parameters: trends      - [IN] the trends to write                         *
+ *             trends_num  - [IN] the number of trends                        *
+ *             trends_diff - [IN/OUT] the disable_from changes buffer         *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_flush_trends(ZBX_DC_TREND *trends, int trends_num, zbx_vector_uint64_pair_t *trends_diff)
+{
+	int	txn_error;
 
 	do
 	{
-		int			trends_num = 0, timers_num = 0, ret = SUCCEED;
-		ZBX_DC_TREND		*trends = NULL;
-
-		*more = ZBX_SYNC_DONE;
-
-		LOCK_CACHE;
-		hc_pop_items(&history_items);		/* select and take items out of history cache */
-		UNLOCK_CACHE;
-
-		if (0 != history_items.values_num)
-		{
-			if (0 == (history_num = zbx_dc_config_lock_triggers_by_history_items(&history_items, &triggerids)))
-			{
-				LOCK_CACHE;
-				hc_push_items(&history_items);
-				UNLOCK_CACHE;
-				zbx_vector_ptr_clear(&history_items);
-			}
-		}
-		else
-			history_num = 0;
+		zbx_db_begin();
 
-		if (0 != history_num)
-		{
-			zbx_dc_um_handle_t	*um_handle;
+		DBmass_update_trends(trends, trends_num, trends_diff);
 
-			if (FAIL == connectors_retrieved)
-			{
-				zbx_dc_config_history_sync_get_connector_filters(&connector_filters_history,
-						&connector_filters_events);
+		if (ZBX_DB_OK == (txn_error = zbx_db_commit()))
+			DCupdate_trends(trends_diff);
 
-				connectors_retrieved = SUCCEED;
+		zbx_vector_uint64_pair_clear(trends_diff);
+	}
+	while (ZBX_DB_DOWN == txn_error);
 
-				if (0 != connector_filters_history.values_num)
-					item_retrieve_mode = ZBX_ITEM_GET_SYNC_EXPORT;
-			}
+	/* invalidate trend function cache after trends are written so old data is not cached again */
+	zbx_tfc_invalidate_trends(trends, trends_num);
+}
 
-			zbx_vector_ptr_sort(&history_items, ZBX_DEFAULT_UINT64_PTR_COMPARE_FUNC);
-			hc_get_item_values(history, &history_items);	/* copy item data from history cache */
+#define ZBX_HC_WRITER_STOPPED	0
+#define ZBX_HC_WRITER_STARTING	1
+#define ZBX_HC_WRITER_RUNNING	2
 
-			if (NULL == items)
-			{
-				items = (zbx_history_sync_item_t *)zbx_malloc(NULL, sizeof(zbx_history_sync_item_t) *
-						(size_t)ZBX_HC_SYNC_MAX);
-			}
+/* the maximum number of trends queued for history writer */
+#define ZBX_HC_WRITER_TRENDS_MAX	(ZBX_HC_SYNC_MAX * 100)
 
-			if (NULL == errcodes)
-				errcodes = (int *)zbx_malloc(NULL, sizeof(int) * (size_t)ZBX_HC_SYNC_MAX);
+/* history writer thread, writes history values of one batch while the next batch is being processed */
+/* and writes trends flushed from trend cache when there are no history values to write              */
+typedef struct
+{
+	pthread_t		thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		event;		/* signalled when a batch or trends are queued or on stop */
+	pthread_cond_t		done;		/* signalled when the queued batch is written or thread has started */
 
-			zbx_vector_uint64_reserve(&itemids, history_num);
+	zbx_hc_sync_batch_t	*batch;		/* the batch being written */
+	int			written;
+	int			state;
+	int			stop;
 
-			for (i = 0; i < history_num; i++)
-				zbx_vector_uint64_append(&itemids, history[i].itemid);
+	ZBX_DC_TREND		*trends;	/* the trends queued for writing */
+	int			trends_num;
+	int			trends_alloc;
+}
+zbx_hc_writer_t;
 
-			zbx_dc_config_history_sync_get_items_by_itemids(items, itemids.values, errcodes,
-					(size_t)history_num, item_retrieve_mode);
+static zbx_hc_writer_t	hc_writer;
 
-			um_handle = zbx_dc_open_user_macros();
+/******************************************************************************
+ *                                                                            *
+ * Purpose: history writer thread entry                                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	*hc_writer_entry(void *args)
+{
+	zbx_hc_writer_t			*writer = (zbx_hc_writer_t *)args;
+	sigset_t			mask;
+	int				err, connected, trends_num;
+	ZBX_DC_TREND			*trends;
+	zbx_vector_uint64_pair_t	trends_diff;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGINT);
+
+	if (0 != (err = pthread_sigmask(SIG_BLOCK, &mask, NULL)))
+		zabbix_log(LOG_LEVEL_WARNING, "cannot block signals: %s", zbx_strerror(err));
+
+	connected = (ZBX_DB_OK == zbx_db_connect(ZBX_DB_CONNECT_ONCE) ? SUCCEED : FAIL);
+
+	trends = (ZBX_DC_TREND *)zbx_malloc(NULL, sizeof(ZBX_DC_TREND) * ZBX_HC_SYNC_MAX);
+	zbx_vector_uint64_pair_create(&trends_diff);
 
-			DCmass_prepare_history(history, items, errcodes, history_num,
-					events_cbs->add_event_cb, &item_diff,
-					&inventory_values, compression_age, &proxy_subscriptions);
+	pthread_mutex_lock(&writer->lock);
 
-			if (FAIL != (ret = DBmass_add_history(history, history_num)))
-			{
-				zbx_dc_config_items_apply_changes(&item_diff);
-				DCmass_update_trends(history, history_num, &trends, &trends_num, compression_age);
+	writer->state = (SUCCEED == connected ? ZBX_HC_WRITER_RUNNING : ZBX_HC_WRITER_STOPPED);
+	pthread_cond_signal(&writer->done);
 
-				if (0 != trends_num)
-					zbx_tfc_invalidate_trends(trends, trends_num);
+	/* queued batch and trends are written also when thread is stopping, because they are already */
+	/* removed from cache                                                                          */
+	while (SUCCEED == connected && (0 == writer->stop || 0 != writer->trends_num ||
+			(NULL != writer->batch && 0 == writer->written)))
+	{
+		zbx_hc_sync_batch_t	*batch;
 
-				do
-				{
-					zbx_db_begin();
+		if (NULL != (batch = writer->batch) && 0 == writer->written)
+		{
+			pthread_mutex_unlock(&writer->lock);
+			batch->ret = DBmass_add_history(batch->history, batch->history_num, &batch->history_values);
+			pthread_mutex_lock(&writer->lock);
 
-					DBmass_update_trends(trends, trends_num, &trends_diff);
+			writer->written = 1;
+			pthread_cond_signal(&writer->done);
 
-					if (ZBX_DB_OK == (txn_error = zbx_db_commit()))
-						DCupdate_trends(&trends_diff);
+			continue;
+		}
 
-					zbx_vector_uint64_pair_clear(&trends_diff);
-				}
-				while (ZBX_DB_DOWN == txn_error);
+		if (0 == writer->trends_num)
+		{
+			pthread_cond_wait(&writer->event, &writer->lock);
+			continue;
+		}
 
-				do
-				{
-					zbx_db_begin();
+		/* write trends in chunks to check for history values to write in between */
+		trends_num = MIN(writer->trends_num, ZBX_HC_SYNC_MAX);
+		memcpy(trends, writer->trends, sizeof(ZBX_DC_TREND) * (size_t)trends_num);
 
-					DBmass_update_items(&item_diff, &inventory_values);
+		writer->trends_num -= trends_num;
+		memmove(writer->trends, writer->trends + trends_num, sizeof(ZBX_DC_TREND) * (size_t)writer->trends_num);
 
-					if (NULL != events_cbs->process_events_cb)
-					{
-						/* process internal events generated by DCmass_prepare_history() */
-						events_cbs->process_events_cb(NULL, NULL);
-					}
+		pthread_mutex_unlock(&writer->lock);
+		hc_flush_trends(trends, trends_num, &trends_diff);
+		pthread_mutex_lock(&writer->lock);
+	}
 
-					if (ZBX_DB_OK != (txn_error = zbx_db_commit()))
-					{
-						if (NULL != events_cbs->reset_event_recovery_cb)
-							events_cbs->reset_event_recovery_cb();
-					}
-				}
-				while (ZBX_DB_DOWN == txn_error);
-			}
+	pthread_mutex_unlock(&writer->lock);
 
-			zbx_dc_close_user_macros(um_handle);
+	zbx_vector_uint64_pair_destroy(&trends_diff);
+	zbx_free(trends);
 
-			if (NULL != events_cbs->clean_events_cb)
-				events_cbs->clean_events_cb();
+	if (SUCCEED == connected)
+		zbx_db_close();
 
-			zbx_vector_ptr_clear_ext(&inventory_values, (zbx_clean_func_t)DCinventory_value_free);
-			zbx_vector_ptr_clear_ext(&item_diff, (zbx_clean_func_t)zbx_ptr_free);
-		}
+	zbx_db_thread_deinit_basic();
 
-		if (FAIL != ret)
-		{
-			/* don't process trigger timers when server is shutting down */
-			if (ZBX_IS_RUNNING())
-			{
-				zbx_dc_get_trigger_timers(&trigger_timers, time(NULL), ZBX_HC_TIMER_SOFT_MAX,
-						ZBX_HC_TIMER_MAX);
-			}
+	return NULL;
+}
 
-			timers_num = trigger_timers.values_num;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: starts history writer thread for pipelined history sync           *
+ *                                                                            *
+ * Comments: With history writer running the history values of a batch are    *
+ *           written on a separate database connection while history syncer   *
+ *           prepares the next batch and recalculates triggers of the         *
+ *           previous batch. Only databases allowing multiple connections     *
+ *           are supported, otherwise the values are written by the caller.   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_hc_history_writer_start(void)
+{
+#if defined(HAVE_MYSQL) || defined(HAVE_POSTGRESQL)
+	pthread_attr_t	attr;
+	int		err;
 
-			if (ZBX_HC_TIMER_SOFT_MAX <= timers_num)
-				*more = ZBX_SYNC_MORE;
+	memset(&hc_writer, 0, sizeof(zbx_hc_writer_t));
 
-			if (0 != history_num || 0 != timers_num)
-			{
-				for (i = 0; i < trigger_timers.values_num; i++)
-				{
-					zbx_trigger_timer_t	*timer = (zbx_trigger_timer_t *)trigger_timers.values[i];
+	pthread_mutex_init(&hc_writer.lock, NULL);
+	pthread_cond_init(&hc_writer.event, NULL);
+	pthread_cond_init(&hc_writer.done, NULL);
 
-					if (0 != timer->lock)
-						zbx_vector_uint64_append(&triggerids, timer->triggerid);
-				}
+	zbx_pthread_init_attr(&attr);
 
-				do
-				{
-					zbx_db_begin();
+	hc_writer.state = ZBX_HC_WRITER_STARTING;
 
-					recalculate_triggers(history, history_num, &itemids, items, errcodes,
-							&trigger_timers, events_cbs->add_event_cb, &trigger_diff,
-							trigger_itemids,
-							trigger_timespecs, &trigger_info, &trigger_order);
+	if (0 != (err = pthread_create(&hc_writer.thread, &attr, hc_writer_entry, (void *)&hc_writer)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot create history writer thread: %s", zbx_strerror(err));
+		hc_writer.state = ZBX_HC_WRITER_STOPPED;
+	}
+	else
+	{
+		pthread_mutex_lock(&hc_writer.lock);
 
-					if (NULL != events_cbs->process_events_cb)
-					{
-						/* process trigger events generated by recalculate_triggers() */
-						events_cbs->process_events_cb(&trigger_diff, &triggerids);
-					}
+		while (ZBX_HC_WRITER_STARTING == hc_writer.state)
+			pthread_cond_wait(&hc_writer.done, &hc_writer.lock);
 
-					if (0 != trigger_diff.values_num)
-						zbx_db_save_trigger_changes(&trigger_diff);
+		pthread_mutex_unlock(&hc_writer.lock);
 
-					if (ZBX_DB_OK == (txn_error = zbx_db_commit()))
-						zbx_dc_config_triggers_apply_changes(&trigger_diff);
-					else if (NULL != events_cbs->clean_events_cb)
-						events_cbs->clean_events_cb();
+		if (ZBX_HC_WRITER_RUNNING != hc_writer.state)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot connect to database for pipelined history sync");
+			pthread_join(hc_writer.thread, NULL);
+		}
+	}
 
-					zbx_vector_ptr_clear_ext(&trigger_diff,
-							(zbx_clean_func_t)zbx_trigger_diff_free);
-				}
-				while (ZBX_DB_DOWN == txn_error);
+	pthread_attr_destroy(&attr);
 
-				if (ZBX_DB_OK == txn_error && NULL != events_cbs->events_update_itservices_cb)
-					events_cbs->events_update_itservices_cb();
-			}
-		}
+	if (ZBX_HC_WRITER_RUNNING != hc_writer.state)
+	{
+		pthread_cond_destroy(&hc_writer.done);
+		pthread_cond_destroy(&hc_writer.event);
+		pthread_mutex_destroy(&hc_writer.lock);
+	}
+#endif
+}
 
-		if (0 != triggerids.values_num)
-		{
-			*triggers_num += triggerids.values_num;
-			zbx_dc_config_unlock_triggers(&triggerids);
-			zbx_vector_uint64_clear(&triggerids);
-		}
+/******************************************************************************
+ *                                                                            *
+ * Purpose: stops history writer thread                                       *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_hc_history_writer_stop(void)
+{
+	if (ZBX_HC_WRITER_RUNNING != hc_writer.state)
+		return;
 
-		if (0 != trigger_timers.values_num)
-		{
-			zbx_dc_reschedule_trigger_timers(&trigger_timers, time(NULL));
-			zbx_vector_ptr_clear(&trigger_timers);
-		}
+	pthread_mutex_lock(&hc_writer.lock);
+	hc_writer.stop = 1;
+	pthread_cond_signal(&hc_writer.event);
+	pthread_mutex_unlock(&hc_writer.lock);
 
-		if (0 != proxy_subscriptions.values_num)
-		{
-			zbx_vector_uint64_pair_sort(&proxy_subscriptions, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
-			zbx_dc_proxy_update_nodata(&proxy_subscriptions);
-			zbx_vector_uint64_pair_clear(&proxy_subscriptions);
-		}
+	pthread_join(hc_writer.thread, NULL);
 
-		if (0 != history_num)
-		{
-			LOCK_CACHE;
-			hc_push_items(&history_items);	/* return items to history cache */
-			cache->history_num -= history_num;
+	hc_writer.state = ZBX_HC_WRITER_STOPPED;
+	zbx_free(hc_writer.trends);
 
-			if (0 != hc_queue_get_size())
-			{
-				/* Continue sync if enough of sync candidates were processed       */
-				/* (meaning most of sync candidates are not locked by triggers).   */
-				/* Otherwise better to wait a bit for other syncers to unlock      */
-				/* items rather than trying and failing to sync locked items over  */
-				/* and over again.                                                 */
-				if (ZBX_HC_SYNC_MIN_PCNT <= history_num * 100 / history_items.values_num)
-					*more = ZBX_SYNC_MORE;
-			}
+	pthread_cond_destroy(&hc_writer.done);
+	pthread_cond_destroy(&hc_writer.event);
+	pthread_mutex_destroy(&hc_writer.lock);
+}
 
-			UNLOCK_CACHE;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes history values of the batch to history storage             *
+ *                                                                            *
+ * Parameters: batch - [IN/OUT]                                               *
+ *                                                                            *
+ * Comments: If history writer is running the values are written              *
+ *           asynchronously and hc_writer_wait() must be called before        *
+ *           accessing the batch.                                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_writer_submit(zbx_hc_sync_batch_t *batch)
+{
+	if (ZBX_HC_WRITER_RUNNING != hc_writer.state)
+	{
+		batch->ret = DBmass_add_history(batch->history, batch->history_num, &batch->history_values);
+		return;
+	}
 
-			*values_num += history_num;
-		}
+	pthread_mutex_lock(&hc_writer.lock);
+	hc_writer.batch = batch;
+	hc_writer.written = 0;
+	pthread_cond_signal(&hc_writer.event);
+	pthread_mutex_unlock(&hc_writer.lock);
+}
 
-		if (FAIL != ret)
-		{
-			int	event_export_enabled = FAIL;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: waits until history values of the batch are written               *
+ *                                                                            *
+ * Parameters: batch - [IN]                                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_writer_wait(const zbx_hc_sync_batch_t *batch)
+{
+	if (ZBX_HC_WRITER_RUNNING != hc_writer.state || batch != hc_writer.batch)
+		return;
 
-			if (0 != history_num)
-			{
-				const zbx_dc_history_t	*phistory = NULL;
-				const ZBX_DC_TREND	*ptrends = NULL;
-				int			history_num_loc = 0, trends_num_loc = 0;
-				int			history_export_enabled = FAIL;
+	pthread_mutex_lock(&hc_writer.lock);
 
-				if (SUCCEED == module_enabled)
-				{
-					DCmodule_prepare_history(history, history_num, history_float, &history_float_num,
-							history_integer, &history_integer_num, history_string,
-							&history_string_num, history_text, &history_text_num, history_log,
-							&history_log_num);
-
-					DCmodule_sync_history(history_float_num, history_integer_num, history_string_num,
-							history_text_num, history_log_num, history_float,
-							history_integer, history_string, history_text, history_log);
-				}
+	while (0 == hc_writer.written)
+		pthread_cond_wait(&hc_writer.done, &hc_writer.lock);
 
-				if (SUCCEED == (history_export_enabled =
-						zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_HISTORY)) ||
-						0 != connector_filters_history.values_num)
-				{
-					phistory = history;
-					history_num_loc = history_num;
-				}
+	hc_writer.batch = NULL;
 
-				if (SUCCEED == zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_TRENDS))
-				{
-					ptrends = trends;
-					trends_num_loc = trends_num;
-				}
+	pthread_mutex_unlock(&hc_writer.lock);
+}
 
-				if (NULL != phistory || NULL != ptrends)
-				{
-					data_offset = 0;
-					DCexport_history_and_trends(phistory, history_num_loc, &itemids, items,
-							errcodes, ptrends, trends_num_loc, history_export_enabled,
-							&connector_filters_history, &data, &data_alloc, &data_offset);
-
-					if (0 != data_offset)
-					{
-						zbx_connector_send(ZBX_IPC_CONNECTOR_REQUEST, data,
-								(zbx_uint32_t)data_offset);
-					}
-				}
-			}
-			else if (0 != timers_num)
-			{
-				if (FAIL == connectors_retrieved)
-				{
-					zbx_dc_config_history_sync_get_connector_filters(&connector_filters_history,
-								&connector_filters_events);
-					connectors_retrieved = SUCCEED;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: queues trends to be written by history writer                     *
+ *                                                                            *
+ * Parameters: trends     - [IN] the trends to write                          *
+ *             trends_num - [IN] the number of trends                         *
+ *                                                                            *
+ * Return value: SUCCEED - the trends were queued                             *
+ *               FAIL    - history writer is not running or its trend queue   *
+ *                         is full, the trends must be written by caller      *
+ *                                                                            *
+ * Comments: Trends are flushed from trend cache in bursts at hour change.    *
+ *           Writing them asynchronously keeps the burst out of history sync. *
+ *           The queue is limited, so that syncers flushing trends faster     *
+ *           than writer can write them are throttled by writing the trends   *
+ *           themselves instead of growing the queue without bounds.          *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_writer_add_trends(const ZBX_DC_TREND *trends, int trends_num)
+{
+	if (ZBX_HC_WRITER_RUNNING != hc_writer.state)
+		return FAIL;
 
-					if (0 != connector_filters_history.values_num)
-						item_retrieve_mode = ZBX_ITEM_GET_SYNC_EXPORT;
-				}
-			}
+	pthread_mutex_lock(&hc_writer.lock);
 
-			if (SUCCEED == (event_export_enabled = zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_EVENTS)) ||
-					0 != connector_filters_events.values_num)
-			{
-				data_offset = 0;
+	if (hc_writer.trends_num + trends_num > ZBX_HC_WRITER_TRENDS_MAX)
+	{
+		pthread_mutex_unlock(&hc_writer.lock);
+		return FAIL;
+	}
 
-				if (NULL != events_cbs->export_events_cb)
-				{
-					events_cbs->export_events_cb(event_export_enabled, &connector_filters_events,
-							&data, &data_alloc, &data_offset);
-				}
+	if (hc_writer.trends_num + trends_num > hc_writer.trends_alloc)
+	{
+		hc_writer.trends_alloc = hc_writer.trends_num + trends_num;
+		hc_writer.trends = (ZBX_DC_TREND *)zbx_realloc(hc_writer.trends,
+				sizeof(ZBX_DC_TREND) * (size_t)hc_writer.trends_alloc);
+	}
 
-				if (0 != data_offset)
-				{
-					zbx_connector_send(ZBX_IPC_CONNECTOR_REQUEST, data,
-							(zbx_uint32_t)data_offset);
-				}
-			}
-		}
+	memcpy(hc_writer.trends + hc_writer.trends_num, trends, sizeof(ZBX_DC_TREND) * (size_t)trends_num);
+	hc_writer.trends_num += trends_num;
 
-		if (0 != history_num || 0 != timers_num)
-		{
-			if (NULL != events_cbs->clean_events_cb)
-				events_cbs->clean_events_cb();
-		}
+	pthread_cond_signal(&hc_writer.event);
+	pthread_mutex_unlock(&hc_writer.lock);
 
-		if (0 != history_num)
-		{
-			zbx_free(trends);
-			zbx_dc_config_clean_history_sync_items(items, errcodes, (size_t)history_num);
+	return SUCCEED;
+}
 
-			zbx_vector_ptr_clear(&history_items);
-			hc_free_item_values(history, history_num);
-		}
+static void	hc_sync_batch_init(zbx_hc_sync_batch_t *batch)
+{
+	memset(batch, 0, sizeof(zbx_hc_sync_batch_t));
+
+	batch->ret = SUCCEED;
+
+	zbx_vector_ptr_create(&batch->history_items);
+	zbx_vector_ptr_reserve(&batch->history_items, ZBX_HC_SYNC_MAX);
+	zbx_vector_ptr_create(&batch->history_values);
+	zbx_vector_uint64_create(&batch->itemids);
+	zbx_vector_uint64_create(&batch->triggerids);
+	zbx_vector_uint64_reserve(&batch->triggerids, ZBX_HC_SYNC_MAX);
+	zbx_vector_ptr_create(&batch->item_diff);
+	zbx_vector_ptr_create(&batch->inventory_values);
+}
 
-		zbx_vector_uint64_clear(&itemids);
+static void	hc_sync_batch_destroy(zbx_hc_sync_batch_t *batch)
+{
+	zbx_free(batch->history);
+	zbx_free(batch->items);
+	zbx_free(batch->errcodes);
+
+	zbx_vector_ptr_destroy(&batch->inventory_values);
+	zbx_vector_ptr_destroy(&batch->item_diff);
+	zbx_vector_uint64_destroy(&batch->triggerids);
+	zbx_vector_uint64_destroy(&batch->itemids);
+	zbx_vector_ptr_destroy(&batch->history_values);
+	zbx_vector_ptr_destroy(&batch->history_items);
+}
 
-		/* Exit from sync loop if we have spent too much time here.       */
-		/* This is done to allow syncer process to update its statistics. */
-	}
-	while (ZBX_SYNC_MORE == *more && ZBX_HC_SYNC_TIME_MAX >= time(NULL) - sync_start);
+static void	hc_sync_get_connector_filters(zbx_hc_sync_t *sync)
+{
+	if (SUCCEED == sync->connectors_retrieved)
+		return;
 
-	zbx_free(items);
-	zbx_free(errcodes);
-	zbx_free(data);
+	zbx_dc_config_history_sync_get_connector_filters(&sync->connector_filters_history,
+			&sync->connector_filters_events);
 
-	zbx_vector_connector_filter_clear_ext(&connector_filters_events, zbx_connector_filter_free);
-	zbx_vector_connector_filter_clear_ext(&connector_filters_history, zbx_connector_filter_free);
-	zbx_vector_connector_filter_destroy(&connector_filters_events);
-	zbx_vector_connector_filter_destroy(&connector_filters_history);
-	zbx_vector_dc_trigger_destroy(&trigger_order);
-	zbx_hashset_destroy(&trigger_info);
-
-	zbx_vector_uint64_destroy(&itemids);
-	zbx_vector_ptr_destroy(&history_items);
-	zbx_vector_ptr_destroy(&inventory_values);
-	zbx_vector_ptr_destroy(&item_diff);
-	zbx_vector_ptr_destroy(&trigger_diff);
-	zbx_vector_uint64_pair_destroy(&trends_diff);
-	zbx_vector_uint64_pair_destroy(&proxy_subscriptions);
+	sync->connectors_retrieved = SUCCEED;
 
-	zbx_vector_ptr_destroy(&trigger_timers);
-	zbx_vector_uint64_destroy(&triggerids);
+	if (0 != sync->connector_filters_history.values_num)
+		sync->item_retrieve_mode = ZBX_ITEM_GET_SYNC_EXPORT;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: writes updates and new data from history cache to database        *
+ * Purpose: takes items out of history cache, locks their triggers and        *
+ *          prepares their values for writing to history storage              *
  *                                                                            *
- * Comments: This function is used to flush history cache at server/proxy     *
- *           exit.                                                            *
- *           Other processes are already terminated, so cache locking is      *
- *           unnecessary.                                                     *
+ * Parameters: sync  - [IN/OUT]                                               *
+ *             batch - [OUT]                                                  *
  *                                                                            *
  ******************************************************************************/
-static void	sync_history_cache_full(const zbx_events_funcs_t *events_cbs)
+static void	hc_sync_batch_prepare(zbx_hc_sync_t *sync, zbx_hc_sync_batch_t *batch)
 {
-	int			values_num = 0, triggers_num = 0, more;
-	zbx_hashset_iter_t	iter;
-	zbx_hc_item_t		*item;
-	zbx_binary_heap_t	tmp_history_queue;
+	int	i, coalesce_trends = FAIL;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() history_num:%d", __func__, cache->history_num);
+	batch->shardid = hc_pop_items(&batch->history_items);	/* select and take items out of history cache */
 
-	/* History index cache might be full without any space left for queueing items from history index to  */
-	/* history queue. The solution: replace the shared-memory history queue with heap-allocated one. Add  */
-	/* all items from history index to the new history queue.                                             */
-	/*                                                                                                    */
-	/* Assertions that must be true.                                                                      */
-	/*   * This is the main server or proxy process,                                                      */
-	/*   * There are no other users of history index cache stored in shared memory. Other processes       */
-	/*     should have quit by this point.                                                                */
-	/*   * other parts of the program do not hold pointers to the elements of history queue that is       */
-	/*     stored in the shared memory.                                                                   */
+	if (0 == batch->history_items.values_num)
+		return;
 
-	if (0 != (get_program_type_cb() & ZBX_PROGRAM_TYPE_SERVER))
+	if (0 == (batch->history_num = zbx_dc_config_lock_triggers_by_history_items(&batch->history_items,
+			&batch->triggerids)))
 	{
-		/* unlock all triggers before full sync so no items are locked by triggers */
-		zbx_dc_config_unlock_all_triggers();
-	}
+		LOCK_SHARD(batch->shardid);
+		hc_push_items(batch->shardid, &batch->history_items);
+		UNLOCK_SHARD(batch->shardid);
+		zbx_vector_ptr_clear(&batch->history_items);
 
-	tmp_history_queue = cache->history_queue;
+		return;
+	}
 
-	zbx_binary_heap_create(&cache->history_queue, hc_queue_elem_compare_func, ZBX_BINARY_HEAP_OPTION_EMPTY);
-	zbx_hashset_iter_reset(&cache->history_items, &iter);
+	hc_sync_get_connector_filters(sync);
 
-	/* add all items from history index to the new history queue */
-	while (NULL != (item = (zbx_hc_item_t *)zbx_hashset_iter_next(&iter)))
+	if (NULL == batch->history)
 	{
-		if (NULL != item->tail)
-		{
-			item->status = ZBX_HC_ITEM_STATUS_NORMAL;
-			hc_queue_item(item);
-		}
+		batch->history = (zbx_dc_history_t *)zbx_malloc(NULL, sizeof(zbx_dc_history_t) *
+				(size_t)ZBX_HC_SYNC_MAX);
 	}
 
-	if (0 != hc_queue_get_size())
+	if (NULL == batch->items)
 	{
-		zabbix_log(LOG_LEVEL_WARNING, "syncing history data...");
+		batch->items = (zbx_history_sync_item_t *)zbx_malloc(NULL, sizeof(zbx_history_sync_item_t) *
+				(size_t)ZBX_HC_SYNC_MAX);
+	}
 
-		do
-		{
-			sync_history_cb(&values_num, &triggers_num, events_cbs, &more);
+	if (NULL == batch->errcodes)
+		batch->errcodes = (int *)zbx_malloc(NULL, sizeof(int) * (size_t)ZBX_HC_SYNC_MAX);
 
-			zabbix_log(LOG_LEVEL_WARNING, "syncing history data... " ZBX_FS_DBL "%%",
-					(double)values_num / (cache->history_num + values_num) * 100);
-		}
-		while (0 != hc_queue_get_size());
+	zbx_vector_ptr_sort(&batch->history_items, ZBX_DEFAULT_UINT64_PTR_COMPARE_FUNC);
+	hc_get_item_values(batch->history, &batch->history_items);	/* copy item data from history cache */
 
-		zabbix_log(LOG_LEVEL_WARNING, "syncing history data done");
-	}
+	zbx_vector_uint64_reserve(&batch->itemids, (size_t)batch->history_num);
 
-	zbx_binary_heap_destroy(&cache->history_queue);
-	cache->history_queue = tmp_history_queue;
+	for (i = 0; i < batch->history_num; i++)
+		zbx_vector_uint64_append(&batch->itemids, batch->history[i].itemid);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+	zbx_dc_config_history_sync_get_items_by_itemids(batch->items, batch->itemids.values, batch->errcodes,
+			(size_t)batch->history_num, sync->item_retrieve_mode);
+
+	/* values folded by history cache would be missing from exported history */
+	if (SUCCEED != zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_HISTORY) &&
+			0 == sync->connector_filters_history.values_num)
+	{
+		coalesce_trends = SUCCEED;
+	}
+
+	DCmass_prepare_history(batch->history, batch->items, batch->errcodes, batch->history_num, &batch->item_diff,
+			&batch->inventory_values, sync->compression_age, &sync->proxy_subscriptions, coalesce_trends);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: log progress of syncing history data                              *
+ * Purpose: updates value cache, items, trends and triggers of the batch with *
+ *          written history values, processes timer triggers and returns the  *
+ *          batch items to history cache                                      *
+ *                                                                            *
+ * Parameters: sync         - [IN/OUT]                                        *
+ *             batch        - [IN/OUT]                                        *
+ *             values_num   - [IN/OUT] the number of synced values            *
+ *             triggers_num - [IN/OUT] the number of processed timers         *
+ *             more         - [OUT] a flag indicating the cache emptiness     *
  *                                                                            *
  ******************************************************************************/
-void	zbx_log_sync_history_cache_progress(void)
+static void	hc_sync_batch_finish(zbx_hc_sync_t *sync, zbx_hc_sync_batch_t *batch, int *values_num,
+		int *triggers_num, int *more)
 {
-	double		pcnt = -1.0;
-	int		ts_last, ts_next, sec;
+	const zbx_events_funcs_t	*events_cbs = sync->events_cbs;
+	int				i, trends_num = 0, timers_num = 0, txn_error;
+	size_t				data_offset;
+	ZBX_DC_TREND			*trends = NULL;
 
-	LOCK_CACHE;
+	*more = ZBX_SYNC_DONE;
 
-	if (INT_MAX == cache->history_progress_ts)
+	if (0 != batch->history_num)
 	{
-		UNLOCK_CACHE;
+		if (FAIL != batch->ret)
+		{
+			zbx_dc_um_handle_t	*um_handle;
+
+			if (0 != batch->history_values.values_num)
+				zbx_vc_cache_values(&batch->history_values);
+
+			um_handle = zbx_dc_open_user_macros();
+
+			zbx_dc_config_items_apply_changes(&batch->item_diff);
+			DCmass_update_trends(batch->history, batch->history_num, &trends, &trends_num,
+					sync->compression_age);
+
+			if (0 != trends_num && SUCCEED != hc_writer_add_trends(trends, trends_num))
+				hc_flush_trends(trends, trends_num, &sync->trends_diff);
+
+			DCmass_add_item_events(batch->history, &batch->itemids, &batch->item_diff,
+					events_cbs->add_event_cb);
+
+			do
+			{
+				zbx_db_begin();
+
+				DBmass_update_items(&batch->item_diff, &batch->inventory_values);
+
+				if (NULL != events_cbs->process_events_cb)
+				{
+					/* process internal events generated by DCmass_add_item_events() */
+					events_cbs->process_events_cb(NULL, NULL);
+				}
+
+				if (ZBX_DB_OK != (txn_error = zbx_db_commit()))
+				{
+					if (NULL != events_cbs->reset_event_recovery_cb)
+						events_cbs->reset_event_recovery_cb();
+				}
+			}
+			while (ZBX_DB_DOWN == txn_error);
+
+			zbx_dc_close_user_macros(um_handle);
+		}
+
+		if (NULL != events_cbs->clean_events_cb)
+			events_cbs->clean_events_cb();
+
+		zbx_vector_ptr_clear_ext(&batch->inventory_values, (zbx_clean_func_t)DCinventory_value_free);
+		zbx_vector_ptr_clear_ext(&batch->item_diff, (zbx_clean_func_t)zbx_ptr_free);
+		zbx_vector_ptr_clear(&batch->history_values);
+	}
+
+	if (FAIL != batch->ret)
+	{
+		/* don't process trigger timers when server is shutting down */
+		if (ZBX_IS_RUNNING())
+		{
+			zbx_dc_get_trigger_timers(&sync->trigger_timers, time(NULL), ZBX_HC_TIMER_SOFT_MAX,
+					ZBX_HC_TIMER_MAX);
+		}
+
+		timers_num = sync->trigger_timers.values_num;
+
+		if (ZBX_HC_TIMER_SOFT_MAX <= timers_num)
+			*more = ZBX_SYNC_MORE;
+
+		if (0 != batch->history_num || 0 != timers_num)
+		{
+			for (i = 0; i < sync->trigger_timers.values_num; i++)
+			{
+				zbx_trigger_timer_t	*timer = (zbx_trigger_timer_t *)sync->trigger_timers.values[i];
+
+				if (0 != timer->lock)
+					zbx_vector_uint64_append(&batch->triggerids, timer->triggerid);
+			}
+
+			do
+			{
+				zbx_db_begin();
+
+				recalculate_triggers(batch->history, batch->history_num, &batch->itemids, batch->items,
+						batch->errcodes, &sync->trigger_timers, events_cbs->add_event_cb,
+						&sync->trigger_diff, sync->trigger_itemids, sync->trigger_timespecs,
+						&sync->trigger_info, &sync->trigger_order);
+
+				if (NULL != events_cbs->process_events_cb)
+				{
+					/* process trigger events generated by recalculate_triggers() */
+					events_cbs->process_events_cb(&sync->trigger_diff, &batch->triggerids);
+				}
+
+				if (0 != sync->trigger_diff.values_num)
+					zbx_db_save_trigger_changes(&sync->trigger_diff);
+
+				if (ZBX_DB_OK == (txn_error = zbx_db_commit()))
+					zbx_dc_config_triggers_apply_changes(&sync->trigger_diff);
+				else if (NULL != events_cbs->clean_events_cb)
+					events_cbs->clean_events_cb();
+
+				zbx_vector_ptr_clear_ext(&sync->trigger_diff, (zbx_clean_func_t)zbx_trigger_diff_free);
+			}
+			while (ZBX_DB_DOWN == txn_error);
+
+			if (ZBX_DB_OK == txn_error && NULL != events_cbs->events_update_itservices_cb)
+				events_cbs->events_update_itservices_cb();
+		}
+	}
+
+	if (0 != batch->triggerids.values_num)
+	{
+		*triggers_num += batch->triggerids.values_num;
+		zbx_dc_config_unlock_triggers(&batch->triggerids);
+		zbx_vector_uint64_clear(&batch->triggerids);
+	}
+
+	if (0 != sync->trigger_timers.values_num)
+	{
+		zbx_dc_reschedule_trigger_timers(&sync->trigger_timers, time(NULL));
+		zbx_vector_ptr_clear(&sync->trigger_timers);
+	}
+
+	if (0 != sync->proxy_subscriptions.values_num)
+	{
+		zbx_vector_uint64_pair_sort(&sync->proxy_subscriptions, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+		zbx_dc_proxy_update_nodata(&sync->proxy_subscriptions);
+		zbx_vector_uint64_pair_clear(&sync->proxy_subscriptions);
+	}
+
+	if (0 != batch->history_num)
+	{
+		LOCK_SHARD(batch->shardid);
+		hc_push_items(batch->shardid, &batch->history_items);	/* return items to history cache */
+		UNLOCK_SHARD(batch->shardid);
+
+		if (0 != hc_queue_get_size())
+		{
+			/* Continue sync if enough of sync candidates were processed       */
+			/* (meaning most of sync candidates are not locked by triggers).   */
+			/* Otherwise better to wait a bit for other syncers to unlock      */
+			/* items rather than trying and failing to sync locked items over  */
+			/* and over again.                                                 */
+			if (ZBX_HC_SYNC_MIN_PCNT <= batch->history_num * 100 / batch->history_items.values_num)
+				*more = ZBX_SYNC_MORE;
+		}
+
+		*values_num += batch->history_num;
+	}
+
+	if (FAIL != batch->ret)
+	{
+		int	event_export_enabled = FAIL;
+
+		if (0 != batch->history_num)
+		{
+			const zbx_dc_history_t	*phistory = NULL;
+			const ZBX_DC_TREND	*ptrends = NULL;
+			int			history_num_loc = 0, trends_num_loc = 0;
+			int			history_export_enabled = FAIL;
+
+			DCmodule_process_history(batch->history, batch->history_num);
+
+			if (SUCCEED == (history_export_enabled = zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_HISTORY)) ||
+					0 != sync->connector_filters_history.values_num)
+			{
+				phistory = batch->history;
+				history_num_loc = batch->history_num;
+			}
+
+			if (SUCCEED == zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_TRENDS))
+			{
+				ptrends = trends;
+				trends_num_loc = trends_num;
+			}
+
+			if (NULL != phistory || NULL != ptrends)
+			{
+				data_offset = 0;
+				DCexport_history_and_trends(phistory, history_num_loc, &batch->itemids, batch->items,
+						batch->errcodes, ptrends, trends_num_loc, history_export_enabled,
+						&sync->connector_filters_history, &sync->data, &sync->data_alloc,
+						&data_offset);
+
+				if (0 != data_offset)
+				{
+					zbx_connector_send(ZBX_IPC_CONNECTOR_REQUEST, sync->data,
+							(zbx_uint32_t)data_offset);
+				}
+			}
+		}
+		else if (0 != timers_num)
+			hc_sync_get_connector_filters(sync);
+
+		if (SUCCEED == (event_export_enabled = zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_EVENTS)) ||
+				0 != sync->connector_filters_events.values_num)
+		{
+			data_offset = 0;
+
+			if (NULL != events_cbs->export_events_cb)
+			{
+				events_cbs->export_events_cb(event_export_enabled, &sync->connector_filters_events,
+						&sync->data, &sync->data_alloc, &data_offset);
+			}
+
+			if (0 != data_offset)
+				zbx_connector_send(ZBX_IPC_CONNECTOR_REQUEST, sync->data, (zbx_uint32_t)data_offset);
+		}
+	}
+
+	if (0 != batch->history_num || 0 != timers_num)
+	{
+		if (NULL != events_cbs->clean_events_cb)
+			events_cbs->clean_events_cb();
+	}
+
+	if (0 != batch->history_num)
+	{
+		zbx_free(trends);
+		zbx_dc_config_clean_history_sync_items(batch->items, batch->errcodes, (size_t)batch->history_num);
+
+		zbx_vector_ptr_clear(&batch->history_items);
+		hc_free_item_values(batch->history, batch->history_num);
+		batch->history_num = 0;
+	}
+
+	zbx_vector_uint64_clear(&batch->itemids);
+	batch->ret = SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: flush history cache to database, process triggers of flushed      *
+ *          and timer triggers from timer queue                               *
+ *                                                                            *
+ * Parameters:                                                                *
+ *             values_num   - [IN/OUT] the number of synced values            *
+ *             triggers_num - [IN/OUT] the number of processed timers         *
+ *             events_cbs   - [IN]                                            *
+ *             more         - [OUT] a flag indicating the cache emptiness:    *
+ *                               ZBX_SYNC_DONE - nothing to sync, go idle     *
+ *                               ZBX_SYNC_MORE - more data to sync            *
+ *                                                                            *
+ * Comments: This function loops syncing history values by 1k batches and     *
+ *           processing timer triggers by batches of 500 triggers.            *
+ *           Unless full sync is being done the loop is aborted if either     *
+ *           timeout has passed or there are no more data to process.         *
+ *           The last is assumed when the following is true:                  *
+ *            a) history cache is empty or less than 10% of batch values were *
+ *               processed (the other items were locked by triggers)          *
+ *            b) less than 500 (full batch) timer triggers were processed     *
+ *                                                                            *
+ *           When history writer is running the batches are pipelined - the   *
+ *           values of one batch are written while the next batch is being    *
+ *           prepared and triggers of the previous batch are recalculated.    *
+ *           Items of a batch are returned to history cache only after its    *
+ *           values are written, so consecutive batches never share items     *
+ *           and values of the same item are always written in order.         *
+ *                                                                            *
+ *           The first history syncer also replays values spilled to disk     *
+ *           when history cache was almost full.                              *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_sync_server_history(int *values_num, int *triggers_num, const zbx_events_funcs_t *events_cbs, int *more)
+{
+	zbx_hc_sync_t		sync;
+	zbx_hc_sync_batch_t	batches[2], *batch, *prev = NULL;
+	time_t			sync_start;
+	int			replayed = FAIL;
+
+	if (1 == hc_syncer_num)
+		replayed = hc_spill_replay();
+
+	sync.events_cbs = events_cbs;
+	sync.compression_age = hc_get_history_compression_age();
+	sync.connectors_retrieved = FAIL;
+	sync.item_retrieve_mode = 0 == zbx_has_export_dir() ? ZBX_ITEM_GET_SYNC : ZBX_ITEM_GET_SYNC_EXPORT;
+	sync.data = NULL;
+	sync.data_alloc = 0;
+
+	zbx_vector_connector_filter_create(&sync.connector_filters_history);
+	zbx_vector_connector_filter_create(&sync.connector_filters_events);
+	zbx_vector_ptr_create(&sync.trigger_diff);
+	zbx_vector_uint64_pair_create(&sync.trends_diff);
+	zbx_vector_uint64_pair_create(&sync.proxy_subscriptions);
+
+	zbx_vector_ptr_create(&sync.trigger_timers);
+	zbx_vector_ptr_reserve(&sync.trigger_timers, ZBX_HC_TIMER_MAX);
+
+	zbx_vector_dc_trigger_create(&sync.trigger_order);
+	zbx_hashset_create(&sync.trigger_info, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	hc_sync_batch_init(&batches[0]);
+	hc_sync_batch_init(&batches[1]);
+
+	sync_start = time(NULL);
+	*more = ZBX_SYNC_DONE;
+
+	do
+	{
+		batch = (&batches[0] == prev ? &batches[1] : &batches[0]);
+
+		hc_sync_batch_prepare(&sync, batch);
+
+		if (NULL != prev)
+			hc_writer_wait(prev);
+
+		if (0 != batch->history_num)
+			hc_writer_submit(batch);
+
+		if (NULL != prev)
+			hc_sync_batch_finish(&sync, prev, values_num, triggers_num, more);
+
+		if (ZBX_HC_WRITER_RUNNING == hc_writer.state)
+		{
+			prev = batch;
+		}
+		else
+		{
+			hc_sync_batch_finish(&sync, batch, values_num, triggers_num, more);
+			prev = NULL;
+		}
+
+		/* Exit from sync loop if we have spent too much time here.       */
+		/* This is done to allow syncer process to update its statistics. */
+	}
+	while ((ZBX_SYNC_MORE == *more || (NULL != prev && 0 != prev->history_num)) &&
+			ZBX_HC_SYNC_TIME_MAX >= time(NULL) - sync_start);
+
+	if (NULL != prev)
+	{
+		hc_writer_wait(prev);
+		hc_sync_batch_finish(&sync, prev, values_num, triggers_num, more);
+	}
+
+	/* come back without delay to replay the remaining spilled values */
+	if (SUCCEED == replayed)
+		*more = ZBX_SYNC_MORE;
+
+	hc_sync_batch_destroy(&batches[1]);
+	hc_sync_batch_destroy(&batches[0]);
+
+	zbx_free(sync.data);
+
+	zbx_vector_connector_filter_clear_ext(&sync.connector_filters_events, zbx_connector_filter_free);
+	zbx_vector_connector_filter_clear_ext(&sync.connector_filters_history, zbx_connector_filter_free);
+	zbx_vector_connector_filter_destroy(&sync.connector_filters_events);
+	zbx_vector_connector_filter_destroy(&sync.connector_filters_history);
+	zbx_vector_dc_trigger_destroy(&sync.trigger_order);
+	zbx_hashset_destroy(&sync.trigger_info);
+
+	zbx_vector_ptr_destroy(&sync.trigger_diff);
+	zbx_vector_uint64_pair_destroy(&sync.trends_diff);
+	zbx_vector_uint64_pair_destroy(&sync.proxy_subscriptions);
+
+	zbx_vector_ptr_destroy(&sync.trigger_timers);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes updates and new data from history cache to database        *
+ *                                                                            *
+ * Comments: This function is used to flush history cache at server/proxy     *
+ *           exit.                                                            *
+ *           Other processes are already terminated, so cache locking is      *
+ *           unnecessary.                                                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	sync_history_cache_full(const zbx_events_funcs_t *events_cbs)
+{
+	int			i, values_num = 0, triggers_num = 0, more, history_num;
+	zbx_hashset_iter_t	iter;
+	zbx_hc_item_t		*item;
+	zbx_binary_heap_t	tmp_history_queues[ZBX_HC_SHARDS_MAX];
+
+	hc_get_shards_stats(NULL, &history_num);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() history_num:%d", __func__, history_num);
+
+	/* History index cache might be full without any space left for queueing items from history index to  */
+	/* history queue. The solution: replace the shared-memory history queue with heap-allocated one. Add  */
+	/* all items from history index to the new history queue.                                             */
+	/*                                                                                                    */
+	/* Assertions that must be true.                                                                      */
+	/*   * This is the main server or proxy process,                                                      */
+	/*   * There are no other users of history index cache stored in shared memory. Other processes       */
+	/*     should have quit by this point.                                                                */
+	/*   * other parts of the program do not hold pointers to the elements of history queue that is       */
+	/*     stored in the shared memory.                                                                   */
+
+	if (0 != (get_program_type_cb() & ZBX_PROGRAM_TYPE_SERVER))
+	{
+		/* unlock all triggers before full sync so no items are locked by triggers */
+		zbx_dc_config_unlock_all_triggers();
+	}
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		zbx_hc_shard_t	*shard = &cache->shards[i];
+
+		tmp_history_queues[i] = shard->history_queue;
+
+		zbx_binary_heap_create(&shard->history_queue, hc_queue_elem_compare_func,
+				ZBX_BINARY_HEAP_OPTION_EMPTY);
+		zbx_hashset_iter_reset(&shard->history_items, &iter);
+
+		/* add all items from history index to the new history queue */
+		while (NULL != (item = (zbx_hc_item_t *)zbx_hashset_iter_next(&iter)))
+		{
+			if (NULL != item->tail)
+			{
+				item->status = ZBX_HC_ITEM_STATUS_NORMAL;
+				hc_queue_item(shard, item);
+			}
+		}
+	}
+
+	if (0 != hc_queue_get_size())
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "syncing history data...");
+
+		do
+		{
+			sync_history_cb(&values_num, &triggers_num, events_cbs, &more);
+			hc_get_shards_stats(NULL, &history_num);
+
+			zabbix_log(LOG_LEVEL_WARNING, "syncing history data... " ZBX_FS_DBL "%%",
+					(double)values_num / (history_num + values_num) * 100);
+		}
+		while (0 != hc_queue_get_size());
+
+		zabbix_log(LOG_LEVEL_WARNING, "syncing history data done");
+	}
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		zbx_binary_heap_destroy(&cache->shards[i].history_queue);
+		cache->shards[i].history_queue = tmp_history_queues[i];
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: log progress of syncing history data                              *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_log_sync_history_cache_progress(void)
+{
+	double		pcnt = -1.0;
+	int		ts_last, ts_next, sec, history_num;
+
+	hc_get_shards_stats(NULL, &history_num);
+
+	LOCK_CACHE;
+
+	if (INT_MAX == cache->history_progress_ts)
+	{
+		UNLOCK_CACHE;
 		return;
 	}
 
@@ -3474,16 +4434,16 @@ void	zbx_log_sync_history_cache_progress(void)
 
 	if (0 == cache->history_progress_ts)
 	{
-		cache->history_num_total = cache->history_num;
+		cache->history_num_total = history_num;
 		cache->history_progress_ts = sec;
 	}
 
-	if (ZBX_HC_SYNC_TIME_MAX <= sec - cache->history_progress_ts || 0 == cache->history_num)
+	if (ZBX_HC_SYNC_TIME_MAX <= sec - cache->history_progress_ts || 0 == history_num)
 	{
 		if (0 != cache->history_num_total)
-			pcnt = 100 * (double)(cache->history_num_total - cache->history_num) / cache->history_num_total;
+			pcnt = 100 * (double)(cache->history_num_total - history_num) / cache->history_num_total;
 
-		cache->history_progress_ts = (0 == cache->history_num ? INT_MAX : sec);
+		cache->history_progress_ts = (0 == history_num ? INT_MAX : sec);
 	}
 
 	ts_next = cache->history_progress_ts;
@@ -3515,7 +4475,7 @@ void	zbx_log_sync_history_cache_progress(void)
  ******************************************************************************/
 void	zbx_sync_history_cache(const zbx_events_funcs_t *events_cbs, int *values_num, int *triggers_num, int *more)
 {
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() history_num:%d", __func__, cache->history_num);
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
 	*values_num = 0;
 	*triggers_num = 0;
@@ -3551,6 +4511,8 @@ static dc_item_value_t	*dc_local_get_history_slot(void)
 	{
 		item_values_alloc += ZBX_STRUCT_REALLOC_STEP;
 		item_values = (dc_item_value_t *)zbx_realloc(item_values, item_values_alloc * sizeof(dc_item_value_t));
+		item_affinities = (zbx_uint64_t *)zbx_realloc(item_affinities, item_values_alloc * sizeof(zbx_uint64_t));
+		item_shardids = (int *)zbx_realloc(item_shardids, item_values_alloc * sizeof(int));
 	}
 
 	return &item_values[item_values_num++];
@@ -4039,15 +5001,13 @@ void	zbx_dc_flush_history(void)
 	if (0 == item_values_num)
 		return;
 
-	LOCK_CACHE;
+	if (-1 == spill_fd || SUCCEED != hc_spill_values(item_values, (int)item_values_num, string_values))
+	{
+		hc_place_values(item_values, (int)item_values_num, item_affinities, item_shardids);
+		hc_add_item_values(item_values, item_shardids, (int)item_values_num, string_values);
+	}
 
-	hc_add_item_values(item_values, item_values_num);
-
-	cache->history_num += item_values_num;
-
-	UNLOCK_CACHE;
-
-	zbx_vps_monitor_add_collected((zbx_uint64_t)item_values_num);
+	zbx_vps_monitor_add_collected((zbx_uint64_t)item_values_num);
 
 	item_values_num = 0;
 	string_values_offset = 0;
@@ -4059,7 +5019,190 @@ void	zbx_dc_flush_history(void)
  *                                                                            *
  ******************************************************************************/
 ZBX_SHMEM_FUNC_IMPL(__hc_index, hc_index_mem)
-ZBX_SHMEM_FUNC_IMPL(__hc, hc_mem)
+ZBX_SHMEM_FUNC1_IMPL_MALLOC(__hc, hc_mem)
+ZBX_SHMEM_FUNC1_IMPL_FREE(__hc, hc_mem)
+
+/* shards allocate from the same history cache shared memory, serialize allocations */
+/* made by processes holding different shard locks                                  */
+static void	*hc_index_shmem_malloc_func(void *old, size_t size)
+{
+	void	*ptr;
+
+	LOCK_CACHE;
+	ptr = __hc_index_shmem_malloc_func(old, size);
+	UNLOCK_CACHE;
+
+	return ptr;
+}
+
+static void	*hc_index_shmem_realloc_func(void *old, size_t size)
+{
+	void	*ptr;
+
+	LOCK_CACHE;
+	ptr = __hc_index_shmem_realloc_func(old, size);
+	UNLOCK_CACHE;
+
+	return ptr;
+}
+
+static void	hc_index_shmem_free_func(void *ptr)
+{
+	LOCK_CACHE;
+	__hc_index_shmem_free_func(ptr);
+	UNLOCK_CACHE;
+}
+
+static int	hc_slab_slots_num(int classid)
+{
+	return (int)((ZBX_HC_SLAB_SIZE - ZBX_HC_SLAB_HEADER_SIZE) / (sizeof(zbx_hc_slab_t *) + hc_slab_sizes[classid]));
+}
+
+static void	hc_slab_link(zbx_hc_slab_class_t *slab_class, zbx_hc_slab_t *slab)
+{
+	slab->prev = NULL;
+
+	if (NULL != (slab->next = slab_class->partial))
+		slab->next->prev = slab;
+
+	slab_class->partial = slab;
+}
+
+static void	hc_slab_unlink(zbx_hc_slab_class_t *slab_class, zbx_hc_slab_t *slab)
+{
+	if (NULL != slab->prev)
+		slab->prev->next = slab->next;
+	else
+		slab_class->partial = slab->next;
+
+	if (NULL != slab->next)
+		slab->next->prev = slab->prev;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: allocates memory block directly from history cache memory         *
+ *                                                                            *
+ ******************************************************************************/
+static void	*hc_slab_malloc_direct(size_t size)
+{
+	zbx_hc_slab_t	**slot;
+
+	if (NULL == (slot = (zbx_hc_slab_t **)__hc_shmem_malloc_func(NULL, sizeof(zbx_hc_slab_t *) + size)))
+		return NULL;
+
+	*slot = NULL;
+
+	return slot + 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: allocates memory block for history data                           *
+ *                                                                            *
+ * Parameters: size - [IN] the block size                                     *
+ *                                                                            *
+ * Return value: the allocated block or NULL if history cache is full         *
+ *                                                                            *
+ * Comments: History cache lock must be held by the caller.                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	*hc_slab_malloc(size_t size)
+{
+	zbx_hc_slab_t		**slot, *slab;
+	zbx_hc_slab_class_t	*slab_class;
+	int			classid;
+
+	for (classid = 0; ZBX_HC_SLAB_CLASSES_NUM > classid && size > hc_slab_sizes[classid]; classid++)
+		;
+
+	if (ZBX_HC_SLAB_CLASSES_NUM == classid)
+		return hc_slab_malloc_direct(size);
+
+	slab_class = &cache->slab_classes[classid];
+
+	if (NULL == (slab = slab_class->partial))
+	{
+		/* when there is no space left for a new slab the remaining memory still can be used */
+		if (NULL == (slab = (zbx_hc_slab_t *)__hc_shmem_malloc_func(NULL, ZBX_HC_SLAB_SIZE)))
+			return hc_slab_malloc_direct(size);
+
+		memset(slab, 0, sizeof(zbx_hc_slab_t));
+		slab->classid = classid;
+
+		hc_slab_link(slab_class, slab);
+		slab_class->slabs_num++;
+	}
+
+	if (NULL != slab->free_slots)
+	{
+		slot = (zbx_hc_slab_t **)slab->free_slots;
+		slab->free_slots = *(void **)slot;
+	}
+	else
+	{
+		slot = (zbx_hc_slab_t **)((char *)slab + ZBX_HC_SLAB_HEADER_SIZE + (size_t)slab->slots_init *
+				(sizeof(zbx_hc_slab_t *) + hc_slab_sizes[classid]));
+		slab->slots_init++;
+	}
+
+	*slot = slab;
+	slab_class->slots_used++;
+
+	if (++slab->slots_used == hc_slab_slots_num(classid))
+		hc_slab_unlink(slab_class, slab);
+
+	return slot + 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees memory block allocated by hc_slab_malloc()                  *
+ *                                                                            *
+ * Comments: History cache lock must be held by the caller.                   *
+ *           Empty slabs are returned to history cache memory, except the     *
+ *           last slab of the class having free slots.                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_slab_free(void *ptr)
+{
+	zbx_hc_slab_t		**slot = (zbx_hc_slab_t **)ptr - 1, *slab;
+	zbx_hc_slab_class_t	*slab_class;
+
+	if (NULL == (slab = *slot))
+	{
+		__hc_shmem_free_func(slot);
+		return;
+	}
+
+	slab_class = &cache->slab_classes[slab->classid];
+
+	if (slab->slots_used-- == hc_slab_slots_num(slab->classid))
+		hc_slab_link(slab_class, slab);
+
+	slab_class->slots_used--;
+
+	*(void **)slot = slab->free_slots;
+	slab->free_slots = slot;
+
+	if (0 == slab->slots_used && (slab_class->partial != slab || NULL != slab->next))
+	{
+		hc_slab_unlink(slab_class, slab);
+		slab_class->slabs_num--;
+		__hc_shmem_free_func(slab);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns index of the shard holding items with the specified       *
+ *          history syncer affinity                                           *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_shard_index(zbx_uint64_t affinity)
+{
+	return (int)(affinity % (zbx_uint64_t)cache->shards_num);
+}
 
 /******************************************************************************
  *                                                                            *
@@ -4084,12 +5227,14 @@ static int	hc_queue_elem_compare_func(const void *d1, const void *d2)
  *                                                                            *
  * Parameters: data - [IN] history item data                                  *
  *                                                                            *
+ * Comments: History cache lock must be held by the caller.                   *
+ *                                                                            *
  ******************************************************************************/
 static void	hc_free_data(zbx_hc_data_t *data)
 {
 	if (ITEM_STATE_NOTSUPPORTED == data->state)
 	{
-		__hc_shmem_free_func(data->value.str);
+		hc_slab_free(data->value.str);
 	}
 	else
 	{
@@ -4100,15 +5245,15 @@ static void	hc_free_data(zbx_hc_data_t *data)
 				case ITEM_VALUE_TYPE_STR:
 				case ITEM_VALUE_TYPE_TEXT:
 				case ITEM_VALUE_TYPE_BIN:
-					__hc_shmem_free_func(data->value.str);
+					hc_slab_free(data->value.str);
 					break;
 				case ITEM_VALUE_TYPE_LOG:
-					__hc_shmem_free_func(data->value.log->value);
+					hc_slab_free(data->value.log->value);
 
 					if (NULL != data->value.log->source)
-						__hc_shmem_free_func(data->value.log->source);
+						hc_slab_free(data->value.log->source);
 
-					__hc_shmem_free_func(data->value.log);
+					hc_slab_free(data->value.log);
 					break;
 				case ITEM_VALUE_TYPE_UINT64:
 				case ITEM_VALUE_TYPE_FLOAT:
@@ -4121,72 +5266,76 @@ static void	hc_free_data(zbx_hc_data_t *data)
 		}
 	}
 
-	__hc_shmem_free_func(data);
+	hc_slab_free(data);
 }
 
 /******************************************************************************
  *                                                                            *
  * Purpose: put back item into history queue                                  *
  *                                                                            *
- * Parameters: data - [IN] history item data                                  *
+ * Parameters: shard - [IN] the history cache shard holding the item          *
+ *             item  - [IN] the history item                                  *
  *                                                                            *
  ******************************************************************************/
-static void	hc_queue_item(zbx_hc_item_t *item)
+static void	hc_queue_item(zbx_hc_shard_t *shard, zbx_hc_item_t *item)
 {
 	zbx_binary_heap_elem_t	elem = {item->itemid, (void *)item};
 
-	zbx_binary_heap_insert(&cache->history_queue, &elem);
+	zbx_binary_heap_insert(&shard->history_queue, &elem);
 }
 
 /******************************************************************************
  *                                                                            *
  * Purpose: returns history item by itemid                                    *
  *                                                                            *
- * Parameters: itemid - [IN] the item id                                      *
+ * Parameters: shard  - [IN] the history cache shard                          *
+ *             itemid - [IN] the item id                                      *
  *                                                                            *
  * Return value: the history item or NULL if the requested item is not in     *
  *               history cache                                                *
  *                                                                            *
  ******************************************************************************/
-static zbx_hc_item_t	*hc_get_item(zbx_uint64_t itemid)
+static zbx_hc_item_t	*hc_get_item(zbx_hc_shard_t *shard, zbx_uint64_t itemid)
 {
-	return (zbx_hc_item_t *)zbx_hashset_search(&cache->history_items, &itemid);
+	return (zbx_hc_item_t *)zbx_hashset_search(&shard->history_items, &itemid);
 }
 
 /******************************************************************************
  *                                                                            *
  * Purpose: adds a new item to history cache                                  *
  *                                                                            *
- * Parameters: itemid - [IN] the item id                                      *
- *                      [IN] the item data                                    *
+ * Parameters: shard  - [IN] the history cache shard                          *
+ *             itemid - [IN] the item id                                      *
+ *             data   - [IN] the item data                                    *
  *                                                                            *
  * Return value: the added history item                                       *
  *                                                                            *
  ******************************************************************************/
-static zbx_hc_item_t	*hc_add_item(zbx_uint64_t itemid, zbx_hc_data_t *data)
+static zbx_hc_item_t	*hc_add_item(zbx_hc_shard_t *shard, zbx_uint64_t itemid, zbx_hc_data_t *data)
 {
 	zbx_hc_item_t	item_local = {itemid, ZBX_HC_ITEM_STATUS_NORMAL, 0, data, data};
 
-	return (zbx_hc_item_t *)zbx_hashset_insert(&cache->history_items, &item_local, sizeof(item_local));
+	return (zbx_hc_item_t *)zbx_hashset_insert(&shard->history_items, &item_local, sizeof(item_local));
 }
 
 /******************************************************************************
  *                                                                            *
  * Purpose: copies string value to history cache                              *
  *                                                                            *
- * Parameters: str - [IN] the string value                                    *
+ * Parameters: str     - [IN] the string value                                *
+ *             strings - [IN] the buffer holding value strings                *
  *                                                                            *
  * Return value: the copied string or NULL if there was not enough memory     *
  *                                                                            *
  ******************************************************************************/
-static char	*hc_mem_value_str_dup(const dc_value_str_t *str)
+static char	*hc_mem_value_str_dup(const dc_value_str_t *str, const char *strings)
 {
 	char	*ptr;
 
-	if (NULL == (ptr = (char *)__hc_shmem_malloc_func(NULL, str->len)))
+	if (NULL == (ptr = (char *)hc_slab_malloc(str->len)))
 		return NULL;
 
-	memcpy(ptr, &string_values[str->pvalue], str->len - 1);
+	memcpy(ptr, &strings[str->pvalue], str->len - 1);
 	ptr[str->len - 1] = '\0';
 
 	return ptr;
@@ -4196,8 +5345,9 @@ static char	*hc_mem_value_str_dup(const dc_value_str_t *str)
  *                                                                            *
  * Purpose: clones string value into history data memory                      *
  *                                                                            *
- * Parameters: dst - [IN/OUT] a reference to the cloned value                 *
- *             str - [IN] the string value to clone                           *
+ * Parameters: dst     - [IN/OUT] a reference to the cloned value             *
+ *             str     - [IN] the string value to clone                       *
+ *             strings - [IN] the buffer holding value strings                *
  *                                                                            *
  * Return value: SUCCESS - either there was no need to clone the string       *
  *                         (it was empty or already cloned) or the string was *
@@ -4208,7 +5358,7 @@ static char	*hc_mem_value_str_dup(const dc_value_str_t *str)
  *           until it finishes cloning string value.                          *
  *                                                                            *
  ******************************************************************************/
-static int	hc_clone_history_str_data(char **dst, const dc_value_str_t *str)
+static int	hc_clone_history_str_data(char **dst, const dc_value_str_t *str, const char *strings)
 {
 	if (0 == str->len)
 		return SUCCEED;
@@ -4216,7 +5366,7 @@ static int	hc_clone_history_str_data(char **dst, const dc_value_str_t *str)
 	if (NULL != *dst)
 		return SUCCEED;
 
-	if (NULL != (*dst = hc_mem_value_str_dup(str)))
+	if (NULL != (*dst = hc_mem_value_str_dup(str, strings)))
 		return SUCCEED;
 
 	return FAIL;
@@ -4228,6 +5378,7 @@ static int	hc_clone_history_str_data(char **dst, const dc_value_str_t *str)
  *                                                                            *
  * Parameters: dst        - [IN/OUT] a reference to the cloned value          *
  *             item_value - [IN] the log value to clone                       *
+ *             strings    - [IN] the buffer holding value strings             *
  *                                                                            *
  * Return value: SUCCESS - the log value was cloned successfully              *
  *               FAIL    - not enough memory                                  *
@@ -4236,21 +5387,21 @@ static int	hc_clone_history_str_data(char **dst, const dc_value_str_t *str)
  *           until it finishes cloning log value.                             *
  *                                                                            *
  ******************************************************************************/
-static int	hc_clone_history_log_data(zbx_log_value_t **dst, const dc_item_value_t *item_value)
+static int	hc_clone_history_log_data(zbx_log_value_t **dst, const dc_item_value_t *item_value,
+		const char *strings)
 {
 	if (NULL == *dst)
 	{
-		/* using realloc instead of malloc just to suppress 'not used' warning for realloc */
-		if (NULL == (*dst = (zbx_log_value_t *)__hc_shmem_realloc_func(NULL, sizeof(zbx_log_value_t))))
+		if (NULL == (*dst = (zbx_log_value_t *)hc_slab_malloc(sizeof(zbx_log_value_t))))
 			return FAIL;
 
 		memset(*dst, 0, sizeof(zbx_log_value_t));
 	}
 
-	if (SUCCEED != hc_clone_history_str_data(&(*dst)->value, &item_value->value.value_str))
+	if (SUCCEED != hc_clone_history_str_data(&(*dst)->value, &item_value->value.value_str, strings))
 		return FAIL;
 
-	if (SUCCEED != hc_clone_history_str_data(&(*dst)->source, &item_value->source))
+	if (SUCCEED != hc_clone_history_str_data(&(*dst)->source, &item_value->source, strings))
 		return FAIL;
 
 	(*dst)->logeventid = item_value->logeventid;
@@ -4266,6 +5417,8 @@ static int	hc_clone_history_log_data(zbx_log_value_t **dst, const dc_item_value_
  *                                                                            *
  * Parameters: data       - [IN/OUT] a reference to the cloned value          *
  *             item_value - [IN] the item value                               *
+ *             strings    - [IN] the buffer holding item value strings        *
+ *             stats      - [IN/OUT] the shard statistics                     *
  *                                                                            *
  * Return value: SUCCESS - the item value was cloned successfully             *
  *               FAIL    - not enough memory                                  *
@@ -4274,11 +5427,12 @@ static int	hc_clone_history_log_data(zbx_log_value_t **dst, const dc_item_value_
  *           until it finishes cloning item value.                            *
  *                                                                            *
  ******************************************************************************/
-static int	hc_clone_history_data(zbx_hc_data_t **data, const dc_item_value_t *item_value)
+static int	hc_clone_history_data(zbx_hc_data_t **data, const dc_item_value_t *item_value, const char *strings,
+		zbx_dc_stats_t *stats)
 {
 	if (NULL == *data)
 	{
-		if (NULL == (*data = (zbx_hc_data_t *)__hc_shmem_malloc_func(NULL, sizeof(zbx_hc_data_t))))
+		if (NULL == (*data = (zbx_hc_data_t *)hc_slab_malloc(sizeof(zbx_hc_data_t))))
 			return FAIL;
 
 		memset(*data, 0, sizeof(zbx_hc_data_t));
@@ -4296,24 +5450,24 @@ static int	hc_clone_history_data(zbx_hc_data_t **data, const dc_item_value_t *it
 
 	if (ITEM_STATE_NOTSUPPORTED == item_value->state)
 	{
-		if (NULL == ((*data)->value.str = hc_mem_value_str_dup(&item_value->value.value_str)))
+		if (NULL == ((*data)->value.str = hc_mem_value_str_dup(&item_value->value.value_str, strings)))
 			return FAIL;
 
 		(*data)->value_type = item_value->value_type;
-		cache->stats.notsupported_counter++;
+		stats->notsupported_counter++;
 
 		return SUCCEED;
 	}
 
 	if (0 != (ZBX_DC_FLAG_LLD & item_value->flags))
 	{
-		if (NULL == ((*data)->value.str = hc_mem_value_str_dup(&item_value->value.value_str)))
+		if (NULL == ((*data)->value.str = hc_mem_value_str_dup(&item_value->value.value_str, strings)))
 			return FAIL;
 
 		(*data)->value_type = ITEM_VALUE_TYPE_TEXT;
 
-		cache->stats.history_text_counter++;
-		cache->stats.history_counter++;
+		stats->history_text_counter++;
+		stats->history_counter++;
 
 		return SUCCEED;
 	}
@@ -4332,13 +5486,13 @@ static int	hc_clone_history_data(zbx_hc_data_t **data, const dc_item_value_t *it
 			case ITEM_VALUE_TYPE_TEXT:
 			case ITEM_VALUE_TYPE_BIN:
 				if (SUCCEED != hc_clone_history_str_data(&(*data)->value.str,
-						&item_value->value.value_str))
+						&item_value->value.value_str, strings))
 				{
 					return FAIL;
 				}
 				break;
 			case ITEM_VALUE_TYPE_LOG:
-				if (SUCCEED != hc_clone_history_log_data(&(*data)->value.log, item_value))
+				if (SUCCEED != hc_clone_history_log_data(&(*data)->value.log, item_value, strings))
 					return FAIL;
 				break;
 			case ITEM_VALUE_TYPE_NONE:
@@ -4350,106 +5504,1439 @@ static int	hc_clone_history_data(zbx_hc_data_t **data, const dc_item_value_t *it
 		switch (item_value->item_value_type)
 		{
 			case ITEM_VALUE_TYPE_FLOAT:
-				cache->stats.history_float_counter++;
+				stats->history_float_counter++;
 				break;
 			case ITEM_VALUE_TYPE_UINT64:
-				cache->stats.history_uint_counter++;
+				stats->history_uint_counter++;
 				break;
 			case ITEM_VALUE_TYPE_STR:
-				cache->stats.history_str_counter++;
+				stats->history_str_counter++;
 				break;
 			case ITEM_VALUE_TYPE_TEXT:
-				cache->stats.history_text_counter++;
+				stats->history_text_counter++;
 				break;
 			case ITEM_VALUE_TYPE_LOG:
-				cache->stats.history_log_counter++;
+				stats->history_log_counter++;
 				break;
 			case ITEM_VALUE_TYPE_BIN:
-				cache->stats.history_bin_counter++;
+				stats->history_bin_counter++;
+				break;
+			case ITEM_VALUE_TYPE_NONE:
+			default:
+				THIS_SHOULD_NEVER_HAPPEN;
+				exit(EXIT_FAILURE);
+		}
+
+		stats->history_counter++;
+	}
+
+	(*data)->value_type = item_value->value_type;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees partially cloned item value                                 *
+ *                                                                            *
+ * Parameters: data       - [IN] the partially cloned value                   *
+ *             item_value - [IN] the item value being cloned                  *
+ *                                                                            *
+ * Comments: History cache lock must be held by the caller.                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_free_partial_data(zbx_hc_data_t *data, const dc_item_value_t *item_value)
+{
+	zbx_log_value_t	*log;
+
+	if (NULL == data)
+		return;
+
+	/* only log values can be left with allocated parts, other values */
+	/* fail on allocating their only string                           */
+	if (ITEM_STATE_NOTSUPPORTED != item_value->state &&
+			0 == (item_value->flags & (ZBX_DC_FLAG_LLD | ZBX_DC_FLAG_NOVALUE)) &&
+			ITEM_VALUE_TYPE_LOG == item_value->value_type && NULL != (log = data->value.log))
+	{
+		if (NULL != log->value)
+			hc_slab_free(log->value);
+
+		if (NULL != log->source)
+			hc_slab_free(log->source);
+
+		hc_slab_free(log);
+	}
+
+	hc_slab_free(data);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks if item value can be folded into trend                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_is_trend_value(const dc_item_value_t *item_value)
+{
+	if (0 != item_value->flags || ITEM_STATE_NORMAL != item_value->state)
+		return FAIL;
+
+	if (item_value->value_type != item_value->item_value_type)
+		return FAIL;
+
+	switch (item_value->value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+			return zbx_validate_value_dbl(item_value->value.value_dbl);
+		case ITEM_VALUE_TYPE_UINT64:
+			return SUCCEED;
+		default:
+			return FAIL;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: folds the last queued item value and new values into trend,       *
+ *          replacing the last queued value with the latest new value         *
+ *                                                                            *
+ * Parameters: item       - [IN] the history cache item                       *
+ *             values     - [IN] the new values of the item                   *
+ *             values_num - [IN] the number of new values                     *
+ *             stats      - [IN/OUT] the shard statistics                     *
+ *                                                                            *
+ * Return value: The number of new values consumed, 0 if the first value must *
+ *               be added to history cache.                                   *
+ *                                                                            *
+ * Comments: Only plain numeric values of items keeping only trends are       *
+ *           folded, when they belong to the hour currently accumulated in    *
+ *           trend cache. This way the history syncers, and so triggers and   *
+ *           value cache, still get the latest item value.                    *
+ *           The values are aggregated before locking trend cache, so the     *
+ *           trend is looked up once per item values batch.                   *
+ *           The shard lock must be held by the caller.                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_coalesce_trend_values(zbx_hc_item_t *item, const dc_item_value_t *values, int values_num,
+		zbx_dc_stats_t *stats)
+{
+	zbx_hc_data_t		*head = item->head;
+	const dc_item_value_t	*last;
+	ZBX_DC_TREND		*trend;
+	zbx_trend_group_t	group;
+	zbx_history_value_t	value;
+	int			hour, i, ret = FAIL;
+
+	if (0 != head->flags || ITEM_STATE_NORMAL != head->state)
+		return 0;
+
+	if (ITEM_VALUE_TYPE_FLOAT == head->value_type)
+	{
+		if (FAIL == zbx_validate_value_dbl(head->value.dbl))
+			return 0;
+	}
+	else if (ITEM_VALUE_TYPE_UINT64 != head->value_type)
+		return 0;
+
+	hour = head->ts.sec - head->ts.sec % SEC_PER_HOUR;
+
+	for (i = 0; i < values_num; i++)
+	{
+		if (SUCCEED != hc_is_trend_value(&values[i]) || values[i].value_type != head->value_type ||
+				hour != values[i].ts.sec - values[i].ts.sec % SEC_PER_HOUR)
+		{
+			break;
+		}
+	}
+
+	if (0 == (values_num = i))
+		return 0;
+
+	memset(&group, 0, sizeof(group));
+	dc_trend_group_add(&group, head->value_type, &head->value);
+
+	for (i = 0; i < values_num - 1; i++)
+	{
+		if (ITEM_VALUE_TYPE_FLOAT == head->value_type)
+			value.dbl = values[i].value.value_dbl;
+		else
+			value.ui64 = values[i].value.value_uint;
+
+		dc_trend_group_add(&group, head->value_type, &value);
+	}
+
+	LOCK_TRENDS;
+
+	if (NULL != (trend = (ZBX_DC_TREND *)zbx_hashset_search(&cache->trends, &item->itemid)) &&
+			0 != trend->trends_only && hour == trend->clock && head->value_type == trend->value_type)
+	{
+		dc_trend_add_group(trend, &group);
+		ret = SUCCEED;
+	}
+
+	UNLOCK_TRENDS;
+
+	if (SUCCEED != ret)
+		return 0;
+
+	last = &values[values_num - 1];
+
+	if (ITEM_VALUE_TYPE_FLOAT == head->value_type)
+	{
+		head->value.dbl = last->value.value_dbl;
+		stats->history_float_counter += (zbx_uint64_t)values_num;
+	}
+	else
+	{
+		head->value.ui64 = last->value.value_uint;
+		stats->history_uint_counter += (zbx_uint64_t)values_num;
+	}
+
+	head->ts = last->ts;
+	stats->history_counter += (zbx_uint64_t)values_num;
+
+	return values_num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds item value to the history cache shard                        *
+ *                                                                            *
+ * Parameters: shardid    - [IN] the history cache shard index                *
+ *             item_value - [IN] the item value to add                        *
+ *             values_num - [IN] the number of consecutive values of the same *
+ *                               item starting with item_value                *
+ *             strings    - [IN] the buffer holding item value strings        *
+ *             wait       - [IN] SUCCEED - wait for free space if history     *
+ *                                         cache is full                      *
+ *                               FAIL    - fail if history cache is full      *
+ *                                                                            *
+ * Return value: The number of values added, 0 if history cache is full and   *
+ *               waiting was not requested.                                   *
+ *                                                                            *
+ * Comments: The shard lock must be held by the caller. If the history cache  *
+ *           is full and waiting is requested this function will release the  *
+ *           lock and wait until history syncers processes values freeing     *
+ *           enough space to store the new value.                             *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_add_item_value(int shardid, dc_item_value_t *item_value, int values_num, const char *strings,
+		int wait)
+{
+	zbx_hc_shard_t	*shard = &cache->shards[shardid];
+	zbx_hc_item_t	*item;
+	zbx_hc_data_t	*data = NULL;
+	int		ret, folded_num;
+
+	/* a record with metadata and no value can be dropped if  */
+	/* the metadata update is copied to the last queued value */
+	if (NULL != (item = hc_get_item(shard, item_value->itemid)) &&
+			0 != (item_value->flags & ZBX_DC_FLAG_NOVALUE) &&
+			0 != (item_value->flags & ZBX_DC_FLAG_META))
+	{
+		/* skip metadata updates when only one value is queued, */
+		/* because the item might be already being processed    */
+		if (item->head != item->tail)
+		{
+			item->head->lastlogsize = item_value->lastlogsize;
+			item->head->mtime = item_value->mtime;
+			item->head->flags |= ZBX_DC_FLAG_META;
+			return 1;
+		}
+	}
+
+	/* values of items keeping only trends can be folded into trends if the */
+	/* last queued value is not the one that might be being processed       */
+	if (NULL != item && item->head != item->tail &&
+			0 != (folded_num = hc_coalesce_trend_values(item, item_value, values_num, &shard->stats)))
+	{
+		return folded_num;
+	}
+
+	LOCK_CACHE;
+
+	if (SUCCEED != (ret = hc_clone_history_data(&data, item_value, strings, &shard->stats)) && SUCCEED != wait)
+		hc_free_partial_data(data, item_value);
+
+	UNLOCK_CACHE;
+
+	if (SUCCEED != ret)
+	{
+		if (SUCCEED != wait)
+			return 0;
+
+		do
+		{
+			UNLOCK_SHARD(shardid);
+
+			zabbix_log(LOG_LEVEL_DEBUG, "History cache is full. Sleeping for 1 second.");
+			sleep(1);
+
+			LOCK_SHARD(shardid);
+
+			LOCK_CACHE;
+			ret = hc_clone_history_data(&data, item_value, strings, &shard->stats);
+			UNLOCK_CACHE;
+		}
+		while (SUCCEED != ret);
+
+		item = hc_get_item(shard, item_value->itemid);
+	}
+
+	if (NULL == item)
+	{
+		item = hc_add_item(shard, item_value->itemid, data);
+		hc_queue_item(shard, item);
+	}
+	else
+	{
+		item->head->next = data;
+		item->head = data;
+	}
+	item->values_num++;
+	shard->history_num++;
+
+	return 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: selects history cache shards for item values                      *
+ *                                                                            *
+ * Parameters: values     - [IN] the item values                              *
+ *             values_num - [IN] the number of item values                    *
+ *             affinities - [OUT] the history syncer affinity of item values  *
+ *             shardids   - [OUT] the shards of item values                   *
+ *                                                                            *
+ * Comments: Items sharing triggers are placed in the same shard, drained     *
+ *           first by the same history syncer. Affinity changes when trigger  *
+ *           links change, so an item having values in history cache keeps    *
+ *           its current shard until all its values there are processed.      *
+ *           Otherwise its values could be queued in two shards and processed *
+ *           by two history syncers out of order.                             *
+ *           The placement is counted for each value until it is added to     *
+ *           the shard item, see hc_release_values(), and is removed after    *
+ *           the shard item is drained, see hc_push_items().                  *
+ *           Proxy places items by itemid, which never changes.               *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_place_values(const dc_item_value_t *values, int values_num, zbx_uint64_t *affinities,
+		int *shardids)
+{
+	int			i;
+	zbx_hc_item_shard_t	*item_shard;
+
+	if (0 == (get_program_type_cb() & ZBX_PROGRAM_TYPE_SERVER))
+	{
+		for (i = 0; i < values_num; i++)
+			shardids[i] = hc_shard_index(values[i].itemid);
+
+		return;
+	}
+
+	for (i = 0; i < values_num; i++)
+		affinities[i] = values[i].itemid;
+
+	/* The configuration cache read lock is taken once per flushed batch of values and is not */
+	/* held while adding values. It is shared with other readers and waits only for           */
+	/* configuration cache updates.                                                           */
+	zbx_dc_config_history_get_affinities(affinities, values_num);
+
+	LOCK_CACHE;
+
+	for (i = 0; i < values_num; i++)
+	{
+		if (NULL == (item_shard = (zbx_hc_item_shard_t *)zbx_hashset_search(&cache->item_shards,
+				&values[i].itemid)))
+		{
+			zbx_hc_item_shard_t	item_shard_local = {values[i].itemid, hc_shard_index(affinities[i]), 0};
+
+			item_shard = (zbx_hc_item_shard_t *)zbx_hashset_insert(&cache->item_shards, &item_shard_local,
+					sizeof(item_shard_local));
+		}
+
+		item_shard->values_num++;
+		shardids[i] = item_shard->shardid;
+	}
+
+	UNLOCK_CACHE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: releases item shard placement of values added to shard items      *
+ *                                                                            *
+ * Parameters: shardid  - [IN] the history cache shard index                  *
+ *             released - [IN] the item identifiers and the number of their   *
+ *                             values added to shard items                    *
+ *                                                                            *
+ * Comments: The shard lock must be held by the caller. Placement of items    *
+ *           without values left in the shard is removed.                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_release_values(int shardid, const zbx_vector_uint64_pair_t *released)
+{
+	int			i;
+	zbx_hc_item_shard_t	*item_shard;
+
+	if (0 == released->values_num || 0 == (get_program_type_cb() & ZBX_PROGRAM_TYPE_SERVER))
+		return;
+
+	LOCK_CACHE;
+
+	for (i = 0; i < released->values_num; i++)
+	{
+		if (NULL == (item_shard = (zbx_hc_item_shard_t *)zbx_hashset_search(&cache->item_shards,
+				&released->values[i].first)))
+		{
+			THIS_SHOULD_NEVER_HAPPEN;
+			continue;
+		}
+
+		item_shard->values_num -= (int)released->values[i].second;
+
+		if (0 == item_shard->values_num && NULL == hc_get_item(&cache->shards[shardid], item_shard->itemid))
+			zbx_hashset_remove_direct(&cache->item_shards, item_shard);
+	}
+
+	UNLOCK_CACHE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: records the number of item values added to shard item             *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_release_append(zbx_vector_uint64_pair_t *released, zbx_uint64_t itemid, int values_num)
+{
+	zbx_uint64_pair_t	pair = {itemid, (zbx_uint64_t)values_num};
+
+	if (0 != released->values_num && itemid == released->values[released->values_num - 1].first)
+	{
+		released->values[released->values_num - 1].second += (zbx_uint64_t)values_num;
+		return;
+	}
+
+	zbx_vector_uint64_pair_append(released, pair);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: gets references to the strings of item value                      *
+ *                                                                            *
+ * Parameters: item_value - [IN] the item value                               *
+ *             strs       - [OUT] the item value strings                      *
+ *                                                                            *
+ * Return value: The number of item value strings.                            *
+ *                                                                            *
+ * Comments: Follows the strings cloned by hc_clone_history_data().           *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_item_value_strings(dc_item_value_t *item_value, dc_value_str_t **strs)
+{
+	if (ITEM_STATE_NOTSUPPORTED == item_value->state || 0 != (ZBX_DC_FLAG_LLD & item_value->flags))
+	{
+		strs[0] = &item_value->value.value_str;
+		return 1;
+	}
+
+	if (0 != (ZBX_DC_FLAG_NOVALUE & item_value->flags))
+		return 0;
+
+	switch (item_value->value_type)
+	{
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+		case ITEM_VALUE_TYPE_BIN:
+			strs[0] = &item_value->value.value_str;
+			return 1;
+		case ITEM_VALUE_TYPE_LOG:
+			strs[0] = &item_value->value.value_str;
+			strs[1] = &item_value->source;
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: stages item values of the shard in its active ingestion buffer    *
+ *                                                                            *
+ * Parameters: shardid    - [IN] the history cache shard index                *
+ *             values     - [IN] the item values                              *
+ *             shardids   - [IN] the shards of item values                    *
+ *             values_num - [IN] the number of item values                    *
+ *             strings    - [IN] the buffer holding item value strings        *
+ *                                                                            *
+ * Return value: SUCCEED - all shard values were staged or there were none    *
+ *               FAIL    - the ingestion buffer is disabled or has not        *
+ *                         enough free space, no values were staged           *
+ *                                                                            *
+ * Comments: Only the ingestion lock is taken, so producers are not blocked   *
+ *           by history syncers processing the shard.                         *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_ingest_add_values(int shardid, dc_item_value_t *values, const int *shardids, int values_num,
+		const char *strings)
+{
+	zbx_hc_ingest_t		*ingest = &cache->shards[shardid].ingest;
+	zbx_hc_ingest_buffer_t	*buffer;
+	dc_item_value_t		*staged;
+	dc_value_str_t		*strs[2];
+	size_t			strings_size = 0;
+	int			i, j, strs_num, shard_values_num = 0, ret = FAIL;
+
+	for (i = 0; i < values_num; i++)
+	{
+		if (shardid != shardids[i])
+			continue;
+
+		shard_values_num++;
+		strs_num = hc_item_value_strings(&values[i], strs);
+
+		for (j = 0; j < strs_num; j++)
+			strings_size += strs[j]->len;
+	}
+
+	if (0 == shard_values_num)
+		return SUCCEED;
+
+	LOCK_INGEST(shardid);
+
+	buffer = &ingest->buffers[ingest->active];
+
+	if (NULL == buffer->data || buffer->size < (size_t)(buffer->values_num + shard_values_num) *
+			sizeof(dc_item_value_t) + buffer->strings_size + strings_size)
+	{
+		goto out;
+	}
+
+	for (i = 0; i < values_num; i++)
+	{
+		if (shardid != shardids[i])
+			continue;
+
+		staged = (dc_item_value_t *)buffer->data + buffer->values_num++;
+		*staged = values[i];
+		strs_num = hc_item_value_strings(staged, strs);
+
+		for (j = 0; j < strs_num; j++)
+		{
+			if (0 == strs[j]->len)
+				continue;
+
+			buffer->strings_size += strs[j]->len;
+			memcpy(buffer->data + buffer->size - buffer->strings_size, &strings[strs[j]->pvalue],
+					strs[j]->len);
+			strs[j]->pvalue = buffer->size - buffer->strings_size;
+		}
+	}
+
+	ret = SUCCEED;
+out:
+	UNLOCK_INGEST(shardid);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: merges staged item values of ingestion buffer into shard queues   *
+ *                                                                            *
+ * Parameters: shardid - [IN] the history cache shard index                   *
+ *             buffer  - [IN/OUT] the ingestion buffer not used by producers  *
+ *                                                                            *
+ * Return value: SUCCEED - all staged values were merged                      *
+ *               FAIL    - history cache is full, the remaining values are    *
+ *                         left staged                                        *
+ *                                                                            *
+ * Comments: The shard lock must be held by the caller.                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_ingest_merge_buffer(int shardid, zbx_hc_ingest_buffer_t *buffer)
+{
+	dc_item_value_t			*values = (dc_item_value_t *)buffer->data;
+	int				i, j, added_num, ret = SUCCEED;
+	zbx_vector_uint64_pair_t	released;
+
+	zbx_vector_uint64_pair_create(&released);
+
+	while (buffer->values_merged < buffer->values_num)
+	{
+		i = buffer->values_merged;
+
+		for (j = i + 1; j < buffer->values_num && values[j].itemid == values[i].itemid; j++)
+			;
+
+		if (0 == (added_num = hc_add_item_value(shardid, &values[i], j - i, buffer->data, FAIL)))
+		{
+			ret = FAIL;
+			goto out;
+		}
+
+		hc_release_append(&released, values[i].itemid, added_num);
+		buffer->values_merged += added_num;
+	}
+
+	buffer->values_num = 0;
+	buffer->values_merged = 0;
+	buffer->strings_size = 0;
+out:
+	hc_release_values(shardid, &released);
+	zbx_vector_uint64_pair_destroy(&released);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: merges item values staged in shard ingestion buffers into shard   *
+ *          queues                                                            *
+ *                                                                            *
+ * Parameters: shardid - [IN] the history cache shard index                   *
+ *                                                                            *
+ * Return value: SUCCEED - all values staged before the call were merged      *
+ *               FAIL    - history cache is full                              *
+ *                                                                            *
+ * Comments: The shard lock must be held by the caller. Values are merged in  *
+ *           the order they were staged - the inactive buffer is emptied      *
+ *           first, then the buffers are swapped and the previously active    *
+ *           buffer is merged.                                                *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_ingest_merge(int shardid)
+{
+	zbx_hc_ingest_t	*ingest = &cache->shards[shardid].ingest;
+	int		swapped = FAIL;
+
+	if (NULL == ingest->buffers[0].data)
+		return SUCCEED;
+
+	/* the active buffer index is changed only with shard lock held */
+	if (SUCCEED != hc_ingest_merge_buffer(shardid, &ingest->buffers[ingest->active ^ 1]))
+		return FAIL;
+
+	LOCK_INGEST(shardid);
+
+	if (0 != ingest->buffers[ingest->active].values_num)
+	{
+		ingest->active ^= 1;
+		swapped = SUCCEED;
+	}
+
+	UNLOCK_INGEST(shardid);
+
+	if (SUCCEED != swapped)
+		return SUCCEED;
+
+	return hc_ingest_merge_buffer(shardid, &ingest->buffers[ingest->active ^ 1]);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds item values to the history cache                             *
+ *                                                                            *
+ * Parameters: values     - [IN] the item values to add                       *
+ *             shardids   - [IN] the shards of item values                    *
+ *             values_num - [IN] the number of item values to add             *
+ *             strings    - [IN] the buffer holding item value strings        *
+ *                                                                            *
+ * Comments: Values are staged in shard ingestion buffers. When a buffer is   *
+ *           full the shard values are added directly, taking the shard lock  *
+ *           once, after merging the staged values.                           *
+ *           The order of values of the same item is preserved, because its   *
+ *           values are placed in the shard already holding its older values  *
+ *           until that shard has processed them, see hc_place_values().      *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_add_item_values(dc_item_value_t *values, const int *shardids, int values_num,
+		const char *strings)
+{
+	int				i, j, shardid, added_num;
+	zbx_vector_uint64_pair_t	released;
+
+	zbx_vector_uint64_pair_create(&released);
+
+	for (shardid = 0; shardid < cache->shards_num; shardid++)
+	{
+		if (SUCCEED == hc_ingest_add_values(shardid, values, shardids, values_num, strings))
+			continue;
+
+		LOCK_SHARD(shardid);
+
+		/* values staged earlier must be queued before the new values of the same items */
+		while (SUCCEED != hc_ingest_merge(shardid))
+		{
+			UNLOCK_SHARD(shardid);
+
+			zabbix_log(LOG_LEVEL_DEBUG, "History cache is full. Sleeping for 1 second.");
+			sleep(1);
+
+			LOCK_SHARD(shardid);
+		}
+
+		for (i = 0; i < values_num;)
+		{
+			if (shardid != shardids[i])
+			{
+				i++;
+				continue;
+			}
+
+			for (j = i + 1; j < values_num && values[j].itemid == values[i].itemid; j++)
+				;
+
+			added_num = hc_add_item_value(shardid, &values[i], j - i, strings, SUCCEED);
+			hc_release_append(&released, values[i].itemid, added_num);
+			i += added_num;
+		}
+
+		hc_release_values(shardid, &released);
+		zbx_vector_uint64_pair_clear(&released);
+
+		UNLOCK_SHARD(shardid);
+	}
+
+	zbx_vector_uint64_pair_destroy(&released);
+}
+
+/* the history cache usage percentage to start spilling flushed values */
+#define ZBX_HC_SPILL_START_PCNT		80
+/* the history cache usage percentage to replay spilled values below */
+#define ZBX_HC_SPILL_REPLAY_PCNT	50
+/* the maximum size of spilled values replayed at once */
+#define ZBX_HC_SPILL_REPLAY_MAX		(4 * ZBX_MEBIBYTE)
+/* the maximum size of spilled values record, unless a single value is larger */
+#define ZBX_HC_SPILL_RECORD_MAX		(256 * ZBX_KIBIBYTE)
+/* the period in seconds of syncing spilled values to disk */
+#define ZBX_HC_SPILL_SYNC_PERIOD	1
+
+#define ZBX_HC_SPILL_SIGNATURE		0x5a485347
+
+/* The spill file is a ring of records following the header. Records between read and write */
+/* offsets are not yet replayed. When the writer wraps to the start of records, the offset   */
+/* where the records end is kept in wrap offset until the reader crosses it.                 */
+typedef struct
+{
+	zbx_uint32_t	signature;
+	zbx_uint32_t	value_size;
+	zbx_uint64_t	read_offset;
+	zbx_uint64_t	write_offset;
+	zbx_uint64_t	wrap_offset;
+}
+zbx_hc_spill_header_t;
+
+/* record header, followed by the item values and their strings padded to 8 bytes */
+typedef struct
+{
+	zbx_uint32_t	values_num;
+	zbx_uint32_t	strings_size;
+}
+zbx_hc_spill_record_t;
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks if history cache memory usage is below the specified       *
+ *          percentage, leaving the specified free space                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_mem_check_usage(zbx_uint64_t pcnt, zbx_uint64_t free_size)
+{
+	int	ret = FAIL;
+
+	LOCK_CACHE;
+
+	if ((hc_mem->total_size - hc_mem->free_size) * 100 < hc_mem->total_size * pcnt &&
+			hc_mem->free_size >= free_size)
+	{
+		ret = SUCCEED;
+	}
+
+	UNLOCK_CACHE;
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads data from the specified spill file offset                   *
+ *                                                                            *
+ * Comments: The spill file descriptor is shared by forked processes, so the  *
+ *           file position is never used.                                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_read(zbx_uint64_t offset, void *buf, size_t size)
+{
+	ssize_t	n;
+
+	while (0 != size)
+	{
+		if (0 >= (n = pread(spill_fd, buf, size, (off_t)offset)))
+		{
+			if (-1 == n && EINTR == errno)
+				continue;
+
+			return FAIL;
+		}
+
+		buf = (char *)buf + n;
+		offset += (zbx_uint64_t)n;
+		size -= (size_t)n;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes data at the specified spill file offset                    *
+ *                                                                            *
+ * Comments: The spill file descriptor is shared by forked processes, so the  *
+ *           file position is never used.                                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_write(zbx_uint64_t offset, const void *buf, size_t size)
+{
+	ssize_t	n;
+
+	while (0 != size)
+	{
+		if (-1 == (n = pwrite(spill_fd, buf, size, (off_t)offset)))
+		{
+			if (EINTR == errno)
+				continue;
+
+			return FAIL;
+		}
+
+		buf = (const char *)buf + n;
+		offset += (zbx_uint64_t)n;
+		size -= (size_t)n;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: saves the offset of values not yet replayed into history cache    *
+ *                                                                            *
+ * Comments: The offset is a single aligned write within the first block of  *
+ *           spill file and is synced to disk before returning.               *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_write_read_offset(zbx_uint64_t read_offset)
+{
+	if (SUCCEED != hc_spill_write(offsetof(zbx_hc_spill_header_t, read_offset), &read_offset,
+			sizeof(read_offset)) || 0 != fsync(spill_fd))
+	{
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: syncs spilled values to disk and saves the offsets of synced      *
+ *          values                                                            *
+ *                                                                            *
+ * Parameters: force - [IN] 1 - sync without waiting for the sync period      *
+ *                                                                            *
+ * Comments: Spilled values are synced periodically instead of on every flush *
+ *           and the spill lock is not held while syncing, so writers are not *
+ *           serialized on disk syncs. Only synced values are replayed, so    *
+ *           the values written after the last sync are lost if the system    *
+ *           fails, like the values in history cache.                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_spill_sync(int force)
+{
+	zbx_uint64_t	offsets[2];
+	time_t		now;
+	int		ret = SUCCEED;
+
+	now = time(NULL);
+
+	LOCK_SPILL;
+
+	if (0 != cache->spill_syncing || cache->spill_synced_offset == cache->spill_write_offset ||
+			(0 == force && ZBX_HC_SPILL_SYNC_PERIOD > now - cache->spill_sync_time))
+	{
+		UNLOCK_SPILL;
+		return;
+	}
+
+	cache->spill_syncing = 1;
+	cache->spill_sync_time = now;
+	offsets[0] = cache->spill_write_offset;
+	offsets[1] = cache->spill_wrap_offset;
+
+	UNLOCK_SPILL;
+
+	/* the spilled values must be on disk before the offsets referring to them */
+	if (0 != fdatasync(spill_fd) || SUCCEED != hc_spill_write(offsetof(zbx_hc_spill_header_t, write_offset),
+			offsets, sizeof(offsets)) || 0 != fdatasync(spill_fd))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot sync history cache spill file: %s", zbx_strerror(errno));
+		ret = FAIL;
+	}
+
+	LOCK_SPILL;
+
+	cache->spill_syncing = 0;
+
+	if (SUCCEED == ret)
+		cache->spill_synced_offset = offsets[0];
+
+	UNLOCK_SPILL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: resets spill file after all spilled values were replayed          *
+ *                                                                            *
+ * Return value: SUCCEED - the spill file was reset                           *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: The spill lock must be held by the caller and the spill file     *
+ *           must not be synced at the same time.                             *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_reset(void)
+{
+	zbx_hc_spill_header_t	header;
+
+	header.signature = ZBX_HC_SPILL_SIGNATURE;
+	header.value_size = sizeof(dc_item_value_t);
+	header.read_offset = sizeof(header);
+	header.write_offset = sizeof(header);
+	header.wrap_offset = 0;
+
+	cache->spill_read_offset = sizeof(header);
+	cache->spill_write_offset = sizeof(header);
+	cache->spill_synced_offset = sizeof(header);
+	cache->spill_wrap_offset = 0;
+
+	/* the header must not refer past the end of file if the system fails while resetting */
+	if (SUCCEED != hc_spill_write(0, &header, sizeof(header)) || 0 != fsync(spill_fd) ||
+			0 != ftruncate(spill_fd, (off_t)sizeof(header)))
+	{
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: opens history cache spill file, keeping values spilled before     *
+ *          restart                                                           *
+ *                                                                            *
+ * Parameters: path  - [IN] the spill file path                               *
+ *             error - [OUT] the error message                                *
+ *                                                                            *
+ * Return value: SUCCEED - the spill file was opened                          *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_open(const char *path, char **error)
+{
+	zbx_hc_spill_header_t	header;
+	zbx_stat_t		buf;
+
+	if (-1 == (spill_fd = open(path, O_RDWR | O_CREAT, 0600)))
+	{
+		*error = zbx_dsprintf(NULL, "cannot open history cache spill file \"%s\": %s", path,
+				zbx_strerror(errno));
+		return FAIL;
+	}
+
+	if (0 != zbx_fstat(spill_fd, &buf))
+	{
+		*error = zbx_dsprintf(NULL, "cannot obtain history cache spill file \"%s\" information: %s", path,
+				zbx_strerror(errno));
+		goto fail;
+	}
+
+	if (0 == buf.st_size)
+	{
+		if (SUCCEED != hc_spill_reset())
+		{
+			*error = zbx_dsprintf(NULL, "cannot write history cache spill file \"%s\": %s", path,
+					zbx_strerror(errno));
+			goto fail;
+		}
+
+		return SUCCEED;
+	}
+
+	if (SUCCEED != hc_spill_read(0, &header, sizeof(header)) || ZBX_HC_SPILL_SIGNATURE != header.signature ||
+			sizeof(dc_item_value_t) != header.value_size || sizeof(header) > header.read_offset ||
+			sizeof(header) > header.write_offset || (zbx_uint64_t)buf.st_size < header.read_offset ||
+			(zbx_uint64_t)buf.st_size < header.write_offset ||
+			(header.write_offset < header.read_offset && (header.wrap_offset < header.read_offset ||
+			(zbx_uint64_t)buf.st_size < header.wrap_offset)))
+	{
+		*error = zbx_dsprintf(NULL, "history cache spill file \"%s\" is not compatible with this version",
+				path);
+		goto fail;
+	}
+
+	/* wrap offset is left over from the last sync if the reader has crossed it since */
+	if (header.read_offset <= header.write_offset)
+	{
+		header.wrap_offset = 0;
+
+		/* values written after the last sync can be incomplete, they were never replayed */
+		if ((zbx_uint64_t)buf.st_size != header.write_offset)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "discarding values not synced to the end of history cache spill"
+					" file");
+
+			if (0 != ftruncate(spill_fd, (off_t)header.write_offset))
+			{
+				*error = zbx_dsprintf(NULL, "cannot truncate history cache spill file \"%s\": %s", path,
+						zbx_strerror(errno));
+				goto fail;
+			}
+		}
+	}
+
+	cache->spill_read_offset = header.read_offset;
+	cache->spill_write_offset = header.write_offset;
+	cache->spill_synced_offset = header.write_offset;
+	cache->spill_wrap_offset = header.wrap_offset;
+
+	if (cache->spill_read_offset != cache->spill_write_offset)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "history cache spill file contains " ZBX_FS_UI64 " bytes of values"
+				" to be processed", 0 == header.wrap_offset ? header.write_offset - header.read_offset :
+				header.wrap_offset - header.read_offset + header.write_offset - sizeof(header));
+	}
+
+	return SUCCEED;
+fail:
+	close(spill_fd);
+	spill_fd = -1;
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: syncs spilled values to disk and closes history cache spill file  *
+ *                                                                            *
+ * Comments: Called when the other processes have been stopped, so the sync   *
+ *           state left by them is ignored.                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_spill_close(void)
+{
+	zbx_uint64_t	offsets[2];
+
+	offsets[0] = cache->spill_write_offset;
+	offsets[1] = cache->spill_wrap_offset;
+
+	if (cache->spill_synced_offset != cache->spill_write_offset && (0 != fdatasync(spill_fd) ||
+			SUCCEED != hc_spill_write(offsetof(zbx_hc_spill_header_t, write_offset), offsets,
+			sizeof(offsets)) || 0 != fdatasync(spill_fd)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot sync history cache spill file: %s", zbx_strerror(errno));
+	}
+
+	close(spill_fd);
+	spill_fd = -1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks if there are spilled values not yet added to history cache *
+ *                                                                            *
+ * Comments: The spill lock must be held by the caller.                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_is_empty(void)
+{
+	if (cache->spill_read_offset == cache->spill_write_offset && 0 == cache->spill_replaying)
+		return SUCCEED;
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: finds the spill file offset to write record of the specified size *
+ *                                                                            *
+ * Parameters: size   - [IN] the record size                                  *
+ *             offset - [OUT] the record offset                               *
+ *                                                                            *
+ * Return value: SUCCEED - the record offset was found                        *
+ *               FAIL    - the spill file is full                             *
+ *                                                                            *
+ * Comments: The spill lock must be held by the caller.                       *
+ *           The write offset never reaches the read offset from below, so    *
+ *           equal offsets always mean there are no spilled values.           *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_find_offset(zbx_uint64_t size, zbx_uint64_t *offset)
+{
+	if (cache->spill_write_offset < cache->spill_read_offset)
+	{
+		if (cache->spill_write_offset + size >= cache->spill_read_offset)
+			return FAIL;
+
+		*offset = cache->spill_write_offset;
+
+		return SUCCEED;
+	}
+
+	if (cache->spill_write_offset + size <= spill_size)
+	{
+		*offset = cache->spill_write_offset;
+
+		return SUCCEED;
+	}
+
+	if (sizeof(zbx_hc_spill_header_t) + size >= cache->spill_read_offset)
+		return FAIL;
+
+	*offset = sizeof(zbx_hc_spill_header_t);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes record of item values to history cache spill file          *
+ *                                                                            *
+ * Parameters: data  - [IN] the record                                        *
+ *             size  - [IN] the record size                                   *
+ *             first - [IN] 1 - no values of the flush were spilled yet       *
+ *                                                                            *
+ * Return value: SUCCEED - the record was written                             *
+ *               FAIL    - the record must be added to history cache          *
+ *                                                                            *
+ * Comments: Once values are spilled, the newer values must be spilled too,   *
+ *           otherwise they would be queued before the older spilled values   *
+ *           of the same items. So this function waits while the spill file   *
+ *           is full and retries when it cannot be written, unless there are  *
+ *           no spilled values left.                                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_write_record(const char *data, zbx_uint64_t size, int first)
+{
+	zbx_uint64_t	offset;
+	int		ret = FAIL, write_failed = 0;
+
+	LOCK_SPILL;
+
+	for (;;)
+	{
+		if (1 == first && SUCCEED == hc_spill_is_empty() &&
+				SUCCEED == hc_mem_check_usage(ZBX_HC_SPILL_START_PCNT, 0))
+		{
+			goto out;
+		}
+
+		if (SUCCEED == hc_spill_find_offset(size, &offset))
+		{
+			if (SUCCEED == hc_spill_write(offset, data, (size_t)size))
 				break;
-			case ITEM_VALUE_TYPE_NONE:
-			default:
-				THIS_SHOULD_NEVER_HAPPEN;
-				exit(EXIT_FAILURE);
+
+			if (1 == first && SUCCEED == hc_spill_is_empty())
+			{
+				zabbix_log(LOG_LEVEL_WARNING, "cannot write history cache spill file: %s",
+						zbx_strerror(errno));
+				goto out;
+			}
+
+			if (0 == write_failed)
+			{
+				zabbix_log(LOG_LEVEL_WARNING, "cannot write history cache spill file: %s, retrying",
+						zbx_strerror(errno));
+				write_failed = 1;
+			}
 		}
+		else
+			zabbix_log(LOG_LEVEL_DEBUG, "History cache spill file is full. Sleeping for 1 second.");
 
-		cache->stats.history_counter++;
+		UNLOCK_SPILL;
+		sleep(1);
+		LOCK_SPILL;
 	}
 
-	(*data)->value_type = item_value->value_type;
+	if (SUCCEED == hc_spill_is_empty())
+		zabbix_log(LOG_LEVEL_WARNING, "history cache is almost full, spilling values to disk");
 
-	return SUCCEED;
+	if (offset < cache->spill_write_offset)
+		cache->spill_wrap_offset = cache->spill_write_offset;
+
+	cache->spill_write_offset = offset + size;
+	ret = SUCCEED;
+out:
+	UNLOCK_SPILL;
+
+	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: adds item values to the history cache                             *
+ * Purpose: appends item values to history cache spill file                   *
  *                                                                            *
- * Parameters: values     - [IN] the item values to add                       *
- *             values_num - [IN] the number of item values to add             *
+ * Parameters: values       - [IN] the item values                            *
+ *             values_num   - [IN] the number of item values                  *
+ *             strings      - [IN] the buffer holding item value strings      *
  *                                                                            *
- * Comments: If the history cache is full this function will wait until       *
- *           history syncers processes values freeing enough space to store   *
- *           the new value.                                                   *
+ * Return value: SUCCEED - the values were spilled                            *
+ *               FAIL    - the values must be added to history cache          *
+ *                                                                            *
+ * Comments: Values are spilled when history cache usage passes the spill     *
+ *           threshold and while there are spilled values not yet replayed,   *
+ *           so values of the same item are never queued before its older     *
+ *           spilled values.                                                  *
+ *           Values are split into records small enough to be replayed into   *
+ *           history cache one at a time, so a large flush cannot prevent     *
+ *           spilled values from being replayed.                              *
  *                                                                            *
  ******************************************************************************/
-static void	hc_add_item_values(dc_item_value_t *values, int values_num)
+static int	hc_spill_values(dc_item_value_t *values, int values_num, const char *strings)
 {
-	dc_item_value_t	*item_value;
-	int		i;
-	zbx_hc_item_t	*item;
+	zbx_hc_spill_record_t	record;
+	dc_item_value_t		*spilled;
+	dc_value_str_t		*strs[2];
+	char			*data = NULL;
+	size_t			data_alloc = 0, record_max, size, value_size, strings_offset;
+	int			i, j, k, n, strs_num, ret = SUCCEED;
 
-	for (i = 0; i < values_num; i++)
+	record_max = MIN(ZBX_HC_SPILL_RECORD_MAX, hc_mem->total_size / 8);
+
+	for (i = 0; i < values_num; i = j)
 	{
-		zbx_hc_data_t	*data = NULL;
+		for (j = i, size = sizeof(record); j < values_num; j++)
+		{
+			value_size = sizeof(dc_item_value_t);
+			strs_num = hc_item_value_strings(&values[j], strs);
+
+			for (k = 0; k < strs_num; k++)
+				value_size += strs[k]->len;
+
+			if (j != i && size + value_size > record_max)
+				break;
+
+			size += value_size;
+		}
+
+		if (data_alloc < ZBX_SIZE_T_ALIGN8(size))
+		{
+			data_alloc = ZBX_SIZE_T_ALIGN8(size);
+			data = (char *)zbx_realloc(data, data_alloc);
+		}
 
-		item_value = &values[i];
+		spilled = (dc_item_value_t *)(data + sizeof(record));
+		memcpy(spilled, &values[i], sizeof(dc_item_value_t) * (size_t)(j - i));
+		strings_offset = 0;
 
-		/* a record with metadata and no value can be dropped if  */
-		/* the metadata update is copied to the last queued value */
-		if (NULL != (item = hc_get_item(item_value->itemid)) &&
-				0 != (item_value->flags & ZBX_DC_FLAG_NOVALUE) &&
-				0 != (item_value->flags & ZBX_DC_FLAG_META))
+		for (n = 0; n < j - i; n++)
 		{
-			/* skip metadata updates when only one value is queued, */
-			/* because the item might be already being processed    */
-			if (item->head != item->tail)
+			strs_num = hc_item_value_strings(&spilled[n], strs);
+
+			for (k = 0; k < strs_num; k++)
 			{
-				item->head->lastlogsize = item_value->lastlogsize;
-				item->head->mtime = item_value->mtime;
-				item->head->flags |= ZBX_DC_FLAG_META;
-				continue;
+				if (0 == strs[k]->len)
+					continue;
+
+				memcpy((char *)&spilled[j - i] + strings_offset, &strings[strs[k]->pvalue], strs[k]->len);
+				strs[k]->pvalue = strings_offset;
+				strings_offset += strs[k]->len;
 			}
 		}
 
-		if (SUCCEED != hc_clone_history_data(&data, item_value))
+		record.values_num = (zbx_uint32_t)(j - i);
+		record.strings_size = (zbx_uint32_t)ZBX_SIZE_T_ALIGN8(strings_offset);
+		memcpy(data, &record, sizeof(record));
+
+		size = sizeof(record) + sizeof(dc_item_value_t) * (size_t)(j - i) + record.strings_size;
+		memset((char *)&spilled[j - i] + strings_offset, 0, record.strings_size - strings_offset);
+
+		if (SUCCEED != hc_spill_write_record(data, size, 0 == i))
 		{
-			do
-			{
-				UNLOCK_CACHE;
+			ret = FAIL;
+			break;
+		}
+	}
+
+	zbx_free(data);
 
-				zabbix_log(LOG_LEVEL_DEBUG, "History cache is full. Sleeping for 1 second.");
-				sleep(1);
+	if (SUCCEED == ret)
+		hc_spill_sync(0);
 
-				LOCK_CACHE;
-			}
-			while (SUCCEED != hc_clone_history_data(&data, item_value));
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: replays spilled item values into history cache                    *
+ *                                                                            *
+ * Return value: SUCCEED - spilled values were replayed                       *
+ *               FAIL    - there were no spilled values or history cache      *
+ *                         usage is too high to replay them                   *
+ *                                                                            *
+ * Comments: Values are replayed in the order they were spilled while history *
+ *           cache usage is below the replay threshold and there is enough    *
+ *           free memory left for the replayed values. The first record is    *
+ *           replayed whenever the usage is below the threshold.              *
+ *           The spill lock is not held while reading the spill file and      *
+ *           adding the replayed values to history cache. New values are      *
+ *           still spilled meanwhile, so they are not added to history cache  *
+ *           before the older spilled values.                                 *
+ *           The replayed position is saved before adding the values, so a    *
+ *           crash cannot replay the values again after they were written to  *
+ *           database. The replayed values are lost on crash like the other   *
+ *           values in history cache.                                         *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_spill_replay(void)
+{
+	zbx_hc_spill_record_t	record;
+	char			*data = NULL, *ptr;
+	size_t			data_alloc = 0, data_offset = 0, size;
+	zbx_uint64_t		*affinities = NULL, read_offset, offset, synced_offset, wrap_offset;
+	int			*shardids = NULL, affinities_alloc = 0, ret = FAIL;
 
-			item = hc_get_item(item_value->itemid);
+	if (-1 == spill_fd)
+		return FAIL;
+
+	hc_spill_sync(1);
+
+	LOCK_SPILL;
+
+	/* the spill file is reset when the replayed values are added and it is not being synced */
+	if (cache->spill_read_offset == cache->spill_write_offset)
+	{
+		if (sizeof(zbx_hc_spill_header_t) != cache->spill_read_offset && 0 == cache->spill_syncing &&
+				SUCCEED != hc_spill_reset())
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot reset history cache spill file: %s",
+					zbx_strerror(errno));
 		}
 
-		if (NULL == item)
+		UNLOCK_SPILL;
+
+		return FAIL;
+	}
+
+	read_offset = cache->spill_read_offset;
+	synced_offset = cache->spill_synced_offset;
+	wrap_offset = cache->spill_wrap_offset;
+
+	UNLOCK_SPILL;
+
+	/* the records between read and synced offsets are not changed by writers */
+	for (offset = read_offset; offset != synced_offset && ZBX_HC_SPILL_REPLAY_MAX > data_offset;
+			offset += sizeof(record) + size)
+	{
+		if (0 != wrap_offset && offset == wrap_offset)
 		{
-			item = hc_add_item(item_value->itemid, data);
-			hc_queue_item(item);
+			offset = sizeof(zbx_hc_spill_header_t);
+
+			if (offset == synced_offset)
+				break;
 		}
-		else
+
+		if (SUCCEED != hc_spill_read(offset, &record, sizeof(record)))
+			goto err;
+
+		size = (size_t)record.values_num * sizeof(dc_item_value_t) + record.strings_size;
+
+		if (spill_size < offset + sizeof(record) + size)
+			goto err;
+
+		/* cloned values take more memory than serialized ones */
+		if (SUCCEED != hc_mem_check_usage(ZBX_HC_SPILL_REPLAY_PCNT, 0 == data_offset ? 0 :
+				(data_offset + size) * 4))
+		{
+			break;
+		}
+
+		if (data_alloc < data_offset + sizeof(record) + size)
+		{
+			data_alloc = data_offset + sizeof(record) + size;
+			data = (char *)zbx_realloc(data, data_alloc);
+		}
+
+		memcpy(data + data_offset, &record, sizeof(record));
+
+		if (SUCCEED != hc_spill_read(offset + sizeof(record), data + data_offset + sizeof(record), size))
+			goto err;
+
+		data_offset += sizeof(record) + size;
+	}
+
+	if (0 == data_offset)
+		goto out;
+
+	if (SUCCEED != hc_spill_write_read_offset(offset))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot write history cache spill file: %s", zbx_strerror(errno));
+		goto out;
+	}
+
+	LOCK_SPILL;
+
+	if (offset < read_offset)
+		cache->spill_wrap_offset = 0;
+
+	cache->spill_read_offset = offset;
+	cache->spill_replaying = 1;
+
+	UNLOCK_SPILL;
+
+	for (ptr = data; ptr < data + data_offset; ptr += sizeof(record) + size)
+	{
+		memcpy(&record, ptr, sizeof(record));
+		size = (size_t)record.values_num * sizeof(dc_item_value_t) + record.strings_size;
+
+		if (affinities_alloc < (int)record.values_num)
 		{
-			item->head->next = data;
-			item->head = data;
+			affinities_alloc = (int)record.values_num;
+			affinities = (zbx_uint64_t *)zbx_realloc(affinities, sizeof(zbx_uint64_t) *
+					(size_t)affinities_alloc);
+			shardids = (int *)zbx_realloc(shardids, sizeof(int) * (size_t)affinities_alloc);
 		}
-		item->values_num++;
+
+		hc_place_values((dc_item_value_t *)(ptr + sizeof(record)), (int)record.values_num, affinities,
+				shardids);
+		hc_add_item_values((dc_item_value_t *)(ptr + sizeof(record)), shardids, (int)record.values_num,
+				ptr + sizeof(record) + record.values_num * sizeof(dc_item_value_t));
 	}
+
+	LOCK_SPILL;
+
+	cache->spill_replaying = 0;
+	ret = SUCCEED;
+
+	if (cache->spill_read_offset == cache->spill_write_offset)
+		zabbix_log(LOG_LEVEL_WARNING, "all values spilled to disk were moved to history cache");
+
+	UNLOCK_SPILL;
+
+	goto out;
+err:
+	zabbix_log(LOG_LEVEL_WARNING, "cannot read history cache spill file, discarding spilled values");
+
+	LOCK_SPILL;
+
+	cache->spill_read_offset = cache->spill_write_offset;
+	cache->spill_wrap_offset = 0;
+
+	UNLOCK_SPILL;
+out:
+	zbx_free(shardids);
+	zbx_free(affinities);
+	zbx_free(data);
+
+	return ret;
 }
 
 /******************************************************************************
@@ -4525,23 +7012,52 @@ static void	hc_copy_history_data(zbx_dc_history_t *history, zbx_uint64_t itemid,
  *                                                                            *
  * Parameters: history_items - [OUT] the locked history items                 *
  *                                                                            *
+ * Return value: the index of shard the items were taken from                 *
+ *                                                                            *
  * Comments: The history_items must be returned back to history cache with    *
  *           hc_push_items() function after they have been processed.         *
+ *           Items are taken from the syncer's own shard. Other shards are    *
+ *           drained only when the own shard queue is empty. All items of a   *
+ *           batch belong to the same shard. An item has values only in one   *
+ *           shard at a time, see hc_place_values(), so concurrent batches    *
+ *           never process values of the same item.                           *
+ *           The shard lock is taken by this function.                        *
  *                                                                            *
  ******************************************************************************/
-void	hc_pop_items(zbx_vector_ptr_t *history_items)
+int	hc_pop_items(zbx_vector_ptr_t *history_items)
 {
 	zbx_binary_heap_elem_t	*elem;
 	zbx_hc_item_t		*item;
+	int			i, shardid = hc_syncer_shardid;
 
-	while (ZBX_HC_SYNC_MAX > history_items->values_num && FAIL == zbx_binary_heap_empty(&cache->history_queue))
+	for (i = 0; i < cache->shards_num; i++)
 	{
-		elem = zbx_binary_heap_find_min(&cache->history_queue);
-		item = (zbx_hc_item_t *)elem->data;
-		zbx_vector_ptr_append(history_items, item);
+		zbx_hc_shard_t	*shard;
+
+		shardid = (hc_syncer_shardid + i) % cache->shards_num;
+		shard = &cache->shards[shardid];
+
+		LOCK_SHARD(shardid);
+
+		hc_ingest_merge(shardid);
+
+		while (ZBX_HC_SYNC_MAX > history_items->values_num &&
+				FAIL == zbx_binary_heap_empty(&shard->history_queue))
+		{
+			elem = zbx_binary_heap_find_min(&shard->history_queue);
+			item = (zbx_hc_item_t *)elem->data;
+			zbx_vector_ptr_append(history_items, item);
+
+			zbx_binary_heap_remove_min(&shard->history_queue);
+		}
+
+		UNLOCK_SHARD(shardid);
 
-		zbx_binary_heap_remove_min(&cache->history_queue);
+		if (0 != history_items->values_num)
+			break;
 	}
+
+	return shardid;
 }
 
 /******************************************************************************
@@ -4574,19 +7090,28 @@ void	hc_get_item_values(zbx_dc_history_t *history, zbx_vector_ptr_t *history_ite
  *                                                                            *
  * Purpose: push back the processed history items into history cache          *
  *                                                                            *
- * Parameters: history_items - [IN] the history items containing processed    *
+ * Parameters: shardid       - [IN] the shard the items were popped from      *
+ *             history_items - [IN] the history items containing processed    *
  *                                  (available) and busy items                *
  *                                                                            *
  * Comments: This function removes processed value from history cache.        *
  *           If there is no more data for this item, then the item itself is  *
  *           removed from history index.                                      *
+ *           The shard lock must be held by the caller.                       *
+ *           Processed values are freed in bulk under a single history cache  *
+ *           lock.                                                            *
  *                                                                            *
  ******************************************************************************/
-void	hc_push_items(zbx_vector_ptr_t *history_items)
+void	hc_push_items(int shardid, zbx_vector_ptr_t *history_items)
 {
-	int		i;
-	zbx_hc_item_t	*item;
-	zbx_hc_data_t	*data_free;
+	int			i;
+	zbx_hc_item_t		*item;
+	zbx_hc_data_t		*data_free, *free_list = NULL;
+	zbx_hc_shard_t		*shard = &cache->shards[shardid];
+	zbx_hc_item_shard_t	*item_shard;
+	zbx_vector_uint64_t	drained_itemids;
+
+	zbx_vector_uint64_create(&drained_itemids);
 
 	for (i = 0; i < history_items->values_num; i++)
 	{
@@ -4597,30 +7122,96 @@ void	hc_push_items(zbx_vector_ptr_t *history_items)
 			case ZBX_HC_ITEM_STATUS_BUSY:
 				/* reset item status before returning it to queue */
 				item->status = ZBX_HC_ITEM_STATUS_NORMAL;
-				hc_queue_item(item);
+				hc_queue_item(shard, item);
 				break;
 			case ZBX_HC_ITEM_STATUS_NORMAL:
 				item->values_num--;
+				shard->history_num--;
 				data_free = item->tail;
 				item->tail = item->tail->next;
-				hc_free_data(data_free);
+				data_free->next = free_list;
+				free_list = data_free;
 				if (NULL == item->tail)
-					zbx_hashset_remove(&cache->history_items, item);
+				{
+					zbx_vector_uint64_append(&drained_itemids, item->itemid);
+					zbx_hashset_remove(&shard->history_items, item);
+				}
 				else
-					hc_queue_item(item);
+					hc_queue_item(shard, item);
 				break;
 		}
 	}
+
+	if (NULL == free_list)
+		goto out;
+
+	LOCK_CACHE;
+
+	while (NULL != (data_free = free_list))
+	{
+		free_list = free_list->next;
+		hc_free_data(data_free);
+	}
+
+	/* drained items can be placed in another shard, unless values placed in this shard are still staged */
+	for (i = 0; i < drained_itemids.values_num; i++)
+	{
+		if (NULL != (item_shard = (zbx_hc_item_shard_t *)zbx_hashset_search(&cache->item_shards,
+				&drained_itemids.values[i])) && 0 == item_shard->values_num)
+		{
+			zbx_hashset_remove_direct(&cache->item_shards, item_shard);
+		}
+	}
+
+	UNLOCK_CACHE;
+out:
+	zbx_vector_uint64_destroy(&drained_itemids);
 }
 
 /******************************************************************************
  *                                                                            *
  * Purpose: retrieve the size of history queue                                *
  *                                                                            *
+ * Comments: Shard locks are taken one at a time, so the caller must not hold *
+ *           any shard lock.                                                  *
+ *           Values staged in ingestion buffers are counted too, because they *
+ *           are queued when history syncers merge them.                      *
+ *                                                                            *
  ******************************************************************************/
 int	hc_queue_get_size(void)
 {
-	return cache->history_queue.elems_num;
+	int	i, j, size = 0;
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		zbx_hc_shard_t	*shard = &cache->shards[i];
+
+		LOCK_SHARD(i);
+		size += shard->history_queue.elems_num;
+
+		LOCK_INGEST(i);
+
+		for (j = 0; j < 2; j++)
+			size += shard->ingest.buffers[j].values_num - shard->ingest.buffers[j].values_merged;
+
+		UNLOCK_INGEST(i);
+		UNLOCK_SHARD(i);
+	}
+
+	return size;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: sets the shard drained first by this history syncer               *
+ *                                                                            *
+ * Parameters: syncer_num - [IN] the history syncer number, starting with 1   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_hc_set_syncer_num(int syncer_num)
+{
+	hc_syncer_num = syncer_num;
+	hc_syncer_shardid = (syncer_num - 1) % cache->shards_num;
 }
 
 int	hc_get_history_compression_age(void)
@@ -4696,11 +7287,12 @@ out:
  * Purpose: Allocate shared memory for database cache                         *
  *                                                                            *
  ******************************************************************************/
-int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_history_sync_f sync_history,
-		zbx_uint64_t history_cache_size, zbx_uint64_t history_index_cache_size,zbx_uint64_t *trends_cache_size,
-		char **error)
+int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_get_config_forks_f get_config_forks,
+		zbx_history_sync_f sync_history, zbx_uint64_t history_cache_size, zbx_uint64_t history_index_cache_size,
+		const char *spill_file, zbx_uint64_t spill_file_size, zbx_uint64_t *trends_cache_size, char **error)
 {
-	int	ret;
+	int		ret, i;
+	zbx_uint64_t	ingest_size;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
@@ -4719,6 +7311,24 @@ int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_history
 	if (SUCCEED != (ret = zbx_mutex_create(&cache_ids_lock, ZBX_MUTEX_CACHE_IDS, error)))
 		goto out;
 
+	if (SUCCEED != (ret = zbx_mutex_create(&spill_lock, ZBX_MUTEX_CACHE_SPILL, error)))
+		goto out;
+
+	for (i = 0; i < ZBX_HC_SHARDS_MAX; i++)
+	{
+		if (SUCCEED != (ret = zbx_mutex_create(&shard_locks[i], (zbx_mutex_name_t)(ZBX_MUTEX_CACHE_SHARD_0 + i),
+				error)))
+		{
+			goto out;
+		}
+
+		if (SUCCEED != (ret = zbx_mutex_create(&ingest_locks[i],
+				(zbx_mutex_name_t)(ZBX_MUTEX_CACHE_INGEST_0 + i), error)))
+		{
+			goto out;
+		}
+	}
+
 	if (SUCCEED != (ret = zbx_shmem_create(&hc_mem, history_cache_size, "history cache",
 			"HistoryCacheSize", 1, error)))
 	{
@@ -4737,12 +7347,39 @@ int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_history
 	ids = (ZBX_DC_IDS *)__hc_index_shmem_malloc_func(NULL, sizeof(ZBX_DC_IDS));
 	memset(ids, 0, sizeof(ZBX_DC_IDS));
 
-	zbx_hashset_create_ext(&cache->history_items, ZBX_HC_ITEMS_INIT_SIZE,
-			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL,
-			__hc_index_shmem_malloc_func, __hc_index_shmem_realloc_func, __hc_index_shmem_free_func);
+	/* one shard per history syncer, so that every shard has a syncer draining it first */
+	if (ZBX_HC_SHARDS_MAX < (cache->shards_num = get_config_forks(ZBX_PROCESS_TYPE_HISTSYNCER)))
+		cache->shards_num = ZBX_HC_SHARDS_MAX;
+	else if (1 > cache->shards_num)
+		cache->shards_num = 1;
 
-	zbx_binary_heap_create_ext(&cache->history_queue, hc_queue_elem_compare_func, ZBX_BINARY_HEAP_OPTION_EMPTY,
-			__hc_index_shmem_malloc_func, __hc_index_shmem_realloc_func, __hc_index_shmem_free_func);
+	/* 1/32 of history cache is reserved for ingestion buffers, two per shard */
+	if (ZBX_HC_INGEST_SIZE_MAX < (ingest_size = history_cache_size / 64 / (zbx_uint64_t)cache->shards_num))
+		ingest_size = ZBX_HC_INGEST_SIZE_MAX;
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		zbx_hc_shard_t	*shard = &cache->shards[i];
+
+		if (ZBX_HC_INGEST_SIZE_MIN <= ingest_size)
+		{
+			int	j;
+
+			for (j = 0; j < 2; j++)
+			{
+				shard->ingest.buffers[j].size = (size_t)ingest_size;
+				shard->ingest.buffers[j].data = (char *)__hc_shmem_malloc_func(NULL, (size_t)ingest_size);
+			}
+		}
+
+		zbx_hashset_create_ext(&shard->history_items, ZBX_HC_ITEMS_INIT_SIZE / cache->shards_num,
+				ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL,
+				hc_index_shmem_malloc_func, hc_index_shmem_realloc_func, hc_index_shmem_free_func);
+
+		zbx_binary_heap_create_ext(&shard->history_queue, hc_queue_elem_compare_func,
+				ZBX_BINARY_HEAP_OPTION_EMPTY, hc_index_shmem_malloc_func, hc_index_shmem_realloc_func,
+				hc_index_shmem_free_func);
+	}
 
 	if (0 != (get_program_type_cb() & ZBX_PROGRAM_TYPE_SERVER))
 	{
@@ -4753,6 +7390,11 @@ int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_history
 		zbx_list_create_ext(&(cache->proxyqueue.list), __hc_index_shmem_malloc_func,
 				__hc_index_shmem_free_func);
 
+		/* item shard placement is accessed with cache lock held */
+		zbx_hashset_create_ext(&cache->item_shards, ZBX_HC_ITEMS_INIT_SIZE, ZBX_DEFAULT_UINT64_HASH_FUNC,
+				ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL, __hc_index_shmem_malloc_func,
+				__hc_index_shmem_realloc_func, __hc_index_shmem_free_func);
+
 		cache->proxyqueue.state = ZBX_HC_PROXYQUEUE_STATE_NORMAL;
 
 		if (SUCCEED != (ret = init_trend_cache(trends_cache_size, error)))
@@ -4764,6 +7406,14 @@ int	zbx_init_database_cache(zbx_get_program_type_f get_program_type, zbx_history
 
 	cache->db_trigger_queue_lock = 1;
 
+	if (NULL != spill_file)
+	{
+		spill_size = spill_file_size;
+
+		if (SUCCEED != (ret = hc_spill_open(spill_file, error)))
+			goto out;
+	}
+
 	if (NULL == sql)
 		sql = (char *)zbx_malloc(sql, sql_alloc);
 out:
@@ -4796,11 +7446,16 @@ static void	DCsync_all(const zbx_events_funcs_t *events_cbs)
  ******************************************************************************/
 void	zbx_free_database_cache(int sync, const zbx_events_funcs_t *events_cbs)
 {
+	int	i;
+
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
 	if (ZBX_SYNC_ALL == sync)
 		DCsync_all(events_cbs);
 
+	if (-1 != spill_fd)
+		hc_spill_close();
+
 	cache = NULL;
 
 	zbx_shmem_destroy(hc_mem);
@@ -4810,6 +7465,13 @@ void	zbx_free_database_cache(int sync, const zbx_events_funcs_t *events_cbs)
 
 	zbx_mutex_destroy(&cache_lock);
 	zbx_mutex_destroy(&cache_ids_lock);
+	zbx_mutex_destroy(&spill_lock);
+
+	for (i = 0; i < ZBX_HC_SHARDS_MAX; i++)
+	{
+		zbx_mutex_destroy(&shard_locks[i]);
+		zbx_mutex_destroy(&ingest_locks[i]);
+	}
 
 	if (0 != (get_program_type_cb() & ZBX_PROGRAM_TYPE_SERVER))
 	{
@@ -4929,12 +7591,20 @@ out:
  ******************************************************************************/
 void	zbx_hc_get_diag_stats(zbx_uint64_t *items_num, zbx_uint64_t *values_num)
 {
-	LOCK_CACHE;
+	int	i;
 
-	*values_num = cache->history_num;
-	*items_num = cache->history_items.num_data;
+	*items_num = 0;
+	*values_num = 0;
 
-	UNLOCK_CACHE;
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		LOCK_SHARD(i);
+
+		*values_num += (zbx_uint64_t)cache->shards[i].history_num;
+		*items_num += (zbx_uint64_t)cache->shards[i].history_items.num_data;
+
+		UNLOCK_SHARD(i);
+	}
 }
 
 /******************************************************************************
@@ -4955,6 +7625,40 @@ void	zbx_hc_get_mem_stats(zbx_shmem_stats_t *data, zbx_shmem_stats_t *index)
 	UNLOCK_CACHE;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get history data slab allocator statistics                        *
+ *                                                                            *
+ * Parameters: stats - [OUT] the slab class statistics (zbx_hc_slab_stats_t)  *
+ *                                                                            *
+ * Comments: Only slab classes having allocated slabs are returned.           *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_hc_get_slab_stats(zbx_vector_ptr_t *stats)
+{
+	int			i;
+	zbx_hc_slab_stats_t	*slab_stats;
+
+	LOCK_CACHE;
+
+	for (i = 0; i < ZBX_HC_SLAB_CLASSES_NUM; i++)
+	{
+		zbx_hc_slab_class_t	*slab_class = &cache->slab_classes[i];
+
+		if (0 == slab_class->slabs_num)
+			continue;
+
+		slab_stats = (zbx_hc_slab_stats_t *)zbx_malloc(NULL, sizeof(zbx_hc_slab_stats_t));
+		slab_stats->size = hc_slab_sizes[i];
+		slab_stats->slabs = slab_class->slabs_num;
+		slab_stats->used = slab_class->slots_used;
+		slab_stats->free = slab_class->slabs_num * (zbx_uint64_t)hc_slab_slots_num(i) - slab_class->slots_used;
+		zbx_vector_ptr_append(stats, slab_stats);
+	}
+
+	UNLOCK_CACHE;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: get statistics of cached items                                    *
@@ -4964,19 +7668,25 @@ void	zbx_hc_get_items(zbx_vector_uint64_pair_t *items)
 {
 	zbx_hashset_iter_t	iter;
 	zbx_hc_item_t		*item;
+	int			i;
 
-	LOCK_CACHE;
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		zbx_hc_shard_t	*shard = &cache->shards[i];
 
-	zbx_vector_uint64_pair_reserve(items, cache->history_items.num_data);
+		LOCK_SHARD(i);
 
-	zbx_hashset_iter_reset(&cache->history_items, &iter);
-	while (NULL != (item = (zbx_hc_item_t *)zbx_hashset_iter_next(&iter)))
-	{
-		zbx_uint64_pair_t	pair = {item->itemid, item->values_num};
-		zbx_vector_uint64_pair_append_ptr(items, &pair);
-	}
+		zbx_vector_uint64_pair_reserve(items, (size_t)(items->values_num + shard->history_items.num_data));
 
-	UNLOCK_CACHE;
+		zbx_hashset_iter_reset(&shard->history_items, &iter);
+		while (NULL != (item = (zbx_hc_item_t *)zbx_hashset_iter_next(&iter)))
+		{
+			zbx_uint64_pair_t	pair = {item->itemid, item->values_num};
+			zbx_vector_uint64_pair_append_ptr(items, &pair);
+		}
+
+		UNLOCK_SHARD(i);
+	}
 }
 
 /******************************************************************************
@@ -5148,22 +7858,12 @@ out:
 	return ret;
 }
 
-void	dbcache_lock(void)
-{
-	LOCK_CACHE;
-}
-
-void	dbcache_unlock(void)
-{
-	UNLOCK_CACHE;
-}
-
-void	dbcache_set_history_num(int num)
+void	dbcache_lock_shard(int shardid)
 {
-	cache->history_num = num;
+	LOCK_SHARD(shardid);
 }
 
-int	dbcache_get_history_num(void)
+void	dbcache_unlock_shard(int shardid)
 {
-	return cache->history_num;
+	UNLOCK_SHARD(shardid);
 }
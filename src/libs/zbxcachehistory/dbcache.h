@@ -31,18 +31,15 @@
 #define ZBX_HC_TIMER_MAX	(ZBX_HC_SYNC_MAX / 2)
 #define ZBX_HC_TIMER_SOFT_MAX	(ZBX_HC_TIMER_MAX - 10)
 
-void	dbcache_lock(void);
-void	dbcache_unlock(void);
+void	dbcache_lock_shard(int shardid);
+void	dbcache_unlock_shard(int shardid);
 
-void	hc_pop_items(zbx_vector_ptr_t *history_items);
-void	hc_push_items(zbx_vector_ptr_t *history_items);
+int	hc_pop_items(zbx_vector_ptr_t *history_items);
+void	hc_push_items(int shardid, zbx_vector_ptr_t *history_items);
 void	hc_get_item_values(zbx_dc_history_t *history, zbx_vector_ptr_t *history_items);
 int	hc_queue_get_size(void);
 void	hc_free_item_values(zbx_dc_history_t *history, int history_num);
 
 void	dc_history_clean_value(zbx_dc_history_t *history);
 
-void	dbcache_set_history_num(int num);
-int	dbcache_get_history_num(void);
-
 #endif
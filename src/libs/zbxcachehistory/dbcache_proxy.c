@@ -373,7 +373,7 @@ void	zbx_sync_proxy_history(int *values_num, int *triggers_num, const zbx_events
 	ZBX_UNUSED(triggers_num);
 	ZBX_UNUSED(events_cbs);
 
-	int			history_num, txn_rc;
+	int			history_num, txn_rc, shardid;
 	time_t			sync_start;
 	zbx_vector_ptr_t	history_items;
 	zbx_vector_ptr_t	item_diff;
@@ -389,13 +389,9 @@ void	zbx_sync_proxy_history(int *values_num, int *triggers_num, const zbx_events
 	{
 		*more = ZBX_SYNC_DONE;
 
-		dbcache_lock();
-
-		hc_pop_items(&history_items);		/* select and take items out of history cache */
+		shardid = hc_pop_items(&history_items);		/* select and take items out of history cache */
 		history_num = history_items.values_num;
 
-		dbcache_unlock();
-
 		if (0 == history_num)
 			break;
 
@@ -415,22 +411,20 @@ void	zbx_sync_proxy_history(int *values_num, int *triggers_num, const zbx_events
 			while (ZBX_DB_DOWN == (txn_rc = zbx_db_commit()));
 		}
 
-		dbcache_lock();
+		dbcache_lock_shard(shardid);
 
-		hc_push_items(&history_items);	/* return items to history cache */
+		hc_push_items(shardid, &history_items);	/* return items to history cache */
 
 		if (ZBX_DB_FAIL != txn_rc)
 		{
 			if (0 != item_diff.values_num)
 				zbx_dc_config_items_apply_changes(&item_diff);
 
-			dbcache_set_history_num(dbcache_get_history_num() - history_num);
+			dbcache_unlock_shard(shardid);
 
 			if (0 != hc_queue_get_size())
 				*more = ZBX_SYNC_MORE;
 
-			dbcache_unlock();
-
 			*values_num += history_num;
 
 			hc_free_item_values(history, history_num);
@@ -438,7 +432,7 @@ void	zbx_sync_proxy_history(int *values_num, int *triggers_num, const zbx_events
 		else
 		{
 			*more = ZBX_SYNC_MORE;
-			dbcache_unlock();
+			dbcache_unlock_shard(shardid);
 		}
 
 		zbx_vector_ptr_clear(&history_items);
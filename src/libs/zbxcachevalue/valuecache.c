@@ -22,6 +22,9 @@
 #include "zbxmutexs.h"
 #include "zbxtime.h"
 #include "zbxvariant.h"
+#include "zbxdbhigh.h"
+#include "zbxthreads.h"
+#include "zbxfile.h"
 
 /*
  * The cache (zbx_vc_cache_t) is organized as a hashset of item records (zbx_vc_item_t).
@@ -61,6 +64,18 @@ static zbx_shmem_info_t	*vc_mem = NULL;
 
 zbx_rwlock_t	vc_lock = ZBX_RWLOCK_NULL;
 
+/* the number of item locks, must match ZBX_RWLOCK_VALUECACHE_ITEMS_* locks */
+#define ZBX_VC_ITEM_LOCKS_NUM	8
+
+/* Item data is protected by item locks, items are assigned to locks by their identifiers.  */
+/* Item data can be read or changed with shared cache lock and the corresponding item lock, */
+/* so syncers adding values do not block requests of items assigned to other locks. The    */
+/* shared memory lock is taken after item write lock to serialize memory allocations and   */
+/* string pool changes. Exclusive cache lock is required to add/remove items and to free   */
+/* cache space by removing other items.                                                    */
+static zbx_rwlock_t	vc_item_locks[ZBX_VC_ITEM_LOCKS_NUM];
+static zbx_mutex_t	vc_shmem_lock = ZBX_MUTEX_NULL;
+
 /* value cache enable/disable flags */
 #define ZBX_VC_DISABLED		0
 #define ZBX_VC_ENABLED		1
@@ -100,7 +115,14 @@ typedef struct zbx_vc_chunk
 	/* the number of item value slots in chunk */
 	int			slots_num;
 
-	/* the item value data */
+	/* the number of values in compressed chunk, 0 for uncompressed chunks */
+	int			packed_num;
+
+	/* the size of compressed value data in bytes */
+	int			packed_size;
+
+	/* the item value data, compressed chunks keep only the first and last values */
+	/* in slots, followed by the compressed data of all chunk values              */
 	zbx_history_record_t	slots[1];
 }
 zbx_vc_chunk_t;
@@ -113,6 +135,105 @@ zbx_vc_chunk_t;
 #define ZBX_VC_MAX_CHUNK_RECORDS	((64 * ZBX_KIBIBYTE - sizeof(zbx_vc_chunk_t)) / \
 		sizeof(zbx_history_record_t) + 1)
 
+/* the number of value slots in compressed chunk - the first and last values */
+#define ZBX_VC_PACKED_SLOTS		2
+
+/* the minimum number of values in chunk to be compressed */
+#define ZBX_VC_PACK_MIN_VALUES		8
+
+/* the number of bits used to store nanoseconds of compressed value timestamp */
+#define ZBX_VC_PACK_NS_BITS		30
+
+/* the compressed chunk encoder/decoder state - the previous value data */
+typedef struct
+{
+	int		sec;
+	int		delta;
+	int		ns;
+	int		leading;
+	int		trailing;
+	zbx_uint64_t	value;
+}
+zbx_vc_pack_state_t;
+
+/* the number of seconds after which unused aggregate is removed */
+#define ZBX_VC_AGGREGATE_EXPIRE_PERIOD	SEC_PER_DAY
+
+/* the maximum number of aggregates kept per item */
+#define ZBX_VC_AGGREGATES_MAX		8
+
+#define ZBX_VC_DEQUE_INIT_SIZE		16
+
+/* the position of value in item history data chunks */
+typedef struct
+{
+	zbx_vc_chunk_t		*chunk;
+
+	/* the value slot index in uncompressed chunk or value number in compressed chunk */
+	int			index;
+
+	/* the compressed chunk decoder bit offset and state after reading the value */
+	size_t			offset;
+	zbx_vc_pack_state_t	state;
+
+	/* the value at cursor position */
+	zbx_history_record_t	record;
+}
+zbx_vc_cursor_t;
+
+/* the monotonic deque element - the window value with its sequence number */
+typedef struct
+{
+	zbx_history_value_t	value;
+	zbx_uint32_t		seq;
+}
+zbx_vc_deque_elem_t;
+
+/* the monotonic deque of aggregate window values */
+typedef struct
+{
+	zbx_vc_deque_elem_t	*elems;
+	int			elems_alloc;
+	int			first;
+	int			num;
+}
+zbx_vc_deque_t;
+
+/* the running aggregate of numeric item values in a sliding window */
+typedef struct zbx_vc_aggregate
+{
+	/* the next aggregate of the same item */
+	struct zbx_vc_aggregate	*next;
+
+	/* the window size - either number of seconds or number of values */
+	int			seconds;
+	int			count;
+
+	/* the last time the aggregate was requested, unused aggregates are removed */
+	int			last_accessed;
+
+	/* The oldest window value in item history data. Window values are not copied, */
+	/* the aggregate is removed when its oldest value is removed from cache.       */
+	zbx_vc_cursor_t		first;
+	int			values_num;
+
+	/* the sequence number of the oldest window value, newer values are numbered consecutively */
+	zbx_uint32_t		first_seq;
+
+	/* The minimum and maximum value candidates in the order of arrival. The front */
+	/* of deque holds the minimum (maximum) value of the window.                    */
+	zbx_vc_deque_t		min;
+	zbx_vc_deque_t		max;
+
+	/* the sum of window values, unsigned sum wraps around as in sum() function */
+	zbx_uint64_t		sum_ui64;
+
+	/* the floating point sum and compensation of its rounding errors */
+	double			sum_dbl;
+	double			sum_comp;
+}
+zbx_vc_aggregate_t;
+
 /* the value cache item data */
 typedef struct
 {
@@ -175,6 +296,9 @@ typedef struct
 
 	/* the first (oldest) chunk of item history data              */
 	zbx_vc_chunk_t	*tail;
+
+	/* the running aggregates of numeric items                    */
+	zbx_vc_aggregate_t	*aggregates;
 }
 zbx_vc_item_t;
 
@@ -224,7 +348,8 @@ ZBX_VECTOR_IMPL(vc_itemweight, zbx_vc_item_weight_t)
 typedef enum
 {
 	ZBX_VC_UPDATE_STATS,
-	ZBX_VC_UPDATE_RANGE
+	ZBX_VC_UPDATE_RANGE,
+	ZBX_VC_UPDATE_AGGREGATE
 }
 zbx_vc_item_update_type_t;
 
@@ -240,6 +365,12 @@ enum
 	ZBX_VC_UPDATE_RANGE_NOW
 };
 
+enum
+{
+	ZBX_VC_UPDATE_AGGREGATE_SECONDS,
+	ZBX_VC_UPDATE_AGGREGATE_COUNT
+};
+
 typedef struct
 {
 	zbx_uint64_t			itemid;
@@ -267,18 +398,110 @@ static void	vc_cache_item_update(zbx_uint64_t itemid, zbx_vc_item_update_type_t
 	update->data[1] = arg2;
 }
 
+/* the process local buffer for values decoded from compressed chunks */
+static zbx_history_record_t	*vc_unpacked = NULL;
+static int			vc_unpacked_alloc = 0;
+
 /* the value cache */
 static zbx_vc_cache_t	*vc_cache = NULL;
 
 #define	RDLOCK_CACHE	zbx_rwlock_rdlock(vc_lock)
 #define	WRLOCK_CACHE	zbx_rwlock_wrlock(vc_lock)
 #define	UNLOCK_CACHE	zbx_rwlock_unlock(vc_lock)
+#define	LOCK_SHMEM	zbx_mutex_lock(vc_shmem_lock)
+#define	UNLOCK_SHMEM	zbx_mutex_unlock(vc_shmem_lock)
+
+#define VC_ITEM_LOCK_INDEX(itemid)	((int)((itemid) % ZBX_VC_ITEM_LOCKS_NUM))
+
+/* the value cache locks held by the current process */
+typedef enum
+{
+	ZBX_VC_LOCK_NONE = 0,
+	/* shared cache lock and item read lock */
+	ZBX_VC_LOCK_ITEM_READ,
+	/* shared cache lock, item write lock and shared memory lock */
+	ZBX_VC_LOCK_ITEM_WRITE,
+	/* exclusive cache lock */
+	ZBX_VC_LOCK_CACHE
+}
+zbx_vc_lock_mode_t;
+
+static zbx_vc_lock_mode_t	vc_lock_mode = ZBX_VC_LOCK_NONE;
+static int			vc_lock_index;
+
+/* the size of failed allocations without exclusive cache lock, which must be released */
+static size_t			vc_release_size = 0;
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: locks items assigned to the specified item lock                   *
+ *                                                                            *
+ * Parameters: index - [IN] the item lock index, see VC_ITEM_LOCK_INDEX()     *
+ *             mode  - [IN] ZBX_VC_LOCK_ITEM_READ - to read item data         *
+ *                          ZBX_VC_LOCK_ITEM_WRITE - to change item data      *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_lock_items(int index, zbx_vc_lock_mode_t mode)
+{
+	RDLOCK_CACHE;
+
+	/* item locks are created only with cache */
+	if (NULL != vc_cache)
+	{
+		if (ZBX_VC_LOCK_ITEM_WRITE == mode)
+		{
+			zbx_rwlock_wrlock(vc_item_locks[index]);
+			LOCK_SHMEM;
+		}
+		else
+			zbx_rwlock_rdlock(vc_item_locks[index]);
+	}
+
+	vc_lock_mode = mode;
+	vc_lock_index = index;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: locks cache for exclusive access                                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_lock_cache(void)
+{
+	WRLOCK_CACHE;
+	vc_lock_mode = ZBX_VC_LOCK_CACHE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: releases value cache locks held by the current process            *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_unlock(void)
+{
+	if (ZBX_VC_LOCK_NONE == vc_lock_mode)
+		return;
+
+	if (ZBX_VC_LOCK_CACHE != vc_lock_mode && NULL != vc_cache)
+	{
+		if (ZBX_VC_LOCK_ITEM_WRITE == vc_lock_mode)
+			UNLOCK_SHMEM;
+
+		zbx_rwlock_unlock(vc_item_locks[vc_lock_index]);
+	}
+
+	UNLOCK_CACHE;
+	vc_lock_mode = ZBX_VC_LOCK_NONE;
+}
 
 /* function prototypes */
 static void	vc_history_record_copy(zbx_history_record_t *dst, const zbx_history_record_t *src, int value_type);
 static void	vc_history_record_vector_clean(zbx_vector_history_record_t *vector, int value_type);
 
 static size_t	vch_item_free_cache(zbx_vc_item_t *item);
+static size_t	vc_item_free_aggregates(zbx_vc_item_t *item);
+static void	vc_item_move_aggregates(zbx_vc_item_t *item, const zbx_vc_chunk_t *chunk, zbx_vc_chunk_t *dst);
+static void	vc_item_remove_aggregates(zbx_vc_item_t *item, const zbx_vc_chunk_t *chunk, int first_value);
 static size_t	vch_item_free_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk);
 static int	vch_item_add_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num);
 static void	vch_item_clean_cache(zbx_vc_item_t *item, int timestamp);
@@ -756,7 +979,10 @@ static void	vc_warn_low_memory(void)
 	{
 		vc_cache->last_warning_time = now;
 		vc_dump_items_statistics();
+
+		LOCK_SHMEM;
 		zbx_shmem_dump_stats(LOG_LEVEL_WARNING, vc_mem);
+		UNLOCK_SHMEM;
 
 		zabbix_log(LOG_LEVEL_WARNING, "value cache is fully used: please increase ValueCacheSize"
 				" configuration parameter");
@@ -869,6 +1095,23 @@ static void	vc_release_space(zbx_vc_item_t *source_item, size_t space)
 	zbx_vector_vc_itemweight_destroy(&items);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees space requested by allocations failed without exclusive     *
+ *          cache lock                                                        *
+ *                                                                            *
+ * Comments: This function must be called with exclusive cache lock.          *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_release_pending_space(void)
+{
+	if (0 == vc_release_size)
+		return;
+
+	vc_release_space(NULL, vc_release_size);
+	vc_release_size = 0;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: copies history value                                              *
@@ -912,7 +1155,7 @@ static void	vc_history_record_copy(zbx_history_record_t *dst, const zbx_history_
  *                                                                            *
  ******************************************************************************/
 static void	vc_history_record_vector_append(zbx_vector_history_record_t *vector, int value_type,
-		zbx_history_record_t *value)
+		const zbx_history_record_t *value)
 {
 	zbx_history_record_t	record;
 
@@ -934,6 +1177,9 @@ static void	vc_history_record_vector_append(zbx_vector_history_record_t *vector,
  *           space in cache by calling vc_free_space() and tries again. If it *
  *           still fails a NULL value is returned.                            *
  *                                                                            *
+ *           Without exclusive cache lock the space is not freed, instead the *
+ *           size is added to vc_release_size and NULL value is returned.     *
+ *                                                                            *
  ******************************************************************************/
 static void	*vc_item_malloc(zbx_vc_item_t *item, size_t size)
 {
@@ -941,6 +1187,12 @@ static void	*vc_item_malloc(zbx_vc_item_t *item, size_t size)
 
 	if (NULL == (ptr = (char *)__vc_shmem_malloc_func(NULL, size)))
 	{
+		if (ZBX_VC_LOCK_CACHE != vc_lock_mode)
+		{
+			vc_release_size += size;
+			return NULL;
+		}
+
 		/* If failed to allocate required memory, try to free space in      */
 		/* cache and allocate again. If there still is not enough space -   */
 		/* return NULL as failure.                                          */
@@ -988,6 +1240,13 @@ static char	*vc_item_strdup(zbx_vc_item_t *item, const char *str)
 		{
 			/* If there is not enough space - free enough to store string + hashset entry overhead */
 			/* and try inserting one more time. If it fails again, then fail the function.         */
+			/* Without exclusive cache lock fail the function, the space is released later.        */
+			if (ZBX_VC_LOCK_CACHE != vc_lock_mode)
+			{
+				vc_release_size += len + REFCOUNT_FIELD_SIZE + sizeof(ZBX_HASHSET_ENTRY_T);
+				return NULL;
+			}
+
 			if (0 == tries++)
 				vc_release_space(item, len + REFCOUNT_FIELD_SIZE + sizeof(ZBX_HASHSET_ENTRY_T));
 			else
@@ -1153,19 +1412,6 @@ static size_t	vc_item_free_values(zbx_vc_item_t *item, zbx_history_record_t *val
 	return freed;
 }
 
-/******************************************************************************
- *                                                                            *
- * Purpose: removes item from cache and frees resources allocated for it      *
- *                                                                            *
- * Parameters: item    - [IN] the item                                        *
- *                                                                            *
- ******************************************************************************/
-static void	vc_remove_item(zbx_vc_item_t *item)
-{
-	vch_item_free_cache(item);
-	zbx_hashset_remove_direct(&vc_cache->items, item);
-}
-
 /******************************************************************************
  *                                                                            *
  * Purpose: removes item from cache and frees resources allocated for it      *
@@ -1267,6 +1513,14 @@ static void	vc_item_update_db_cached_from(zbx_vc_item_t *item, int timestamp)
  *
  * After adding a new chunk, the older chunks (outside the largest request
  * range) are automatically removed from cache.
+ *
+ * Closed (full, non-head) chunks of numeric items are compressed - timestamp
+ * seconds are stored as delta-of-delta, nanoseconds only when changed and
+ * values are XOR-ed with previous value, storing only the meaningful bits.
+ * Compressed chunks keep the first and last values uncompressed in slots, so
+ * the chunk time range can be checked without decoding. The values are decoded
+ * into process local buffer when read and compressed chunks are converted back
+ * to uncompressed ones before changing their contents.
  */
 
 /******************************************************************************
@@ -1398,1534 +1652,4258 @@ static int	vch_item_add_chunk(zbx_vc_item_t *item, int nslots, zbx_vc_chunk_t *i
 	return SUCCEED;
 }
 
+/* the compressed chunk bit buffer */
+typedef struct
+{
+	unsigned char	*data;
+	size_t		size;
+	size_t		offset;
+}
+zbx_vc_bitbuf_t;
+
 /******************************************************************************
  *                                                                            *
- * Purpose: find the index of the last value in chunk with timestamp less or  *
- *          equal to the specified timestamp.                                 *
- *                                                                            *
- * Parameters:  chunk - [IN] the chunk                                        *
- *              ts    - [IN] the target timestamp                             *
+ * Purpose: writes the specified number of lowest value bits to bit buffer    *
  *                                                                            *
- * Return value: The index of the last value in chunk with timestamp less or  *
- *               equal to the specified timestamp.                            *
- *               -1 is returned in the case of failure (meaning that all      *
- *               values have timestamps greater than the target timestamp).   *
+ * Parameters: buf   - [IN/OUT] the bit buffer                                *
+ *             value - [IN] the value to write                                *
+ *             num   - [IN] the number of bits to write (1-64)                *
  *                                                                            *
  ******************************************************************************/
-static int	vch_chunk_find_last_value_before(const zbx_vc_chunk_t *chunk, const zbx_timespec_t *ts)
+static void	vc_bitbuf_write(zbx_vc_bitbuf_t *buf, zbx_uint64_t value, int num)
 {
-	int	start = chunk->first_value, end = chunk->last_value, middle;
+	size_t	size = (buf->offset + (size_t)num + 7) / 8;
 
-	/* check if the last value timestamp is already greater or equal to the specified timestamp */
-	if (0 >= zbx_timespec_compare(&chunk->slots[end].timestamp, ts))
-		return end;
-
-	/* chunk contains only one value, which did not pass the above check, return failure */
-	if (start == end)
-		return -1;
-
-	/* perform value lookup using binary search */
-	while (start != end)
+	if (size > buf->size)
 	{
-		middle = start + (end - start) / 2;
-
-		if (0 < zbx_timespec_compare(&chunk->slots[middle].timestamp, ts))
-		{
-			end = middle;
-			continue;
-		}
+		size_t	old_size = buf->size;
 
-		if (0 >= zbx_timespec_compare(&chunk->slots[middle + 1].timestamp, ts))
-		{
-			start = middle;
-			continue;
-		}
+		while (size > buf->size)
+			buf->size = (0 == buf->size ? ZBX_KIBIBYTE : buf->size * 2);
 
-		return middle;
+		buf->data = (unsigned char *)zbx_realloc(buf->data, buf->size);
+		memset(buf->data + old_size, 0, buf->size - old_size);
 	}
 
-	return -1;
+	while (0 != num)
+	{
+		int	free_bits = 8 - (int)(buf->offset & 7), bits = MIN(free_bits, num);
+
+		num -= bits;
+		buf->data[buf->offset >> 3] |= (unsigned char)(((value >> num) & ((1u << bits) - 1)) <<
+				(free_bits - bits));
+		buf->offset += (size_t)bits;
+	}
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: gets the chunk and index of the last value with a timestamp less  *
- *          or equal to the specified timestamp                               *
- *                                                                            *
- * Parameters:  item          - [IN] the item                                 *
- *              ts            - [IN] the target timestamp                     *
- *                                   (NULL - current time)                    *
- *              pchunk        - [OUT] the chunk containing the target value   *
- *              pindex        - [OUT] the index of the target value           *
+ * Purpose: reads the specified number of bits from compressed data           *
  *                                                                            *
- * Return value: SUCCEED - the last value was found successfully              *
- *               FAIL - all values in cache have timestamps greater than the  *
- *                      target (timeshift) timestamp.                         *
+ * Parameters: data   - [IN] the compressed data                              *
+ *             offset - [IN/OUT] the read offset in bits                      *
+ *             num    - [IN] the number of bits to read (1-64)                *
  *                                                                            *
- * Comments: If end_timestamp value is 0, then simply the last item value in  *
- *           cache is returned.                                               *
+ * Return value: the value read                                               *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_get_last_value(const zbx_vc_item_t *item, const zbx_timespec_t *ts, zbx_vc_chunk_t **pchunk,
-		int *pindex)
+static zbx_uint64_t	vc_bitbuf_read(const unsigned char *data, size_t *offset, int num)
 {
-	zbx_vc_chunk_t	*chunk = item->head;
-	int		index;
-
-	if (NULL == chunk)
-		return FAIL;
+	zbx_uint64_t	value = 0;
 
-	index = chunk->last_value;
-
-	if (0 < zbx_timespec_compare(&chunk->slots[index].timestamp, ts))
+	while (0 != num)
 	{
-		while (0 < zbx_timespec_compare(&chunk->slots[chunk->first_value].timestamp, ts))
-		{
-			chunk = chunk->prev;
-			/* there are no values for requested range, return failure */
-			if (NULL == chunk)
-				return FAIL;
-		}
-		index = vch_chunk_find_last_value_before(chunk, ts);
-	}
+		int	avail_bits = 8 - (int)(*offset & 7), bits = MIN(avail_bits, num);
 
-	*pchunk = chunk;
-	*pindex = index;
+		value = (value << bits) | ((data[*offset >> 3] >> (avail_bits - bits)) & ((1u << bits) - 1));
+		*offset += (size_t)bits;
+		num -= bits;
+	}
 
-	return SUCCEED;
+	return value;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: copies value in the specified item's chunk slot                   *
- *                                                                            *
- * Parameters: chunk        - [IN/OUT] the target chunk                       *
- *             index        - [IN] the target slot                            *
- *             source_value - [IN] the value to copy                          *
+ * Purpose: compresses history value                                          *
  *                                                                            *
- * Return value: SUCCEED - the value was copied successfully                  *
- *               FAIL    - the value copying failed (not enough space for     *
- *                         string, text or log type data)                     *
+ * Parameters: buf    - [IN/OUT] the bit buffer                               *
+ *             state  - [IN/OUT] the encoder state                            *
+ *             record - [IN] the value to compress                            *
+ *             first  - [IN] 1 - the first value, 0 - otherwise               *
  *                                                                            *
- * Comments: This function is used to copy data to cache. The contents of     *
- *           str, text and log type values are stored in cache string pool.   *
+ * Comments: Floating point values are compressed by their binary             *
+ *           representation, so both numeric types use the same encoding.     *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_copy_value(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk, int index,
-		const zbx_history_record_t *source_value)
+static void	vc_pack_value(zbx_vc_bitbuf_t *buf, zbx_vc_pack_state_t *state, const zbx_history_record_t *record,
+		int first)
 {
-	zbx_history_record_t	*value;
-	int			ret = FAIL;
+	int		delta, dod, leading, trailing;
+	zbx_uint64_t	value;
 
-	value = &chunk->slots[index];
+	if (0 != first)
+	{
+		vc_bitbuf_write(buf, (zbx_uint32_t)record->timestamp.sec, 32);
+		vc_bitbuf_write(buf, (zbx_uint64_t)record->timestamp.ns, ZBX_VC_PACK_NS_BITS);
+		vc_bitbuf_write(buf, record->value.ui64, 64);
 
-	switch (item->value_type)
+		state->sec = record->timestamp.sec;
+		state->delta = 0;
+		state->ns = record->timestamp.ns;
+		state->leading = -1;
+		state->value = record->value.ui64;
+
+		return;
+	}
+
+	/* values are sorted by timestamps, so deltas are not negative and their difference fits int */
+	delta = record->timestamp.sec - state->sec;
+	dod = delta - state->delta;
+
+	if (0 == dod)
+		vc_bitbuf_write(buf, 0, 1);
+	else if (-63 <= dod && 64 >= dod)
+		vc_bitbuf_write(buf, (__UINT64_C(0x2) << 7) | (zbx_uint64_t)(dod + 63), 2 + 7);
+	else if (-255 <= dod && 256 >= dod)
+		vc_bitbuf_write(buf, (__UINT64_C(0x6) << 9) | (zbx_uint64_t)(dod + 255), 3 + 9);
+	else if (-2047 <= dod && 2048 >= dod)
+		vc_bitbuf_write(buf, (__UINT64_C(0xe) << 12) | (zbx_uint64_t)(dod + 2047), 4 + 12);
+	else
+		vc_bitbuf_write(buf, (__UINT64_C(0xf) << 32) | (zbx_uint32_t)dod, 4 + 32);
+
+	state->sec = record->timestamp.sec;
+	state->delta = delta;
+
+	if (record->timestamp.ns == state->ns)
 	{
-		case ITEM_VALUE_TYPE_STR:
-		case ITEM_VALUE_TYPE_TEXT:
-			if (NULL == (value->value.str = vc_item_strdup(item, source_value->value.str)))
-				goto out;
-			break;
-		case ITEM_VALUE_TYPE_LOG:
-			if (NULL == (value->value.log = vc_item_logdup(item, source_value->value.log)))
-				goto out;
-			break;
-		default:
-			value->value = source_value->value;
+		vc_bitbuf_write(buf, 0, 1);
+	}
+	else
+	{
+		vc_bitbuf_write(buf, (__UINT64_C(1) << ZBX_VC_PACK_NS_BITS) | (zbx_uint64_t)record->timestamp.ns,
+				1 + ZBX_VC_PACK_NS_BITS);
+		state->ns = record->timestamp.ns;
 	}
-	value->timestamp = source_value->timestamp;
 
-	ret = SUCCEED;
-out:
-	return ret;
+	if (0 == (value = record->value.ui64 ^ state->value))
+	{
+		vc_bitbuf_write(buf, 0, 1);
+		return;
+	}
+
+	state->value = record->value.ui64;
+
+	for (leading = 0; 0 == (value & (__UINT64_C(1) << (63 - leading))); leading++)
+		;
+
+	for (trailing = 0; 0 == (value & (__UINT64_C(1) << trailing)); trailing++)
+		;
+
+	/* the number of leading zeros is stored in 5 bits */
+	if (31 < leading)
+		leading = 31;
+
+	if (-1 != state->leading && leading >= state->leading && trailing >= state->trailing)
+	{
+		/* the meaningful bits fit in the previous value window */
+		vc_bitbuf_write(buf, 0x2, 2);
+		vc_bitbuf_write(buf, value >> state->trailing, 64 - state->leading - state->trailing);
+		return;
+	}
+
+	vc_bitbuf_write(buf, 0x3, 2);
+	vc_bitbuf_write(buf, (zbx_uint64_t)leading, 5);
+	vc_bitbuf_write(buf, (zbx_uint64_t)(64 - leading - trailing - 1), 6);
+	vc_bitbuf_write(buf, value >> trailing, 64 - leading - trailing);
+
+	state->leading = leading;
+	state->trailing = trailing;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: copies values at the beginning of item tail chunk                 *
- *                                                                            *
- * Parameters: item       - [IN/OUT] the target item                          *
- *             values     - [IN] the values to copy                           *
- *             values_num - [IN] the number of values to copy                 *
- *                                                                            *
- * Return value: SUCCEED - the values were copied successfully                *
- *               FAIL    - the value copying failed (not enough space for     *
- *                         string, text or log type data)                     *
+ * Purpose: decompresses history value                                        *
  *                                                                            *
- * Comments: This function is used to copy data to cache. The contents of     *
- *           str, text and log type values are stored in cache string pool.   *
+ * Parameters: data   - [IN] the compressed data                              *
+ *             offset - [IN/OUT] the read offset in bits                      *
+ *             state  - [IN/OUT] the decoder state                            *
+ *             record - [OUT] the decompressed value                          *
+ *             first  - [IN] 1 - the first value, 0 - otherwise               *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_copy_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+static void	vc_unpack_value(const unsigned char *data, size_t *offset, zbx_vc_pack_state_t *state,
+		zbx_history_record_t *record, int first)
 {
-	int	i, ret = FAIL, first_value = item->tail->first_value;
+	int	dod, bits;
 
-	switch (item->value_type)
+	if (0 != first)
 	{
-		case ITEM_VALUE_TYPE_STR:
-		case ITEM_VALUE_TYPE_TEXT:
-			for (i = values_num - 1; i >= 0; i--)
-			{
-				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
+		state->sec = (int)(zbx_uint32_t)vc_bitbuf_read(data, offset, 32);
+		state->delta = 0;
+		state->ns = (int)vc_bitbuf_read(data, offset, ZBX_VC_PACK_NS_BITS);
+		state->leading = -1;
+		state->value = vc_bitbuf_read(data, offset, 64);
+	}
+	else
+	{
+		if (0 == vc_bitbuf_read(data, offset, 1))
+			dod = 0;
+		else if (0 == vc_bitbuf_read(data, offset, 1))
+			dod = (int)vc_bitbuf_read(data, offset, 7) - 63;
+		else if (0 == vc_bitbuf_read(data, offset, 1))
+			dod = (int)vc_bitbuf_read(data, offset, 9) - 255;
+		else if (0 == vc_bitbuf_read(data, offset, 1))
+			dod = (int)vc_bitbuf_read(data, offset, 12) - 2047;
+		else
+			dod = (int)(zbx_uint32_t)vc_bitbuf_read(data, offset, 32);
 
-				if (NULL == (value->value.str = vc_item_strdup(item, values[i].value.str)))
-					goto out;
+		state->delta += dod;
+		state->sec += state->delta;
 
-				value->timestamp = values[i].timestamp;
-				item->tail->first_value--;
-			}
-			ret = SUCCEED;
+		if (0 != vc_bitbuf_read(data, offset, 1))
+			state->ns = (int)vc_bitbuf_read(data, offset, ZBX_VC_PACK_NS_BITS);
 
-			break;
-		case ITEM_VALUE_TYPE_LOG:
-			for (i = values_num - 1; i >= 0; i--)
+		if (0 != vc_bitbuf_read(data, offset, 1))
+		{
+			if (0 != vc_bitbuf_read(data, offset, 1))
 			{
-				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
-
-				if (NULL == (value->value.log = vc_item_logdup(item, values[i].value.log)))
-					goto out;
-
-				value->timestamp = values[i].timestamp;
-				item->tail->first_value--;
+				state->leading = (int)vc_bitbuf_read(data, offset, 5);
+				bits = (int)vc_bitbuf_read(data, offset, 6) + 1;
+				state->trailing = 64 - state->leading - bits;
 			}
-			ret = SUCCEED;
+			else
+				bits = 64 - state->leading - state->trailing;
 
-			break;
-		default:
-			memcpy(&item->tail->slots[item->tail->first_value - values_num], values,
-					(size_t)values_num * sizeof(zbx_history_record_t));
-			item->tail->first_value -= values_num;
-			ret = SUCCEED;
+			state->value ^= vc_bitbuf_read(data, offset, bits) << state->trailing;
+		}
 	}
-out:
-	item->values_total += first_value - item->tail->first_value;
 
-	return ret;
+	record->timestamp.sec = state->sec;
+	record->timestamp.ns = state->ns;
+	record->value.ui64 = state->value;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: frees chunk and all resources allocated to store its values       *
+ * Purpose: returns the number of values in chunk                             *
  *                                                                            *
- * Parameters: item    - [IN] the chunk owner item                            *
- *             chunk   - [IN] the chunk to free                               *
+ ******************************************************************************/
+static int	vch_chunk_values_num(const zbx_vc_chunk_t *chunk)
+{
+	if (0 != chunk->packed_num)
+		return chunk->packed_num;
+
+	return chunk->last_value - chunk->first_value + 1;
+}
+
+/******************************************************************************
  *                                                                            *
- * Return value: the number of bytes freed                                    *
+ * Purpose: returns the size of memory allocated for chunk                    *
  *                                                                            *
  ******************************************************************************/
-static size_t	vch_item_free_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+static size_t	vch_chunk_size(const zbx_vc_chunk_t *chunk)
 {
-	size_t	freed;
+	if (0 != chunk->packed_num)
+	{
+		return sizeof(zbx_vc_chunk_t) + sizeof(zbx_history_record_t) * (ZBX_VC_PACKED_SLOTS - 1) +
+				(size_t)chunk->packed_size;
+	}
 
-	freed = sizeof(zbx_vc_chunk_t) + (size_t)(chunk->slots_num - 1) * sizeof(zbx_history_record_t);
-	freed += vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->last_value);
+	return sizeof(zbx_vc_chunk_t) + sizeof(zbx_history_record_t) * (size_t)(chunk->slots_num - 1);
+}
 
-	__vc_shmem_free_func(chunk);
+/******************************************************************************
+ *                                                                            *
+ * Purpose: decompresses all values of compressed chunk                       *
+ *                                                                            *
+ * Parameters: chunk  - [IN] the compressed chunk                             *
+ *             values - [OUT] the decompressed values                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_chunk_unpack_values(const zbx_vc_chunk_t *chunk, zbx_history_record_t *values)
+{
+	const unsigned char	*data = (const unsigned char *)&chunk->slots[ZBX_VC_PACKED_SLOTS];
+	size_t			offset = 0;
+	zbx_vc_pack_state_t	state = {0};
+	int			i;
 
-	return freed;
+	for (i = 0; i < chunk->packed_num; i++)
+		vc_unpack_value(data, &offset, &state, &values[i], 0 == i);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: removes item history data chunk                                   *
+ * Purpose: gets chunk values, decompressing them if necessary                *
  *                                                                            *
- * Parameters: item    - [IN ] the chunk owner item                           *
- *             chunk   - [IN] the chunk to remove                             *
+ * Parameters: chunk - [IN] the chunk                                         *
+ *             plast - [OUT] the index of the last (newest) value             *
+ *                                                                            *
+ * Return value: The chunk values, starting with the first (oldest) value.    *
+ *                                                                            *
+ * Comments: Compressed chunk values are decoded into process local buffer,   *
+ *           which is valid until the next compressed chunk is read.          *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_remove_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+static const zbx_history_record_t	*vch_chunk_get_values(const zbx_vc_chunk_t *chunk, int *plast)
 {
-	if (NULL != chunk->next)
-		chunk->next->prev = chunk->prev;
-
-	if (NULL != chunk->prev)
-		chunk->prev->next = chunk->next;
+	if (0 == chunk->packed_num)
+	{
+		*plast = chunk->last_value - chunk->first_value;
+		return &chunk->slots[chunk->first_value];
+	}
 
-	if (chunk == item->head)
-		item->head = chunk->prev;
+	if (vc_unpacked_alloc < chunk->packed_num)
+	{
+		vc_unpacked_alloc = chunk->packed_num;
+		vc_unpacked = (zbx_history_record_t *)zbx_realloc(vc_unpacked,
+				sizeof(zbx_history_record_t) * (size_t)vc_unpacked_alloc);
+	}
 
-	if (chunk == item->tail)
-		item->tail = chunk->next;
+	vch_chunk_unpack_values(chunk, vc_unpacked);
+	*plast = chunk->packed_num - 1;
 
-	vch_item_free_chunk(item, chunk);
+	return vc_unpacked;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: removes item history data that are outside (older) the maximum    *
- *          request range                                                     *
+ * Purpose: replaces item history data chunk with another chunk               *
  *                                                                            *
- * Parameters:  item      - [IN] the target item                              *
- *              timestamp - [IN] last timestamp in active range               *
+ * Parameters: item  - [IN/OUT] the chunk owner item                          *
+ *             chunk - [IN] the chunk to replace, it's freed afterwards       *
+ *             dst   - [IN/OUT] the chunk to put in the place of source chunk *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_clean_cache(zbx_vc_item_t *item, int timestamp)
+static void	vch_item_replace_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk, zbx_vc_chunk_t *dst)
 {
-	zbx_vc_chunk_t	*next;
+	dst->prev = chunk->prev;
+	dst->next = chunk->next;
 
-	if (0 != item->active_range)
-	{
-		zbx_vc_chunk_t	*tail = item->tail;
-		zbx_vc_chunk_t	*chunk = tail;
+	if (NULL != dst->prev)
+		dst->prev->next = dst;
+	else
+		item->tail = dst;
 
-		timestamp -= item->active_range;
+	if (NULL != dst->next)
+		dst->next->prev = dst;
+	else
+		item->head = dst;
 
-		/* Try to remove chunks with all history values older than maximum request range, maximum */
-		/* request range should be calculated from last received value with which active range    */
-		/* was calculated to avoid dropping of chunks that might be still used in count request.  */
-		while (NULL != chunk && chunk->slots[chunk->last_value].timestamp.sec < timestamp &&
-				chunk->slots[chunk->last_value].timestamp.sec !=
-						item->head->slots[item->head->last_value].timestamp.sec)
-		{
-			/* don't remove the head chunk */
-			if (NULL == (next = chunk->next))
-				break;
+	vc_item_move_aggregates(item, chunk, dst);
 
-			/* Values with the same timestamps (seconds resolution) always should be either   */
-			/* kept in cache or removed together. There should not be a case when one of them */
-			/* is in cache and the second is dropped.                                         */
-			/* Here we are handling rare case, when the last value of first chunk has the     */
-			/* same timestamp (seconds resolution) as the first value in the second chunk.    */
-			/* In this case increase the first value index of the next chunk until the first  */
-			/* value timestamp is greater.                                                    */
+	__vc_shmem_free_func(chunk);
+}
 
-			if (next->slots[next->first_value].timestamp.sec != next->slots[next->last_value].timestamp.sec)
-			{
-				while (next->slots[next->first_value].timestamp.sec ==
-						chunk->slots[chunk->last_value].timestamp.sec)
-				{
-					vc_item_free_values(item, next->slots, next->first_value, next->first_value);
-					next->first_value++;
-				}
-			}
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compresses closed chunk of numeric item                           *
+ *                                                                            *
+ * Parameters: item  - [IN/OUT] the chunk owner item                          *
+ *             chunk - [IN] the chunk to compress                             *
+ *                                                                            *
+ * Comments: Compression is skipped if it does not reduce chunk size or       *
+ *           there is not enough free space in cache. Cache space is not      *
+ *           released for compression, so other items are not dropped to     *
+ *           compress values.                                                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_pack_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+{
+	zbx_vc_bitbuf_t		buf = {0};
+	zbx_vc_pack_state_t	state = {0};
+	zbx_vc_chunk_t		*packed;
+	int			i;
+	size_t			size;
 
-			/* set the database cached from timestamp to the last (oldest) removed value timestamp + 1 */
-			item->db_cached_from = chunk->slots[chunk->last_value].timestamp.sec + 1;
+	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
+		return;
 
-			vch_item_remove_chunk(item, chunk);
+	if (0 != chunk->packed_num || ZBX_VC_PACK_MIN_VALUES > vch_chunk_values_num(chunk))
+		return;
 
-			chunk = next;
-		}
+	for (i = chunk->first_value; i <= chunk->last_value; i++)
+	{
+		if (0 > chunk->slots[i].timestamp.ns || (1 << ZBX_VC_PACK_NS_BITS) <= chunk->slots[i].timestamp.ns)
+			goto out;
 
-		/* reset the status flags if data was removed from cache */
-		if (tail != item->tail)
-			item->status = 0;
+		vc_pack_value(&buf, &state, &chunk->slots[i], i == chunk->first_value);
 	}
+
+	size = sizeof(zbx_vc_chunk_t) + sizeof(zbx_history_record_t) * (ZBX_VC_PACKED_SLOTS - 1) + (buf.offset + 7) / 8;
+
+	if (size >= vch_chunk_size(chunk))
+		goto out;
+
+	if (NULL == (packed = (zbx_vc_chunk_t *)__vc_shmem_malloc_func(NULL, size)))
+		goto out;
+
+	memset(packed, 0, sizeof(zbx_vc_chunk_t));
+	packed->slots_num = ZBX_VC_PACKED_SLOTS;
+	packed->first_value = 0;
+	packed->last_value = ZBX_VC_PACKED_SLOTS - 1;
+	packed->packed_num = vch_chunk_values_num(chunk);
+	packed->packed_size = (int)((buf.offset + 7) / 8);
+	packed->slots[0] = chunk->slots[chunk->first_value];
+	packed->slots[1] = chunk->slots[chunk->last_value];
+	memcpy(&packed->slots[ZBX_VC_PACKED_SLOTS], buf.data, (size_t)packed->packed_size);
+
+	vch_item_replace_chunk(item, chunk, packed);
+out:
+	zbx_free(buf.data);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: removes item history data that are older than the specified       *
- *          timestamp                                                         *
+ * Purpose: converts compressed chunk back to uncompressed chunk              *
  *                                                                            *
- * Parameters:  item      - [IN] the target item                              *
- *              timestamp - [IN] the timestamp (number of seconds since the   *
- *                               Epoch)                                       *
+ * Parameters: item   - [IN/OUT] the chunk owner item                         *
+ *             pchunk - [IN/OUT] the chunk to decompress, replaced with the   *
+ *                               uncompressed chunk                           *
+ *                                                                            *
+ * Return value: SUCCEED - the chunk was decompressed or was not compressed   *
+ *               FAIL    - not enough memory to decompress the chunk          *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_remove_values(zbx_vc_item_t *item, int timestamp)
+static int	vch_item_unpack_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t **pchunk)
 {
-	zbx_vc_chunk_t	*chunk = item->tail;
+	zbx_vc_chunk_t	*chunk;
+	int		values_num = (*pchunk)->packed_num;
 
-	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
-		item->status = 0;
+	if (0 == values_num)
+		return SUCCEED;
 
-	/* try to remove chunks with all history values older than the timestamp */
-	while (NULL != chunk && chunk->slots[chunk->first_value].timestamp.sec < timestamp)
+	if (NULL == (chunk = (zbx_vc_chunk_t *)vc_item_malloc(item, sizeof(zbx_vc_chunk_t) +
+			sizeof(zbx_history_record_t) * (size_t)(values_num - 1))))
 	{
-		zbx_vc_chunk_t	*next;
+		return FAIL;
+	}
 
-		/* If chunk contains values with timestamp greater or equal - remove */
-		/* only the values with less timestamp. Otherwise remove the while   */
-		/* chunk and check next one.                                         */
-		if (chunk->slots[chunk->last_value].timestamp.sec >= timestamp)
-		{
-			while (chunk->slots[chunk->first_value].timestamp.sec < timestamp)
-			{
-				vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->first_value);
-				chunk->first_value++;
-			}
+	memset(chunk, 0, sizeof(zbx_vc_chunk_t));
+	chunk->slots_num = values_num;
+	chunk->first_value = 0;
+	chunk->last_value = values_num - 1;
+	vch_chunk_unpack_values(*pchunk, chunk->slots);
 
-			break;
-		}
+	vch_item_replace_chunk(item, *pchunk, chunk);
+	*pchunk = chunk;
 
-		next = chunk->next;
-		vch_item_remove_chunk(item, chunk);
-		chunk = next;
-	}
+	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: adds one item history value at the end of current item's history  *
- *          data                                                              *
- *                                                                            *
- * Parameters:  item   - [IN] the item to add history data to                 *
- *              value  - [IN] the item history data value                     *
+ * Purpose: find the index of the last value in chunk with timestamp less or  *
+ *          equal to the specified timestamp.                                 *
  *                                                                            *
- * Return value: SUCCEED - the history data value was added successfully      *
- *               FAIL - failed to add history data value (not enough memory)  *
+ * Parameters:  values - [IN] the chunk values                                *
+ *              last   - [IN] the index of the last chunk value               *
+ *              ts     - [IN] the target timestamp                            *
  *                                                                            *
- * Comments: In the case of failure the item will be removed from cache       *
- *           later.                                                           *
+ * Return value: The index of the last value in chunk with timestamp less or  *
+ *               equal to the specified timestamp.                            *
+ *               -1 is returned in the case of failure (meaning that all      *
+ *               values have timestamps greater than the target timestamp).   *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_add_value_at_head(zbx_vc_item_t *item, const zbx_history_record_t *value)
+static int	vch_chunk_find_last_value_before(const zbx_history_record_t *values, int last, const zbx_timespec_t *ts)
 {
-	int		ret = FAIL, index, sindex, nslots = 0;
-	zbx_vc_chunk_t	*chunk, *schunk;
+	int	start = 0, end = last, middle;
 
-	if (NULL != item->head &&
-			0 < zbx_history_record_compare_asc_func(&item->head->slots[item->head->last_value], value))
-	{
-		if (0 < zbx_history_record_compare_asc_func(&item->tail->slots[item->tail->first_value], value))
-		{
-			/* If the added value has the same or older timestamp as the first value in cache */
-			/* we can't add it to keep cache consistency. Additionally we must make sure no   */
-			/* values with matching timestamp seconds are kept in cache.                      */
-			vch_item_remove_values(item, value->timestamp.sec + 1);
+	/* check if the last value timestamp is already greater or equal to the specified timestamp */
+	if (0 >= zbx_timespec_compare(&values[end].timestamp, ts))
+		return end;
 
-			/* empty items must be removed to avoid situation when a new value is added to cache */
-			/* while other values with matching timestamp seconds are not cached                 */
-			if (NULL == item->head)
-				goto out;
+	/* chunk contains only one value, which did not pass the above check, return failure */
+	if (start == end)
+		return -1;
 
-			/* if the value is newer than the database cached from timestamp we must */
-			/* adjust the cached from timestamp to exclude this value                */
-			if (item->db_cached_from <= value->timestamp.sec)
-				item->db_cached_from = value->timestamp.sec + 1;
+	/* perform value lookup using binary search */
+	while (start != end)
+	{
+		middle = start + (end - start) / 2;
 
-			ret = SUCCEED;
-			goto out;
+		if (0 < zbx_timespec_compare(&values[middle].timestamp, ts))
+		{
+			end = middle;
+			continue;
 		}
 
-		sindex = item->head->last_value;
-		schunk = item->head;
-
-		if (0 == item->head->slots_num - item->head->last_value - 1)
+		if (0 >= zbx_timespec_compare(&values[middle + 1].timestamp, ts))
 		{
-			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
-				goto out;
+			start = middle;
+			continue;
 		}
-		else
-			item->head->last_value++;
 
-		item->values_total++;
-
-		chunk = item->head;
-		index = item->head->last_value;
+		return middle;
+	}
 
-		do
-		{
-			chunk->slots[index] = schunk->slots[sindex];
+	return -1;
+}
 
-			chunk = schunk;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: gets the chunk and index of the last value with a timestamp less  *
+ *          or equal to the specified timestamp                               *
+ *                                                                            *
+ * Parameters:  item          - [IN] the item                                 *
+ *              ts            - [IN] the target timestamp                     *
+ *                                   (NULL - current time)                    *
+ *              pchunk        - [OUT] the chunk containing the target value   *
+ *              pvalues       - [OUT] the chunk values                        *
+ *              pindex        - [OUT] the index of the target value in chunk  *
+ *                                    values                                  *
+ *                                                                            *
+ * Return value: SUCCEED - the last value was found successfully              *
+ *               FAIL - all values in cache have timestamps greater than the  *
+ *                      target (timeshift) timestamp.                         *
+ *                                                                            *
+ * Comments: If end_timestamp value is 0, then simply the last item value in  *
+ *           cache is returned.                                               *
+ *                                                                            *
+ *           See vch_chunk_get_values() for returned chunk values lifetime.   *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_get_last_value(const zbx_vc_item_t *item, const zbx_timespec_t *ts, zbx_vc_chunk_t **pchunk,
+		const zbx_history_record_t **pvalues, int *pindex)
+{
+	zbx_vc_chunk_t			*chunk = item->head;
+	const zbx_history_record_t	*values;
+	int				index;
+
+	if (NULL == chunk)
+		return FAIL;
+
+	if (0 < zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp, ts))
+	{
+		while (0 < zbx_timespec_compare(&chunk->slots[chunk->first_value].timestamp, ts))
+		{
+			chunk = chunk->prev;
+			/* there are no values for requested range, return failure */
+			if (NULL == chunk)
+				return FAIL;
+		}
+
+		values = vch_chunk_get_values(chunk, &index);
+		index = vch_chunk_find_last_value_before(values, index, ts);
+	}
+	else
+		values = vch_chunk_get_values(chunk, &index);
+
+	*pchunk = chunk;
+	*pvalues = values;
+	*pindex = index;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: copies value in the specified item's chunk slot                   *
+ *                                                                            *
+ * Parameters: chunk        - [IN/OUT] the target chunk                       *
+ *             index        - [IN] the target slot                            *
+ *             source_value - [IN] the value to copy                          *
+ *                                                                            *
+ * Return value: SUCCEED - the value was copied successfully                  *
+ *               FAIL    - the value copying failed (not enough space for     *
+ *                         string, text or log type data)                     *
+ *                                                                            *
+ * Comments: This function is used to copy data to cache. The contents of     *
+ *           str, text and log type values are stored in cache string pool.   *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_copy_value(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk, int index,
+		const zbx_history_record_t *source_value)
+{
+	zbx_history_record_t	*value;
+	int			ret = FAIL;
+
+	value = &chunk->slots[index];
+
+	switch (item->value_type)
+	{
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			if (NULL == (value->value.str = vc_item_strdup(item, source_value->value.str)))
+				goto out;
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			if (NULL == (value->value.log = vc_item_logdup(item, source_value->value.log)))
+				goto out;
+			break;
+		default:
+			value->value = source_value->value;
+	}
+	value->timestamp = source_value->timestamp;
+
+	ret = SUCCEED;
+out:
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: copies values at the beginning of item tail chunk                 *
+ *                                                                            *
+ * Parameters: item       - [IN/OUT] the target item                          *
+ *             values     - [IN] the values to copy                           *
+ *             values_num - [IN] the number of values to copy                 *
+ *                                                                            *
+ * Return value: SUCCEED - the values were copied successfully                *
+ *               FAIL    - the value copying failed (not enough space for     *
+ *                         string, text or log type data)                     *
+ *                                                                            *
+ * Comments: This function is used to copy data to cache. The contents of     *
+ *           str, text and log type values are stored in cache string pool.   *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_copy_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+{
+	int	i, ret = FAIL, first_value = item->tail->first_value;
+
+	switch (item->value_type)
+	{
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			for (i = values_num - 1; i >= 0; i--)
+			{
+				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
+
+				if (NULL == (value->value.str = vc_item_strdup(item, values[i].value.str)))
+					goto out;
+
+				value->timestamp = values[i].timestamp;
+				item->tail->first_value--;
+			}
+			ret = SUCCEED;
+
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			for (i = values_num - 1; i >= 0; i--)
+			{
+				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
+
+				if (NULL == (value->value.log = vc_item_logdup(item, values[i].value.log)))
+					goto out;
+
+				value->timestamp = values[i].timestamp;
+				item->tail->first_value--;
+			}
+			ret = SUCCEED;
+
+			break;
+		default:
+			memcpy(&item->tail->slots[item->tail->first_value - values_num], values,
+					(size_t)values_num * sizeof(zbx_history_record_t));
+			item->tail->first_value -= values_num;
+			ret = SUCCEED;
+	}
+out:
+	item->values_total += first_value - item->tail->first_value;
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees chunk and all resources allocated to store its values       *
+ *                                                                            *
+ * Parameters: item    - [IN] the chunk owner item                            *
+ *             chunk   - [IN] the chunk to free                               *
+ *                                                                            *
+ * Return value: the number of bytes freed                                    *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vch_item_free_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+{
+	size_t	freed;
+
+	freed = vch_chunk_size(chunk);
+
+	vc_item_remove_aggregates(item, chunk, -1);
+
+	/* compressed chunks are used only for numeric values, which have no resources to free */
+	if (0 != chunk->packed_num)
+		item->values_total -= chunk->packed_num;
+	else
+		freed += vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->last_value);
+
+	__vc_shmem_free_func(chunk);
+
+	return freed;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: removes item history data chunk                                   *
+ *                                                                            *
+ * Parameters: item    - [IN ] the chunk owner item                           *
+ *             chunk   - [IN] the chunk to remove                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_remove_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+{
+	if (NULL != chunk->next)
+		chunk->next->prev = chunk->prev;
+
+	if (NULL != chunk->prev)
+		chunk->prev->next = chunk->next;
+
+	if (chunk == item->head)
+		item->head = chunk->prev;
+
+	if (chunk == item->tail)
+		item->tail = chunk->next;
+
+	vch_item_free_chunk(item, chunk);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: removes item history data that are outside (older) the maximum    *
+ *          request range                                                     *
+ *                                                                            *
+ * Parameters:  item      - [IN] the target item                              *
+ *              timestamp - [IN] last timestamp in active range               *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_clean_cache(zbx_vc_item_t *item, int timestamp)
+{
+	zbx_vc_chunk_t	*next;
+
+	if (0 != item->active_range)
+	{
+		zbx_vc_chunk_t	*tail = item->tail;
+		zbx_vc_chunk_t	*chunk = tail;
+
+		timestamp -= item->active_range;
+
+		/* Try to remove chunks with all history values older than maximum request range, maximum */
+		/* request range should be calculated from last received value with which active range    */
+		/* was calculated to avoid dropping of chunks that might be still used in count request.  */
+		while (NULL != chunk && chunk->slots[chunk->last_value].timestamp.sec < timestamp &&
+				chunk->slots[chunk->last_value].timestamp.sec !=
+						item->head->slots[item->head->last_value].timestamp.sec)
+		{
+			/* don't remove the head chunk */
+			if (NULL == (next = chunk->next))
+				break;
+
+			/* Values with the same timestamps (seconds resolution) always should be either   */
+			/* kept in cache or removed together. There should not be a case when one of them */
+			/* is in cache and the second is dropped.                                         */
+			/* Here we are handling rare case, when the last value of first chunk has the     */
+			/* same timestamp (seconds resolution) as the first value in the second chunk.    */
+			/* In this case increase the first value index of the next chunk until the first  */
+			/* value timestamp is greater.                                                    */
+
+			if (next->slots[next->first_value].timestamp.sec != next->slots[next->last_value].timestamp.sec)
+			{
+				/* values can be removed only from uncompressed chunk, stop cleaning if it fails */
+				if (next->slots[next->first_value].timestamp.sec ==
+						chunk->slots[chunk->last_value].timestamp.sec &&
+						FAIL == vch_item_unpack_chunk(item, &next))
+				{
+					break;
+				}
+
+				while (next->slots[next->first_value].timestamp.sec ==
+						chunk->slots[chunk->last_value].timestamp.sec)
+				{
+					vc_item_free_values(item, next->slots, next->first_value, next->first_value);
+					next->first_value++;
+				}
+
+				vc_item_remove_aggregates(item, next, next->first_value);
+			}
+
+			/* set the database cached from timestamp to the last (oldest) removed value timestamp + 1 */
+			item->db_cached_from = chunk->slots[chunk->last_value].timestamp.sec + 1;
+
+			vch_item_remove_chunk(item, chunk);
+
+			chunk = next;
+		}
+
+		/* reset the status flags if data was removed from cache */
+		if (tail != item->tail)
+			item->status = 0;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: removes item history data that are older than the specified       *
+ *          timestamp                                                         *
+ *                                                                            *
+ * Parameters:  item      - [IN] the target item                              *
+ *              timestamp - [IN] the timestamp (number of seconds since the   *
+ *                               Epoch)                                       *
+ *                                                                            *
+ * Return value: SUCCEED - the values were removed                            *
+ *               FAIL    - failed to decompress chunk (not enough memory)     *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_remove_values(zbx_vc_item_t *item, int timestamp)
+{
+	zbx_vc_chunk_t	*chunk = item->tail;
+
+	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
+		item->status = 0;
+
+	/* try to remove chunks with all history values older than the timestamp */
+	while (NULL != chunk && chunk->slots[chunk->first_value].timestamp.sec < timestamp)
+	{
+		zbx_vc_chunk_t	*next;
+
+		/* If chunk contains values with timestamp greater or equal - remove */
+		/* only the values with less timestamp. Otherwise remove the while   */
+		/* chunk and check next one.                                         */
+		if (chunk->slots[chunk->last_value].timestamp.sec >= timestamp)
+		{
+			if (FAIL == vch_item_unpack_chunk(item, &chunk))
+				return FAIL;
+
+			while (chunk->slots[chunk->first_value].timestamp.sec < timestamp)
+			{
+				vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->first_value);
+				chunk->first_value++;
+			}
+
+			vc_item_remove_aggregates(item, chunk, chunk->first_value);
+
+			break;
+		}
+
+		next = chunk->next;
+		vch_item_remove_chunk(item, chunk);
+		chunk = next;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds one item history value at the end of current item's history  *
+ *          data                                                              *
+ *                                                                            *
+ * Parameters:  item   - [IN] the item to add history data to                 *
+ *              value  - [IN] the item history data value                     *
+ *                                                                            *
+ * Return value: SUCCEED - the history data value was added successfully      *
+ *               FAIL - failed to add history data value (not enough memory)  *
+ *                                                                            *
+ * Comments: In the case of failure the item will be removed from cache       *
+ *           later.                                                           *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_add_value_at_head(zbx_vc_item_t *item, const zbx_history_record_t *value)
+{
+	int		ret = FAIL, index, sindex, nslots = 0;
+	zbx_vc_chunk_t	*chunk, *schunk, *closed = NULL;
+
+	if (NULL != item->head &&
+			0 < zbx_history_record_compare_asc_func(&item->head->slots[item->head->last_value], value))
+	{
+		if (0 < zbx_history_record_compare_asc_func(&item->tail->slots[item->tail->first_value], value))
+		{
+			/* If the added value has the same or older timestamp as the first value in cache */
+			/* we can't add it to keep cache consistency. Additionally we must make sure no   */
+			/* values with matching timestamp seconds are kept in cache.                      */
+			if (FAIL == vch_item_remove_values(item, value->timestamp.sec + 1))
+				goto out;
+
+			/* empty items must be removed to avoid situation when a new value is added to cache */
+			/* while other values with matching timestamp seconds are not cached                 */
+			if (NULL == item->head)
+				goto out;
+
+			/* if the value is newer than the database cached from timestamp we must */
+			/* adjust the cached from timestamp to exclude this value                */
+			if (item->db_cached_from <= value->timestamp.sec)
+				item->db_cached_from = value->timestamp.sec + 1;
+
+			ret = SUCCEED;
+			goto out;
+		}
+
+		/* values are moved towards head in chunks newer than the added value, so those */
+		/* chunks must be uncompressed                                                  */
+		for (schunk = item->head; NULL != schunk; schunk = schunk->prev)
+		{
+			if (0 >= zbx_timespec_compare(&schunk->slots[schunk->last_value].timestamp, &value->timestamp))
+				break;
+
+			if (FAIL == vch_item_unpack_chunk(item, &schunk))
+				goto out;
+		}
+
+		sindex = item->head->last_value;
+		schunk = item->head;
+
+		if (0 == item->head->slots_num - item->head->last_value - 1)
+		{
+			closed = item->head;
+
+			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
+				goto out;
+		}
+		else
+			item->head->last_value++;
+
+		item->values_total++;
+
+		chunk = item->head;
+		index = item->head->last_value;
+
+		do
+		{
+			chunk->slots[index] = schunk->slots[sindex];
+
+			chunk = schunk;
 			index = sindex;
 
-			if (--sindex < schunk->first_value)
-			{
-				if (NULL == (schunk = schunk->prev))
-				{
-					memset(&chunk->slots[index], 0, sizeof(zbx_vc_chunk_t));
-					THIS_SHOULD_NEVER_HAPPEN;
+			if (--sindex < schunk->first_value)
+			{
+				if (NULL == (schunk = schunk->prev))
+				{
+					memset(&chunk->slots[index], 0, sizeof(zbx_vc_chunk_t));
+					THIS_SHOULD_NEVER_HAPPEN;
+
+					goto out;
+				}
+
+				sindex = schunk->last_value;
+			}
+		}
+		while (0 < zbx_timespec_compare(&schunk->slots[sindex].timestamp, &value->timestamp));
+	}
+	else
+	{
+		/* find the number of free slots on the right side in last (head) chunk */
+		if (NULL != item->head)
+			nslots = item->head->slots_num - item->head->last_value - 1;
+
+		if (0 == nslots)
+		{
+			closed = item->head;
+
+			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
+				goto out;
+		}
+		else
+			item->head->last_value++;
+
+		item->values_total++;
+
+		chunk = item->head;
+		index = item->head->last_value;
+	}
+
+	if (SUCCEED != vch_item_copy_value(item, chunk, index, value))
+		goto out;
+
+	/* compress closed chunks - the previous head chunk after adding a new head chunk and */
+	/* the chunks decompressed to move values when inserting value before the last value  */
+	for (chunk = item->head->prev; NULL != chunk; chunk = schunk)
+	{
+		schunk = chunk->prev;
+
+		if (chunk != closed && 0 > zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp,
+				&value->timestamp))
+		{
+			break;
+		}
+
+		vch_item_pack_chunk(item, chunk);
+	}
+
+	ret = SUCCEED;
+out:
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds item history values at the beginning of current item's       *
+ *          history data                                                      *
+ *                                                                            *
+ * Parameters:  item   - [IN] the item to add history data to                 *
+ *              values - [IN] the item history data values                    *
+ *              num    - [IN] the number of history data values to add        *
+ *                                                                            *
+ * Return value: SUCCEED - the history data values were added successfully    *
+ *               FAIL - failed to add history data values (not enough memory) *
+ *                                                                            *
+ * Comments: In the case of failure the item is removed from cache.           *
+ *           Overlapping values (by timestamp seconds) are ignored.           *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_add_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+{
+	int 	count = values_num, ret = FAIL;
+
+	/* skip values already added to the item cache by another process */
+	if (NULL != item->tail)
+	{
+		int	sec = item->tail->slots[item->tail->first_value].timestamp.sec;
+
+		while (--count >= 0 && values[count].timestamp.sec >= sec)
+			;
+		++count;
+	}
+
+	while (0 != count)
+	{
+		int	copy_slots, nslots = 0;
+
+		/* find the number of free slots on the left side in first (tail) chunk */
+		if (NULL != item->tail)
+			nslots = item->tail->first_value;
+
+		if (0 == nslots)
+		{
+			nslots = vch_item_chunk_slot_count(item, count);
+
+			if (FAIL == vch_item_add_chunk(item, nslots, item->tail))
+				goto out;
+
+			item->tail->last_value = nslots - 1;
+			item->tail->first_value = nslots;
+		}
+
+		/* copy values to chunk */
+		copy_slots = MIN(nslots, count);
+		count -= copy_slots;
+
+		if (FAIL == vch_item_copy_values_at_tail(item, values + count, copy_slots))
+			goto out;
+
+		/* full tail chunk is closed unless it's also the head chunk */
+		if (0 == item->tail->first_value && item->tail != item->head)
+			vch_item_pack_chunk(item, item->tail);
+	}
+
+	ret = SUCCEED;
+out:
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: cache item history data for the specified time period             *
+ *                                                                            *
+ * Parameters: item        - [IN] the item                                    *
+ *             range_start - [IN] the interval start time                     *
+ *                                                                            *
+ * Return value:  >=0    - the number of values read from database            *
+ *                FAIL   - an error occurred while trying to cache values     *
+ *                                                                            *
+ * Comments: This function checks if the requested value range is cached and  *
+ *           updates cache from database if necessary.                        *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_cache_values_by_time(zbx_vc_item_t **item, int range_start)
+{
+	int				ret, range_end;
+	zbx_vector_history_record_t	records;
+	zbx_uint64_t			itemid;
+	unsigned char			value_type;
+
+	if (ZBX_ITEM_STATUS_CACHED_ALL == (*item)->status)
+		return SUCCEED;
+
+	/* check if the requested period is in the cached range */
+	if (0 != (*item)->db_cached_from && range_start >= (*item)->db_cached_from)
+		return SUCCEED;
+
+	/* find if the cache should be updated to cover the required range */
+	if (NULL != (*item)->tail)
+	{
+		/* we need to get item values before the first cached value, but not including it */
+		range_end = (*item)->tail->slots[(*item)->tail->first_value].timestamp.sec - 1;
+	}
+	else
+		range_end = ZBX_JAN_2038;
+
+	/* update cache if necessary */
+	if (range_start >= range_end)
+		return SUCCEED;
+
+	zbx_vector_history_record_create(&records);
+	itemid = (*item)->itemid;
+	value_type = (*item)->value_type;
+
+	vc_unlock();
+
+	if (SUCCEED == (ret = vc_db_read_values_by_time(itemid, value_type, &records, range_start, range_end)))
+	{
+		zbx_vector_history_record_sort(&records,
+				(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+	}
+
+	vc_lock_cache();
+
+	if (SUCCEED != ret)
+		goto out;
+
+	if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
+	{
+		zbx_vc_item_t	new_item = {.itemid = itemid, .value_type = value_type};
+
+		if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item,
+				sizeof(new_item))))
+		{
+			ret = FAIL;
+			goto out;
+		}
+	}
+
+	/* when updating cache with time based request we can always reset status flags */
+	/* flag even if the requested period contains no data                           */
+	(*item)->status = 0;
+
+	if (0 < records.values_num)
+	{
+		if (SUCCEED != (ret = vch_item_add_values_at_tail(*item, records.values, records.values_num)))
+			goto out;
+	}
+
+	ret = records.values_num;
+	vc_item_update_db_cached_from(*item, range_start);
+out:
+	zbx_history_record_vector_destroy(&records, value_type);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: cache the specified number of history data values for time period *
+ *          since timestamp                                                   *
+ *                                                                            *
+ * Parameters: item        - [IN] the item                                    *
+ *             range_start - [IN] the interval start time                     *
+ *             count       - [IN] the number of history values to retrieve    *
+ *             ts          - [IN] the target timestamp                        *
+ *                                                                            *
+ * Return value:  >=0    - the number of values read from database            *
+ *                FAIL   - an error occurred while trying to cache values     *
+ *                                                                            *
+ * Comments: This function checks if the requested number of values is cached *
+ *           and updates cache from database if necessary.                    *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_cache_values_by_time_and_count(zbx_vc_item_t **item, int range_start, int count,
+		const zbx_timespec_t *ts)
+{
+	int				ret = SUCCEED, cached_records = 0, range_end, records_offset;
+	zbx_vector_history_record_t	records;
+	zbx_uint64_t			itemid;
+	unsigned char			value_type;
+
+	if (ZBX_ITEM_STATUS_CACHED_ALL == (*item)->status)
+		return SUCCEED;
+
+	/* check if the requested period is in the cached range */
+	if (0 != (*item)->db_cached_from && range_start >= (*item)->db_cached_from)
+		return SUCCEED;
+
+	/* find if the cache should be updated to cover the required count */
+	if (NULL != (*item)->head)
+	{
+		zbx_vc_chunk_t			*chunk;
+		const zbx_history_record_t	*slots;
+		int				index;
+
+		if (SUCCEED == vch_item_get_last_value(*item, ts, &chunk, &slots, &index))
+		{
+			cached_records = index + 1;
+
+			while (NULL != (chunk = chunk->prev) && cached_records < count)
+				cached_records += vch_chunk_values_num(chunk);
+		}
+	}
+
+	/* update cache if necessary */
+	if (cached_records >= count)
+		return SUCCEED;
+
+	/* get the end timestamp to which (including) the values should be cached */
+	if (NULL != (*item)->head)
+		range_end = (*item)->tail->slots[(*item)->tail->first_value].timestamp.sec - 1;
+	else
+		range_end = ZBX_JAN_2038;
+
+	itemid = (*item)->itemid;
+	value_type = (*item)->value_type;
+	vc_unlock();
+
+	zbx_vector_history_record_create(&records);
+
+	if (range_end > ts->sec)
+	{
+		ret = vc_db_read_values_by_time(itemid, value_type, &records, ts->sec + 1, range_end);
+		range_end = ts->sec;
+	}
+
+	records_offset = records.values_num;
+
+	if (SUCCEED == ret && SUCCEED == (ret = vc_db_read_values_by_time_and_count(itemid, value_type, &records,
+			range_start, count - cached_records, range_end, ts)))
+	{
+		zbx_vector_history_record_sort(&records,
+				(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+	}
+
+	vc_lock_cache();
+
+	if (SUCCEED != ret)
+		goto out;
+
+	if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
+	{
+		zbx_vc_item_t	new_item = {.itemid = itemid, .value_type = value_type};
+
+		if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item, sizeof(new_item))))
+		{
+			ret = FAIL;
+			goto out;
+		}
+	}
+
+	if (0 < records.values_num)
+		ret = vch_item_add_values_at_tail(*item, records.values, records.values_num);
+
+	if (SUCCEED != ret)
+		goto out;
+
+	ret = records.values_num;
+
+	if (0 == range_start && count - cached_records > records.values_num - records_offset)
+	{
+		(*item)->active_range = 0;
+		(*item)->daily_range = 0;
+		(*item)->status = ZBX_ITEM_STATUS_CACHED_ALL;
+	}
+
+	if ((count <= records.values_num || 0 == range_start) && 0 != records.values_num)
+	{
+		vc_item_update_db_cached_from(*item,
+				(*item)->tail->slots[(*item)->tail->first_value].timestamp.sec);
+	}
+	else if (0 != range_start)
+		vc_item_update_db_cached_from(*item, range_start);
+
+out:
+	zbx_history_record_vector_destroy(&records, value_type);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: retrieves item history data from cache                            *
+ *                                                                            *
+ * Parameters: item      - [IN] the item                                      *
+ *             values    - [OUT] the item history data stored time/value      *
+ *                         pairs in undefined order                           *
+ *             seconds   - [IN] the time period to retrieve data for          *
+ *             ts        - [IN] the requested period end timestamp            *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_get_values_by_time(const zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
+		const zbx_timespec_t *ts)
+{
+	int				index, now;
+	zbx_timespec_t			start = {ts->sec - seconds, ts->ns};
+	zbx_vc_chunk_t			*chunk;
+	const zbx_history_record_t	*slots;
+
+	/* Check if maximum request range is not set and all data are cached.  */
+	/* Because that indicates there was a count based request with unknown */
+	/* range which might be greater than the current request range.        */
+	if (0 != item->active_range || ZBX_ITEM_STATUS_CACHED_ALL != item->status)
+	{
+		now = (int)time(NULL);
+		/* add another second to include nanosecond shifts */
+		vc_cache_item_update(item->itemid, ZBX_VC_UPDATE_RANGE, seconds + now - ts->sec + 1, now);
+	}
+
+	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &slots, &index))
+	{
+		/* Cache does not contain records for the specified timeshift & seconds range. */
+		/* Return empty vector with success.                                           */
+		return;
+	}
+
+	/* fill the values vector with item history values until the start timestamp is reached, */
+	/* chunk values are decoded only for chunks with values in the requested period          */
+	while (0 < zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp, &start))
+	{
+		while (index >= 0 && 0 < zbx_timespec_compare(&slots[index].timestamp, &start))
+			vc_history_record_vector_append(values, item->value_type, &slots[index--]);
+
+		if (NULL == (chunk = chunk->prev))
+			break;
+
+		slots = vch_chunk_get_values(chunk, &index);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: retrieves item history data from cache                            *
+ *                                                                            *
+ * Parameters: item      - [IN] the item                                      *
+ *             values    - [OUT] the item history data stored time/value      *
+ *                         pairs in undefined order, optional                 *
+ *                         If null then cache is updated if necessary, but no *
+ *                         values are returned. Used to ensure that cache     *
+ *                         contains a value of the specified timestamp.       *
+ *             seconds   - [IN] the time period                               *
+ *             count     - [IN] the number of history values to retrieve      *
+ *             timestamp - [IN] the target timestamp                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_get_values_by_time_and_count(zbx_vc_item_t *item, zbx_vector_history_record_t *values,
+		int seconds, int count, const zbx_timespec_t *ts)
+{
+	int				index, now, range_timestamp;
+	zbx_vc_chunk_t			*chunk;
+	const zbx_history_record_t	*slots;
+	zbx_timespec_t			start;
+
+	/* set start timestamp of the requested time period */
+	if (0 != seconds)
+	{
+		start.sec = ts->sec - seconds;
+		start.ns = ts->ns;
+	}
+	else
+	{
+		start.sec = 0;
+		start.ns = 0;
+	}
+
+	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &slots, &index))
+	{
+		/* return empty vector with success */
+		goto out;
+	}
+
+	/* fill the values vector with item history values until the <count> values are read    */
+	/* or no more values within specified time period                                       */
+	/* fill the values vector with item history values until the start timestamp is reached */
+	while (0 < zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp, &start))
+	{
+		while (index >= 0 && 0 < zbx_timespec_compare(&slots[index].timestamp, &start))
+		{
+			vc_history_record_vector_append(values, item->value_type, &slots[index--]);
+
+			if (values->values_num == count)
+				goto out;
+		}
+
+		if (NULL == (chunk = chunk->prev))
+			break;
+
+		slots = vch_chunk_get_values(chunk, &index);
+	}
+out:
+	if (count > values->values_num)
+	{
+		if (0 == seconds)
+			return;
+
+		/* not enough data in the requested period, set the range equal to the period plus */
+		/* one second to include nanosecond shifts                                         */
+		range_timestamp = ts->sec - seconds;
+	}
+	else
+	{
+		/* the requested number of values was retrieved, set the range to the oldest value timestamp */
+		range_timestamp = values->values[values->values_num - 1].timestamp.sec - 1;
+	}
+
+	now = (int)time(NULL);
+	vc_cache_item_update(item->itemid, ZBX_VC_UPDATE_RANGE, now - range_timestamp, now);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get item values for the specified range                           *
+ *                                                                            *
+ * Parameters: item      - [IN] the item                                      *
+ *             values    - [OUT] the item history data stored time/value      *
+ *                         pairs in undefined order, optional                 *
+ *                         If null then cache is updated if necessary, but no *
+ *                         values are returned. Used to ensure that cache     *
+ *                         contains a value of the specified timestamp.       *
+ *             seconds   - [IN] the time period to retrieve data for          *
+ *             count     - [IN] the number of history values to retrieve      *
+ *             ts        - [IN] the target timestamp                          *
+ *                                                                            *
+ * Return value:  SUCCEED - the item history data was retrieved successfully  *
+ *                FAIL    - the item history data was not retrieved           *
+ *                                                                            *
+ * Comments: This function returns data from cache if necessary updating it   *
+ *           from DB. If cache update was required and failed (not enough     *
+ *           memory to cache DB values), then this function also fails.       *
+ *                                                                            *
+ *           If <count> is set then value range is defined as <count> values  *
+ *           before <timestamp>. Otherwise the range is defined as <seconds>  *
+ *           seconds before <timestamp>.                                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_get_values(zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
+		int count, const zbx_timespec_t *ts)
+{
+	int	ret, records_read, hits, misses, range_start;
+
+	zbx_vector_history_record_clear(values);
+
+	if (0 == count)
+	{
+		if (0 > (range_start = ts->sec - seconds))
+			range_start = 0;
+
+		if (FAIL == (ret = vch_item_cache_values_by_time(&item, range_start)))
+			goto out;
+
+		records_read = ret;
+
+		vch_item_get_values_by_time(item, values, seconds, ts);
+
+		if (records_read > values->values_num)
+			records_read = values->values_num;
+	}
+	else
+	{
+		range_start = (0 == seconds ? 0 : ts->sec - seconds);
+
+		if (FAIL == (ret = vch_item_cache_values_by_time_and_count(&item, range_start, count, ts)))
+			goto out;
+
+		records_read = ret;
+
+		vch_item_get_values_by_time_and_count(item, values, seconds, count, ts);
+
+		if (records_read > values->values_num)
+			records_read = values->values_num;
+	}
+
+	hits = values->values_num - records_read;
+	misses = records_read;
+
+	vc_cache_item_update(item->itemid, ZBX_VC_UPDATE_STATS, hits, misses);
+
+	ret = SUCCEED;
+out:
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees resources allocated for item history data                   *
+ *                                                                            *
+ * Parameters: item    - [IN] the item                                        *
+ *                                                                            *
+ * Return value: the size of freed memory (bytes)                             *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vch_item_free_cache(zbx_vc_item_t *item)
+{
+	size_t	freed = 0;
+
+	zbx_vc_chunk_t	*chunk = item->tail;
+
+	while (NULL != chunk)
+	{
+		zbx_vc_chunk_t	*next = chunk->next;
+
+		freed += vch_item_free_chunk(item, chunk);
+		chunk = next;
+	}
+	item->values_total = 0;
+	item->head = NULL;
+	item->tail = NULL;
+
+	freed += vc_item_free_aggregates(item);
+
+	return freed;
+}
+
+/******************************************************************************************************************
+ *                                                                                                                *
+ * Aggregate API                                                                                                  *
+ *                                                                                                                *
+ ******************************************************************************************************************/
+/*
+ * Numeric items can keep running aggregates (sum, minimum, maximum, number of
+ * values) of sliding windows, defined either by number of seconds or by number
+ * of values. An aggregate is created after the first request of its window and
+ * is updated whenever a new value is added to cache, so aggregate functions do
+ * not have to copy and iterate all window values on every evaluation.
+ *
+ * Window values are not copied - the aggregate keeps a cursor pointing to the
+ * oldest window value in item history data chunks and two monotonic deques of
+ * the minimum and maximum candidates. The aggregate window ends with the last
+ * item value. Requests ending later skip the oldest values that fall out of
+ * the requested period, requests ending before the last item value must be
+ * served by reading values from cache.
+ *
+ * Floating point sum is compensated (Kahan-Babuska summation), so rounding
+ * errors of the values added and removed over time do not accumulate.
+ */
+
+#define VC_DEQUE_ELEM(deque, index)	(&(deque)->elems[((deque)->first + (index)) % (deque)->elems_alloc])
+
+/* deque orders */
+#define VC_DEQUE_MIN	1
+#define VC_DEQUE_MAX	-1
+
+static int	vc_value_compare(unsigned char value_type, const zbx_history_value_t *v1, const zbx_history_value_t *v2)
+{
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+	{
+		ZBX_RETURN_IF_NOT_EQUAL(v1->dbl, v2->dbl);
+	}
+	else
+	{
+		ZBX_RETURN_IF_NOT_EQUAL(v1->ui64, v2->ui64);
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds value to compensated floating point sum                      *
+ *                                                                            *
+ * Parameters: sum   - [IN/OUT] the sum                                       *
+ *             comp  - [IN/OUT] the compensation of lost low-order bits       *
+ *             value - [IN] the value to add                                  *
+ *                                                                            *
+ * Comments: The compensated sum is sum + comp.                               *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_sum_add(double *sum, double *comp, double value)
+{
+	double	total = *sum + value;
+
+	if (fabs(*sum) >= fabs(value))
+		*comp += (*sum - total) + value;
+	else
+		*comp += (value - total) + *sum;
+
+	*sum = total;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: positions cursor at the specified chunk value                     *
+ *                                                                            *
+ * Parameters: cursor - [OUT] the cursor                                      *
+ *             chunk  - [IN] the chunk                                        *
+ *             pos    - [IN] the value number, starting with the first        *
+ *                           (oldest) chunk value                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_cursor_set(zbx_vc_cursor_t *cursor, zbx_vc_chunk_t *chunk, int pos)
+{
+	const unsigned char	*data;
+	int			i;
+
+	cursor->chunk = chunk;
+
+	if (0 == chunk->packed_num)
+	{
+		cursor->index = chunk->first_value + pos;
+		cursor->record = chunk->slots[cursor->index];
+		return;
+	}
+
+	data = (const unsigned char *)&chunk->slots[ZBX_VC_PACKED_SLOTS];
+	cursor->offset = 0;
+
+	for (i = 0; i <= pos; i++)
+		vc_unpack_value(data, &cursor->offset, &cursor->state, &cursor->record, 0 == i);
+
+	cursor->index = pos;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns the cursor value number in chunk                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_cursor_pos(const zbx_vc_cursor_t *cursor)
+{
+	if (0 == cursor->chunk->packed_num)
+		return cursor->index - cursor->chunk->first_value;
+
+	return cursor->index;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: moves cursor to the next (newer) value                            *
+ *                                                                            *
+ * Return value: SUCCEED - the cursor was moved                               *
+ *               FAIL    - the cursor is at the last item value               *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_cursor_next(zbx_vc_cursor_t *cursor)
+{
+	zbx_vc_chunk_t	*chunk = cursor->chunk;
+
+	if (0 == chunk->packed_num)
+	{
+		if (cursor->index < chunk->last_value)
+		{
+			cursor->record = chunk->slots[++cursor->index];
+			return SUCCEED;
+		}
+	}
+	else if (cursor->index < chunk->packed_num - 1)
+	{
+		vc_unpack_value((const unsigned char *)&chunk->slots[ZBX_VC_PACKED_SLOTS], &cursor->offset,
+				&cursor->state, &cursor->record, 0);
+		cursor->index++;
+		return SUCCEED;
+	}
+
+	if (NULL == chunk->next)
+		return FAIL;
+
+	vc_cursor_set(cursor, chunk->next, 0);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: doubles the deque buffer size                                     *
+ *                                                                            *
+ * Return value: SUCCEED - the buffer was resized                             *
+ *               FAIL    - not enough memory                                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_deque_reserve(zbx_vc_item_t *item, zbx_vc_deque_t *deque)
+{
+	zbx_vc_deque_elem_t	*elems;
+	int			i, elems_alloc;
+
+	elems_alloc = (0 == deque->elems_alloc ? ZBX_VC_DEQUE_INIT_SIZE : deque->elems_alloc * 2);
+
+	if (NULL == (elems = (zbx_vc_deque_elem_t *)vc_item_malloc(item,
+			sizeof(zbx_vc_deque_elem_t) * (size_t)elems_alloc)))
+	{
+		return FAIL;
+	}
+
+	for (i = 0; i < deque->num; i++)
+		elems[i] = *VC_DEQUE_ELEM(deque, i);
+
+	if (NULL != deque->elems)
+		__vc_shmem_free_func(deque->elems);
+
+	deque->elems = elems;
+	deque->elems_alloc = elems_alloc;
+	deque->first = 0;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds value at the back of monotonic deque                         *
+ *                                                                            *
+ * Parameters: item  - [IN] the aggregate owner item                          *
+ *             deque - [IN/OUT] the deque                                     *
+ *             value - [IN] the value                                         *
+ *             seq   - [IN] the value sequence number                         *
+ *             order - [IN] the deque order (VC_DEQUE_MIN/MAX)                *
+ *                                                                            *
+ * Return value: SUCCEED - the value was added                                *
+ *               FAIL    - not enough memory                                  *
+ *                                                                            *
+ * Comments: Older values that cannot become the window minimum (maximum)     *
+ *           any more are removed from deque.                                 *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_deque_push(zbx_vc_item_t *item, zbx_vc_deque_t *deque, const zbx_history_value_t *value,
+		zbx_uint32_t seq, int order)
+{
+	zbx_vc_deque_elem_t	*elem;
+
+	while (0 != deque->num && 0 <= order * vc_value_compare(item->value_type,
+			&VC_DEQUE_ELEM(deque, deque->num - 1)->value, value))
+	{
+		deque->num--;
+	}
+
+	if (deque->num == deque->elems_alloc && SUCCEED != vc_deque_reserve(item, deque))
+		return FAIL;
+
+	elem = VC_DEQUE_ELEM(deque, deque->num++);
+	elem->value = *value;
+	elem->seq = seq;
+
+	return SUCCEED;
+}
+
+static void	vc_deque_remove_value(zbx_vc_deque_t *deque, zbx_uint32_t seq)
+{
+	if (0 != deque->num && seq == deque->elems[deque->first].seq)
+	{
+		deque->first = (deque->first + 1) % deque->elems_alloc;
+		deque->num--;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns the first deque value within the requested period         *
+ *                                                                            *
+ * Parameters: aggr  - [IN] the aggregate                                     *
+ *             deque - [IN] the deque                                         *
+ *             skip  - [IN] the number of the oldest window values outside    *
+ *                          the requested period                              *
+ *                                                                            *
+ * Return value: the value or NULL if there are no values                     *
+ *                                                                            *
+ ******************************************************************************/
+static const zbx_history_value_t	*vc_deque_get_value(const zbx_vc_aggregate_t *aggr,
+		const zbx_vc_deque_t *deque, int skip)
+{
+	int	i;
+
+	for (i = 0; i < deque->num; i++)
+	{
+		const zbx_vc_deque_elem_t	*elem = VC_DEQUE_ELEM(deque, i);
+
+		if ((zbx_uint32_t)skip <= elem->seq - aggr->first_seq)
+			return &elem->value;
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: removes the oldest value from aggregate window                    *
+ *                                                                            *
+ * Comments: The window always ends with the last item value, so it's never   *
+ *           emptied and the cursor can be moved to the next value.           *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_aggregate_remove_value(zbx_vc_aggregate_t *aggr, unsigned char value_type)
+{
+	const zbx_history_value_t	*value = &aggr->first.record.value;
+
+	vc_deque_remove_value(&aggr->min, aggr->first_seq);
+	vc_deque_remove_value(&aggr->max, aggr->first_seq);
+
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+	{
+		vc_sum_add(&aggr->sum_dbl, &aggr->sum_comp, -value->dbl);
+	}
+	else
+	{
+		aggr->sum_ui64 -= value->ui64;
+		vc_sum_add(&aggr->sum_dbl, &aggr->sum_comp, -(double)value->ui64);
+	}
+
+	aggr->first_seq++;
+	aggr->values_num--;
+
+	vc_cursor_next(&aggr->first);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds new value to aggregate window                                *
+ *                                                                            *
+ * Parameters: item   - [IN] the aggregate owner item                         *
+ *             aggr   - [IN/OUT] the aggregate                                *
+ *             record - [IN] the value to add, it must be the item value      *
+ *                           following the last window value                  *
+ *                                                                            *
+ * Return value: SUCCEED - the value was added                                *
+ *               FAIL    - not enough memory                                  *
+ *                                                                            *
+ * Comments: Values falling out of the window are removed.                    *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_aggregate_add_value(zbx_vc_item_t *item, zbx_vc_aggregate_t *aggr, const zbx_history_record_t *record)
+{
+	zbx_uint32_t	seq = aggr->first_seq + (zbx_uint32_t)aggr->values_num;
+
+	if (SUCCEED != vc_deque_push(item, &aggr->min, &record->value, seq, VC_DEQUE_MIN) ||
+			SUCCEED != vc_deque_push(item, &aggr->max, &record->value, seq, VC_DEQUE_MAX))
+	{
+		return FAIL;
+	}
+
+	aggr->values_num++;
+
+	if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+	{
+		vc_sum_add(&aggr->sum_dbl, &aggr->sum_comp, record->value.dbl);
+	}
+	else
+	{
+		aggr->sum_ui64 += record->value.ui64;
+		vc_sum_add(&aggr->sum_dbl, &aggr->sum_comp, (double)record->value.ui64);
+	}
+
+	if (0 != aggr->count)
+	{
+		while (aggr->values_num > aggr->count)
+			vc_aggregate_remove_value(aggr, item->value_type);
+	}
+	else
+	{
+		zbx_timespec_t	start = {record->timestamp.sec - aggr->seconds, record->timestamp.ns};
+
+		while (0 >= zbx_timespec_compare(&aggr->first.record.timestamp, &start))
+			vc_aggregate_remove_value(aggr, item->value_type);
+	}
+
+	return SUCCEED;
+}
+
+static size_t	vc_aggregate_free(zbx_vc_aggregate_t *aggr)
+{
+	size_t	freed;
+
+	freed = sizeof(zbx_vc_aggregate_t) +
+			sizeof(zbx_vc_deque_elem_t) * (size_t)(aggr->min.elems_alloc + aggr->max.elems_alloc);
+
+	if (NULL != aggr->min.elems)
+		__vc_shmem_free_func(aggr->min.elems);
+
+	if (NULL != aggr->max.elems)
+		__vc_shmem_free_func(aggr->max.elems);
+
+	__vc_shmem_free_func(aggr);
+
+	return freed;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees all item aggregates                                         *
+ *                                                                            *
+ * Return value: the number of bytes freed                                    *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vc_item_free_aggregates(zbx_vc_item_t *item)
+{
+	size_t	freed = 0;
+
+	while (NULL != item->aggregates)
+	{
+		zbx_vc_aggregate_t	*aggr = item->aggregates;
+
+		item->aggregates = aggr->next;
+		freed += vc_aggregate_free(aggr);
+	}
+
+	return freed;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: moves cursors of item aggregates to the chunk replacing the chunk *
+ *          with the oldest window value                                      *
+ *                                                                            *
+ * Parameters: item  - [IN/OUT] the item                                      *
+ *             chunk - [IN] the replaced chunk                                *
+ *             dst   - [IN] the chunk with the same values                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_item_move_aggregates(zbx_vc_item_t *item, const zbx_vc_chunk_t *chunk, zbx_vc_chunk_t *dst)
+{
+	zbx_vc_aggregate_t	*aggr;
+
+	for (aggr = item->aggregates; NULL != aggr; aggr = aggr->next)
+	{
+		if (aggr->first.chunk == chunk)
+			vc_cursor_set(&aggr->first, dst, vc_cursor_pos(&aggr->first));
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: removes item aggregates with the oldest window value removed from *
+ *          cache                                                             *
+ *                                                                            *
+ * Parameters: item        - [IN/OUT] the item                                *
+ *             chunk       - [IN] the chunk values were removed from          *
+ *             first_value - [IN] the index of the first value left in        *
+ *                                uncompressed chunk or -1 if the whole chunk *
+ *                                is removed                                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_item_remove_aggregates(zbx_vc_item_t *item, const zbx_vc_chunk_t *chunk, int first_value)
+{
+	zbx_vc_aggregate_t	*aggr, **paggr = &item->aggregates;
+
+	while (NULL != (aggr = *paggr))
+	{
+		if (aggr->first.chunk == chunk && (-1 == first_value || aggr->first.index < first_value))
+		{
+			*paggr = aggr->next;
+			vc_aggregate_free(aggr);
+			continue;
+		}
+
+		paggr = &aggr->next;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds new item value to item aggregates                            *
+ *                                                                            *
+ * Parameters: item   - [IN/OUT] the item                                     *
+ *             record - [IN] the value added at the end of item history       *
+ *             now    - [IN] the current timestamp                            *
+ *                                                                            *
+ * Comments: Expired aggregates and aggregates failed to add value to are     *
+ *           removed.                                                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_item_update_aggregates(zbx_vc_item_t *item, const zbx_history_record_t *record, int now)
+{
+	zbx_vc_aggregate_t	*aggr, **paggr = &item->aggregates;
+
+	while (NULL != (aggr = *paggr))
+	{
+		if (ZBX_VC_AGGREGATE_EXPIRE_PERIOD < now - aggr->last_accessed ||
+				SUCCEED != vc_aggregate_add_value(item, aggr, record))
+		{
+			*paggr = aggr->next;
+			vc_aggregate_free(aggr);
+			continue;
+		}
+
+		paggr = &aggr->next;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: creates item aggregate from cached values                         *
+ *                                                                            *
+ * Parameters: item    - [IN/OUT] the item                                    *
+ *             seconds - [IN] the window size in seconds                      *
+ *             count   - [IN] the window size in number of values             *
+ *             now     - [IN] the current timestamp                           *
+ *                                                                            *
+ * Comments: Aggregate is created only if all window values are cached.       *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_item_create_aggregate(zbx_vc_item_t *item, int seconds, int count, int now)
+{
+	zbx_vc_chunk_t		*chunk;
+	zbx_vc_aggregate_t	*aggr;
+	zbx_vc_cursor_t		cursor;
+	int			pos, values_num = 0;
+
+	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
+		return;
+
+	if (NULL == (chunk = item->head))
+		return;
+
+	/* find the oldest window value */
+	if (0 != seconds)
+	{
+		zbx_timespec_t	start = {chunk->slots[chunk->last_value].timestamp.sec - seconds,
+				chunk->slots[chunk->last_value].timestamp.ns};
+
+		if (ZBX_ITEM_STATUS_CACHED_ALL != item->status &&
+				(0 == item->db_cached_from || start.sec < item->db_cached_from))
+		{
+			return;
+		}
+
+		while (0 < zbx_timespec_compare(&chunk->slots[chunk->first_value].timestamp, &start) &&
+				NULL != chunk->prev)
+		{
+			chunk = chunk->prev;
+		}
+
+		if (0 < zbx_timespec_compare(&chunk->slots[chunk->first_value].timestamp, &start))
+		{
+			/* all cached values are in the window */
+			pos = 0;
+		}
+		else
+		{
+			const zbx_history_record_t	*values;
+			int				last;
+
+			values = vch_chunk_get_values(chunk, &last);
+
+			if (last < (pos = vch_chunk_find_last_value_before(values, last, &start) + 1))
+			{
+				chunk = chunk->next;
+				pos = 0;
+			}
+		}
+	}
+	else
+	{
+		while (values_num + vch_chunk_values_num(chunk) < count && NULL != chunk->prev)
+		{
+			values_num += vch_chunk_values_num(chunk);
+			chunk = chunk->prev;
+		}
+
+		if (values_num + vch_chunk_values_num(chunk) < count)
+		{
+			/* fewer values than requested are cached */
+			if (ZBX_ITEM_STATUS_CACHED_ALL != item->status)
+				return;
+
+			pos = 0;
+		}
+		else
+			pos = vch_chunk_values_num(chunk) - (count - values_num);
+	}
+
+	if (NULL == (aggr = (zbx_vc_aggregate_t *)vc_item_malloc(item, sizeof(zbx_vc_aggregate_t))))
+		return;
+
+	memset(aggr, 0, sizeof(zbx_vc_aggregate_t));
+
+	aggr->seconds = seconds;
+	aggr->count = count;
+	aggr->last_accessed = now;
+
+	vc_cursor_set(&aggr->first, chunk, pos);
+	cursor = aggr->first;
+
+	do
+	{
+		/* the window is already limited, adding values cannot remove older values */
+		if (SUCCEED != vc_aggregate_add_value(item, aggr, &cursor.record))
+		{
+			vc_aggregate_free(aggr);
+			return;
+		}
+	}
+	while (SUCCEED == vc_cursor_next(&cursor));
+
+	aggr->next = item->aggregates;
+	item->aggregates = aggr;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: marks item aggregate as used, creating it if necessary            *
+ *                                                                            *
+ * Parameters: item    - [IN/OUT] the item                                    *
+ *             seconds - [IN] the window size in seconds                      *
+ *             count   - [IN] the window size in number of values             *
+ *             now     - [IN] the current timestamp                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_item_touch_aggregate(zbx_vc_item_t *item, int seconds, int count, int now)
+{
+	zbx_vc_aggregate_t	*aggr;
+	int			aggregates_num = 0;
+
+	for (aggr = item->aggregates; NULL != aggr; aggr = aggr->next)
+	{
+		if (aggr->seconds == seconds && aggr->count == count)
+		{
+			aggr->last_accessed = now;
+			return;
+		}
+
+		aggregates_num++;
+	}
+
+	if (ZBX_VC_MODE_NORMAL != vc_cache->mode || ZBX_VC_AGGREGATES_MAX <= aggregates_num)
+		return;
+
+	vc_item_create_aggregate(item, seconds, count, now);
+}
+
+/******************************************************************************************************************
+ *                                                                                                                *
+ * Warm-up API                                                                                                    *
+ *                                                                                                                *
+ ******************************************************************************************************************/
+/*
+ * At exit the list of cached items with their active ranges is saved to the
+ * warm-up file. At startup, before history syncers are started, the listed
+ * items are loaded back into cache. Items are grouped into batches of the same
+ * value type and similar range, each batch is read from history storage with a
+ * single multi item request. Batches are read by helper threads with their own
+ * database connections and added to cache by the calling thread in order.
+ */
+
+#define ZBX_VC_WARMUP_SIGNATURE		0x5a565357
+
+/* the number of items read from history storage with one request */
+#define ZBX_VC_WARMUP_BATCH_SIZE	500
+
+/* the number of helper threads reading batches from history storage */
+#define ZBX_VC_WARMUP_THREADS_NUM	4
+
+/* the number of batches read ahead of the batch being added to cache */
+#define ZBX_VC_WARMUP_READ_AHEAD	(ZBX_VC_WARMUP_THREADS_NUM * 2)
+
+typedef struct
+{
+	zbx_uint32_t	signature;
+	zbx_uint32_t	item_size;
+}
+zbx_vc_warmup_header_t;
+
+typedef struct
+{
+	zbx_uint64_t	itemid;
+	int		range;
+	unsigned char	value_type;
+}
+zbx_vc_warmup_item_t;
+
+ZBX_VECTOR_DECL(vc_warmup_item, zbx_vc_warmup_item_t)
+ZBX_VECTOR_IMPL(vc_warmup_item, zbx_vc_warmup_item_t)
+
+#define ZBX_VC_WARMUP_BATCH_QUEUED	0
+#define ZBX_VC_WARMUP_BATCH_READ	1
+#define ZBX_VC_WARMUP_BATCH_DONE	2
+
+typedef struct
+{
+	/* the batch items, sorted by itemid */
+	zbx_vc_warmup_item_t		*items;
+	int				items_num;
+
+	unsigned char			value_type;
+
+	/* the values are read from range_start (including) to the current time */
+	int				range_start;
+
+	/* the read values grouped by itemid and their itemids */
+	zbx_vector_uint64_t		value_itemids;
+	zbx_vector_history_record_t	values;
+
+	/* see ZBX_VC_WARMUP_BATCH_* defines */
+	int				state;
+	int				ret;
+}
+zbx_vc_warmup_batch_t;
+
+typedef struct
+{
+	pthread_t		threads[ZBX_VC_WARMUP_THREADS_NUM];
+	int			threads_num;
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		event;		/* signalled when batch is read or added, or on stop */
+
+	zbx_vc_warmup_batch_t	*batches;
+	int			batches_num;
+	int			batches_next;	/* the next batch to be read */
+	int			batches_added;	/* the number of batches added to cache */
+
+	int			stop;
+}
+zbx_vc_warmup_t;
+
+static int	vc_warmup_item_compare_func(const void *d1, const void *d2)
+{
+	const zbx_vc_warmup_item_t	*i1 = (const zbx_vc_warmup_item_t *)d1;
+	const zbx_vc_warmup_item_t	*i2 = (const zbx_vc_warmup_item_t *)d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(i1->value_type, i2->value_type);
+	ZBX_RETURN_IF_NOT_EQUAL(i1->range, i2->range);
+	ZBX_RETURN_IF_NOT_EQUAL(i1->itemid, i2->itemid);
+
+	return 0;
+}
+
+static int	vc_warmup_itemid_compare_func(const void *d1, const void *d2)
+{
+	const zbx_vc_warmup_item_t	*i1 = (const zbx_vc_warmup_item_t *)d1;
+	const zbx_vc_warmup_item_t	*i2 = (const zbx_vc_warmup_item_t *)d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(i1->itemid, i2->itemid);
+
+	return 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads warm-up items from file                                     *
+ *                                                                            *
+ * Parameters: path  - [IN] the warm-up file path                             *
+ *             items - [OUT] the warm-up items                                *
+ *                                                                            *
+ * Return value: SUCCEED - the items were read                                *
+ *               FAIL    - the file does not exist or cannot be used          *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_warmup_read_items(const char *path, zbx_vector_vc_warmup_item_t *items)
+{
+	int			fd, ret = FAIL;
+	zbx_stat_t		buf;
+	zbx_vc_warmup_header_t	header;
+	size_t			items_num;
+
+	if (-1 == (fd = open(path, O_RDONLY)))
+	{
+		if (ENOENT != errno)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot open value cache warm-up file \"%s\": %s", path,
+					zbx_strerror(errno));
+		}
+
+		return FAIL;
+	}
+
+	if (0 != zbx_fstat(fd, &buf))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot obtain value cache warm-up file \"%s\" information: %s", path,
+				zbx_strerror(errno));
+		goto out;
+	}
+
+	if ((ssize_t)sizeof(header) != read(fd, &header, sizeof(header)) ||
+			ZBX_VC_WARMUP_SIGNATURE != header.signature ||
+			sizeof(zbx_vc_warmup_item_t) != header.item_size ||
+			0 != (buf.st_size - sizeof(header)) % sizeof(zbx_vc_warmup_item_t))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "value cache warm-up file \"%s\" is not compatible with this version",
+				path);
+		goto out;
+	}
+
+	items_num = (buf.st_size - sizeof(header)) / sizeof(zbx_vc_warmup_item_t);
+	zbx_vector_vc_warmup_item_reserve(items, items_num);
+
+	if ((ssize_t)(items_num * sizeof(zbx_vc_warmup_item_t)) != read(fd, items->values,
+			items_num * sizeof(zbx_vc_warmup_item_t)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot read value cache warm-up file \"%s\": %s", path,
+				zbx_strerror(errno));
+		goto out;
+	}
+
+	items->values_num = (int)items_num;
+	ret = SUCCEED;
+out:
+	close(fd);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads values of warm-up batch items from history storage          *
+ *                                                                            *
+ * Parameters: batch - [IN/OUT] the warm-up batch                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_warmup_read_batch(zbx_vc_warmup_batch_t *batch)
+{
+	zbx_vector_uint64_t	itemids;
+	int			i;
+
+	zbx_vector_uint64_create(&itemids);
+	zbx_vector_uint64_reserve(&itemids, (size_t)batch->items_num);
+
+	for (i = 0; i < batch->items_num; i++)
+		zbx_vector_uint64_append(&itemids, batch->items[i].itemid);
+
+	zbx_vector_uint64_create(&batch->value_itemids);
+	zbx_history_record_vector_create(&batch->values);
+
+	/* decrement interval start point because interval starting point is excluded by history backend */
+	batch->ret = zbx_history_get_values_multi(&itemids, batch->value_type, batch->range_start - 1, ZBX_JAN_2038,
+			&batch->value_itemids, &batch->values);
+
+	zbx_vector_uint64_destroy(&itemids);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees values read for warm-up batch                               *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_warmup_clear_batch(zbx_vc_warmup_batch_t *batch)
+{
+	zbx_history_record_vector_destroy(&batch->values, batch->value_type);
+	zbx_vector_uint64_destroy(&batch->value_itemids);
+	batch->state = ZBX_VC_WARMUP_BATCH_DONE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds values of warm-up batch items to cache                       *
+ *                                                                            *
+ * Parameters: batch      - [IN/OUT] the warm-up batch                        *
+ *             now        - [IN] the current timestamp                        *
+ *             values_num - [IN/OUT] the number of added values               *
+ *                                                                            *
+ * Return value: the number of added items or FAIL if cache is out of memory  *
+ *                                                                            *
+ * Comments: The values of each item are sorted and added to the item cache,  *
+ *           items already present in cache are left untouched.               *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_warmup_add_batch(zbx_vc_warmup_batch_t *batch, int now, zbx_uint64_t *values_num)
+{
+	int		i, start, end = 0, items_num = 0;
+	zbx_vc_item_t	*item;
+
+	vc_lock_cache();
+
+	for (i = 0; i < batch->items_num; i++)
+	{
+		zbx_vc_warmup_item_t	*warmup_item = &batch->items[i];
+		zbx_vc_item_t		new_item;
+
+		if (ZBX_VC_MODE_NORMAL != vc_cache->mode)
+		{
+			items_num = FAIL;
+			break;
+		}
+
+		/* find item values, skipping values of items not requested */
+		start = end;
+		while (start < batch->values.values_num && batch->value_itemids.values[start] < warmup_item->itemid)
+			start++;
+
+		end = start;
+		while (end < batch->values.values_num && batch->value_itemids.values[end] == warmup_item->itemid)
+			end++;
+
+		if (NULL != zbx_hashset_search(&vc_cache->items, &warmup_item->itemid))
+			continue;
+
+		memset(&new_item, 0, sizeof(new_item));
+		new_item.itemid = warmup_item->itemid;
+		new_item.value_type = warmup_item->value_type;
+		new_item.range_sync_hour = (unsigned char)((now / SEC_PER_HOUR) & 0xff);
+		new_item.last_accessed = now;
+		new_item.active_range = warmup_item->range;
+		new_item.daily_range = warmup_item->range;
+		new_item.db_cached_from = batch->range_start;
+
+		if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item,
+				sizeof(new_item))))
+		{
+			items_num = FAIL;
+			break;
+		}
+
+		if (start != end)
+		{
+			qsort(batch->values.values + start, (size_t)(end - start), sizeof(zbx_history_record_t),
+					(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+
+			if (SUCCEED != vch_item_add_values_at_tail(item, batch->values.values + start, end - start))
+			{
+				vc_remove_item_by_id(warmup_item->itemid);
+				items_num = FAIL;
+				break;
+			}
+
+			*values_num += (zbx_uint64_t)(end - start);
+		}
+
+		items_num++;
+	}
+
+	vc_unlock();
+
+	return items_num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads queued warm-up batches                                      *
+ *                                                                            *
+ * Parameters: warmup    - [IN] the warm-up data, must be locked              *
+ *             read_next - [IN] the index of the batch to read before         *
+ *                              returning or -1 to read while read ahead      *
+ *                              limit allows                                  *
+ *                                                                            *
+ * Comments: The lock is released while batch is being read.                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_warmup_read_batches(zbx_vc_warmup_t *warmup, int read_next)
+{
+	while (0 == warmup->stop && warmup->batches_next < warmup->batches_num)
+	{
+		zbx_vc_warmup_batch_t	*batch;
+
+		if (-1 == read_next)
+		{
+			if (warmup->batches_next >= warmup->batches_added + ZBX_VC_WARMUP_READ_AHEAD)
+				break;
+		}
+		else if (warmup->batches_next > read_next)
+			break;
+
+		batch = &warmup->batches[warmup->batches_next++];
+
+		pthread_mutex_unlock(&warmup->lock);
+		vc_warmup_read_batch(batch);
+		pthread_mutex_lock(&warmup->lock);
+
+		batch->state = ZBX_VC_WARMUP_BATCH_READ;
+		pthread_cond_broadcast(&warmup->event);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: warm-up helper thread entry                                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	*vc_warmup_thread_entry(void *args)
+{
+	zbx_vc_warmup_t	*warmup = (zbx_vc_warmup_t *)args;
+	sigset_t	mask;
+	int		err;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGINT);
+
+	if (0 != (err = pthread_sigmask(SIG_BLOCK, &mask, NULL)))
+		zabbix_log(LOG_LEVEL_WARNING, "cannot block signals: %s", zbx_strerror(err));
+
+	/* without own connection the thread is useless, batches will be read by other threads */
+	if (ZBX_DB_OK != zbx_db_connect(ZBX_DB_CONNECT_ONCE))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot connect to database for value cache warm-up");
+		goto out;
+	}
+
+	pthread_mutex_lock(&warmup->lock);
+
+	while (0 == warmup->stop && warmup->batches_next < warmup->batches_num)
+	{
+		vc_warmup_read_batches(warmup, -1);
+
+		if (0 == warmup->stop && warmup->batches_next < warmup->batches_num)
+			pthread_cond_wait(&warmup->event, &warmup->lock);
+	}
+
+	pthread_mutex_unlock(&warmup->lock);
+
+	zbx_db_close();
+out:
+	zbx_db_thread_deinit_basic();
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: starts warm-up helper threads                                     *
+ *                                                                            *
+ * Comments: Parallel reading is supported only by databases allowing         *
+ *           multiple connections.                                            *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_warmup_start_threads(zbx_vc_warmup_t *warmup)
+{
+#if defined(HAVE_MYSQL) || defined(HAVE_POSTGRESQL)
+	pthread_attr_t	attr;
+	int		i, err;
+
+	zbx_pthread_init_attr(&attr);
+
+	for (i = 0; i < ZBX_VC_WARMUP_THREADS_NUM && i < warmup->batches_num - 1; i++)
+	{
+		if (0 != (err = pthread_create(&warmup->threads[warmup->threads_num], &attr, vc_warmup_thread_entry,
+				(void *)warmup)))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot create value cache warm-up thread: %s",
+					zbx_strerror(err));
+			break;
+		}
+
+		warmup->threads_num++;
+	}
+
+	pthread_attr_destroy(&attr);
+#else
+	ZBX_UNUSED(warmup);
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: stops warm-up helper threads                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_warmup_stop_threads(zbx_vc_warmup_t *warmup)
+{
+	int	i;
+
+	pthread_mutex_lock(&warmup->lock);
+	warmup->stop = 1;
+	pthread_cond_broadcast(&warmup->event);
+	pthread_mutex_unlock(&warmup->lock);
+
+	for (i = 0; i < warmup->threads_num; i++)
+		pthread_join(warmup->threads[i], NULL);
+
+	warmup->threads_num = 0;
+}
+
+/*
+ * The cache contents can also be dumped to file at exit and restored at startup,
+ * before the main process connects to database. The shared memory segment holds
+ * absolute pointers and is attached at a different address after restart, so
+ * items are dumped one by one with their values. Restored items are validated
+ * by warm-up - the last restored value must be found in history storage and
+ * newer values are added to cache, otherwise the item is removed.
+ */
+
+#define ZBX_VC_DUMP_SIGNATURE		0x5a564344
+
+#define ZBX_VC_DUMP_BUF_SIZE		ZBX_MEBIBYTE
+
+/* The maximum time since the last restored item value. Validating items after longer downtime */
+/* would read too much history, so their values are read on demand instead.                  */
+#define ZBX_VC_RESTORE_MAX_GAP		SEC_PER_HOUR
+
+typedef struct
+{
+	zbx_uint32_t	signature;
+	zbx_uint32_t	item_size;
+}
+zbx_vc_dump_header_t;
+
+/* item record, followed by the item values */
+typedef struct
+{
+	zbx_uint64_t	itemid;
+	int		active_range;
+	int		daily_range;
+	int		db_cached_from;
+	int		values_num;
+	unsigned char	value_type;
+	unsigned char	status;
+}
+zbx_vc_dump_item_t;
+
+typedef struct
+{
+	int	fd;
+	char	*data;
+	size_t	size;
+	size_t	offset;
+}
+zbx_vc_dump_buf_t;
+
+/* the restored item, which must be validated against history storage */
+typedef struct
+{
+	zbx_uint64_t	itemid;
+
+	/* the last restored value timestamp or, if there were no values, */
+	/* the timestamp (ns = -1) since which values must be read        */
+	zbx_timespec_t	last;
+
+	unsigned char	value_type;
+}
+zbx_vc_restored_item_t;
+
+ZBX_VECTOR_DECL(vc_restored_item, zbx_vc_restored_item_t)
+ZBX_VECTOR_IMPL(vc_restored_item, zbx_vc_restored_item_t)
+
+/* items restored by the main process, validated during warm-up */
+static zbx_vector_vc_restored_item_t	vc_restored_items;
+static int				vc_restored_items_init = 0;
+
+static int	vc_dump_flush(zbx_vc_dump_buf_t *buf)
+{
+	if (0 != buf->offset && SUCCEED != zbx_write_all(buf->fd, buf->data, buf->offset))
+		return FAIL;
+
+	buf->offset = 0;
+
+	return SUCCEED;
+}
+
+static int	vc_dump_write(zbx_vc_dump_buf_t *buf, const void *data, size_t size)
+{
+	if (buf->offset + size > ZBX_VC_DUMP_BUF_SIZE && SUCCEED != vc_dump_flush(buf))
+		return FAIL;
+
+	if (ZBX_VC_DUMP_BUF_SIZE < size)
+		return zbx_write_all(buf->fd, (const char *)data, size);
+
+	memcpy(buf->data + buf->offset, data, size);
+	buf->offset += size;
+
+	return SUCCEED;
+}
+
+static int	vc_dump_write_str(zbx_vc_dump_buf_t *buf, const char *str)
+{
+	/* string length is written incremented by one, zero is used for NULL strings */
+	zbx_uint32_t	len = (NULL == str ? 0 : (zbx_uint32_t)strlen(str) + 1);
+
+	if (SUCCEED != vc_dump_write(buf, &len, sizeof(len)))
+		return FAIL;
+
+	return (1 < len ? vc_dump_write(buf, str, len - 1) : SUCCEED);
+}
+
+static int	vc_dump_read(zbx_vc_dump_buf_t *buf, void *data, size_t size)
+{
+	while (0 < size)
+	{
+		size_t	len;
+
+		if (buf->offset == buf->size)
+		{
+			ssize_t	n;
+
+			if (0 >= (n = read(buf->fd, buf->data, ZBX_VC_DUMP_BUF_SIZE)))
+				return FAIL;
+
+			buf->size = (size_t)n;
+			buf->offset = 0;
+		}
+
+		len = MIN(size, buf->size - buf->offset);
+		memcpy(data, buf->data + buf->offset, len);
+		buf->offset += len;
+		data = (char *)data + len;
+		size -= len;
+	}
+
+	return SUCCEED;
+}
+
+static int	vc_dump_read_str(zbx_vc_dump_buf_t *buf, char **str)
+{
+	zbx_uint32_t	len;
+
+	*str = NULL;
+
+	if (SUCCEED != vc_dump_read(buf, &len, sizeof(len)))
+		return FAIL;
+
+	if (0 == len)
+		return SUCCEED;
+
+	*str = (char *)zbx_malloc(NULL, len);
+	(*str)[len - 1] = '\0';
+
+	if (SUCCEED != vc_dump_read(buf, *str, len - 1))
+	{
+		zbx_free(*str);
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes item value to dump file                                    *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_dump_write_value(zbx_vc_dump_buf_t *buf, const zbx_history_record_t *value, int value_type)
+{
+	if (SUCCEED != vc_dump_write(buf, &value->timestamp, sizeof(value->timestamp)))
+		return FAIL;
+
+	switch (value_type)
+	{
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			return vc_dump_write_str(buf, value->value.str);
+		case ITEM_VALUE_TYPE_LOG:
+			if (SUCCEED != vc_dump_write(buf, &value->value.log->timestamp, sizeof(int)) ||
+					SUCCEED != vc_dump_write(buf, &value->value.log->logeventid, sizeof(int)) ||
+					SUCCEED != vc_dump_write(buf, &value->value.log->severity, sizeof(int)) ||
+					SUCCEED != vc_dump_write_str(buf, value->value.log->source))
+			{
+				return FAIL;
+			}
+
+			return vc_dump_write_str(buf, value->value.log->value);
+		default:
+			return vc_dump_write(buf, &value->value, sizeof(value->value));
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads item value from dump file                                   *
+ *                                                                            *
+ * Comments: Memory allocated for value data must be freed by the caller.     *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_dump_read_value(zbx_vc_dump_buf_t *buf, zbx_history_record_t *value, int value_type)
+{
+	zbx_log_value_t	*log;
+
+	if (SUCCEED != vc_dump_read(buf, &value->timestamp, sizeof(value->timestamp)))
+		return FAIL;
+
+	switch (value_type)
+	{
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			if (SUCCEED != vc_dump_read_str(buf, &value->value.str))
+				return FAIL;
+
+			/* keep the value valid for history record functions */
+			if (NULL == value->value.str)
+				value->value.str = zbx_strdup(NULL, "");
+
+			return SUCCEED;
+		case ITEM_VALUE_TYPE_LOG:
+			log = (zbx_log_value_t *)zbx_malloc(NULL, sizeof(zbx_log_value_t));
+			log->source = NULL;
+			log->value = NULL;
+			value->value.log = log;
+
+			if (SUCCEED != vc_dump_read(buf, &log->timestamp, sizeof(int)) ||
+					SUCCEED != vc_dump_read(buf, &log->logeventid, sizeof(int)) ||
+					SUCCEED != vc_dump_read(buf, &log->severity, sizeof(int)) ||
+					SUCCEED != vc_dump_read_str(buf, &log->source) ||
+					SUCCEED != vc_dump_read_str(buf, &log->value))
+			{
+				zbx_free(log->source);
+				zbx_free(log);
+				return FAIL;
+			}
+
+			if (NULL == log->value)
+				log->value = zbx_strdup(NULL, "");
+
+			return SUCCEED;
+		default:
+			return vc_dump_read(buf, &value->value, sizeof(value->value));
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: validates restored items against history storage and caches      *
+ *          values added after the dump                                       *
+ *                                                                            *
+ * Parameters: items     - [IN] the restored items of the same value type,    *
+ *                              sorted by itemid                              *
+ *             items_num - [IN] the number of restored items                  *
+ *             start     - [IN] the oldest timestamp to read values from      *
+ *                                                                            *
+ * Return value: the number of removed items                                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_restored_items_sync(const zbx_vc_restored_item_t *items, int items_num, int start)
+{
+	zbx_vector_uint64_t		itemids, value_itemids;
+	zbx_vector_history_record_t	values;
+	int				i, j, first, end = 0, removed = 0, ret;
+	unsigned char			value_type = items[0].value_type;
+
+	zbx_vector_uint64_create(&itemids);
+	zbx_vector_uint64_create(&value_itemids);
+	zbx_history_record_vector_create(&values);
 
-					goto out;
-				}
+	for (i = 0; i < items_num; i++)
+		zbx_vector_uint64_append(&itemids, items[i].itemid);
 
-				sindex = schunk->last_value;
-			}
-		}
-		while (0 < zbx_timespec_compare(&schunk->slots[sindex].timestamp, &value->timestamp));
-	}
-	else
+	/* decrement interval start point because interval starting point is excluded by history backend */
+	ret = zbx_history_get_values_multi(&itemids, value_type, start - 1, ZBX_JAN_2038, &value_itemids, &values);
+
+	vc_lock_cache();
+
+	for (i = 0; i < items_num; i++)
 	{
-		/* find the number of free slots on the right side in last (head) chunk */
-		if (NULL != item->head)
-			nslots = item->head->slots_num - item->head->last_value - 1;
+		const zbx_vc_restored_item_t	*restored = &items[i];
+		zbx_vc_item_t			*item;
 
-		if (0 == nslots)
+		first = end;
+		while (first < values.values_num && value_itemids.values[first] < restored->itemid)
+			first++;
+
+		end = first;
+		while (end < values.values_num && value_itemids.values[end] == restored->itemid)
+			end++;
+
+		if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &restored->itemid)))
+			continue;
+
+		if (SUCCEED != ret || item->value_type != value_type)
+			goto remove;
+
+		qsort(values.values + first, (size_t)(end - first), sizeof(zbx_history_record_t),
+				(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+
+		/* skip values up to the last restored value, which must be present in history storage */
+		if (-1 != restored->last.ns)
 		{
-			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
-				goto out;
+			while (first < end && 0 > zbx_timespec_compare(&values.values[first].timestamp, &restored->last))
+				first++;
+
+			if (first == end || 0 != zbx_timespec_compare(&values.values[first].timestamp, &restored->last))
+				goto remove;
+
+			first++;
 		}
 		else
-			item->head->last_value++;
+		{
+			while (first < end && values.values[first].timestamp.sec < restored->last.sec)
+				first++;
+		}
 
-		item->values_total++;
+		for (j = first; j < end; j++)
+		{
+			if (SUCCEED != vch_item_add_value_at_head(item, &values.values[j]))
+				goto remove;
+		}
 
-		chunk = item->head;
-		index = item->head->last_value;
+		continue;
+remove:
+		vc_remove_item_by_id(restored->itemid);
+		removed++;
 	}
 
-	if (SUCCEED != vch_item_copy_value(item, chunk, index, value))
-		goto out;
+	vc_unlock();
 
-	ret = SUCCEED;
-out:
-	return ret;
+	zbx_history_record_vector_destroy(&values, value_type);
+	zbx_vector_uint64_destroy(&value_itemids);
+	zbx_vector_uint64_destroy(&itemids);
+
+	return removed;
+}
+
+static int	vc_restored_item_compare_func(const void *d1, const void *d2)
+{
+	const zbx_vc_restored_item_t	*i1 = (const zbx_vc_restored_item_t *)d1;
+	const zbx_vc_restored_item_t	*i2 = (const zbx_vc_restored_item_t *)d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(i1->value_type, i2->value_type);
+	ZBX_RETURN_IF_NOT_EQUAL(i1->last.sec, i2->last.sec);
+	ZBX_RETURN_IF_NOT_EQUAL(i1->itemid, i2->itemid);
+
+	return 0;
+}
+
+static int	vc_restored_itemid_compare_func(const void *d1, const void *d2)
+{
+	const zbx_vc_restored_item_t	*i1 = (const zbx_vc_restored_item_t *)d1;
+	const zbx_vc_restored_item_t	*i2 = (const zbx_vc_restored_item_t *)d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(i1->itemid, i2->itemid);
+
+	return 0;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: adds item history values at the beginning of current item's       *
- *          history data                                                      *
- *                                                                            *
- * Parameters:  item   - [IN] the item to add history data to                 *
- *              values - [IN] the item history data values                    *
- *              num    - [IN] the number of history data values to add        *
+ * Purpose: validates items restored from dump file against history storage   *
  *                                                                            *
- * Return value: SUCCEED - the history data values were added successfully    *
- *               FAIL - failed to add history data values (not enough memory) *
+ ******************************************************************************/
+static void	vc_restored_items_validate(void)
+{
+	zbx_vc_restored_item_t	*items;
+	int			i, j, removed = 0;
+	double			sec;
+
+	if (0 == vc_restored_items_init)
+		return;
+
+	if (0 == vc_restored_items.values_num)
+		goto out;
+
+	sec = zbx_time();
+
+	/* group items with the same value type and similar last value into batches */
+	zbx_vector_vc_restored_item_sort(&vc_restored_items, vc_restored_item_compare_func);
+	items = vc_restored_items.values;
+
+	for (i = 0; i < vc_restored_items.values_num; i = j)
+	{
+		int	start = items[i].last.sec;
+
+		j = i + 1;
+		while (j < vc_restored_items.values_num && ZBX_VC_WARMUP_BATCH_SIZE > j - i &&
+				items[j].value_type == items[i].value_type)
+		{
+			j++;
+		}
+
+		qsort(items + i, (size_t)(j - i), sizeof(zbx_vc_restored_item_t), vc_restored_itemid_compare_func);
+		removed += vc_restored_items_sync(items + i, j - i, start);
+	}
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "value cache validated %d restored items in " ZBX_FS_DBL " sec, %d items"
+			" were removed", vc_restored_items.values_num, zbx_time() - sec, removed);
+out:
+	zbx_vector_vc_restored_item_destroy(&vc_restored_items);
+	vc_restored_items_init = 0;
+}
+
+/******************************************************************************************************************
+ *                                                                                                                *
+ * Public API                                                                                                     *
+ *                                                                                                                *
+ ******************************************************************************************************************/
+
+/******************************************************************************
  *                                                                            *
- * Comments: In the case of failure the item is removed from cache.           *
- *           Overlapping values (by timestamp seconds) are ignored.           *
+ * Purpose: initializes value cache                                           *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_add_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+int	zbx_vc_init(zbx_uint64_t value_cache_size, char **error)
 {
-	int 	count = values_num, ret = FAIL;
+	zbx_uint64_t	size_reserved;
+	int		ret = FAIL, i;
 
-	/* skip values already added to the item cache by another process */
-	if (NULL != item->tail)
-	{
-		int	sec = item->tail->slots[item->tail->first_value].timestamp.sec;
+	if (0 == value_cache_size)
+		return SUCCEED;
 
-		while (--count >= 0 && values[count].timestamp.sec >= sec)
-			;
-		++count;
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
+
+	if (SUCCEED != (ret = zbx_rwlock_create(&vc_lock, ZBX_RWLOCK_VALUECACHE, error)))
+		goto out;
+
+	for (i = 0; i < ZBX_VC_ITEM_LOCKS_NUM; i++)
+	{
+		if (SUCCEED != (ret = zbx_rwlock_create(&vc_item_locks[i],
+				(zbx_rwlock_name_t)(ZBX_RWLOCK_VALUECACHE_ITEMS_0 + i), error)))
+		{
+			goto out;
+		}
 	}
 
-	while (0 != count)
+	if (SUCCEED != (ret = zbx_mutex_create(&vc_shmem_lock, ZBX_MUTEX_VALUECACHE, error)))
+		goto out;
+
+	size_reserved = zbx_shmem_required_size(1, "value cache size", "ValueCacheSize");
+
+	if (SUCCEED != zbx_shmem_create(&vc_mem, value_cache_size, "value cache size", "ValueCacheSize", 1,
+			error))
 	{
-		int	copy_slots, nslots = 0;
+		goto out;
+	}
 
-		/* find the number of free slots on the left side in first (tail) chunk */
-		if (NULL != item->tail)
-			nslots = item->tail->first_value;
+	value_cache_size -= size_reserved;
 
-		if (0 == nslots)
-		{
-			nslots = vch_item_chunk_slot_count(item, count);
+	vc_cache = (zbx_vc_cache_t *)__vc_shmem_malloc_func(vc_cache, sizeof(zbx_vc_cache_t));
 
-			if (FAIL == vch_item_add_chunk(item, nslots, item->tail))
-				goto out;
+	if (NULL == vc_cache)
+	{
+		*error = zbx_strdup(*error, "cannot allocate value cache header");
+		goto out;
+	}
+	memset(vc_cache, 0, sizeof(zbx_vc_cache_t));
 
-			item->tail->last_value = nslots - 1;
-			item->tail->first_value = nslots;
-		}
+	zbx_hashset_create_ext(&vc_cache->items, VC_ITEMS_INIT_SIZE,
+			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL,
+			__vc_shmem_malloc_func, __vc_shmem_realloc_func, __vc_shmem_free_func);
 
-		/* copy values to chunk */
-		copy_slots = MIN(nslots, count);
-		count -= copy_slots;
+	if (NULL == vc_cache->items.slots)
+	{
+		*error = zbx_strdup(*error, "cannot allocate value cache data storage");
+		goto out;
+	}
 
-		if (FAIL == vch_item_copy_values_at_tail(item, values + count, copy_slots))
-			goto out;
+	zbx_hashset_create_ext(&vc_cache->strpool, VC_STRPOOL_INIT_SIZE,
+			vc_strpool_hash_func, vc_strpool_compare_func, NULL,
+			__vc_shmem_malloc_func, __vc_shmem_realloc_func, __vc_shmem_free_func);
+
+	if (NULL == vc_cache->strpool.slots)
+	{
+		*error = zbx_strdup(*error, "cannot allocate string pool for value cache data storage");
+		goto out;
 	}
 
+	/* the free space request should be 5% of cache size, but no more than 128KB */
+	vc_cache->min_free_request = (value_cache_size / 100) * 5;
+	if (vc_cache->min_free_request > 128 * ZBX_KIBIBYTE)
+		vc_cache->min_free_request = 128 * ZBX_KIBIBYTE;
+
+	zbx_vector_vc_itemupdate_create(&vc_itemupdates);
+	zbx_vector_vc_itemupdate_reserve(&vc_itemupdates, 256);
+
 	ret = SUCCEED;
 out:
+	zbx_vc_disable();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+
 	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: cache item history data for the specified time period             *
- *                                                                            *
- * Parameters: item        - [IN] the item                                    *
- *             range_start - [IN] the interval start time                     *
- *                                                                            *
- * Return value:  >=0    - the number of values read from database            *
- *                FAIL   - an error occurred while trying to cache values     *
- *                                                                            *
- * Comments: This function checks if the requested value range is cached and  *
- *           updates cache from database if necessary.                        *
+ * Purpose: destroys value cache                                              *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_cache_values_by_time(zbx_vc_item_t **item, int range_start)
+void	zbx_vc_destroy(void)
 {
-	int				ret, range_end;
-	zbx_vector_history_record_t	records;
-	zbx_uint64_t			itemid;
-	unsigned char			value_type;
-
-	if (ZBX_ITEM_STATUS_CACHED_ALL == (*item)->status)
-		return SUCCEED;
+	int	i;
 
-	/* check if the requested period is in the cached range */
-	if (0 != (*item)->db_cached_from && range_start >= (*item)->db_cached_from)
-		return SUCCEED;
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	/* find if the cache should be updated to cover the required range */
-	if (NULL != (*item)->tail)
+	if (NULL != vc_cache)
 	{
-		/* we need to get item values before the first cached value, but not including it */
-		range_end = (*item)->tail->slots[(*item)->tail->first_value].timestamp.sec - 1;
-	}
-	else
-		range_end = ZBX_JAN_2038;
+		zbx_vector_vc_itemupdate_destroy(&vc_itemupdates);
 
-	/* update cache if necessary */
-	if (range_start >= range_end)
-		return SUCCEED;
+		zbx_hashset_destroy(&vc_cache->items);
+		zbx_hashset_destroy(&vc_cache->strpool);
 
-	zbx_vector_history_record_create(&records);
-	itemid = (*item)->itemid;
-	value_type = (*item)->value_type;
+		__vc_shmem_free_func(vc_cache);
+		vc_cache = NULL;
 
-	UNLOCK_CACHE;
+		zbx_shmem_destroy(vc_mem);
+		vc_mem = NULL;
+		zbx_rwlock_destroy(&vc_lock);
 
-	if (SUCCEED == (ret = vc_db_read_values_by_time(itemid, value_type, &records, range_start, range_end)))
-	{
-		zbx_vector_history_record_sort(&records,
-				(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+		for (i = 0; i < ZBX_VC_ITEM_LOCKS_NUM; i++)
+			zbx_rwlock_destroy(&vc_item_locks[i]);
+
+		zbx_mutex_destroy(&vc_shmem_lock);
 	}
 
-	WRLOCK_CACHE;
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+}
 
-	if (SUCCEED != ret)
-		goto out;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: resets value cache                                                *
+ *                                                                            *
+ * Comments: All items and their historical data are removed,                 *
+ *           cache working mode, statistics reset.                            *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_reset(void)
+{
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
+	if (NULL != vc_cache)
 	{
-		zbx_vc_item_t	new_item = {.itemid = itemid, .value_type = value_type};
+		zbx_vc_item_t		*item;
+		zbx_hashset_iter_t	iter;
 
-		if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item,
-				sizeof(new_item))))
+		WRLOCK_CACHE;
+
+		zbx_hashset_iter_reset(&vc_cache->items, &iter);
+		while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
 		{
-			ret = FAIL;
-			goto out;
+			vch_item_free_cache(item);
+			zbx_hashset_iter_remove(&iter);
 		}
-	}
 
-	/* when updating cache with time based request we can always reset status flags */
-	/* flag even if the requested period contains no data                           */
-	(*item)->status = 0;
+		vc_cache->hits = 0;
+		vc_cache->misses = 0;
+		vc_cache->min_free_request = 0;
+		vc_cache->mode = ZBX_VC_MODE_NORMAL;
+		vc_cache->mode_time = 0;
+		vc_cache->last_warning_time = 0;
 
-	if (0 < records.values_num)
-	{
-		if (SUCCEED != (ret = vch_item_add_values_at_tail(*item, records.values, records.values_num)))
-			goto out;
+		UNLOCK_CACHE;
 	}
 
-	ret = records.values_num;
-	vc_item_update_db_cached_from(*item, range_start);
-out:
-	zbx_history_record_vector_destroy(&records, value_type);
-
-	return ret;
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: cache the specified number of history data values for time period *
- *          since timestamp                                                   *
- *                                                                            *
- * Parameters: item        - [IN] the item                                    *
- *             range_start - [IN] the interval start time                     *
- *             count       - [IN] the number of history values to retrieve    *
- *             ts          - [IN] the target timestamp                        *
- *                                                                            *
- * Return value:  >=0    - the number of values read from database            *
- *                FAIL   - an error occurred while trying to cache values     *
+ * Purpose: adds item values already written to history storage to the value  *
+ *          cache                                                             *
  *                                                                            *
- * Comments: This function checks if the requested number of values is cached *
- *           and updates cache from database if necessary.                    *
+ * Parameters: history - [IN] item history values                             *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_cache_values_by_time_and_count(zbx_vc_item_t **item, int range_start, int count,
-		const zbx_timespec_t *ts)
+void	zbx_vc_cache_values(const zbx_vector_ptr_t *history)
 {
-	int				ret = SUCCEED, cached_records = 0, range_end, records_offset;
-	zbx_vector_history_record_t	records;
-	zbx_uint64_t			itemid;
-	unsigned char			value_type;
+	zbx_vc_item_t			*item;
+	int				i, index, locked;
+	zbx_dc_history_t		*h;
+	zbx_vector_uint64_pair_t	new_items;
+	zbx_vector_uint64_t		del_itemids;
 
-	if (ZBX_ITEM_STATUS_CACHED_ALL == (*item)->status)
-		return SUCCEED;
+	if (ZBX_VC_DISABLED == vc_state)
+		return;
 
-	/* check if the requested period is in the cached range */
-	if (0 != (*item)->db_cached_from && range_start >= (*item)->db_cached_from)
-		return SUCCEED;
+	zbx_vector_uint64_pair_create(&new_items);
+	zbx_vector_uint64_create(&del_itemids);
 
-	/* find if the cache should be updated to cover the required count */
-	if (NULL != (*item)->head)
+	/* values are cached with item locks, so readers of other items are not blocked, */
+	/* while changes of the item hashset are postponed until exclusive cache lock    */
+	for (index = 0; index < ZBX_VC_ITEM_LOCKS_NUM; index++)
 	{
-		zbx_vc_chunk_t	*chunk;
-		int		index;
+		locked = 0;
 
-		if (SUCCEED == vch_item_get_last_value(*item, ts, &chunk, &index))
+		for (i = 0; i < history->values_num; i++)
 		{
-			cached_records = index - chunk->first_value + 1;
+			h = (zbx_dc_history_t *)history->values[i];
 
-			while (NULL != (chunk = chunk->prev) && cached_records < count)
-				cached_records += chunk->last_value - chunk->first_value + 1;
-		}
-	}
+			if (index != VC_ITEM_LOCK_INDEX(h->itemid))
+				continue;
 
-	/* update cache if necessary */
-	if (cached_records >= count)
-		return SUCCEED;
+			if (0 == locked)
+			{
+				vc_lock_items(index, ZBX_VC_LOCK_ITEM_WRITE);
+				locked = 1;
+			}
 
-	/* get the end timestamp to which (including) the values should be cached */
-	if (NULL != (*item)->head)
-		range_end = (*item)->tail->slots[(*item)->tail->first_value].timestamp.sec - 1;
-	else
-		range_end = ZBX_JAN_2038;
+			if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &h->itemid)))
+			{
+				if (0 != (h->flags & ZBX_DC_FLAG_HASTRIGGER) && ZBX_VC_MODE_NORMAL == vc_cache->mode)
+				{
+					zbx_uint64_pair_t	pair = {h->itemid, h->value_type};
 
-	itemid = (*item)->itemid;
-	value_type = (*item)->value_type;
-	UNLOCK_CACHE;
+					zbx_vector_uint64_pair_append(&new_items, pair);
+				}
 
-	zbx_vector_history_record_create(&records);
+				continue;
+			}
 
-	if (range_end > ts->sec)
-	{
-		ret = vc_db_read_values_by_time(itemid, value_type, &records, ts->sec + 1, range_end);
-		range_end = ts->sec;
-	}
+			/* cache new values only after the item history database status is known */
+			if (ZBX_ITEM_STATUS_CACHED_ALL == item->status || 0 != item->db_cached_from)
+			{
+				zbx_history_record_t	record = {h->ts, h->value};
+				zbx_vc_chunk_t		*head = item->head;
+				int			last_value_timestamp;
 
-	records_offset = records.values_num;
+				if (NULL != head)
+				{
+					last_value_timestamp = head->slots[head->last_value].timestamp.sec;
+
+					/* aggregate windows cannot be updated with values older than the last */
+					/* value, remove them before values are moved to insert the new value */
+					if (0 <= zbx_history_record_compare_asc_func(&head->slots[head->last_value],
+							&record))
+					{
+						vc_item_free_aggregates(item);
+					}
+				}
+				else
+					last_value_timestamp = (int)time(NULL);
+
+				/* If the new value type does not match the item's type in cache remove it, */
+				/* so it's cached with the correct type from correct tables when accessed   */
+				/* next time.                                                               */
+				/* Also remove item if the value adding failed. In this case we             */
+				/* won't have the latest data in cache - so the requests must go directly   */
+				/* to the database.                                                         */
+				/* Until removed the item is left without data and history status, so the  */
+				/* following values are not cached.                                         */
+				if (item->value_type != h->value_type ||
+						FAIL == vch_item_add_value_at_head(item, &record))
+				{
+					vch_item_free_cache(item);
+					item->status = 0;
+					item->db_cached_from = 0;
+					zbx_vector_uint64_append(&del_itemids, item->itemid);
+					continue;
+				}
 
-	if (SUCCEED == ret && SUCCEED == (ret = vc_db_read_values_by_time_and_count(itemid, value_type, &records,
-			range_start, count - cached_records, range_end, ts)))
-	{
-		zbx_vector_history_record_sort(&records,
-				(zbx_compare_func_t)zbx_history_record_compare_asc_func);
-	}
+				if (NULL != item->aggregates)
+					vc_item_update_aggregates(item, &record, (int)time(NULL));
 
-	WRLOCK_CACHE;
+				/* try to remove old (unused) chunks if a new chunk was added */
+				if (head != item->head)
+					vch_item_clean_cache(item, last_value_timestamp);
+			}
+		}
 
-	if (SUCCEED != ret)
-		goto out;
+		if (0 != locked)
+			vc_unlock();
+	}
 
-	if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
+	if (0 != new_items.values_num || 0 != del_itemids.values_num || 0 != vc_release_size)
 	{
-		zbx_vc_item_t	new_item = {.itemid = itemid, .value_type = value_type};
+		vc_lock_cache();
 
-		if (NULL == (*item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item, sizeof(new_item))))
-		{
-			ret = FAIL;
-			goto out;
-		}
-	}
+		for (i = 0; i < del_itemids.values_num; i++)
+			vc_remove_item_by_id(del_itemids.values[i]);
 
-	if (0 < records.values_num)
-		ret = vch_item_add_values_at_tail(*item, records.values, records.values_num);
+		vc_release_pending_space();
 
-	if (SUCCEED != ret)
-		goto out;
+		for (i = 0; i < new_items.values_num && ZBX_VC_MODE_NORMAL == vc_cache->mode; i++)
+		{
+			if (NULL != zbx_hashset_search(&vc_cache->items, &new_items.values[i].first))
+				continue;
 
-	ret = records.values_num;
+			zbx_vc_item_t	item_local = {
+					.itemid = new_items.values[i].first,
+					.value_type = (unsigned char)new_items.values[i].second,
+					.last_accessed = (int)time(NULL)
 
-	if (0 == range_start && count - cached_records > records.values_num - records_offset)
-	{
-		(*item)->active_range = 0;
-		(*item)->daily_range = 0;
-		(*item)->status = ZBX_ITEM_STATUS_CACHED_ALL;
-	}
+			};
 
-	if ((count <= records.values_num || 0 == range_start) && 0 != records.values_num)
-	{
-		vc_item_update_db_cached_from(*item,
-				(*item)->tail->slots[(*item)->tail->first_value].timestamp.sec);
-	}
-	else if (0 != range_start)
-		vc_item_update_db_cached_from(*item, range_start);
+			if (NULL == zbx_hashset_insert(&vc_cache->items, &item_local, sizeof(item_local)))
+				break;
+		}
 
-out:
-	zbx_history_record_vector_destroy(&records, value_type);
+		vc_unlock();
+	}
 
-	return ret;
+	zbx_vector_uint64_destroy(&del_itemids);
+	zbx_vector_uint64_pair_destroy(&new_items);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: retrieves item history data from cache                            *
+ * Purpose: adds item values to the history and value cache                   *
  *                                                                            *
- * Parameters: item      - [IN] the item                                      *
- *             values    - [OUT] the item history data stored time/value      *
- *                         pairs in undefined order                           *
- *             seconds   - [IN] the time period to retrieve data for          *
- *             ts        - [IN] the requested period end timestamp            *
+ * Parameters: history - [IN] item history values                             *
+ *                                                                            *
+ * Return value: SUCCEED - the values were added successfully                 *
+ *               FAIL    - otherwise                                          *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_get_values_by_time(const zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
-		const zbx_timespec_t *ts)
+int	zbx_vc_add_values(zbx_vector_ptr_t *history, int *ret_flush)
 {
-	int		index, now;
-	zbx_timespec_t	start = {ts->sec - seconds, ts->ns};
-	zbx_vc_chunk_t	*chunk;
-
-	/* Check if maximum request range is not set and all data are cached.  */
-	/* Because that indicates there was a count based request with unknown */
-	/* range which might be greater than the current request range.        */
-	if (0 != item->active_range || ZBX_ITEM_STATUS_CACHED_ALL != item->status)
-	{
-		now = (int)time(NULL);
-		/* add another second to include nanosecond shifts */
-		vc_cache_item_update(item->itemid, ZBX_VC_UPDATE_RANGE, seconds + now - ts->sec + 1, now);
-	}
-
-	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &index))
-	{
-		/* Cache does not contain records for the specified timeshift & seconds range. */
-		/* Return empty vector with success.                                           */
-		return;
-	}
-
-	/* fill the values vector with item history values until the start timestamp is reached */
-	while (0 < zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp, &start))
-	{
-		while (index >= chunk->first_value && 0 < zbx_timespec_compare(&chunk->slots[index].timestamp, &start))
-			vc_history_record_vector_append(values, item->value_type, &chunk->slots[index--]);
+	if (SUCCEED != zbx_history_add_values(history, ret_flush))
+		return FAIL;
 
-		if (NULL == (chunk = chunk->prev))
-			break;
+	zbx_vc_cache_values(history);
 
-		index = chunk->last_value;
-	}
+	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: retrieves item history data from cache                            *
+ * Purpose: get item history data for the specified time period               *
  *                                                                            *
- * Parameters: item      - [IN] the item                                      *
- *             values    - [OUT] the item history data stored time/value      *
- *                         pairs in undefined order, optional                 *
- *                         If null then cache is updated if necessary, but no *
- *                         values are returned. Used to ensure that cache     *
- *                         contains a value of the specified timestamp.       *
- *             seconds   - [IN] the time period                               *
- *             count     - [IN] the number of history values to retrieve      *
- *             timestamp - [IN] the target timestamp                          *
+ * Parameters: itemid     - [IN] the item id                                  *
+ *             value_type - [IN] the item value type                          *
+ *             values     - [OUT] the item history data stored time/value     *
+ *                          pairs in descending order                         *
+ *             seconds    - [IN] the time period to retrieve data for         *
+ *             count      - [IN] the number of history values to retrieve     *
+ *             ts         - [IN] the period end timestamp                     *
+ *                                                                            *
+ * Return value:  SUCCEED - the item history data was retrieved successfully  *
+ *                FAIL    - the item history data was not retrieved           *
+ *                                                                            *
+ * Comments: If the data is not in cache, it's read from DB, so this function *
+ *           will always return the requested data, unless some error occurs. *
+ *                                                                            *
+ *           If <count> is set then value range is defined as <count> values  *
+ *           before <timestamp>. Otherwise the range is defined as <seconds>  *
+ *           seconds before <timestamp>.                                      *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_get_values_by_time_and_count(zbx_vc_item_t *item, zbx_vector_history_record_t *values,
+int	zbx_vc_get_values(zbx_uint64_t itemid, unsigned char value_type, zbx_vector_history_record_t *values,
 		int seconds, int count, const zbx_timespec_t *ts)
 {
-	int		index, now, range_timestamp;
-	zbx_vc_chunk_t	*chunk;
-	zbx_timespec_t	start;
+	zbx_vc_item_t	*item, new_item;
+	int 		ret = FAIL, cache_used = 1;
 
-	/* set start timestamp of the requested time period */
-	if (0 != seconds)
-	{
-		start.sec = ts->sec - seconds;
-		start.ns = ts->ns;
-	}
-	else
-	{
-		start.sec = 0;
-		start.ns = 0;
-	}
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid:" ZBX_FS_UI64 " value_type:%d count:%d period:%d end_timestamp"
+			" '%s'", __func__, itemid, value_type, count, seconds, zbx_timespec_str(ts));
+
+	vc_lock_items(VC_ITEM_LOCK_INDEX(itemid), ZBX_VC_LOCK_ITEM_READ);
+
+	if (ZBX_VC_DISABLED == vc_state)
+		goto out;
+
+	if (ZBX_VC_MODE_LOWMEM == vc_cache->mode)
+		vc_warn_low_memory();
 
-	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &index))
+	if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
 	{
-		/* return empty vector with success */
+		if (ZBX_VC_MODE_NORMAL != vc_cache->mode)
+			goto out;
+
+		memset(&new_item, 0, sizeof(new_item));
+		new_item.itemid = itemid;
+		new_item.value_type = value_type;
+		item = &new_item;
+	}
+	else if (item->value_type != value_type)
 		goto out;
-	}
 
-	/* fill the values vector with item history values until the <count> values are read    */
-	/* or no more values within specified time period                                       */
-	/* fill the values vector with item history values until the start timestamp is reached */
-	while (0 < zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp, &start))
+	ret = vch_item_get_values(item, values, seconds, count, ts);
+out:
+	if (FAIL == ret)
 	{
-		while (index >= chunk->first_value && 0 < zbx_timespec_compare(&chunk->slots[index].timestamp, &start))
-		{
-			vc_history_record_vector_append(values, item->value_type, &chunk->slots[index--]);
+		cache_used = 0;
 
-			if (values->values_num == count)
-				goto out;
-		}
+		vc_unlock();
+		ret = vc_db_get_values(itemid, value_type, values, seconds, count, ts);
+		vc_lock_cache();
 
-		if (NULL == (chunk = chunk->prev))
-			break;
+		if (ZBX_VC_DISABLED != vc_state)
+			vc_remove_item_by_id(itemid);
 
-		index = chunk->last_value;
+		if (SUCCEED == ret)
+			vc_update_statistics(NULL, 0, values->values_num, (int)time(NULL));
 	}
-out:
-	if (count > values->values_num)
-	{
-		if (0 == seconds)
-			return;
 
-		/* not enough data in the requested period, set the range equal to the period plus */
-		/* one second to include nanosecond shifts                                         */
-		range_timestamp = ts->sec - seconds;
-	}
-	else
-	{
-		/* the requested number of values was retrieved, set the range to the oldest value timestamp */
-		range_timestamp = values->values[values->values_num - 1].timestamp.sec - 1;
-	}
+	vc_unlock();
 
-	now = (int)time(NULL);
-	vc_cache_item_update(item->itemid, ZBX_VC_UPDATE_RANGE, now - range_timestamp, now);
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s count:%d cached:%d",
+			__func__, zbx_result_string(ret), values->values_num, cache_used);
+
+	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: get item values for the specified range                           *
+ * Purpose: gets aggregate of numeric item values for the specified period    *
+ *          from running aggregate                                            *
  *                                                                            *
- * Parameters: item      - [IN] the item                                      *
- *             values    - [OUT] the item history data stored time/value      *
- *                         pairs in undefined order, optional                 *
- *                         If null then cache is updated if necessary, but no *
- *                         values are returned. Used to ensure that cache     *
- *                         contains a value of the specified timestamp.       *
- *             seconds   - [IN] the time period to retrieve data for          *
- *             count     - [IN] the number of history values to retrieve      *
- *             ts        - [IN] the target timestamp                          *
+ * Parameters: itemid     - [IN] the item id                                  *
+ *             value_type - [IN] the item value type                          *
+ *             func       - [IN] the aggregate function (ZBX_VC_AGGREGATE_*)  *
+ *             seconds    - [IN] the time period to aggregate values for      *
+ *             count      - [IN] the number of values to aggregate            *
+ *             ts         - [IN] the period end timestamp                     *
+ *             value      - [OUT] the aggregated value - sum, minimum or      *
+ *                                maximum value of item type, average value   *
+ *                                as double. Not set if there are no values.  *
+ *             values_num - [OUT] the number of aggregated values             *
  *                                                                            *
- * Return value:  SUCCEED - the item history data was retrieved successfully  *
- *                FAIL    - the item history data was not retrieved           *
+ * Return value:  SUCCEED - the aggregate was calculated                      *
+ *                FAIL    - the running aggregate is not available, values    *
+ *                          must be retrieved with zbx_vc_get_values()        *
  *                                                                            *
- * Comments: This function returns data from cache if necessary updating it   *
- *           from DB. If cache update was required and failed (not enough     *
- *           memory to cache DB values), then this function also fails.       *
+ * Comments: Either <seconds> or <count> must be set, not both.               *
  *                                                                            *
- *           If <count> is set then value range is defined as <count> values  *
- *           before <timestamp>. Otherwise the range is defined as <seconds>  *
- *           seconds before <timestamp>.                                      *
+ *           Running aggregate is created after the first failed request, so  *
+ *           the caller is expected to fall back to zbx_vc_get_values(),      *
+ *           which also ensures that window values are cached.                *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_get_values(zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
-		int count, const zbx_timespec_t *ts)
+int	zbx_vc_get_aggregate(zbx_uint64_t itemid, unsigned char value_type, int func, int seconds, int count,
+		const zbx_timespec_t *ts, zbx_history_value_t *value, int *values_num)
 {
-	int	ret, records_read, hits, misses, range_start;
+	zbx_vc_item_t			*item;
+	zbx_vc_aggregate_t		*aggr;
+	const zbx_history_record_t	*last;
+	const zbx_history_value_t	*bound;
+	zbx_uint64_t			sum_ui64;
+	double				sum_dbl, sum_comp;
+	int				ret = FAIL, skip = 0, now;
+
+	if (ITEM_VALUE_TYPE_FLOAT != value_type && ITEM_VALUE_TYPE_UINT64 != value_type)
+		return FAIL;
 
-	zbx_vector_history_record_clear(values);
+	if ((0 == seconds) == (0 == count))
+		return FAIL;
 
-	if (0 == count)
-	{
-		if (0 > (range_start = ts->sec - seconds))
-			range_start = 0;
+	vc_lock_items(VC_ITEM_LOCK_INDEX(itemid), ZBX_VC_LOCK_ITEM_READ);
 
-		if (FAIL == (ret = vch_item_cache_values_by_time(&item, range_start)))
-			goto out;
+	if (ZBX_VC_DISABLED == vc_state)
+		goto out;
 
-		records_read = ret;
+	if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)) ||
+			item->value_type != value_type)
+	{
+		goto out;
+	}
 
-		vch_item_get_values_by_time(item, values, seconds, ts);
+	/* request the aggregate to be created or mark it as used */
+	vc_cache_item_update(itemid, ZBX_VC_UPDATE_AGGREGATE, seconds, count);
 
-		if (records_read > values->values_num)
-			records_read = values->values_num;
-	}
-	else
+	for (aggr = item->aggregates; NULL != aggr; aggr = aggr->next)
 	{
-		range_start = (0 == seconds ? 0 : ts->sec - seconds);
+		if (aggr->seconds == seconds && aggr->count == count)
+			break;
+	}
 
-		if (FAIL == (ret = vch_item_cache_values_by_time_and_count(&item, range_start, count, ts)))
-			goto out;
+	if (NULL == aggr)
+		goto out;
 
-		records_read = ret;
+	/* the aggregate window ends with the last item value */
+	last = &item->head->slots[item->head->last_value];
 
-		vch_item_get_values_by_time_and_count(item, values, seconds, count, ts);
+	if (0 > zbx_timespec_compare(ts, &last->timestamp))
+		goto out;
 
-		if (records_read > values->values_num)
-			records_read = values->values_num;
+	now = (int)time(NULL);
+	sum_ui64 = aggr->sum_ui64;
+	sum_dbl = aggr->sum_dbl;
+	sum_comp = aggr->sum_comp;
+
+	if (0 != seconds)
+	{
+		zbx_timespec_t	start = {ts->sec - seconds, ts->ns};
+		zbx_vc_cursor_t	cursor = aggr->first;
+
+		/* exclude the oldest window values outside the requested period */
+		while (skip < aggr->values_num && 0 >= zbx_timespec_compare(&cursor.record.timestamp, &start))
+		{
+			if (ITEM_VALUE_TYPE_FLOAT == value_type)
+			{
+				vc_sum_add(&sum_dbl, &sum_comp, -cursor.record.value.dbl);
+			}
+			else
+			{
+				sum_ui64 -= cursor.record.value.ui64;
+				vc_sum_add(&sum_dbl, &sum_comp, -(double)cursor.record.value.ui64);
+			}
+
+			skip++;
+			vc_cursor_next(&cursor);
+		}
+
+		/* add another second to include nanosecond shifts */
+		vc_cache_item_update(itemid, ZBX_VC_UPDATE_RANGE, seconds + now - ts->sec + 1, now);
+	}
+	else if (aggr->values_num == count)
+	{
+		vc_cache_item_update(itemid, ZBX_VC_UPDATE_RANGE, now - aggr->first.record.timestamp.sec + 1, now);
 	}
 
-	hits = values->values_num - records_read;
-	misses = records_read;
+	*values_num = aggr->values_num - skip;
 
-	vc_cache_item_update(item->itemid, ZBX_VC_UPDATE_STATS, hits, misses);
+	switch (func)
+	{
+		case ZBX_VC_AGGREGATE_SUM:
+		case ZBX_VC_AGGREGATE_AVG:
+			if (ITEM_VALUE_TYPE_UINT64 == value_type && ZBX_VC_AGGREGATE_SUM == func)
+				value->ui64 = sum_ui64;
+			else
+				value->dbl = sum_dbl + sum_comp;
+
+			if (ZBX_VC_AGGREGATE_AVG == func && 0 != *values_num)
+				value->dbl /= *values_num;
+			break;
+		case ZBX_VC_AGGREGATE_MIN:
+			if (NULL != (bound = vc_deque_get_value(aggr, &aggr->min, skip)))
+				*value = *bound;
+			break;
+		case ZBX_VC_AGGREGATE_MAX:
+			if (NULL != (bound = vc_deque_get_value(aggr, &aggr->max, skip)))
+				*value = *bound;
+			break;
+	}
+
+	vc_cache_item_update(itemid, ZBX_VC_UPDATE_STATS, *values_num, 0);
 
 	ret = SUCCEED;
 out:
+	vc_unlock();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() itemid:" ZBX_FS_UI64 " func:%d count:%d period:%d end_timestamp:'%s'"
+			" result:%s", __func__, itemid, func, count, seconds, zbx_timespec_str(ts),
+			zbx_result_string(ret));
+
 	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: frees resources allocated for item history data                   *
+ * Purpose: get the last history value with a timestamp less or equal to the  *
+ *          target timestamp                                                  *
  *                                                                            *
- * Parameters: item    - [IN] the item                                        *
+ * Parameters: itemid     - [IN] the item id                                  *
+ *             value_type - [IN] the item value type                          *
+ *             ts         - [IN] the target timestamp                         *
+ *             value      - [OUT] the value found                             *
  *                                                                            *
- * Return value: the size of freed memory (bytes)                             *
+ * Return Value: SUCCEED - the item was retrieved                             *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: Depending on the value type this function might allocate memory  *
+ *           to store value data. To free it use zbx_vc_history_value_clear() *
+ *           function.                                                        *
  *                                                                            *
  ******************************************************************************/
-static size_t	vch_item_free_cache(zbx_vc_item_t *item)
+int	zbx_vc_get_value(zbx_uint64_t itemid, unsigned char value_type, const zbx_timespec_t *ts,
+		zbx_history_record_t *value)
 {
-	size_t	freed = 0;
+	zbx_vector_history_record_t	values;
+	int				ret = FAIL;
 
-	zbx_vc_chunk_t	*chunk = item->tail;
+	zbx_history_record_vector_create(&values);
 
-	while (NULL != chunk)
-	{
-		zbx_vc_chunk_t	*next = chunk->next;
+	if (SUCCEED != zbx_vc_get_values(itemid, value_type, &values, ts->sec, 1, ts) || 0 == values.values_num)
+		goto out;
 
-		freed += vch_item_free_chunk(item, chunk);
-		chunk = next;
-	}
-	item->values_total = 0;
-	item->head = NULL;
-	item->tail = NULL;
+	*value = values.values[0];
 
-	return freed;
-}
+	/* reset values vector size so the returned value is not cleared when destroying the vector */
+	values.values_num = 0;
 
-/******************************************************************************************************************
- *                                                                                                                *
- * Public API                                                                                                     *
- *                                                                                                                *
- ******************************************************************************************************************/
+	ret = SUCCEED;
+out:
+	zbx_history_record_vector_destroy(&values, value_type);
+
+	return ret;
+}
 
 /******************************************************************************
  *                                                                            *
- * Purpose: initializes value cache                                           *
+ * Purpose: retrieves usage cache statistics                                  *
+ *                                                                            *
+ * Parameters: stats     - [OUT] the cache usage statistics                   *
+ *                                                                            *
+ * Return value:  SUCCEED - the cache statistics were retrieved successfully  *
+ *                FAIL    - failed to retrieve cache statistics               *
+ *                          (cache was not initialized)                       *
  *                                                                            *
  ******************************************************************************/
-int	zbx_vc_init(zbx_uint64_t value_cache_size, char **error)
+int	zbx_vc_get_statistics(zbx_vc_stats_t *stats)
 {
-	zbx_uint64_t	size_reserved;
-	int		ret = FAIL;
-
-	if (0 == value_cache_size)
-		return SUCCEED;
-
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
+	if (ZBX_VC_DISABLED == vc_state)
+		return FAIL;
 
-	if (SUCCEED != (ret = zbx_rwlock_create(&vc_lock, ZBX_RWLOCK_VALUECACHE, error)))
-		goto out;
+	RDLOCK_CACHE;
 
-	size_reserved = zbx_shmem_required_size(1, "value cache size", "ValueCacheSize");
+	stats->hits = vc_cache->hits;
+	stats->misses = vc_cache->misses;
+	stats->mode = vc_cache->mode;
 
-	if (SUCCEED != zbx_shmem_create(&vc_mem, value_cache_size, "value cache size", "ValueCacheSize", 1,
-			error))
-	{
-		goto out;
-	}
+	LOCK_SHMEM;
+	stats->total_size = vc_mem->total_size;
+	stats->free_size = vc_mem->free_size;
+	UNLOCK_SHMEM;
 
-	value_cache_size -= size_reserved;
+	UNLOCK_CACHE;
 
-	vc_cache = (zbx_vc_cache_t *)__vc_shmem_malloc_func(vc_cache, sizeof(zbx_vc_cache_t));
+	return SUCCEED;
+}
 
-	if (NULL == vc_cache)
-	{
-		*error = zbx_strdup(*error, "cannot allocate value cache header");
-		goto out;
-	}
-	memset(vc_cache, 0, sizeof(zbx_vc_cache_t));
+/******************************************************************************
+ *                                                                            *
+ * Purpose: enables value caching for current process                         *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_enable(void)
+{
+	if (NULL != vc_cache)
+		vc_state = ZBX_VC_ENABLED;
+}
 
-	zbx_hashset_create_ext(&vc_cache->items, VC_ITEMS_INIT_SIZE,
-			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL,
-			__vc_shmem_malloc_func, __vc_shmem_realloc_func, __vc_shmem_free_func);
+/******************************************************************************
+ *                                                                            *
+ * Purpose: disables value caching for current process                        *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_disable(void)
+{
+	vc_state = ZBX_VC_DISABLED;
+}
 
-	if (NULL == vc_cache->items.slots)
-	{
-		*error = zbx_strdup(*error, "cannot allocate value cache data storage");
-		goto out;
-	}
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get value cache diagnostic statistics                             *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_get_diag_stats(zbx_uint64_t *items_num, zbx_uint64_t *values_num, int *mode)
+{
+	zbx_hashset_iter_t	iter;
+	zbx_vc_item_t		*item;
 
-	zbx_hashset_create_ext(&vc_cache->strpool, VC_STRPOOL_INIT_SIZE,
-			vc_strpool_hash_func, vc_strpool_compare_func, NULL,
-			__vc_shmem_malloc_func, __vc_shmem_realloc_func, __vc_shmem_free_func);
+	*values_num = 0;
 
-	if (NULL == vc_cache->strpool.slots)
+	if (ZBX_VC_DISABLED == vc_state)
 	{
-		*error = zbx_strdup(*error, "cannot allocate string pool for value cache data storage");
-		goto out;
+		*items_num = 0;
+		*mode = -1;
+		return;
 	}
 
-	/* the free space request should be 5% of cache size, but no more than 128KB */
-	vc_cache->min_free_request = (value_cache_size / 100) * 5;
-	if (vc_cache->min_free_request > 128 * ZBX_KIBIBYTE)
-		vc_cache->min_free_request = 128 * ZBX_KIBIBYTE;
+	RDLOCK_CACHE;
 
-	zbx_vector_vc_itemupdate_create(&vc_itemupdates);
-	zbx_vector_vc_itemupdate_reserve(&vc_itemupdates, 256);
+	*items_num = (zbx_uint64_t)vc_cache->items.num_data;
+	*mode = vc_cache->mode;
 
-	ret = SUCCEED;
-out:
-	zbx_vc_disable();
+	zbx_hashset_iter_reset(&vc_cache->items, &iter);
+	while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
+		*values_num += (zbx_uint64_t)item->values_total;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+	UNLOCK_CACHE;
+}
 
-	return ret;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get value cache shared memory statistics                          *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_get_mem_stats(zbx_shmem_stats_t *mem)
+{
+	if (ZBX_VC_DISABLED == vc_state)
+	{
+		memset(mem, 0, sizeof(zbx_shmem_stats_t));
+		return;
+	}
+
+	RDLOCK_CACHE;
+	LOCK_SHMEM;
+	zbx_shmem_get_stats(vc_mem, mem);
+	UNLOCK_SHMEM;
+	UNLOCK_CACHE;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: destroys value cache                                              *
+ * Purpose: get statistics of cached items                                    *
  *                                                                            *
  ******************************************************************************/
-void	zbx_vc_destroy(void)
+void	zbx_vc_get_item_stats(zbx_vector_ptr_t *stats)
 {
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
+	zbx_hashset_iter_t	iter;
+	zbx_vc_item_t		*item;
+	zbx_vc_item_stats_t	*item_stats;
 
-	if (NULL != vc_cache)
-	{
-		zbx_vector_vc_itemupdate_destroy(&vc_itemupdates);
+	if (ZBX_VC_DISABLED == vc_state)
+		return;
 
-		zbx_hashset_destroy(&vc_cache->items);
-		zbx_hashset_destroy(&vc_cache->strpool);
+	RDLOCK_CACHE;
 
-		__vc_shmem_free_func(vc_cache);
-		vc_cache = NULL;
+	zbx_vector_ptr_reserve(stats, (size_t)vc_cache->items.num_data);
 
-		zbx_shmem_destroy(vc_mem);
-		vc_mem = NULL;
-		zbx_rwlock_destroy(&vc_lock);
+	zbx_hashset_iter_reset(&vc_cache->items, &iter);
+	while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
+	{
+		item_stats = (zbx_vc_item_stats_t *)zbx_malloc(NULL, sizeof(zbx_vc_item_stats_t));
+		item_stats->itemid = item->itemid;
+		item_stats->values_num = item->values_total;
+		item_stats->hourly_num = item->last_hourly_num;
+		zbx_vector_ptr_append(stats, item_stats);
 	}
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+	UNLOCK_CACHE;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: resets value cache                                                *
- *                                                                            *
- * Comments: All items and their historical data are removed,                 *
- *           cache working mode, statistics reset.                            *
+ * Purpose: flush locally cached statistics                                   *
  *                                                                            *
  ******************************************************************************/
-void	zbx_vc_reset(void)
+void	zbx_vc_flush_stats(void)
 {
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
+	int		i, index, now;
+	zbx_vc_item_t	*item = NULL;
+	zbx_uint64_t	itemid;
 
-	if (NULL != vc_cache)
-	{
-		zbx_vc_item_t		*item;
-		zbx_hashset_iter_t	iter;
+	if (ZBX_VC_DISABLED == vc_state || 0 == vc_itemupdates.values_num)
+		return;
 
-		WRLOCK_CACHE;
+	zbx_vector_vc_itemupdate_sort(&vc_itemupdates, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 
-		zbx_hashset_iter_reset(&vc_cache->items, &iter);
-		while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
+	now = (int)time(NULL);
+
+	for (index = 0; index < ZBX_VC_ITEM_LOCKS_NUM; index++)
+	{
+		itemid = 0;
+
+		for (i = 0; i < vc_itemupdates.values_num; i++)
 		{
-			vch_item_free_cache(item);
-			zbx_hashset_iter_remove(&iter);
+			zbx_vc_item_update_t	*update = &vc_itemupdates.values[i];
+
+			if (index != VC_ITEM_LOCK_INDEX(update->itemid))
+				continue;
+
+			if (itemid != update->itemid)
+			{
+				if (0 == itemid)
+					vc_lock_items(index, ZBX_VC_LOCK_ITEM_WRITE);
+
+				itemid = update->itemid;
+				item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid);
+			}
+
+			if (NULL == item)
+				continue;
+
+			switch (update->type)
+			{
+				case ZBX_VC_UPDATE_RANGE:
+					vch_item_update_range(item, update->data[ZBX_VC_UPDATE_RANGE_SECONDS],
+							update->data[ZBX_VC_UPDATE_RANGE_NOW]);
+					break;
+				case ZBX_VC_UPDATE_STATS:
+					vc_update_statistics(item, update->data[ZBX_VC_UPDATE_STATS_HITS],
+							update->data[ZBX_VC_UPDATE_STATS_MISSES], now);
+					break;
+				case ZBX_VC_UPDATE_AGGREGATE:
+					vc_item_touch_aggregate(item, update->data[ZBX_VC_UPDATE_AGGREGATE_SECONDS],
+							update->data[ZBX_VC_UPDATE_AGGREGATE_COUNT], now);
+					break;
+			}
 		}
 
-		vc_cache->hits = 0;
-		vc_cache->misses = 0;
-		vc_cache->min_free_request = 0;
-		vc_cache->mode = ZBX_VC_MODE_NORMAL;
-		vc_cache->mode_time = 0;
-		vc_cache->last_warning_time = 0;
+		if (0 != itemid)
+			vc_unlock();
+	}
 
-		UNLOCK_CACHE;
+	/* aggregates might have failed to allocate memory */
+	if (0 != vc_release_size)
+	{
+		vc_lock_cache();
+		vc_release_pending_space();
+		vc_unlock();
 	}
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+	zbx_vector_vc_itemupdate_clear(&vc_itemupdates);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: adds item values to the history and value cache                   *
- *                                                                            *
- * Parameters: history - [IN] item history values                             *
- *                                                                            *
- * Return value: SUCCEED - the values were added successfully                 *
- *               FAIL    - otherwise                                          *
+ * Purpose: add newly created items with triggers to value cachel              *
  *                                                                            *
  ******************************************************************************/
-int	zbx_vc_add_values(zbx_vector_ptr_t *history, int *ret_flush)
+void	zbx_vc_add_new_items(const zbx_vector_uint64_pair_t *items)
 {
-	zbx_vc_item_t		*item;
-	int			i;
-	zbx_dc_history_t	*h;
-
-	if (SUCCEED != zbx_history_add_values(history, ret_flush))
-		return FAIL;
-
 	if (ZBX_VC_DISABLED == vc_state)
-		return SUCCEED;
+		return;
 
 	WRLOCK_CACHE;
 
-	for (i = 0; i < history->values_num; i++)
+	if (ZBX_VC_MODE_NORMAL == vc_cache->mode)
 	{
-		h = (zbx_dc_history_t *)history->values[i];
-
-		item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &h->itemid);
+		int	i;
 
-		if (NULL == item && 0 != (h->flags & ZBX_DC_FLAG_HASTRIGGER) && ZBX_VC_MODE_NORMAL == vc_cache->mode)
+		for (i = 0; i < items->values_num; i++)
 		{
+			if (NULL != zbx_hashset_search(&vc_cache->items, &items->values[i]))
+				continue;
+
 			zbx_vc_item_t	item_local = {
-					.itemid = h->itemid,
-					.value_type = h->value_type,
+					.itemid = items->values[i].first,
+					.value_type = (unsigned char)items->values[i].second,
+					.status = ZBX_ITEM_STATUS_CACHED_ALL,
 					.last_accessed = (int)time(NULL)
 
 			};
 
-			item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &item_local, sizeof(item_local));
-		}
-
-		/* cache new values only after the item history database status is known */
-		if (NULL != item && (ZBX_ITEM_STATUS_CACHED_ALL == item->status || 0 != item->db_cached_from))
-		{
-			zbx_history_record_t	record = {h->ts, h->value};
-			zbx_vc_chunk_t		*head = item->head;
-			int			last_value_timestamp;
-
-			if (NULL != head)
-				last_value_timestamp = head->slots[head->last_value].timestamp.sec;
-			else
-				last_value_timestamp = (int)time(NULL);
-
-			/* If the new value type does not match the item's type in cache remove it, */
-			/* so it's cached with the correct type from correct tables when accessed   */
-			/* next time.                                                               */
-			/* Also remove item if the value adding failed. In this case we             */
-			/* won't have the latest data in cache - so the requests must go directly   */
-			/* to the database.                                                         */
-			if (item->value_type != h->value_type || FAIL == vch_item_add_value_at_head(item, &record))
+			if (NULL == zbx_hashset_insert(&vc_cache->items, &item_local, sizeof(item_local)))
 			{
-				vc_remove_item(item);
-				continue;
+				/* out of memory - cache will switch to low memory mode on next caching request */
+				break;
 			}
-
-			/* try to remove old (unused) chunks if a new chunk was added */
-			if (head != item->head)
-				vch_item_clean_cache(item, last_value_timestamp);
 		}
 	}
 
 	UNLOCK_CACHE;
-
-	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: get item history data for the specified time period               *
- *                                                                            *
- * Parameters: itemid     - [IN] the item id                                  *
- *             value_type - [IN] the item value type                          *
- *             values     - [OUT] the item history data stored time/value     *
- *                          pairs in descending order                         *
- *             seconds    - [IN] the time period to retrieve data for         *
- *             count      - [IN] the number of history values to retrieve     *
- *             ts         - [IN] the period end timestamp                     *
- *                                                                            *
- * Return value:  SUCCEED - the item history data was retrieved successfully  *
- *                FAIL    - the item history data was not retrieved           *
+ * Purpose: saves cached items with their ranges to value cache warm-up file  *
  *                                                                            *
- * Comments: If the data is not in cache, it's read from DB, so this function *
- *           will always return the requested data, unless some error occurs. *
+ * Parameters: path - [IN] the warm-up file path, can be NULL                 *
  *                                                                            *
- *           If <count> is set then value range is defined as <count> values  *
- *           before <timestamp>. Otherwise the range is defined as <seconds>  *
- *           seconds before <timestamp>.                                      *
+ * Comments: This function is called at exit, before destroying value cache.  *
+ *           The file is written under temporary name and renamed, so it's    *
+ *           left intact if the server is terminated while writing it.        *
  *                                                                            *
  ******************************************************************************/
-int	zbx_vc_get_values(zbx_uint64_t itemid, unsigned char value_type, zbx_vector_history_record_t *values,
-		int seconds, int count, const zbx_timespec_t *ts)
+void	zbx_vc_save_items(const char *path)
 {
-	zbx_vc_item_t	*item, new_item;
-	int 		ret = FAIL, cache_used = 1;
-
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid:" ZBX_FS_UI64 " value_type:%d count:%d period:%d end_timestamp"
-			" '%s'", __func__, itemid, value_type, count, seconds, zbx_timespec_str(ts));
+	zbx_vector_vc_warmup_item_t	items;
+	zbx_vc_warmup_header_t		header = {ZBX_VC_WARMUP_SIGNATURE, sizeof(zbx_vc_warmup_item_t)};
+	zbx_hashset_iter_t		iter;
+	zbx_vc_item_t			*item;
+	char				*tmp_path;
+	int				fd;
 
-	RDLOCK_CACHE;
+	if (NULL == path || NULL == vc_cache)
+		return;
 
-	if (ZBX_VC_DISABLED == vc_state)
-		goto out;
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	if (ZBX_VC_MODE_LOWMEM == vc_cache->mode)
-		vc_warn_low_memory();
+	zbx_vector_vc_warmup_item_create(&items);
 
-	if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
-	{
-		if (ZBX_VC_MODE_NORMAL != vc_cache->mode)
-			goto out;
+	RDLOCK_CACHE;
 
-		memset(&new_item, 0, sizeof(new_item));
-		new_item.itemid = itemid;
-		new_item.value_type = value_type;
-		item = &new_item;
-	}
-	else if (item->value_type != value_type)
-		goto out;
+	zbx_vector_vc_warmup_item_reserve(&items, (size_t)vc_cache->items.num_data);
 
-	ret = vch_item_get_values(item, values, seconds, count, ts);
-out:
-	if (FAIL == ret)
+	zbx_hashset_iter_reset(&vc_cache->items, &iter);
+	while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
 	{
-		cache_used = 0;
+		zbx_vc_warmup_item_t	warmup_item;
 
-		UNLOCK_CACHE;
-		ret = vc_db_get_values(itemid, value_type, values, seconds, count, ts);
-		WRLOCK_CACHE;
+		/* skip items without requests */
+		if (0 == item->active_range && 0 == item->daily_range)
+			continue;
 
-		if (ZBX_VC_DISABLED != vc_state)
-			vc_remove_item_by_id(itemid);
+		memset(&warmup_item, 0, sizeof(warmup_item));
+		warmup_item.itemid = item->itemid;
+		warmup_item.range = MAX(item->active_range, item->daily_range);
+		warmup_item.value_type = item->value_type;
 
-		if (SUCCEED == ret)
-			vc_update_statistics(NULL, 0, values->values_num, (int)time(NULL));
+		zbx_vector_vc_warmup_item_append_ptr(&items, &warmup_item);
 	}
 
 	UNLOCK_CACHE;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s count:%d cached:%d",
-			__func__, zbx_result_string(ret), values->values_num, cache_used);
-
-	return ret;
-}
-
-/******************************************************************************
- *                                                                            *
- * Purpose: get the last history value with a timestamp less or equal to the  *
- *          target timestamp                                                  *
- *                                                                            *
- * Parameters: itemid     - [IN] the item id                                  *
- *             value_type - [IN] the item value type                          *
- *             ts         - [IN] the target timestamp                         *
- *             value      - [OUT] the value found                             *
- *                                                                            *
- * Return Value: SUCCEED - the item was retrieved                             *
- *               FAIL    - otherwise                                          *
- *                                                                            *
- * Comments: Depending on the value type this function might allocate memory  *
- *           to store value data. To free it use zbx_vc_history_value_clear() *
- *           function.                                                        *
- *                                                                            *
- ******************************************************************************/
-int	zbx_vc_get_value(zbx_uint64_t itemid, unsigned char value_type, const zbx_timespec_t *ts,
-		zbx_history_record_t *value)
-{
-	zbx_vector_history_record_t	values;
-	int				ret = FAIL;
-
-	zbx_history_record_vector_create(&values);
+	tmp_path = zbx_dsprintf(NULL, "%s.tmp", path);
 
-	if (SUCCEED != zbx_vc_get_values(itemid, value_type, &values, ts->sec, 1, ts) || 0 == values.values_num)
+	if (-1 == (fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot open value cache warm-up file \"%s\": %s", tmp_path,
+				zbx_strerror(errno));
 		goto out;
+	}
 
-	*value = values.values[0];
+	if (SUCCEED != zbx_write_all(fd, (const char *)&header, sizeof(header)) ||
+			SUCCEED != zbx_write_all(fd, (const char *)items.values,
+			sizeof(zbx_vc_warmup_item_t) * (size_t)items.values_num) || 0 != fsync(fd))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot write value cache warm-up file \"%s\": %s", tmp_path,
+				zbx_strerror(errno));
+		close(fd);
+		goto out;
+	}
 
-	/* reset values vector size so the returned value is not cleared when destroying the vector */
-	values.values_num = 0;
+	close(fd);
 
-	ret = SUCCEED;
+	if (0 != rename(tmp_path, path))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot rename value cache warm-up file \"%s\" to \"%s\": %s", tmp_path,
+				path, zbx_strerror(errno));
+	}
 out:
-	zbx_history_record_vector_destroy(&values, value_type);
+	zbx_free(tmp_path);
+	zbx_vector_vc_warmup_item_destroy(&items);
 
-	return ret;
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: retrieves usage cache statistics                                  *
+ * Purpose: loads items listed in value cache warm-up file into cache         *
  *                                                                            *
- * Parameters: stats     - [OUT] the cache usage statistics                   *
+ * Parameters: path - [IN] the warm-up file path, can be NULL                 *
  *                                                                            *
- * Return value:  SUCCEED - the cache statistics were retrieved successfully  *
- *                FAIL    - failed to retrieve cache statistics               *
- *                          (cache was not initialized)                       *
+ * Comments: This function must be called by the main process with database   *
+ *           connection, before history syncers are started. Values of each   *
+ *           item are cached for its saved active range up to now, so the     *
+ *           first trigger evaluations are served from cache.                 *
+ *                                                                            *
+ *           Items restored from dump file by zbx_vc_restore() are validated  *
+ *           against history storage first.                                   *
  *                                                                            *
  ******************************************************************************/
-int	zbx_vc_get_statistics(zbx_vc_stats_t *stats)
+void	zbx_vc_warmup(const char *path)
 {
+	zbx_vector_vc_warmup_item_t	items;
+	zbx_vc_warmup_t			warmup;
+	zbx_vc_warmup_batch_t		*batch;
+	int				i, j, now, ret, items_num = 0;
+	zbx_uint64_t			values_num = 0;
+	double				sec;
+
 	if (ZBX_VC_DISABLED == vc_state)
-		return FAIL;
+		return;
 
-	RDLOCK_CACHE;
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	stats->hits = vc_cache->hits;
-	stats->misses = vc_cache->misses;
-	stats->mode = vc_cache->mode;
+	vc_restored_items_validate();
 
-	stats->total_size = vc_mem->total_size;
-	stats->free_size = vc_mem->free_size;
+	zbx_vector_vc_warmup_item_create(&items);
 
-	UNLOCK_CACHE;
+	if (NULL == path || SUCCEED != vc_warmup_read_items(path, &items) || 0 == items.values_num)
+		goto out;
 
-	return SUCCEED;
-}
+	sec = zbx_time();
+	now = (int)time(NULL);
 
-/******************************************************************************
- *                                                                            *
- * Purpose: enables value caching for current process                         *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_enable(void)
-{
-	if (NULL != vc_cache)
-		vc_state = ZBX_VC_ENABLED;
-}
+	/* group items with the same value type and similar range into batches */
+	zbx_vector_vc_warmup_item_sort(&items, vc_warmup_item_compare_func);
 
-/******************************************************************************
- *                                                                            *
- * Purpose: disables value caching for current process                        *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_disable(void)
-{
-	vc_state = ZBX_VC_DISABLED;
-}
+	memset(&warmup, 0, sizeof(warmup));
+	warmup.batches = (zbx_vc_warmup_batch_t *)zbx_malloc(NULL,
+			sizeof(zbx_vc_warmup_batch_t) * (size_t)items.values_num);
 
-/******************************************************************************
- *                                                                            *
- * Purpose: get value cache diagnostic statistics                             *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_get_diag_stats(zbx_uint64_t *items_num, zbx_uint64_t *values_num, int *mode)
-{
-	zbx_hashset_iter_t	iter;
-	zbx_vc_item_t		*item;
+	for (i = 0; i < items.values_num; i = j)
+	{
+		j = i + 1;
+		while (j < items.values_num && ZBX_VC_WARMUP_BATCH_SIZE > j - i &&
+				items.values[j].value_type == items.values[i].value_type)
+		{
+			j++;
+		}
 
-	*values_num = 0;
+		batch = &warmup.batches[warmup.batches_num++];
+		batch->items = items.values + i;
+		batch->items_num = j - i;
+		batch->value_type = items.values[i].value_type;
+		batch->state = ZBX_VC_WARMUP_BATCH_QUEUED;
 
-	if (ZBX_VC_DISABLED == vc_state)
-	{
-		*items_num = 0;
-		*mode = -1;
-		return;
+		/* the last item has the largest range */
+		batch->range_start = now - items.values[j - 1].range;
+
+		qsort(batch->items, (size_t)batch->items_num, sizeof(zbx_vc_warmup_item_t),
+				vc_warmup_itemid_compare_func);
 	}
 
-	RDLOCK_CACHE;
+	pthread_mutex_init(&warmup.lock, NULL);
+	pthread_cond_init(&warmup.event, NULL);
 
-	*items_num = (zbx_uint64_t)vc_cache->items.num_data;
-	*mode = vc_cache->mode;
+	vc_warmup_start_threads(&warmup);
 
-	zbx_hashset_iter_reset(&vc_cache->items, &iter);
-	while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
-		*values_num += (zbx_uint64_t)item->values_total;
+	/* batches are added to cache in order, reading the next batch if it's not read by helper threads */
+	pthread_mutex_lock(&warmup.lock);
 
-	UNLOCK_CACHE;
-}
+	for (i = 0; i < warmup.batches_num; i++)
+	{
+		batch = &warmup.batches[i];
 
-/******************************************************************************
- *                                                                            *
- * Purpose: get value cache shared memory statistics                          *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_get_mem_stats(zbx_shmem_stats_t *mem)
-{
-	if (ZBX_VC_DISABLED == vc_state)
+		while (ZBX_VC_WARMUP_BATCH_READ != batch->state)
+		{
+			vc_warmup_read_batches(&warmup, i);
+
+			if (ZBX_VC_WARMUP_BATCH_READ != batch->state)
+				pthread_cond_wait(&warmup.event, &warmup.lock);
+		}
+
+		pthread_mutex_unlock(&warmup.lock);
+
+		ret = (SUCCEED == batch->ret ? vc_warmup_add_batch(batch, now, &values_num) : 0);
+		vc_warmup_clear_batch(batch);
+
+		pthread_mutex_lock(&warmup.lock);
+
+		warmup.batches_added = i + 1;
+		pthread_cond_broadcast(&warmup.event);
+
+		if (FAIL == ret)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "value cache is out of memory, stopping warm-up");
+			break;
+		}
+
+		items_num += ret;
+	}
+
+	pthread_mutex_unlock(&warmup.lock);
+
+	vc_warmup_stop_threads(&warmup);
+
+	for (i = 0; i < warmup.batches_num; i++)
 	{
-		memset(mem, 0, sizeof(zbx_shmem_stats_t));
-		return;
+		if (ZBX_VC_WARMUP_BATCH_READ == warmup.batches[i].state)
+			vc_warmup_clear_batch(&warmup.batches[i]);
 	}
 
-	RDLOCK_CACHE;
-	zbx_shmem_get_stats(vc_mem, mem);
-	UNLOCK_CACHE;
+	pthread_cond_destroy(&warmup.event);
+	pthread_mutex_destroy(&warmup.lock);
+	zbx_free(warmup.batches);
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "value cache warm-up loaded %d items with " ZBX_FS_UI64 " values in "
+			ZBX_FS_DBL " sec", items_num, values_num, zbx_time() - sec);
+out:
+	zbx_vector_vc_warmup_item_destroy(&items);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: get statistics of cached items                                    *
+ * Purpose: dumps value cache contents to file                                *
+ *                                                                            *
+ * Parameters: path - [IN] the dump file path, can be NULL                    *
+ *                                                                            *
+ * Comments: This function is called at exit, before destroying value cache.  *
+ *           The file is written under temporary name and renamed, so a       *
+ *           partially written dump is never restored.                        *
  *                                                                            *
  ******************************************************************************/
-void	zbx_vc_get_item_stats(zbx_vector_ptr_t *stats)
+void	zbx_vc_dump(const char *path)
 {
+	zbx_vc_dump_header_t	header = {ZBX_VC_DUMP_SIGNATURE, sizeof(zbx_vc_dump_item_t)};
+	zbx_vc_dump_buf_t	buf;
 	zbx_hashset_iter_t	iter;
 	zbx_vc_item_t		*item;
-	zbx_vc_item_stats_t	*item_stats;
+	char			*tmp_path;
+	int			ret = FAIL, items_num = 0;
 
-	if (ZBX_VC_DISABLED == vc_state)
+	if (NULL == path || NULL == vc_cache)
 		return;
 
-	RDLOCK_CACHE;
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	zbx_vector_ptr_reserve(stats, (size_t)vc_cache->items.num_data);
+	tmp_path = zbx_dsprintf(NULL, "%s.tmp", path);
+
+	if (-1 == (buf.fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot open value cache dump file \"%s\": %s", tmp_path,
+				zbx_strerror(errno));
+		goto out;
+	}
+
+	buf.data = (char *)zbx_malloc(NULL, ZBX_VC_DUMP_BUF_SIZE);
+	buf.offset = 0;
+
+	if (SUCCEED != vc_dump_write(&buf, &header, sizeof(header)))
+		goto close;
+
+	RDLOCK_CACHE;
 
 	zbx_hashset_iter_reset(&vc_cache->items, &iter);
 	while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
 	{
-		item_stats = (zbx_vc_item_stats_t *)zbx_malloc(NULL, sizeof(zbx_vc_item_stats_t));
-		item_stats->itemid = item->itemid;
-		item_stats->values_num = item->values_total;
-		item_stats->hourly_num = item->last_hourly_num;
-		zbx_vector_ptr_append(stats, item_stats);
+		zbx_vc_dump_item_t	dump_item;
+		zbx_vc_chunk_t		*chunk;
+
+		memset(&dump_item, 0, sizeof(dump_item));
+		dump_item.itemid = item->itemid;
+		dump_item.active_range = item->active_range;
+		dump_item.daily_range = item->daily_range;
+		dump_item.db_cached_from = item->db_cached_from;
+		dump_item.values_num = item->values_total;
+		dump_item.value_type = item->value_type;
+		dump_item.status = item->status;
+
+		if (SUCCEED != vc_dump_write(&buf, &dump_item, sizeof(dump_item)))
+			break;
+
+		for (chunk = item->tail; NULL != chunk; chunk = chunk->next)
+		{
+			const zbx_history_record_t	*values;
+			int				i, last;
+
+			values = vch_chunk_get_values(chunk, &last);
+
+			for (i = 0; i <= last; i++)
+			{
+				if (SUCCEED != vc_dump_write_value(&buf, &values[i], item->value_type))
+					break;
+			}
+
+			if (i <= last)
+				break;
+		}
+
+		if (NULL != chunk)
+			break;
+
+		items_num++;
 	}
 
 	UNLOCK_CACHE;
+
+	/* sync file data before renaming, otherwise a crash could leave empty dump file */
+	if (NULL == item && SUCCEED == vc_dump_flush(&buf) && 0 == fsync(buf.fd))
+		ret = SUCCEED;
+close:
+	if (SUCCEED != ret)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot write value cache dump file \"%s\": %s", tmp_path,
+				zbx_strerror(errno));
+	}
+
+	zbx_free(buf.data);
+	close(buf.fd);
+
+	if (SUCCEED == ret)
+	{
+		if (0 != rename(tmp_path, path))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot rename value cache dump file \"%s\" to \"%s\": %s",
+					tmp_path, path, zbx_strerror(errno));
+		}
+		else
+			zabbix_log(LOG_LEVEL_INFORMATION, "value cache dumped %d items", items_num);
+	}
+	else
+		unlink(tmp_path);
+out:
+	zbx_free(tmp_path);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
 /******************************************************************************
  *                                                                            *
- * Purpose: flush locally cached statistics                                   *
+ * Purpose: restores value cache contents from dump file                      *
+ *                                                                            *
+ * Parameters: path - [IN] the dump file path, can be NULL                    *
+ *                                                                            *
+ * Comments: This function is called by the main process right after value    *
+ *           cache initialization. The dump file is removed after restoring,  *
+ *           so it's not restored again after unclean shutdown. Restored      *
+ *           items are validated against history storage by zbx_vc_warmup().  *
+ *           Items without data and items with the last value older than      *
+ *           their request range or ZBX_VC_RESTORE_MAX_GAP are not restored.  *
  *                                                                            *
  ******************************************************************************/
-void	zbx_vc_flush_stats(void)
+void	zbx_vc_restore(const char *path)
 {
-	int		i, now;
-	zbx_vc_item_t	*item = NULL;
-	zbx_uint64_t	itemid = 0;
+	zbx_vc_dump_header_t		header;
+	zbx_vc_dump_buf_t		buf;
+	zbx_vc_dump_item_t		dump_item;
+	zbx_vector_history_record_t	values;
+	zbx_vc_item_t			new_item, *item;
+	int				i, ret, now, last, items_num = 0, skipped_num = 0;
+	zbx_uint64_t			values_num = 0;
+	double				sec;
 
-	if (ZBX_VC_DISABLED == vc_state || 0 == vc_itemupdates.values_num)
+	if (NULL == path || NULL == vc_cache)
 		return;
 
-	zbx_vector_vc_itemupdate_sort(&vc_itemupdates, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
+
+	if (-1 == (buf.fd = open(path, O_RDONLY)))
+	{
+		if (ENOENT != errno)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot open value cache dump file \"%s\": %s", path,
+					zbx_strerror(errno));
+		}
+
+		goto out;
+	}
 
+	sec = zbx_time();
 	now = (int)time(NULL);
 
-	WRLOCK_CACHE;
+	buf.data = (char *)zbx_malloc(NULL, ZBX_VC_DUMP_BUF_SIZE);
+	buf.size = 0;
+	buf.offset = 0;
+
+	if (SUCCEED != vc_dump_read(&buf, &header, sizeof(header)) || ZBX_VC_DUMP_SIGNATURE != header.signature ||
+			sizeof(zbx_vc_dump_item_t) != header.item_size)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "value cache dump file \"%s\" is not compatible with this version", path);
+		goto close;
+	}
+
+	zbx_vector_vc_restored_item_create(&vc_restored_items);
+	vc_restored_items_init = 1;
+
+	zbx_history_record_vector_create(&values);
 
-	for (i = 0; i < vc_itemupdates.values_num; i++)
+	while (SUCCEED == vc_dump_read(&buf, &dump_item, sizeof(dump_item)))
 	{
-		zbx_vc_item_update_t	*update = &vc_itemupdates.values[i];
+		zbx_vc_restored_item_t	restored;
 
-		if (itemid != update->itemid)
+		if (ITEM_VALUE_TYPE_FLOAT != dump_item.value_type && ITEM_VALUE_TYPE_UINT64 != dump_item.value_type &&
+				ITEM_VALUE_TYPE_STR != dump_item.value_type &&
+				ITEM_VALUE_TYPE_TEXT != dump_item.value_type &&
+				ITEM_VALUE_TYPE_LOG != dump_item.value_type)
 		{
-			itemid = update->itemid;
-			item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid);
+			zabbix_log(LOG_LEVEL_WARNING, "invalid data in value cache dump file \"%s\"", path);
+			break;
 		}
 
-		if (NULL == item)
-			continue;
-
-		switch (update->type)
+		for (i = 0; i < dump_item.values_num; i++)
 		{
-			case ZBX_VC_UPDATE_RANGE:
-				vch_item_update_range(item, update->data[ZBX_VC_UPDATE_RANGE_SECONDS],
-						update->data[ZBX_VC_UPDATE_RANGE_NOW]);
-				break;
-			case ZBX_VC_UPDATE_STATS:
-				vc_update_statistics(item, update->data[ZBX_VC_UPDATE_STATS_HITS],
-						update->data[ZBX_VC_UPDATE_STATS_MISSES], now);
+			zbx_history_record_t	value;
+
+			if (SUCCEED != vc_dump_read_value(&buf, &value, dump_item.value_type))
 				break;
+
+			zbx_vector_history_record_append_ptr(&values, &value);
 		}
-	}
 
-	UNLOCK_CACHE;
+		if (i != dump_item.values_num)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "unexpected end of value cache dump file \"%s\"", path);
+			zbx_history_record_vector_clean(&values, dump_item.value_type);
+			break;
+		}
 
-	zbx_vector_vc_itemupdate_clear(&vc_itemupdates);
-}
+		/* skip items without data and items with values older than request range or maximum gap */
+		if (0 != values.values_num)
+			last = values.values[values.values_num - 1].timestamp.sec;
+		else
+			last = dump_item.db_cached_from;
 
-/******************************************************************************
- *                                                                            *
- * Purpose: add newly created items with triggers to value cachel              *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_add_new_items(const zbx_vector_uint64_pair_t *items)
-{
-	if (ZBX_VC_DISABLED == vc_state)
-		return;
+		if (0 == last || now - last > MIN(MAX(dump_item.active_range, dump_item.daily_range),
+				ZBX_VC_RESTORE_MAX_GAP))
+		{
+			zbx_history_record_vector_clean(&values, dump_item.value_type);
+			skipped_num++;
+			continue;
+		}
 
-	WRLOCK_CACHE;
+		memset(&new_item, 0, sizeof(new_item));
+		new_item.itemid = dump_item.itemid;
+		new_item.value_type = dump_item.value_type;
+		new_item.status = dump_item.status;
+		new_item.range_sync_hour = (unsigned char)((now / SEC_PER_HOUR) & 0xff);
+		new_item.last_accessed = now;
+		new_item.active_range = dump_item.active_range;
+		new_item.daily_range = dump_item.daily_range;
+		new_item.db_cached_from = dump_item.db_cached_from;
 
-	if (ZBX_VC_MODE_NORMAL == vc_cache->mode)
-	{
-		int	i;
+		ret = FAIL;
 
-		for (i = 0; i < items->values_num; i++)
+		vc_lock_cache();
+
+		if (ZBX_VC_MODE_NORMAL == vc_cache->mode && NULL != (item = (zbx_vc_item_t *)zbx_hashset_insert(
+				&vc_cache->items, &new_item, sizeof(new_item))))
 		{
-			if (NULL != zbx_hashset_search(&vc_cache->items, &items->values[i]))
-				continue;
+			if (0 == values.values_num ||
+					SUCCEED == vch_item_add_values_at_tail(item, values.values, values.values_num))
+			{
+				ret = SUCCEED;
+			}
+			else
+				vc_remove_item_by_id(dump_item.itemid);
+		}
 
-			zbx_vc_item_t	item_local = {
-					.itemid = items->values[i].first,
-					.value_type = (unsigned char)items->values[i].second,
-					.status = ZBX_ITEM_STATUS_CACHED_ALL,
-					.last_accessed = (int)time(NULL)
+		vc_unlock();
 
-			};
+		if (SUCCEED == ret)
+		{
+			restored.itemid = dump_item.itemid;
+			restored.value_type = dump_item.value_type;
 
-			if (NULL == zbx_hashset_insert(&vc_cache->items, &item_local, sizeof(item_local)))
+			if (0 != values.values_num)
 			{
-				/* out of memory - cache will switch to low memory mode on next caching request */
-				break;
+				restored.last = values.values[values.values_num - 1].timestamp;
+			}
+			else
+			{
+				restored.last.sec = dump_item.db_cached_from;
+				restored.last.ns = -1;
 			}
+
+			zbx_vector_vc_restored_item_append_ptr(&vc_restored_items, &restored);
+
+			items_num++;
+			values_num += (zbx_uint64_t)values.values_num;
+		}
+
+		zbx_history_record_vector_clean(&values, dump_item.value_type);
+
+		if (SUCCEED != ret)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "value cache is out of memory, stopping restore");
+			break;
 		}
 	}
 
-	UNLOCK_CACHE;
+	zbx_vector_history_record_destroy(&values);
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "value cache restored %d items with " ZBX_FS_UI64 " values in " ZBX_FS_DBL
+			" sec, %d items were skipped", items_num, values_num, zbx_time() - sec, skipped_num);
+close:
+	zbx_free(buf.data);
+	close(buf.fd);
+
+	if (0 != unlink(path))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot remove value cache dump file \"%s\": %s", path,
+				zbx_strerror(errno));
+	}
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
@@ -65,22 +65,23 @@ struct zbx_db_result
 #endif
 };
 
-static int		txn_level = 0;	/* transaction level, nested transactions are not supported */
-static int		txn_error = ZBX_DB_OK;	/* failed transaction */
-static int		txn_end_error = ZBX_DB_OK;	/* transaction result */
+/* connection and transaction state is kept per thread so that helper threads can open their own connections */
+static ZBX_THREAD_LOCAL int	txn_level = 0;	/* transaction level, nested transactions are not supported */
+static ZBX_THREAD_LOCAL int	txn_error = ZBX_DB_OK;	/* failed transaction */
+static ZBX_THREAD_LOCAL int	txn_end_error = ZBX_DB_OK;	/* transaction result */
 
-static char		*last_db_strerror = NULL;	/* last database error message */
+static ZBX_THREAD_LOCAL char	*last_db_strerror = NULL;	/* last database error message */
 
 static int		config_log_slow_queries;
 
 static int		db_auto_increment;
 
 #if defined(HAVE_MYSQL)
-static MYSQL			*conn = NULL;
-static int			mysql_err_cnt = 0;
+static ZBX_THREAD_LOCAL MYSQL	*conn = NULL;
+static ZBX_THREAD_LOCAL int	mysql_err_cnt = 0;
 static zbx_uint32_t		ZBX_MYSQL_SVERSION = ZBX_DBVERSION_UNDEFINED;
 static int			ZBX_MARIADB_SFORK = OFF;
-static int			txn_begin = 0;	/* transaction begin statement is executed */
+static ZBX_THREAD_LOCAL int	txn_begin = 0;	/* transaction begin statement is executed */
 #elif defined(HAVE_ORACLE)
 #include "zbxalgo.h"
 
@@ -108,14 +109,14 @@ static ub4	OCI_DBserver_status(void);
 #define ZBX_PG_UNIQUE_VIOLATION	"23505"
 #define ZBX_PG_DEADLOCK		"40P01"
 
-static PGconn			*conn = NULL;
+static ZBX_THREAD_LOCAL PGconn	*conn = NULL;
 static unsigned int		ZBX_PG_BYTEAOID = 0;
 static int			ZBX_TSDB_VERSION = -1;
 static zbx_uint32_t		ZBX_PG_SVERSION = ZBX_DBVERSION_UNDEFINED;
 char				ZBX_PG_ESCAPE_BACKSLASH = 1;
 static int 			ZBX_TIMESCALE_COMPRESSION_AVAILABLE = OFF;
 #elif defined(HAVE_SQLITE3)
-static sqlite3			*conn = NULL;
+static ZBX_THREAD_LOCAL sqlite3	*conn = NULL;
 static zbx_mutex_t		sqlite_access = ZBX_MUTEX_NULL;
 #endif
 
@@ -124,7 +125,7 @@ static void	OCI_DBclean_result_handle(zbx_db_result_t result);
 static void	OCI_DBclean_result(zbx_db_result_t result);
 #endif
 
-static zbx_err_codes_t last_db_errcode;
+static ZBX_THREAD_LOCAL zbx_err_codes_t	last_db_errcode;
 
 static void	zbx_db_errlog(zbx_err_codes_t zbx_errno, int db_errno, const char *db_error, const char *context)
 {
@@ -397,6 +398,37 @@ static int	is_recoverable_postgresql_error(const PGconn *pg_conn, const PGresult
 
 	return FAIL;
 }
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: logs failed PostgreSQL statement result                           *
+ *                                                                            *
+ * Parameters: pg_result - [IN] the failed statement result                   *
+ *             sql       - [IN] the executed statement                        *
+ *                                                                            *
+ * Return value: ZBX_DB_DOWN - the error is recoverable                       *
+ *               ZBX_DB_FAIL - otherwise                                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	zbx_postgresql_execute_error(const PGresult *pg_result, const char *sql)
+{
+	zbx_err_codes_t	errcode;
+	char		*error = NULL;
+
+	zbx_postgresql_error(&error, pg_result);
+
+	if (0 == zbx_strcmp_null(PQresultErrorField(pg_result, PG_DIAG_SQLSTATE), ZBX_PG_UNIQUE_VIOLATION))
+		errcode = ERR_Z3008;
+	else if (0 == zbx_strcmp_null(PQresultErrorField(pg_result, PG_DIAG_SQLSTATE), ZBX_PG_READ_ONLY))
+		errcode = ERR_Z3009;
+	else
+		errcode = ERR_Z3005;
+
+	zbx_db_errlog(errcode, 0, error, sql);
+	zbx_free(error);
+
+	return (SUCCEED == is_recoverable_postgresql_error(conn, pg_result) ? ZBX_DB_DOWN : ZBX_DB_FAIL);
+}
 #endif
 
 /******************************************************************************
@@ -1031,6 +1063,22 @@ void	zbx_db_close_basic(void)
 #endif
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: releases database client library resources allocated for the     *
+ *          calling thread                                                    *
+ *                                                                            *
+ * Comments: Must be called by helper threads after closing their database    *
+ *           connection, before the thread exits.                             *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_db_thread_deinit_basic(void)
+{
+#if defined(HAVE_MYSQL)
+	mysql_thread_end();
+#endif
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: start transaction                                                 *
@@ -1489,7 +1537,6 @@ int	zbx_db_vexecute(const char *fmt, va_list args)
 	sword		err = OCI_SUCCESS;
 #elif defined(HAVE_POSTGRESQL)
 	PGresult	*result;
-	char		*error = NULL;
 #elif defined(HAVE_SQLITE3)
 	int		err;
 	char		*error = NULL;
@@ -1587,21 +1634,7 @@ int	zbx_db_vexecute(const char *fmt, va_list args)
 	}
 	else if (PGRES_COMMAND_OK != PQresultStatus(result))
 	{
-		zbx_err_codes_t	errcode;
-
-		zbx_postgresql_error(&error, result);
-
-		if (0 == zbx_strcmp_null(PQresultErrorField(result, PG_DIAG_SQLSTATE), ZBX_PG_UNIQUE_VIOLATION))
-			errcode = ERR_Z3008;
-		else if (0 == zbx_strcmp_null(PQresultErrorField(result, PG_DIAG_SQLSTATE), ZBX_PG_READ_ONLY))
-			errcode = ERR_Z3009;
-		else
-			errcode = ERR_Z3005;
-
-		zbx_db_errlog(errcode, 0, error, sql);
-		zbx_free(error);
-
-		ret = (SUCCEED == is_recoverable_postgresql_error(conn, result) ? ZBX_DB_DOWN : ZBX_DB_FAIL);
+		ret = zbx_postgresql_execute_error(result, sql);
 	}
 
 	if (ZBX_DB_OK == ret)
@@ -1662,6 +1695,113 @@ clean:
 	return ret;
 }
 
+#if defined(HAVE_POSTGRESQL)
+/******************************************************************************
+ *                                                                            *
+ * Purpose: streams rows into table using binary COPY protocol                *
+ *                                                                            *
+ * Parameters: table  - [IN] the target table                                 *
+ *             fields - [IN] the comma separated list of target fields        *
+ *             data   - [IN] the binary COPY data, including header and       *
+ *                           trailer                                          *
+ *             size   - [IN] the data size                                    *
+ *                                                                            *
+ * Return value: ZBX_DB_OK   - the rows were copied                           *
+ *               ZBX_DB_FAIL - failed to copy rows                            *
+ *               ZBX_DB_DOWN - database connection is down                    *
+ *                                                                            *
+ * Comments: Rows are either copied all or none. Duplicate key errors are     *
+ *           reported with ERR_Z3008 error code like failed inserts.          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_db_copy_binary_basic(const char *table, const char *fields, const char *data, size_t size)
+{
+#define ZBX_DB_COPY_CHUNK_SIZE	ZBX_MEBIBYTE
+	char		*sql;
+	int		ret = ZBX_DB_OK;
+	double		sec = 0;
+	size_t		offset, chunk;
+	PGresult	*result;
+
+	if (0 != config_log_slow_queries)
+		sec = zbx_time();
+
+	sql = zbx_dsprintf(NULL, "copy %s (%s) from stdin (format binary)", table, fields);
+
+	if (0 == txn_level)
+		zabbix_log(LOG_LEVEL_DEBUG, "query without transaction detected");
+
+	if (ZBX_DB_OK != txn_error)
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "ignoring query [txnlev:%d] [%s] within failed transaction", txn_level,
+				sql);
+		ret = ZBX_DB_FAIL;
+		goto clean;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "query [txnlev:%d] [%s] [" ZBX_FS_SIZE_T " bytes]", txn_level, sql,
+			(zbx_fs_size_t)size);
+
+	if (NULL == (result = PQexec(conn, sql)))
+	{
+		zbx_db_errlog(ERR_Z3005, 0, "result is NULL", sql);
+		ret = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+		goto out;
+	}
+
+	if (PGRES_COPY_IN != PQresultStatus(result))
+	{
+		ret = zbx_postgresql_execute_error(result, sql);
+		PQclear(result);
+		goto out;
+	}
+
+	PQclear(result);
+
+	for (offset = 0; offset < size; offset += chunk)
+	{
+		if (ZBX_DB_COPY_CHUNK_SIZE < (chunk = size - offset))
+			chunk = ZBX_DB_COPY_CHUNK_SIZE;
+
+		if (1 != PQputCopyData(conn, data + offset, (int)chunk))
+			break;
+	}
+
+	if (offset < size || 1 != PQputCopyEnd(conn, NULL))
+	{
+		zbx_db_errlog(ERR_Z3005, 0, PQerrorMessage(conn), sql);
+		ret = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+	}
+
+	/* the command status is reported after all data are sent, drain all results to keep connection usable */
+	while (NULL != (result = PQgetResult(conn)))
+	{
+		if (ZBX_DB_OK == ret && PGRES_COMMAND_OK != PQresultStatus(result))
+			ret = zbx_postgresql_execute_error(result, sql);
+
+		PQclear(result);
+	}
+out:
+	if (0 != config_log_slow_queries)
+	{
+		sec = zbx_time() - sec;
+		if (sec > (double)config_log_slow_queries / 1000.0)
+			zabbix_log(LOG_LEVEL_WARNING, "slow query: " ZBX_FS_DBL " sec, \"%s\"", sec, sql);
+	}
+
+	if (ZBX_DB_FAIL == ret && 0 < txn_level)
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "query [%s] failed, setting transaction as failed", sql);
+		txn_error = ZBX_DB_FAIL;
+	}
+clean:
+	zbx_free(sql);
+
+	return ret;
+#undef ZBX_DB_COPY_CHUNK_SIZE
+}
+#endif
+
 /******************************************************************************
  *                                                                            *
  * Purpose: execute a select statement                                        *
@@ -2710,7 +2850,7 @@ void	zbx_db_version_json_create(struct zbx_json *json, struct zbx_db_version_inf
  * Return value: DBMS version or DBVERSION_UNDEFINED if unknown               *
  *                                                                            *
  ******************************************************************************/
-static zbx_uint32_t	zbx_dbms_version_get(void)
+zbx_uint32_t	zbx_dbms_version_get(void)
 {
 #if defined(HAVE_MYSQL)
 	return ZBX_MYSQL_SVERSION;
@@ -2723,6 +2863,21 @@ static zbx_uint32_t	zbx_dbms_version_get(void)
 #endif
 }
 
+#if defined(HAVE_MYSQL)
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks if MariaDB fork of MySQL was detected                      *
+ *                                                                            *
+ * Return value: ON  - MariaDB is used                                        *
+ *               OFF - otherwise                                              *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbms_mariadb_used(void)
+{
+	return ZBX_MARIADB_SFORK;
+}
+#endif
+
 /***************************************************************************************************************
  *                                                                                                             *
  * Purpose: retrieves the DB version info, including numeric version value                                     *
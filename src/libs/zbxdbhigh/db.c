@@ -63,7 +63,7 @@
 ZBX_PTR_VECTOR_IMPL(db_event, zbx_db_event *)
 ZBX_PTR_VECTOR_IMPL(events_ptr, zbx_event_t *)
 
-static int	connection_failure;
+static ZBX_THREAD_LOCAL int	connection_failure;
 
 static const zbx_config_dbhigh_t	*zbx_cfg_dbhigh = NULL;
 
@@ -392,6 +392,37 @@ void	zbx_db_statement_prepare(const char *sql)
 }
 #endif
 
+#ifdef HAVE_POSTGRESQL
+/******************************************************************************
+ *                                                                            *
+ * Purpose: copies rows into table using binary COPY protocol                 *
+ *                                                                            *
+ * Comments: retry until DB is up                                             *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_db_copy_binary(const char *table, const char *fields, const char *data, size_t size)
+{
+	int	rc;
+
+	rc = zbx_db_copy_binary_basic(table, fields, data, size);
+
+	while (ZBX_DB_DOWN == rc)
+	{
+		zbx_db_close();
+		zbx_db_connect(ZBX_DB_CONNECT_NORMAL);
+
+		if (ZBX_DB_DOWN == (rc = zbx_db_copy_binary_basic(table, fields, data, size)))
+		{
+			zabbix_log(LOG_LEVEL_ERR, "database is down: retrying in %d seconds", ZBX_DB_WAIT_DOWN);
+			connection_failure = 1;
+			sleep(ZBX_DB_WAIT_DOWN);
+		}
+	}
+
+	return rc;
+}
+#endif
+
 /******************************************************************************
  *                                                                            *
  * Purpose: execute a non-select statement                                    *
@@ -138,6 +138,11 @@ ZBX_THREAD_ENTRY(zbx_dbsyncer_thread, args)
 	if (1 == process_num)
 		db_trigger_queue_cleanup();
 
+	zbx_hc_set_syncer_num(process_num);
+
+	if (0 != (info->program_type & ZBX_PROGRAM_TYPE_SERVER))
+		zbx_hc_history_writer_start();
+
 	zbx_unblock_signals(&orig_mask);
 
 	if (SUCCEED == zbx_is_export_enabled(ZBX_FLAG_EXPTYPE_HISTORY))
@@ -225,6 +230,7 @@ ZBX_THREAD_ENTRY(zbx_dbsyncer_thread, args)
 	if (SUCCEED != zbx_db_trigger_queue_locked())
 		zbx_db_flush_timer_queue();
 
+	zbx_hc_history_writer_stop();
 	zbx_db_close();
 	zbx_unblock_signals(&orig_mask);
 
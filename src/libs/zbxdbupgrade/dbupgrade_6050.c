@@ -3218,6 +3218,36 @@ static int	DBpatch_6050209(void)
 
 	return DBadd_field("config", &field);
 }
+
+static int	DBpatch_6050210(void)
+{
+	return DBcreate_changelog_insert_trigger("globalmacro", "globalmacroid");
+}
+
+static int	DBpatch_6050211(void)
+{
+	return DBcreate_changelog_update_trigger("globalmacro", "globalmacroid");
+}
+
+static int	DBpatch_6050212(void)
+{
+	return DBcreate_changelog_delete_trigger("globalmacro", "globalmacroid");
+}
+
+static int	DBpatch_6050213(void)
+{
+	return DBcreate_changelog_insert_trigger("hostmacro", "hostmacroid");
+}
+
+static int	DBpatch_6050214(void)
+{
+	return DBcreate_changelog_update_trigger("hostmacro", "hostmacroid");
+}
+
+static int	DBpatch_6050215(void)
+{
+	return DBcreate_changelog_delete_trigger("hostmacro", "hostmacroid");
+}
 #endif
 
 DBPATCH_START(6050)
@@ -3432,5 +3462,11 @@ DBPATCH_ADD(6050206, 0, 1)
 DBPATCH_ADD(6050207, 0, 1)
 DBPATCH_ADD(6050208, 0, 1)
 DBPATCH_ADD(6050209, 0, 1)
+DBPATCH_ADD(6050210, 0, 1)
+DBPATCH_ADD(6050211, 0, 1)
+DBPATCH_ADD(6050212, 0, 1)
+DBPATCH_ADD(6050213, 0, 1)
+DBPATCH_ADD(6050214, 0, 1)
+DBPATCH_ADD(6050215, 0, 1)
 
 DBPATCH_END()
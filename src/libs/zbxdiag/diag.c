@@ -23,6 +23,7 @@
 #include "zbxalgo.h"
 #include "zbxshmem.h"
 #include "zbxcachehistory.h"
+#include "zbxcacheconfig.h"
 #include "zbxconnector.h"
 #include "zbxlog.h"
 #include "zbxmutexs.h"
@@ -37,16 +38,22 @@
 #define ZBX_DIAG_HISTORYCACHE_VALUES		0x00000002
 #define ZBX_DIAG_HISTORYCACHE_MEMORY_DATA	0x00000004
 #define ZBX_DIAG_HISTORYCACHE_MEMORY_INDEX	0x00000008
+#define ZBX_DIAG_HISTORYCACHE_MEMORY_SLABS	0x00000010
 
 #define ZBX_DIAG_HISTORYCACHE_SIMPLE	(ZBX_DIAG_HISTORYCACHE_ITEMS | \
 					ZBX_DIAG_HISTORYCACHE_VALUES)
 
 #define ZBX_DIAG_HISTORYCACHE_MEMORY	(ZBX_DIAG_HISTORYCACHE_MEMORY_DATA | \
-					ZBX_DIAG_HISTORYCACHE_MEMORY_INDEX)
+					ZBX_DIAG_HISTORYCACHE_MEMORY_INDEX | \
+					ZBX_DIAG_HISTORYCACHE_MEMORY_SLABS)
 
 #define ZBX_DIAG_CONNECTOR_VALUES			0x00000001
 #define ZBX_DIAG_CONNECTOR_SIMPLE		(ZBX_DIAG_CONNECTOR_VALUES)
 
+#define ZBX_DIAG_CONFIGCACHE_STRPOOL		0x00000001
+#define ZBX_DIAG_CONFIGCACHE_MEMORY		0x00000002
+#define ZBX_DIAG_CONFIGCACHE_USERMACRO		0x00000004
+
 static zbx_diag_add_section_info_func_t	add_diag_cb;
 
 void	zbx_diag_map_free(zbx_diag_map_t *map)
@@ -268,6 +275,7 @@ int	zbx_diag_add_historycache_info(const struct zbx_json_parse *jp, struct zbx_j
 					{"memory", ZBX_DIAG_HISTORYCACHE_MEMORY},
 					{"memory.data", ZBX_DIAG_HISTORYCACHE_MEMORY_DATA},
 					{"memory.index", ZBX_DIAG_HISTORYCACHE_MEMORY_INDEX},
+					{"memory.slabs", ZBX_DIAG_HISTORYCACHE_MEMORY_SLABS},
 					{NULL, 0}
 					};
 
@@ -297,19 +305,49 @@ int	zbx_diag_add_historycache_info(const struct zbx_json_parse *jp, struct zbx_j
 		if (0 != (fields & ZBX_DIAG_HISTORYCACHE_MEMORY))
 		{
 			zbx_shmem_stats_t	data_mem, index_mem, *pdata_mem, *pindex_mem;
+			zbx_vector_ptr_t	slabs;
 
 			pdata_mem = (0 != (fields & ZBX_DIAG_HISTORYCACHE_MEMORY_DATA) ? &data_mem : NULL);
 			pindex_mem = (0 != (fields & ZBX_DIAG_HISTORYCACHE_MEMORY_INDEX) ? &index_mem : NULL);
 
+			zbx_vector_ptr_create(&slabs);
+
 			time1 = zbx_time();
 			zbx_hc_get_mem_stats(pdata_mem, pindex_mem);
+
+			if (0 != (fields & ZBX_DIAG_HISTORYCACHE_MEMORY_SLABS))
+				zbx_hc_get_slab_stats(&slabs);
+
 			time2 = zbx_time();
 			time_total += time2 - time1;
 
 			zbx_json_addobject(json, "memory");
 			zbx_diag_add_mem_stats(json, "data", pdata_mem);
 			zbx_diag_add_mem_stats(json, "index", pindex_mem);
+
+			if (0 != (fields & ZBX_DIAG_HISTORYCACHE_MEMORY_SLABS))
+			{
+				zbx_json_addarray(json, "slabs");
+
+				for (i = 0; i < slabs.values_num; i++)
+				{
+					zbx_hc_slab_stats_t	*slab_stats = (zbx_hc_slab_stats_t *)slabs.values[i];
+
+					zbx_json_addobject(json, NULL);
+					zbx_json_adduint64(json, "size", slab_stats->size);
+					zbx_json_adduint64(json, "slabs", slab_stats->slabs);
+					zbx_json_adduint64(json, "used", slab_stats->used);
+					zbx_json_adduint64(json, "free", slab_stats->free);
+					zbx_json_close(json);
+				}
+
+				zbx_json_close(json);
+			}
+
 			zbx_json_close(json);
+
+			zbx_vector_ptr_clear_ext(&slabs, zbx_ptr_free);
+			zbx_vector_ptr_destroy(&slabs);
 		}
 
 		if (0 != tops.values_num)
@@ -418,15 +456,42 @@ void	zbx_diag_add_locks_info(struct zbx_json *json)
 				"ZBX_MUTEX_VALUECACHE", "ZBX_MUTEX_VMWARE", "ZBX_MUTEX_SQLITE3",
 				"ZBX_MUTEX_PROCSTAT", "ZBX_MUTEX_PROXY_HISTORY", "ZBX_MUTEX_KSTAT", "ZBX_MUTEX_MODBUS",
 				"ZBX_MUTEX_TREND_FUNC", "ZBX_MUTEX_REMOTE_COMMANDS", "ZBX_MUTEX_PROXY_BUFFER",
-				"ZBX_MUTEX_VPS_MONITOR"};
+				"ZBX_MUTEX_VPS_MONITOR", "ZBX_MUTEX_UM_CACHE", "ZBX_MUTEX_ITEM_QUEUE_NORMAL",
+				"ZBX_MUTEX_ITEM_QUEUE_IPMI", "ZBX_MUTEX_ITEM_QUEUE_PINGER",
+				"ZBX_MUTEX_ITEM_QUEUE_HISTORY", "ZBX_MUTEX_ITEM_QUEUE_ODBC",
+				"ZBX_MUTEX_ITEM_QUEUE_HTTPAGENT", "ZBX_MUTEX_ITEM_QUEUE_AGENT",
+				"ZBX_MUTEX_ITEM_QUEUE_SNMP", "ZBX_MUTEX_ITEM_QUEUE_INTERNAL",
+				"ZBX_MUTEX_ITEM_QUEUE_MEM", "ZBX_MUTEX_CACHE_SHARD_0", "ZBX_MUTEX_CACHE_SHARD_1",
+				"ZBX_MUTEX_CACHE_SHARD_2", "ZBX_MUTEX_CACHE_SHARD_3", "ZBX_MUTEX_CACHE_SHARD_4",
+				"ZBX_MUTEX_CACHE_SHARD_5", "ZBX_MUTEX_CACHE_SHARD_6", "ZBX_MUTEX_CACHE_SHARD_7",
+				"ZBX_MUTEX_CACHE_INGEST_0", "ZBX_MUTEX_CACHE_INGEST_1", "ZBX_MUTEX_CACHE_INGEST_2",
+				"ZBX_MUTEX_CACHE_INGEST_3", "ZBX_MUTEX_CACHE_INGEST_4", "ZBX_MUTEX_CACHE_INGEST_5",
+				"ZBX_MUTEX_CACHE_INGEST_6", "ZBX_MUTEX_CACHE_INGEST_7", "ZBX_MUTEX_CACHE_SPILL"};
 #else
 	const char	*names[ZBX_MUTEX_COUNT] = {"ZBX_MUTEX_LOG", "ZBX_MUTEX_CACHE", "ZBX_MUTEX_TRENDS",
 				"ZBX_MUTEX_CACHE_IDS", "ZBX_MUTEX_SELFMON", "ZBX_MUTEX_CPUSTATS", "ZBX_MUTEX_DISKSTATS",
 				"ZBX_MUTEX_VALUECACHE", "ZBX_MUTEX_VMWARE", "ZBX_MUTEX_SQLITE3",
 				"ZBX_MUTEX_PROCSTAT", "ZBX_MUTEX_PROXY_HISTORY", "ZBX_MUTEX_MODBUS",
 				"ZBX_MUTEX_TREND_FUNC", "ZBX_MUTEX_REMOTE_COMMANDS", "ZBX_MUTEX_PROXY_BUFFER",
-				"ZBX_MUTEX_VPS_MONITOR"};
+				"ZBX_MUTEX_VPS_MONITOR", "ZBX_MUTEX_UM_CACHE", "ZBX_MUTEX_ITEM_QUEUE_NORMAL",
+				"ZBX_MUTEX_ITEM_QUEUE_IPMI", "ZBX_MUTEX_ITEM_QUEUE_PINGER",
+				"ZBX_MUTEX_ITEM_QUEUE_HISTORY", "ZBX_MUTEX_ITEM_QUEUE_ODBC",
+				"ZBX_MUTEX_ITEM_QUEUE_HTTPAGENT", "ZBX_MUTEX_ITEM_QUEUE_AGENT",
+				"ZBX_MUTEX_ITEM_QUEUE_SNMP", "ZBX_MUTEX_ITEM_QUEUE_INTERNAL",
+				"ZBX_MUTEX_ITEM_QUEUE_MEM", "ZBX_MUTEX_CACHE_SHARD_0", "ZBX_MUTEX_CACHE_SHARD_1",
+				"ZBX_MUTEX_CACHE_SHARD_2", "ZBX_MUTEX_CACHE_SHARD_3", "ZBX_MUTEX_CACHE_SHARD_4",
+				"ZBX_MUTEX_CACHE_SHARD_5", "ZBX_MUTEX_CACHE_SHARD_6", "ZBX_MUTEX_CACHE_SHARD_7",
+				"ZBX_MUTEX_CACHE_INGEST_0", "ZBX_MUTEX_CACHE_INGEST_1", "ZBX_MUTEX_CACHE_INGEST_2",
+				"ZBX_MUTEX_CACHE_INGEST_3", "ZBX_MUTEX_CACHE_INGEST_4", "ZBX_MUTEX_CACHE_INGEST_5",
+				"ZBX_MUTEX_CACHE_INGEST_6", "ZBX_MUTEX_CACHE_INGEST_7", "ZBX_MUTEX_CACHE_SPILL"};
 #endif
+	const char	*rwlock_names[ZBX_RWLOCK_COUNT] = {"ZBX_RWLOCK_CONFIG", "ZBX_RWLOCK_CONFIG_HISTORY",
+				"ZBX_RWLOCK_VALUECACHE", "ZBX_RWLOCK_VALUECACHE_ITEMS_0",
+				"ZBX_RWLOCK_VALUECACHE_ITEMS_1", "ZBX_RWLOCK_VALUECACHE_ITEMS_2",
+				"ZBX_RWLOCK_VALUECACHE_ITEMS_3", "ZBX_RWLOCK_VALUECACHE_ITEMS_4",
+				"ZBX_RWLOCK_VALUECACHE_ITEMS_5", "ZBX_RWLOCK_VALUECACHE_ITEMS_6",
+				"ZBX_RWLOCK_VALUECACHE_ITEMS_7"};
+
 	zbx_json_addarray(json, ZBX_DIAG_LOCKS);
 
 	for (i = 0; i < ZBX_MUTEX_COUNT; i++)
@@ -436,17 +501,12 @@ void	zbx_diag_add_locks_info(struct zbx_json *json)
 		zbx_json_close(json);
 	}
 
-	zbx_json_addobject(json, NULL);
-	zbx_json_addhex(json, "ZBX_RWLOCK_CONFIG", (zbx_uint64_t)zbx_rwlock_addr_get(ZBX_RWLOCK_CONFIG));
-	zbx_json_close(json);
-
-	zbx_json_addobject(json, NULL);
-	zbx_json_addhex(json, "ZBX_RWLOCK_CONFIG_HISTORY", (zbx_uint64_t)zbx_rwlock_addr_get(ZBX_RWLOCK_CONFIG_HISTORY));
-	zbx_json_close(json);
-
-	zbx_json_addobject(json, NULL);
-	zbx_json_addhex(json, "ZBX_RWLOCK_VALUECACHE", (zbx_uint64_t)zbx_rwlock_addr_get(ZBX_RWLOCK_VALUECACHE));
-	zbx_json_close(json);
+	for (i = 0; i < ZBX_RWLOCK_COUNT; i++)
+	{
+		zbx_json_addobject(json, NULL);
+		zbx_json_addhex(json, rwlock_names[i], (zbx_uint64_t)zbx_rwlock_addr_get(i));
+		zbx_json_close(json);
+	}
 
 	zbx_json_close(json);
 }
@@ -555,6 +615,9 @@ static void	diag_prepare_default_request(struct zbx_json *j, unsigned int flags)
 	if (0 != (flags & (1 << ZBX_DIAGINFO_PROXYBUFFER)))
 		diag_add_section_request(j, ZBX_DIAG_PROXYBUFFER, NULL);
 
+	if (0 != (flags & (1 << ZBX_DIAGINFO_CONFIGCACHE)))
+		diag_add_section_request(j, ZBX_DIAG_CONFIGCACHE, NULL);
+
 }
 
 /******************************************************************************
@@ -702,6 +765,7 @@ static void	diag_log_history_cache(struct zbx_json_parse *jp, char **out, size_t
 
 	diag_log_memory_info(jp, "memory.data", "$.memory.data", out, out_alloc, out_offset);
 	diag_log_memory_info(jp, "memory.index", "$.memory.index", out, out_alloc, out_offset);
+	diag_log_top_view(jp, "memory.slabs", "$.memory.slabs", out, out_alloc, out_offset);
 
 	diag_log_top_view(jp, "top.values", "$.top.values", out, out_alloc, out_offset);
 
@@ -832,6 +896,42 @@ static void	diag_log_proxybuffer(struct zbx_json_parse *jp, char **out, size_t *
 	zbx_strlog_alloc(LOG_LEVEL_INFORMATION, out, out_alloc, out_offset, "==");
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: log configuration cache diagnostic information                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	diag_log_config_cache(struct zbx_json_parse *jp, char **out, size_t *out_alloc, size_t *out_offset)
+{
+	struct zbx_json_parse	jp_strpool, jp_usermacro;
+	char			*msg = NULL;
+
+	zbx_strlog_alloc(LOG_LEVEL_INFORMATION, out, out_alloc, out_offset,
+			"== configuration cache diagnostic information ==");
+
+	diag_get_simple_values(jp, &msg);
+	zbx_strlog_alloc(LOG_LEVEL_INFORMATION, out, out_alloc, out_offset, "%s", msg);
+	zbx_free(msg);
+
+	if (SUCCEED == zbx_json_open_path(jp, "$.strpool", &jp_strpool))
+	{
+		diag_get_simple_values(&jp_strpool, &msg);
+		zbx_strlog_alloc(LOG_LEVEL_INFORMATION, out, out_alloc, out_offset, "strpool: %s", msg);
+		zbx_free(msg);
+	}
+
+	if (SUCCEED == zbx_json_open_path(jp, "$.usermacro", &jp_usermacro))
+	{
+		diag_get_simple_values(&jp_usermacro, &msg);
+		zbx_strlog_alloc(LOG_LEVEL_INFORMATION, out, out_alloc, out_offset, "usermacro: %s", msg);
+		zbx_free(msg);
+	}
+
+	diag_log_memory_info(jp, "memory", "$.memory", out, out_alloc, out_offset);
+
+	zbx_strlog_alloc(LOG_LEVEL_INFORMATION, out, out_alloc, out_offset, "==");
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: log diagnostic information                                        *
@@ -898,6 +998,8 @@ void	zbx_diag_log_info(unsigned int flags, char **result)
 				diag_log_connector(&jp_section, result, &result_alloc, &result_offset);
 			else if (0 == strcmp(section, ZBX_DIAG_PROXYBUFFER))
 				diag_log_proxybuffer(&jp_section, result, &result_alloc, &result_offset);
+			else if (0 == strcmp(section, ZBX_DIAG_CONFIGCACHE))
+				diag_log_config_cache(&jp_section, result, &result_alloc, &result_offset);
 		}
 	}
 	else
@@ -1010,6 +1112,89 @@ out:
 	return ret;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: add requested configuration cache diagnostic information to json  *
+ *          data                                                              *
+ *                                                                            *
+ * Parameters: jp    - [IN] the request                                       *
+ *             json  - [IN/OUT] the json to update                            *
+ *             error - [OUT] error message                                    *
+ *                                                                            *
+ * Return value: SUCCEED - the information was added successfully             *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_diag_add_configcache_info(const struct zbx_json_parse *jp, struct zbx_json *json, char **error)
+{
+	zbx_vector_ptr_t	tops;
+	int			ret;
+	double			time1, time2, time_total = 0;
+	zbx_uint64_t		fields;
+	zbx_diag_map_t		field_map[] = {
+					{"", ZBX_DIAG_CONFIGCACHE_STRPOOL | ZBX_DIAG_CONFIGCACHE_MEMORY |
+							ZBX_DIAG_CONFIGCACHE_USERMACRO},
+					{"strpool", ZBX_DIAG_CONFIGCACHE_STRPOOL},
+					{"memory", ZBX_DIAG_CONFIGCACHE_MEMORY},
+					{"usermacro", ZBX_DIAG_CONFIGCACHE_USERMACRO},
+					{NULL, 0}
+					};
+
+	zbx_vector_ptr_create(&tops);
+
+	if (SUCCEED == (ret = zbx_diag_parse_request(jp, field_map, &fields, &tops, error)))
+	{
+		zbx_json_addobject(json, ZBX_DIAG_CONFIGCACHE);
+
+		if (0 != (fields & ZBX_DIAG_CONFIGCACHE_STRPOOL))
+		{
+			zbx_dc_strpool_stats_t	stats;
+
+			time1 = zbx_time();
+			zbx_dc_get_strpool_stats(&stats);
+			time2 = zbx_time();
+			time_total += time2 - time1;
+
+			zbx_json_addobject(json, "strpool");
+			zbx_json_adduint64(json, "strings", stats.strings_num);
+			zbx_json_adduint64(json, "references", stats.refs_num);
+			zbx_json_adduint64(json, "size", stats.size);
+			zbx_json_adduint64(json, "saved", stats.saved);
+			zbx_json_close(json);
+		}
+
+		if (0 != (fields & ZBX_DIAG_CONFIGCACHE_MEMORY))
+		{
+			zbx_shmem_stats_t	stats;
+
+			time1 = zbx_time();
+			zbx_dc_get_mem_stats(&stats);
+			time2 = zbx_time();
+			time_total += time2 - time1;
+
+			zbx_diag_add_mem_stats(json, "memory", &stats);
+		}
+
+		if (0 != (fields & ZBX_DIAG_CONFIGCACHE_USERMACRO))
+		{
+			zbx_json_addobject(json, "usermacro");
+			zbx_json_adduint64(json, "hits",
+					*(zbx_uint64_t *)zbx_dc_config_get_stats(ZBX_CONFSTATS_UMCACHE_HITS));
+			zbx_json_adduint64(json, "misses",
+					*(zbx_uint64_t *)zbx_dc_config_get_stats(ZBX_CONFSTATS_UMCACHE_MISSES));
+			zbx_json_close(json);
+		}
+
+		zbx_json_addfloat(json, "time", time_total);
+		zbx_json_close(json);
+	}
+
+	zbx_vector_ptr_clear_ext(&tops, (zbx_ptr_free_func_t)zbx_diag_map_free);
+	zbx_vector_ptr_destroy(&tops);
+
+	return ret;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: init section add callback function                                *
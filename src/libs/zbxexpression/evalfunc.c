@@ -1083,6 +1083,7 @@ static int	evaluate_COUNT(zbx_variant_t *value, const zbx_dc_evaluate_item_t *it
 	zbx_vector_history_record_t	values;
 	zbx_timespec_t			ts_end = *ts;
 	zbx_eval_count_pattern_data_t	pdata;
+	zbx_history_value_t		result;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() params:%s", __func__, ZBX_NULL2EMPTY_STR(parameters));
 
@@ -1137,6 +1138,14 @@ static int	evaluate_COUNT(zbx_variant_t *value, const zbx_dc_evaluate_item_t *it
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (OP_ANY == pdata.op && COUNT_ALL == unique && SUCCEED == zbx_vc_get_aggregate(item->itemid,
+			item->value_type, ZBX_VC_AGGREGATE_COUNT, seconds, nvalues, &ts_end, &result, &count))
+	{
+		zbx_variant_set_dbl(value, MIN(count, limit));
+		ret = SUCCEED;
+		goto clean;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -1222,7 +1231,7 @@ out:
 static int	evaluate_SUM(zbx_variant_t *value, const zbx_dc_evaluate_item_t *item, const char *parameters,
 		const zbx_timespec_t *ts, char **error)
 {
-	int				arg1, i, ret = FAIL, seconds = 0, nvalues = 0, time_shift;
+	int				arg1, i, ret = FAIL, seconds = 0, nvalues = 0, time_shift, values_num;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_history_record_t	values;
 	zbx_history_value_t		result;
@@ -1265,6 +1274,17 @@ static int	evaluate_SUM(zbx_variant_t *value, const zbx_dc_evaluate_item_t *item
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type, ZBX_VC_AGGREGATE_SUM, seconds, nvalues,
+			&ts_end, &result, &values_num))
+	{
+		if (0 == values_num)
+			memset(&result, 0, sizeof(result));
+
+		zbx_history_value2variant(&result, item->value_type, value);
+		ret = SUCCEED;
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -1314,10 +1334,11 @@ out:
 static int	evaluate_AVG(zbx_variant_t *value, const zbx_dc_evaluate_item_t *item, const char *parameters,
 		const zbx_timespec_t *ts, char **error)
 {
-	int				arg1, ret = FAIL, i, seconds = 0, nvalues = 0, time_shift;
+	int				arg1, ret = FAIL, i, seconds = 0, nvalues = 0, time_shift, values_num;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_history_record_t	values;
 	zbx_timespec_t			ts_end = *ts;
+	zbx_history_value_t		result;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
@@ -1356,6 +1377,20 @@ static int	evaluate_AVG(zbx_variant_t *value, const zbx_dc_evaluate_item_t *item
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type, ZBX_VC_AGGREGATE_AVG, seconds, nvalues,
+			&ts_end, &result, &values_num))
+	{
+		if (0 < values_num)
+		{
+			zbx_variant_set_dbl(value, result.dbl);
+			ret = SUCCEED;
+		}
+		else
+			*error = zbx_strdup(*error, "not enough data");
+
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -1462,10 +1497,11 @@ static int	evaluate_LAST(zbx_variant_t *value, const zbx_dc_evaluate_item_t *ite
 static int	evaluate_MIN_or_MAX(zbx_variant_t *value, const zbx_dc_evaluate_item_t *item, const char *parameters,
 		const zbx_timespec_t *ts, char **error, int min_or_max)
 {
-	int				arg1, i, ret = FAIL, seconds = 0, nvalues = 0, time_shift;
+	int				arg1, i, ret = FAIL, seconds = 0, nvalues = 0, time_shift, values_num;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_history_record_t	values;
 	zbx_timespec_t			ts_end = *ts;
+	zbx_history_value_t		result;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
@@ -1504,6 +1540,21 @@ static int	evaluate_MIN_or_MAX(zbx_variant_t *value, const zbx_dc_evaluate_item_
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type,
+			EVALUATE_MIN == min_or_max ? ZBX_VC_AGGREGATE_MIN : ZBX_VC_AGGREGATE_MAX, seconds, nvalues,
+			&ts_end, &result, &values_num))
+	{
+		if (0 < values_num)
+		{
+			zbx_history_value2variant(&result, item->value_type, value);
+			ret = SUCCEED;
+		}
+		else
+			*error = zbx_strdup(*error, "not enough data");
+
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -184,6 +184,50 @@ int	zbx_history_get_values(zbx_uint64_t itemid, int value_type, int start, int c
 	return ret;
 }
 
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: gets values of multiple items from history storage                      *
+ *                                                                                  *
+ * Parameters:  itemids       - [IN] the itemids                                    *
+ *              value_type    - [IN] the items value type                           *
+ *              start         - [IN] the period start timestamp                     *
+ *              end           - [IN] the period end timestamp                       *
+ *              value_itemids - [OUT] the itemids of read values                    *
+ *              values        - [OUT] the items history data values                 *
+ *                                                                                  *
+ * Return value: SUCCEED - the history data were read successfully                  *
+ *               FAIL - otherwise or the history storage does not support reading   *
+ *                      values of multiple items                                    *
+ *                                                                                  *
+ * Comments: This function reads all values from ]<start>,<end>] interval. The      *
+ *           values are grouped by itemid in ascending order and value_itemids      *
+ *           holds itemid of the value with the same index.                         *
+ *                                                                                  *
+ ************************************************************************************/
+int	zbx_history_get_values_multi(const zbx_vector_uint64_t *itemids, int value_type, int start, int end,
+		zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values)
+{
+	int			ret, pos;
+	zbx_history_iface_t	*writer = &history_ifaces[value_type];
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() items:%d value_type:%d start:%d end:%d", __func__,
+			itemids->values_num, value_type, start, end);
+
+	if (NULL == writer->get_values_multi)
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "End of %s(): not supported", __func__);
+		return FAIL;
+	}
+
+	pos = values->values_num;
+	ret = writer->get_values_multi(writer, itemids, start, end, value_itemids, values);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s values:%d", __func__, zbx_result_string(ret),
+			values->values_num - pos);
+
+	return ret;
+}
+
 /************************************************************************************
  *                                                                                  *
  * Purpose: checks if the value type requires trends data calculations              *
@@ -33,6 +33,9 @@ typedef void (*zbx_history_destroy_func_t)(struct zbx_history_iface *hist);
 typedef int (*zbx_history_add_values_func_t)(struct zbx_history_iface *hist, const zbx_vector_ptr_t *history);
 typedef int (*zbx_history_get_values_func_t)(struct zbx_history_iface *hist, zbx_uint64_t itemid, int start,
 		int count, int end, zbx_vector_history_record_t *values);
+typedef int (*zbx_history_get_values_multi_func_t)(struct zbx_history_iface *hist,
+		const zbx_vector_uint64_t *itemids, int start, int end, zbx_vector_uint64_t *value_itemids,
+		zbx_vector_history_record_t *values);
 typedef int (*zbx_history_flush_func_t)(struct zbx_history_iface *hist);
 
 typedef void (*zbx_history_func_t)(const zbx_vector_ptr_t *);
@@ -49,6 +52,7 @@ struct zbx_history_iface
 	zbx_history_destroy_func_t	destroy;
 	zbx_history_add_values_func_t	add_values;
 	zbx_history_get_values_func_t	get_values;
+	zbx_history_get_values_multi_func_t	get_values_multi;
 	zbx_history_flush_func_t	flush;
 };
 
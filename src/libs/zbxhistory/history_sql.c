@@ -23,14 +23,37 @@
 #include "zbxalgo.h"
 #include "zbxdbhigh.h"
 #include "zbxcacheconfig.h"
+#ifdef HAVE_POSTGRESQL
+#	include "zbxcrypto.h"
+#endif
 
 typedef struct
 {
 	unsigned char		initialized;
 	zbx_vector_ptr_t	dbinserts;
+#ifdef HAVE_POSTGRESQL
+	zbx_vector_ptr_t	dbcopies;
+	/* write the next batch of the value type with bulk inserts, set after */
+	/* copy into its table was rejected because of duplicate values        */
+	unsigned char		insert_fallback[ITEM_VALUE_TYPE_BIN + 1];
+#endif
 }
 zbx_sql_writer_t;
 
+#ifdef HAVE_POSTGRESQL
+/* binary COPY data of a single history table */
+typedef struct
+{
+	unsigned char	value_type;
+	const char	*table;
+	const char	*fields;
+	char		*data;
+	size_t		data_alloc;
+	size_t		data_offset;
+}
+zbx_sql_copy_t;
+#endif
+
 static zbx_sql_writer_t	writer;
 
 typedef void (*vc_str2value_func_t)(zbx_history_value_t *value, zbx_db_row_t row);
@@ -105,6 +128,9 @@ static void	sql_writer_init(void)
 		return;
 
 	zbx_vector_ptr_create(&writer.dbinserts);
+#ifdef HAVE_POSTGRESQL
+	zbx_vector_ptr_create(&writer.dbcopies);
+#endif
 
 	writer.initialized = 1;
 }
@@ -129,6 +155,18 @@ static void	sql_writer_release(void)
 	zbx_vector_ptr_clear(&writer.dbinserts);
 	zbx_vector_ptr_destroy(&writer.dbinserts);
 
+#ifdef HAVE_POSTGRESQL
+	for (i = 0; i < writer.dbcopies.values_num; i++)
+	{
+		zbx_sql_copy_t	*copy = (zbx_sql_copy_t *)writer.dbcopies.values[i];
+
+		zbx_free(copy->data);
+		zbx_free(copy);
+	}
+	zbx_vector_ptr_clear(&writer.dbcopies);
+	zbx_vector_ptr_destroy(&writer.dbcopies);
+#endif
+
 	writer.initialized = 0;
 }
 
@@ -152,7 +190,10 @@ static void	sql_writer_add_dbinsert(zbx_db_insert_t *db_insert)
  ************************************************************************************/
 static int	sql_writer_flush(void)
 {
-	int	i, txn_error;
+	int			i, txn_error;
+#ifdef HAVE_POSTGRESQL
+	const zbx_sql_copy_t	*failed_copy;
+#endif
 
 	/* The writer might be uninitialized only if the history */
 	/* was already flushed. In that case, return SUCCEED */
@@ -162,15 +203,35 @@ static int	sql_writer_flush(void)
 	do
 	{
 		zbx_db_begin();
-
+#ifdef HAVE_POSTGRESQL
+		failed_copy = NULL;
+#endif
 		for (i = 0; i < writer.dbinserts.values_num; i++)
 		{
 			zbx_db_insert_t	*db_insert = (zbx_db_insert_t *)writer.dbinserts.values[i];
 			zbx_db_insert_execute(db_insert);
 		}
+#ifdef HAVE_POSTGRESQL
+		for (i = 0; i < writer.dbcopies.values_num; i++)
+		{
+			const zbx_sql_copy_t	*copy = (const zbx_sql_copy_t *)writer.dbcopies.values[i];
+
+			if (ZBX_DB_OK != zbx_db_copy_binary(copy->table, copy->fields, copy->data, copy->data_offset))
+			{
+				failed_copy = copy;
+				break;
+			}
+		}
+#endif
 	}
 	while (ZBX_DB_DOWN == (txn_error = zbx_db_commit()));
 
+#ifdef HAVE_POSTGRESQL
+	/* Copy is rejected as a whole on the first duplicate value. After the caller removes */
+	/* duplicates the values of the rejected table are written again with bulk inserts.   */
+	if (NULL != failed_copy && ZBX_DB_FAIL == txn_error && ERR_Z3008 == zbx_db_last_errcode())
+		writer.insert_fallback[failed_copy->value_type] = 1;
+#endif
 	sql_writer_release();
 
 	if (ZBX_DB_OK == txn_error)
@@ -311,6 +372,316 @@ static void	add_history_bin(const zbx_vector_ptr_t *history)
 	sql_writer_add_dbinsert(db_insert);
 }
 
+#ifdef HAVE_POSTGRESQL
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: appends raw data to binary copy buffer                                  *
+ *                                                                                  *
+ ***********************************************************************************/
+static void	sql_copy_append(zbx_sql_copy_t *copy, const void *data, size_t size)
+{
+	if (copy->data_alloc < copy->data_offset + size)
+	{
+		while (copy->data_alloc < copy->data_offset + size)
+			copy->data_alloc *= 2;
+
+		copy->data = (char *)zbx_realloc(copy->data, copy->data_alloc);
+	}
+
+	memcpy(copy->data + copy->data_offset, data, size);
+	copy->data_offset += size;
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: appends unsigned integer in network byte order to binary copy           *
+ *          buffer                                                                  *
+ *                                                                                  *
+ * Parameters: copy  - [IN/OUT] the binary copy data                                *
+ *             value - [IN] the value to append                                     *
+ *             size  - [IN] the value size in bytes (2, 4 or 8)                     *
+ *                                                                                  *
+ ***********************************************************************************/
+static void	sql_copy_append_uint(zbx_sql_copy_t *copy, zbx_uint64_t value, int size)
+{
+	unsigned char	buf[sizeof(zbx_uint64_t)];
+	int		i;
+
+	for (i = size - 1; 0 <= i; i--)
+	{
+		buf[i] = (unsigned char)(value & 0xff);
+		value >>= 8;
+	}
+
+	sql_copy_append(copy, buf, (size_t)size);
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: creates binary copy data for the specified history table                *
+ *                                                                                  *
+ * Parameters: value_type - [IN] the value type stored in the table                 *
+ *             table      - [IN] the history table                                  *
+ *             fields     - [IN] the comma separated list of copied fields          *
+ *                                                                                  *
+ * Return value: the binary copy data with header written                           *
+ *                                                                                  *
+ ***********************************************************************************/
+static zbx_sql_copy_t	*sql_copy_create(unsigned char value_type, const char *table, const char *fields)
+{
+	static const char	signature[] = "PGCOPY\n\377\r\n";
+	zbx_sql_copy_t		*copy;
+
+	copy = (zbx_sql_copy_t *)zbx_malloc(NULL, sizeof(zbx_sql_copy_t));
+	copy->value_type = value_type;
+	copy->table = table;
+	copy->fields = fields;
+	copy->data_alloc = 16 * ZBX_KIBIBYTE;
+	copy->data_offset = 0;
+	copy->data = (char *)zbx_malloc(NULL, copy->data_alloc);
+
+	/* header - signature including the terminating zero byte, flags and header extension length */
+	sql_copy_append(copy, signature, sizeof(signature));
+	sql_copy_append_uint(copy, 0, 4);
+	sql_copy_append_uint(copy, 0, 4);
+
+	return copy;
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: starts a new history row in binary copy data                            *
+ *                                                                                  *
+ * Parameters: copy       - [IN/OUT] the binary copy data                           *
+ *             fields_num - [IN] the number of row fields                           *
+ *             h          - [IN] the history value                                  *
+ *                                                                                  *
+ * Comments: The common itemid, clock and ns fields are appended to the row.        *
+ *                                                                                  *
+ ***********************************************************************************/
+static void	sql_copy_add_row(zbx_sql_copy_t *copy, int fields_num, const zbx_dc_history_t *h)
+{
+	sql_copy_append_uint(copy, (zbx_uint64_t)fields_num, 2);
+
+	sql_copy_append_uint(copy, sizeof(zbx_uint64_t), 4);
+	sql_copy_append_uint(copy, h->itemid, 8);
+
+	sql_copy_append_uint(copy, sizeof(zbx_uint32_t), 4);
+	sql_copy_append_uint(copy, (zbx_uint32_t)h->ts.sec, 4);
+
+	sql_copy_append_uint(copy, sizeof(zbx_uint32_t), 4);
+	sql_copy_append_uint(copy, (zbx_uint32_t)h->ts.ns, 4);
+}
+
+static void	sql_copy_add_int(zbx_sql_copy_t *copy, int value)
+{
+	sql_copy_append_uint(copy, sizeof(zbx_uint32_t), 4);
+	sql_copy_append_uint(copy, (zbx_uint32_t)value, 4);
+}
+
+static void	sql_copy_add_double(zbx_sql_copy_t *copy, double value)
+{
+	zbx_uint64_t	bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	sql_copy_append_uint(copy, sizeof(bits), 4);
+	sql_copy_append_uint(copy, bits, 8);
+}
+
+static void	sql_copy_add_str(zbx_sql_copy_t *copy, const char *str, size_t len)
+{
+	sql_copy_append_uint(copy, (zbx_uint64_t)len, 4);
+	sql_copy_append(copy, str, len);
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: appends unsigned integer value as numeric field                         *
+ *                                                                                  *
+ * Comments: Numeric binary format consists of digit count, weight of the           *
+ *           first digit, sign, display scale and base 10000 digits,                *
+ *           starting with the most significant one.                                *
+ *                                                                                  *
+ ***********************************************************************************/
+static void	sql_copy_add_numeric(zbx_sql_copy_t *copy, zbx_uint64_t value)
+{
+	zbx_uint64_t	digits[5];
+	int		i, digits_num = 0, first = 0, weight;
+
+	for (; 0 != value; value /= 10000)
+		digits[digits_num++] = value % 10000;
+
+	weight = (0 == digits_num ? 0 : digits_num - 1);
+
+	/* trailing zero digits are implied by weight */
+	while (first < digits_num && 0 == digits[first])
+		first++;
+
+	sql_copy_append_uint(copy, (zbx_uint64_t)(4 + digits_num - first) * 2, 4);
+	sql_copy_append_uint(copy, (zbx_uint64_t)(digits_num - first), 2);
+	sql_copy_append_uint(copy, (zbx_uint64_t)weight, 2);
+	sql_copy_append_uint(copy, 0, 2);
+	sql_copy_append_uint(copy, 0, 2);
+
+	for (i = digits_num - 1; i >= first; i--)
+		sql_copy_append_uint(copy, digits[i], 2);
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: finishes binary copy data and adds it to be flushed later               *
+ *                                                                                  *
+ ***********************************************************************************/
+static void	sql_writer_add_dbcopy(zbx_sql_copy_t *copy)
+{
+	/* trailer - field count of -1 */
+	sql_copy_append_uint(copy, 0xffff, 2);
+
+	sql_writer_init();
+	zbx_vector_ptr_append(&writer.dbcopies, copy);
+}
+
+static void	copy_history_dbl(const zbx_vector_ptr_t *history)
+{
+	zbx_sql_copy_t	*copy = sql_copy_create(ITEM_VALUE_TYPE_FLOAT, "history", "itemid,clock,ns,value");
+
+	for (int i = 0; i < history->values_num; i++)
+	{
+		const zbx_dc_history_t	*h = (zbx_dc_history_t *)history->values[i];
+
+		if (ITEM_VALUE_TYPE_FLOAT != h->value_type)
+			continue;
+
+		sql_copy_add_row(copy, 4, h);
+		sql_copy_add_double(copy, h->value.dbl);
+	}
+
+	sql_writer_add_dbcopy(copy);
+}
+
+static void	copy_history_uint(const zbx_vector_ptr_t *history)
+{
+	zbx_sql_copy_t	*copy = sql_copy_create(ITEM_VALUE_TYPE_UINT64, "history_uint", "itemid,clock,ns,value");
+
+	for (int i = 0; i < history->values_num; i++)
+	{
+		const zbx_dc_history_t	*h = (zbx_dc_history_t *)history->values[i];
+
+		if (ITEM_VALUE_TYPE_UINT64 != h->value_type)
+			continue;
+
+		sql_copy_add_row(copy, 4, h);
+		sql_copy_add_numeric(copy, h->value.ui64);
+	}
+
+	sql_writer_add_dbcopy(copy);
+}
+
+static void	copy_history_str(const zbx_vector_ptr_t *history)
+{
+	zbx_sql_copy_t	*copy = sql_copy_create(ITEM_VALUE_TYPE_STR, "history_str", "itemid,clock,ns,value");
+
+	for (int i = 0; i < history->values_num; i++)
+	{
+		const zbx_dc_history_t	*h = (zbx_dc_history_t *)history->values[i];
+
+		if (ITEM_VALUE_TYPE_STR != h->value_type)
+			continue;
+
+		sql_copy_add_row(copy, 4, h);
+		sql_copy_add_str(copy, h->value.str, strlen(h->value.str));
+	}
+
+	sql_writer_add_dbcopy(copy);
+}
+
+static void	copy_history_text(const zbx_vector_ptr_t *history)
+{
+	zbx_sql_copy_t	*copy = sql_copy_create(ITEM_VALUE_TYPE_TEXT, "history_text", "itemid,clock,ns,value");
+
+	for (int i = 0; i < history->values_num; i++)
+	{
+		const zbx_dc_history_t	*h = (zbx_dc_history_t *)history->values[i];
+
+		if (ITEM_VALUE_TYPE_TEXT != h->value_type)
+			continue;
+
+		sql_copy_add_row(copy, 4, h);
+		sql_copy_add_str(copy, h->value.str, strlen(h->value.str));
+	}
+
+	sql_writer_add_dbcopy(copy);
+}
+
+static void	copy_history_log(const zbx_vector_ptr_t *history)
+{
+	zbx_sql_copy_t	*copy = sql_copy_create(ITEM_VALUE_TYPE_LOG, "history_log",
+			"itemid,clock,ns,timestamp,source,severity,value,logeventid");
+
+	for (int i = 0; i < history->values_num; i++)
+	{
+		const zbx_dc_history_t	*h = (zbx_dc_history_t *)history->values[i];
+		const zbx_log_value_t	*log;
+		const char		*source;
+
+		if (ITEM_VALUE_TYPE_LOG != h->value_type)
+			continue;
+
+		log = h->value.log;
+		source = ZBX_NULL2EMPTY_STR(log->source);
+
+		sql_copy_add_row(copy, 8, h);
+		sql_copy_add_int(copy, log->timestamp);
+		sql_copy_add_str(copy, source, strlen(source));
+		sql_copy_add_int(copy, log->severity);
+		sql_copy_add_str(copy, log->value, strlen(log->value));
+		sql_copy_add_int(copy, log->logeventid);
+	}
+
+	sql_writer_add_dbcopy(copy);
+}
+
+static void	copy_history_bin(const zbx_vector_ptr_t *history)
+{
+	zbx_sql_copy_t	*copy = sql_copy_create(ITEM_VALUE_TYPE_BIN, "history_bin", "itemid,clock,ns,value");
+	char		*buf = NULL;
+	size_t		buf_alloc = 0;
+
+	for (int i = 0; i < history->values_num; i++)
+	{
+		const zbx_dc_history_t	*h = (zbx_dc_history_t *)history->values[i];
+		size_t			len;
+
+		if (ITEM_VALUE_TYPE_BIN != h->value_type)
+			continue;
+
+		/* binary values are kept base64 encoded, bytea field expects raw data */
+		if (buf_alloc < (len = strlen(h->value.str) * 3 / 4 + 1))
+			buf = (char *)zbx_realloc(buf, buf_alloc = len);
+
+		zbx_base64_decode(h->value.str, buf, buf_alloc, &len);
+
+		sql_copy_add_row(copy, 4, h);
+		sql_copy_add_str(copy, buf, len);
+	}
+
+	zbx_free(buf);
+
+	sql_writer_add_dbcopy(copy);
+}
+
+/* value_type - binary copy function mapping */
+static zbx_history_func_t	copy_history_funcs[] = {
+	copy_history_dbl,
+	copy_history_str,
+	copy_history_log,
+	copy_history_uint,
+	copy_history_text,
+	copy_history_bin
+};
+#endif
+
 /******************************************************************************************************************
  *                                                                                                                *
  * database reading support                                                                                       *
@@ -644,6 +1015,72 @@ static int	sql_get_values(zbx_history_iface_t *hist, zbx_uint64_t itemid, int st
 	return db_read_values_by_time_and_count(itemid, hist->value_type, values, end - start, count, end);
 }
 
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: gets history data of multiple items from history storage                *
+ *                                                                                  *
+ * Parameters:  hist          - [IN] the history storage interface                  *
+ *              itemids       - [IN] the itemids                                    *
+ *              start         - [IN] the period start timestamp                     *
+ *              end           - [IN] the period end timestamp                       *
+ *              value_itemids - [OUT] the itemids of read values                    *
+ *              values        - [OUT] the items history data values                 *
+ *                                                                                  *
+ * Return value: SUCCEED - the history data were read successfully                  *
+ *               FAIL - otherwise                                                   *
+ *                                                                                  *
+ ************************************************************************************/
+static int	sql_get_values_multi(zbx_history_iface_t *hist, const zbx_vector_uint64_t *itemids, int start,
+		int end, zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values)
+{
+	char			*sql = NULL;
+	size_t			sql_alloc = 0, sql_offset = 0;
+	zbx_db_result_t		result;
+	zbx_db_row_t		row;
+	zbx_vc_history_table_t	*table = &vc_history_tables[hist->value_type];
+	time_t			time_from = start;
+
+	zbx_recalc_time_period(&time_from, ZBX_RECALC_TIME_PERIOD_HISTORY);
+
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset,
+			"select itemid,clock,ns,%s"
+			" from %s"
+			" where",
+			table->fields, table->name);
+
+	zbx_db_add_condition_alloc(&sql, &sql_alloc, &sql_offset, "itemid", itemids->values, itemids->values_num);
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, " and clock>" ZBX_FS_I64, time_from);
+
+	if (ZBX_JAN_2038 != end)
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, " and clock<=%d", end);
+
+	zbx_strcpy_alloc(&sql, &sql_alloc, &sql_offset, " order by itemid");
+
+	result = zbx_db_select("%s", sql);
+
+	zbx_free(sql);
+
+	if (NULL == result)
+		return FAIL;
+
+	while (NULL != (row = zbx_db_fetch(result)))
+	{
+		zbx_uint64_t		itemid;
+		zbx_history_record_t	value;
+
+		ZBX_STR2UINT64(itemid, row[0]);
+		value.timestamp.sec = atoi(row[1]);
+		value.timestamp.ns = atoi(row[2]);
+		table->rtov(&value.value, row + 3);
+
+		zbx_vector_uint64_append(value_itemids, itemid);
+		zbx_vector_history_record_append_ptr(values, &value);
+	}
+	zbx_db_free_result(result);
+
+	return SUCCEED;
+}
+
 /************************************************************************************
  *                                                                                  *
  * Purpose: sends history data to the storage                                       *
@@ -665,7 +1102,18 @@ static int	sql_add_values(zbx_history_iface_t *hist, const zbx_vector_ptr_t *his
 	}
 
 	if (0 != h_num)
+	{
+#ifdef HAVE_POSTGRESQL
+		if (0 == writer.insert_fallback[hist->value_type])
+		{
+			copy_history_funcs[hist->value_type](history);
+			return h_num;
+		}
+
+		writer.insert_fallback[hist->value_type] = 0;
+#endif
 		hist->data.sql_history_func(history);
+	}
 
 	return h_num;
 }
@@ -702,6 +1150,7 @@ void	zbx_history_sql_init(zbx_history_iface_t *hist, unsigned char value_type)
 	hist->add_values = sql_add_values;
 	hist->flush = sql_flush;
 	hist->get_values = sql_get_values;
+	hist->get_values_multi = sql_get_values_multi;
 
 	switch (value_type)
 	{
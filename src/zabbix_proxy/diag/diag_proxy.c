@@ -108,6 +108,8 @@ int	diag_add_section_info(const char *section, const struct zbx_json_parse *jp,
 		zbx_diag_add_locks_info(json);
 		ret = SUCCEED;
 	}
+	else if (0 == strcmp(section, ZBX_DIAG_CONFIGCACHE))
+		ret = zbx_diag_add_configcache_info(jp, json, error);
 	else
 		*error = zbx_dsprintf(*error, "Unsupported diagnostics section: %s", section);
 
@@ -103,8 +103,9 @@ static const char	*help_message[] = {
 	"                                   target is not specified",
 	"      " ZBX_SNMP_CACHE_RELOAD "          Reload SNMP cache",
 	"      " ZBX_DIAGINFO "=section           Log internal diagnostic information of the",
-	"                                 section (historycache, preprocessing, locks) or",
-	"                                 everything if section is not specified",
+	"                                 section (historycache, preprocessing, locks,",
+	"                                 configcache) or everything if section is not",
+	"                                 specified",
 	"      " ZBX_PROF_ENABLE "=target         Enable profiling, affects all processes if",
 	"                                   target is not specified",
 	"      " ZBX_PROF_DISABLE "=target        Disable profiling, affects all processes if",
@@ -1572,8 +1573,9 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 		exit(EXIT_FAILURE);
 	}
 
-	if (SUCCEED != zbx_init_database_cache(get_zbx_program_type, zbx_sync_proxy_history, config_history_cache_size,
-			config_history_index_cache_size, &config_trends_cache_size, &error))
+	if (SUCCEED != zbx_init_database_cache(get_zbx_program_type, get_config_forks, zbx_sync_proxy_history,
+			config_history_cache_size, config_history_index_cache_size, NULL, 0, &config_trends_cache_size,
+			&error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize database cache: %s", error);
 		zbx_free(error);
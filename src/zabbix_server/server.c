@@ -133,8 +133,8 @@ static const char	*help_message[] = {
 	"      " ZBX_SECRETS_RELOAD "                  Reload secrets from Vault",
 	"      " ZBX_DIAGINFO "=section                Log internal diagnostic information of the",
 	"                                        section (historycache, preprocessing, alerting,",
-	"                                        lld, valuecache, locks, connector) or everything if section is",
-	"                                        not specified",
+	"                                        lld, valuecache, locks, connector, configcache) or everything if",
+	"                                        section is not specified",
 	"      " ZBX_PROF_ENABLE "=target              Enable profiling, affects all processes if",
 	"                                        target is not specified",
 	"      " ZBX_PROF_DISABLE "=target             Disable profiling, affects all processes if",
@@ -308,9 +308,13 @@ static int	config_vmware_timeout		= 10;
 static zbx_uint64_t	config_conf_cache_size		= 32 * ZBX_MEBIBYTE;
 static zbx_uint64_t	config_history_cache_size	= 16 * ZBX_MEBIBYTE;
 static zbx_uint64_t	config_history_index_cache_size	= 4 * ZBX_MEBIBYTE;
+static char		*config_history_cache_spill_file = NULL;
+static zbx_uint64_t	config_history_cache_spill_size	= ZBX_GIBIBYTE;
 static zbx_uint64_t	config_trends_cache_size	= 4 * ZBX_MEBIBYTE;
 static zbx_uint64_t	config_trend_func_cache_size	= 4 * ZBX_MEBIBYTE;
 static zbx_uint64_t	config_value_cache_size		= 8 * ZBX_MEBIBYTE;
+static char		*config_value_cache_warmup_file	= NULL;
+static char		*config_value_cache_dump_file	= NULL;
 static zbx_uint64_t	config_vmware_cache_size	= 8 * ZBX_MEBIBYTE;
 
 static int	config_unreachable_period		= 45;
@@ -862,12 +866,20 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	128 * ZBX_KIBIBYTE,	__UINT64_C(2) * ZBX_GIBIBYTE},
 		{"HistoryIndexCacheSize",	&config_history_index_cache_size,	TYPE_UINT64,
 			PARM_OPT,	128 * ZBX_KIBIBYTE,	__UINT64_C(2) * ZBX_GIBIBYTE},
+		{"HistoryCacheSpillFile",	&config_history_cache_spill_file,	TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"HistoryCacheSpillSize",	&config_history_cache_spill_size,	TYPE_UINT64,
+			PARM_OPT,	ZBX_MEBIBYTE,		__UINT64_C(1024) * ZBX_GIBIBYTE},
 		{"TrendCacheSize",		&config_trends_cache_size,		TYPE_UINT64,
 			PARM_OPT,	128 * ZBX_KIBIBYTE,	__UINT64_C(2) * ZBX_GIBIBYTE},
 		{"TrendFunctionCacheSize",	&config_trend_func_cache_size,		TYPE_UINT64,
 			PARM_OPT,	0,			__UINT64_C(2) * ZBX_GIBIBYTE},
 		{"ValueCacheSize",		&config_value_cache_size,		TYPE_UINT64,
 			PARM_OPT,	0,			__UINT64_C(64) * ZBX_GIBIBYTE},
+		{"ValueCacheWarmupFile",	&config_value_cache_warmup_file,	TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"ValueCacheDumpFile",		&config_value_cache_dump_file,		TYPE_STRING,
+			PARM_OPT,	0,			0},
 		{"CacheUpdateFrequency",	&config_confsyncer_frequency,		TYPE_INT,
 			PARM_OPT,	1,			SEC_PER_HOUR},
 		{"HousekeepingFrequency",	&config_housekeeping_frequency,		TYPE_INT,
@@ -1125,6 +1137,14 @@ static void	zbx_on_exit(int ret)
 		zbx_free_configuration_cache();
 
 		/* free history value cache */
+		/* Value cache is saved only on clean shutdown - after a failure it could be left inconsistent */
+		/* by the processes that were killed.                                                          */
+		if (SUCCEED == ret)
+		{
+			zbx_vc_save_items(config_value_cache_warmup_file);
+			zbx_vc_dump(config_value_cache_dump_file);
+		}
+
 		zbx_vc_destroy();
 
 		zbx_deinit_remote_commands_cache();
@@ -1504,8 +1524,9 @@ static int	server_startup(zbx_socket_t *listen_sock, int *ha_stat, int *ha_failo
 								.config_service_manager_sync_frequency =
 								config_service_manager_sync_frequency};
 
-	if (SUCCEED != zbx_init_database_cache(get_zbx_program_type, zbx_sync_server_history, config_history_cache_size,
-			config_history_index_cache_size, &config_trends_cache_size, &error))
+	if (SUCCEED != zbx_init_database_cache(get_zbx_program_type, get_config_forks, zbx_sync_server_history,
+			config_history_cache_size, config_history_index_cache_size, config_history_cache_spill_file,
+			config_history_cache_spill_size, &config_trends_cache_size, &error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize database cache: %s", error);
 		zbx_free(error);
@@ -1543,6 +1564,8 @@ static int	server_startup(zbx_socket_t *listen_sock, int *ha_stat, int *ha_failo
 		return FAIL;
 	}
 
+	zbx_vc_restore(config_value_cache_dump_file);
+
 	if (SUCCEED != zbx_tfc_init(config_trend_func_cache_size, &error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize trends read cache: %s", error);
@@ -1654,6 +1677,9 @@ static int	server_startup(zbx_socket_t *listen_sock, int *ha_stat, int *ha_failo
 				/* update maintenance states */
 				zbx_dc_update_maintenances(MAINTENANCE_TIMER_PENDING);
 
+				/* load value cache before history syncers start evaluating triggers */
+				zbx_vc_warmup(config_value_cache_warmup_file);
+
 				zbx_db_close();
 				break;
 			case ZBX_PROCESS_TYPE_POLLER:
@@ -1903,6 +1929,9 @@ static void	server_teardown(zbx_rtc_t *rtc, zbx_socket_t *listen_sock)
 
 	/* destroy shared caches */
 	zbx_tfc_destroy();
+
+	/* Value cache is not dumped - the processes were killed and could have left it inconsistent. */
+	/* Also the node switches to standby, so the dump would be outdated by the time it's active.  */
 	zbx_vc_destroy();
 	zbx_vmware_destroy();
 	zbx_free_selfmon_collector();
@@ -2150,8 +2179,9 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 		exit(EXIT_FAILURE);
 	}
 
-	if (SUCCEED != zbx_init_database_cache(get_zbx_program_type, zbx_sync_server_history, config_history_cache_size,
-			config_history_index_cache_size, &config_trends_cache_size, &error))
+	if (SUCCEED != zbx_init_database_cache(get_zbx_program_type, get_config_forks, zbx_sync_server_history,
+			config_history_cache_size, config_history_index_cache_size, config_history_cache_spill_file,
+			config_history_cache_spill_size, &config_trends_cache_size, &error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize database cache: %s", error);
 		zbx_free(error);
@@ -0,0 +1,166 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "../../../src/libs/zbxcachehistory/dbcache.c"
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+int	__wrap_zbx_db_connect(int flag);
+void	__wrap_zbx_db_close(void);
+void	__wrap_zbx_db_thread_deinit_basic(void);
+int	__wrap_zbx_db_execute(const char *fmt, ...);
+int	__wrap_zbx_history_add_values(const zbx_vector_ptr_t *history, int *ret_flush);
+void	__wrap_zbx_tfc_invalidate_trends(ZBX_DC_TREND *trends, int trends_num);
+void	__wrap_zbx_vps_monitor_add_written(zbx_uint64_t values_num);
+
+static int	written_values_num;
+
+int	__wrap_zbx_db_connect(int flag)
+{
+	ZBX_UNUSED(flag);
+
+	return ZBX_DB_OK;
+}
+
+void	__wrap_zbx_db_close(void)
+{
+}
+
+void	__wrap_zbx_db_thread_deinit_basic(void)
+{
+}
+
+int	__wrap_zbx_db_execute(const char *fmt, ...)
+{
+	ZBX_UNUSED(fmt);
+
+	return ZBX_DB_OK;
+}
+
+int	__wrap_zbx_history_add_values(const zbx_vector_ptr_t *history, int *ret_flush)
+{
+	ZBX_UNUSED(ret_flush);
+
+	/* give the syncer time to request the writer to stop before the batch is written */
+	zbx_sleep(1);
+	written_values_num += history->values_num;
+
+	return SUCCEED;
+}
+
+void	__wrap_zbx_tfc_invalidate_trends(ZBX_DC_TREND *trends, int trends_num)
+{
+	ZBX_UNUSED(trends);
+	ZBX_UNUSED(trends_num);
+}
+
+void	__wrap_zbx_vps_monitor_add_written(zbx_uint64_t values_num)
+{
+	ZBX_UNUSED(values_num);
+}
+
+void	zbx_mock_test_entry(void **state)
+{
+#if defined(HAVE_MYSQL) || defined(HAVE_POSTGRESQL)
+	int			values_num, trends_num, hour, i, trends_written = 0, expected_ret;
+	zbx_hc_sync_batch_t	batch;
+	ZBX_DC_TREND		*trends;
+
+	ZBX_UNUSED(state);
+
+	values_num = (int)zbx_mock_get_parameter_uint64("in.values");
+	trends_num = (int)zbx_mock_get_parameter_uint64("in.trends");
+	expected_ret = zbx_mock_str_to_return_code(zbx_mock_get_parameter_string("out.return"));
+	hour = 1700000000 - 1700000000 % SEC_PER_HOUR;
+
+	cache = (ZBX_DC_CACHE *)zbx_malloc(NULL, sizeof(ZBX_DC_CACHE));
+	memset(cache, 0, sizeof(ZBX_DC_CACHE));
+	zbx_hashset_create(&cache->trends, (size_t)trends_num, ZBX_DEFAULT_UINT64_HASH_FUNC,
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	trends = (ZBX_DC_TREND *)zbx_malloc(NULL, sizeof(ZBX_DC_TREND) * (size_t)(trends_num + 1));
+
+	for (i = 0; i < trends_num; i++)
+	{
+		memset(&trends[i], 0, sizeof(ZBX_DC_TREND));
+		trends[i].itemid = (zbx_uint64_t)i + 1;
+		trends[i].clock = hour;
+		trends[i].num = 1;
+		trends[i].value_type = ITEM_VALUE_TYPE_FLOAT;
+
+		zbx_hashset_insert(&cache->trends, &trends[i], sizeof(ZBX_DC_TREND));
+	}
+
+	hc_sync_batch_init(&batch);
+	batch.history = (zbx_dc_history_t *)zbx_malloc(NULL, sizeof(zbx_dc_history_t) * (size_t)(values_num + 1));
+	batch.history_num = values_num;
+
+	for (i = 0; i < values_num; i++)
+	{
+		memset(&batch.history[i], 0, sizeof(zbx_dc_history_t));
+		batch.history[i].itemid = (zbx_uint64_t)i + 1;
+		batch.history[i].value_type = ITEM_VALUE_TYPE_FLOAT;
+		batch.history[i].value.dbl = i;
+		batch.history[i].ts.sec = hour;
+	}
+
+	zbx_hc_history_writer_start();
+	zbx_mock_assert_int_eq("history writer state", ZBX_HC_WRITER_RUNNING, hc_writer.state);
+
+	if (0 != trends_num)
+	{
+		zbx_mock_assert_result_eq("hc_writer_add_trends()", expected_ret,
+				hc_writer_add_trends(trends, trends_num));
+	}
+
+	if (0 != values_num)
+		hc_writer_submit(&batch);
+
+	/* stop without waiting for the batch, the queued values and trends must still be written */
+	zbx_hc_history_writer_stop();
+
+	zbx_mock_assert_int_eq("written history values", (int)zbx_mock_get_parameter_uint64("out.values"),
+			written_values_num);
+	zbx_mock_assert_int_eq("batch write result", SUCCEED, batch.ret);
+
+	for (i = 0; i < trends_num; i++)
+	{
+		ZBX_DC_TREND	*trend;
+
+		trend = (ZBX_DC_TREND *)zbx_hashset_search(&cache->trends, &trends[i].itemid);
+
+		if (hour + SEC_PER_HOUR == trend->disable_from)
+			trends_written++;
+	}
+
+	zbx_mock_assert_int_eq("written trends", (int)zbx_mock_get_parameter_uint64("out.trends"), trends_written);
+
+	hc_sync_batch_destroy(&batch);
+	zbx_free(trends);
+	zbx_hashset_destroy(&cache->trends);
+	zbx_free(cache);
+#else
+	ZBX_UNUSED(state);
+
+	skip();
+#endif
+}
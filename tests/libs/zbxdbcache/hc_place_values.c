@@ -0,0 +1,170 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "../../../src/libs/zbxcachehistory/dbcache.c"
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#define HC_TEST_CACHE_SIZE	(4 * ZBX_MEBIBYTE)
+
+void	__wrap_zbx_dc_config_history_get_affinities(zbx_uint64_t *ids, int ids_num);
+void	__wrap_zbx_vps_monitor_add_collected(zbx_uint64_t values_num);
+
+/* the history syncer affinity returned by configuration cache for the next added value */
+static zbx_uint64_t	item_affinity;
+
+void	__wrap_zbx_dc_config_history_get_affinities(zbx_uint64_t *ids, int ids_num)
+{
+	int	i;
+
+	for (i = 0; i < ids_num; i++)
+		ids[i] = item_affinity;
+}
+
+void	__wrap_zbx_vps_monitor_add_collected(zbx_uint64_t values_num)
+{
+	ZBX_UNUSED(values_num);
+}
+
+static unsigned char	get_server_program_type(void)
+{
+	return ZBX_PROGRAM_TYPE_SERVER;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns index of the shard holding item values or -1              *
+ *                                                                            *
+ ******************************************************************************/
+static int	hc_test_find_item_shard(zbx_uint64_t itemid)
+{
+	int	i, shardid = -1;
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		if (NULL == hc_get_item(&cache->shards[i], itemid))
+			continue;
+
+		if (-1 != shardid)
+			fail_msg("item " ZBX_FS_UI64 " has values in shards %d and %d", itemid, shardid, i);
+
+		shardid = i;
+	}
+
+	return shardid;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: processes all values of the shard like history syncer would       *
+ *                                                                            *
+ ******************************************************************************/
+static void	hc_test_sync_shard(int shardid)
+{
+	zbx_vector_ptr_t	history_items;
+
+	zbx_vector_ptr_create(&history_items);
+	hc_syncer_shardid = shardid;
+
+	while (0 != cache->shards[shardid].history_items.num_data)
+	{
+		zbx_mock_assert_int_eq("popped shard", shardid, hc_pop_items(&history_items));
+		hc_push_items(shardid, &history_items);
+		zbx_vector_ptr_clear(&history_items);
+	}
+
+	zbx_vector_ptr_destroy(&history_items);
+}
+
+void	zbx_mock_test_entry(void **state)
+{
+	zbx_mock_handle_t	hsteps, hstep, hsync;
+	zbx_mock_error_t	err;
+	zbx_timespec_t		ts = {1700000000, 0};
+	char			*error = NULL;
+	int			i;
+
+	ZBX_UNUSED(state);
+
+	get_program_type_cb = get_server_program_type;
+
+	if (SUCCEED != zbx_shmem_create(&hc_mem, HC_TEST_CACHE_SIZE, "history cache", "HistoryCacheSize", 1, &error))
+		fail_msg("cannot create history cache: %s", error);
+
+	cache = (ZBX_DC_CACHE *)zbx_malloc(NULL, sizeof(ZBX_DC_CACHE));
+	memset(cache, 0, sizeof(ZBX_DC_CACHE));
+	cache->shards_num = (int)zbx_mock_get_parameter_uint64("in.shards");
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		zbx_hashset_create(&cache->shards[i].history_items, ZBX_HC_ITEMS_INIT_SIZE,
+				ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+		zbx_binary_heap_create(&cache->shards[i].history_queue, hc_queue_elem_compare_func,
+				ZBX_BINARY_HEAP_OPTION_EMPTY);
+	}
+
+	zbx_hashset_create(&cache->item_shards, ZBX_HC_ITEMS_INIT_SIZE, ZBX_DEFAULT_UINT64_HASH_FUNC,
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	hsteps = zbx_mock_get_parameter_handle("in.steps");
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hsteps, &hstep))))
+	{
+		zbx_uint64_t	itemid;
+		int		expected_shardid;
+
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read test step: %s", zbx_mock_error_string(err));
+
+		if (ZBX_MOCK_SUCCESS == zbx_mock_object_member(hstep, "sync", &hsync))
+		{
+			hc_test_sync_shard(zbx_mock_get_object_member_int(hstep, "sync"));
+			continue;
+		}
+
+		itemid = zbx_mock_get_object_member_uint64(hstep, "itemid");
+		item_affinity = zbx_mock_get_object_member_uint64(hstep, "affinity");
+		expected_shardid = zbx_mock_get_object_member_int(hstep, "shard");
+
+		dc_local_add_history_uint(itemid, ITEM_VALUE_TYPE_UINT64, &ts, itemid, 0, 0, 0);
+		zbx_dc_flush_history();
+		ts.sec++;
+
+		zbx_mock_assert_int_eq("item shard", expected_shardid, hc_test_find_item_shard(itemid));
+	}
+
+	zbx_mock_assert_int_eq("item shard placements", (int)zbx_mock_get_parameter_uint64("out.placements"),
+			cache->item_shards.num_data);
+
+	for (i = 0; i < cache->shards_num; i++)
+	{
+		hc_test_sync_shard(i);
+		zbx_hashset_destroy(&cache->shards[i].history_items);
+		zbx_binary_heap_destroy(&cache->shards[i].history_queue);
+	}
+
+	zbx_mock_assert_int_eq("item shard placements after sync", 0, cache->item_shards.num_data);
+
+	zbx_hashset_destroy(&cache->item_shards);
+	zbx_free(cache);
+	zbx_shmem_destroy(hc_mem);
+}
@@ -0,0 +1,268 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "../../../src/libs/zbxcachehistory/dbcache.c"
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#define HC_TEST_CACHE_SIZE	(4 * ZBX_MEBIBYTE)
+#define HC_TEST_SPILL_SIZE	ZBX_MEBIBYTE
+#define HC_TEST_TIMESTAMP	1700000000
+#define HC_TEST_ITEMS_NUM	10
+
+void	__wrap_zbx_vps_monitor_add_collected(zbx_uint64_t values_num);
+
+void	__wrap_zbx_vps_monitor_add_collected(zbx_uint64_t values_num)
+{
+	ZBX_UNUSED(values_num);
+}
+
+static unsigned char	get_proxy_program_type(void)
+{
+	return ZBX_PROGRAM_TYPE_PROXY;
+}
+
+static zbx_uint64_t	hc_test_spill_file_size(void)
+{
+	zbx_stat_t	buf;
+
+	if (0 != zbx_fstat(spill_fd, &buf))
+		fail_msg("cannot obtain spill file information: %s", zbx_strerror(errno));
+
+	return (zbx_uint64_t)buf.st_size;
+}
+
+static zbx_uint64_t	hc_test_spill_read_offset(void)
+{
+	zbx_hc_spill_header_t	header;
+
+	if (SUCCEED != hc_spill_read(0, &header, sizeof(header)))
+		fail_msg("cannot read spill file header: %s", zbx_strerror(errno));
+
+	return header.read_offset;
+}
+
+static void	hc_test_spill_open(const char *path)
+{
+	char	*error = NULL;
+
+	if (SUCCEED != hc_spill_open(path, &error))
+		fail_msg("cannot open spill file: %s", error);
+}
+
+/* the value index is used as value and timestamp offset, so the cached values can be checked */
+static void	hc_test_flush_values(int values_num, size_t text_size, zbx_uint64_t *index)
+{
+	zbx_timespec_t	ts;
+	char		*text = NULL;
+	int		i;
+
+	if (0 != text_size)
+		text = (char *)zbx_malloc(NULL, text_size);
+
+	for (i = 0; i < values_num; i++, (*index)++)
+	{
+		ts.sec = HC_TEST_TIMESTAMP + (int)*index;
+		ts.ns = 0;
+
+		if (0 == text_size)
+		{
+			dc_local_add_history_uint(*index % HC_TEST_ITEMS_NUM + 1, ITEM_VALUE_TYPE_UINT64, &ts, *index,
+					0, 0, 0);
+			continue;
+		}
+
+		memset(text, 'a' + (int)(*index % 26), text_size - 1);
+		text[text_size - 1] = '\0';
+
+		dc_local_add_history_text(*index % HC_TEST_ITEMS_NUM + 1, ITEM_VALUE_TYPE_TEXT, &ts, text, 0, 0, 0);
+	}
+
+	zbx_dc_flush_history();
+
+	zbx_free(text);
+}
+
+/* checks that values of each item are cached in the order they were added */
+static int	hc_test_check_cached_values(size_t text_size)
+{
+	zbx_hashset_iter_t	iter;
+	zbx_hc_item_t		*item;
+	zbx_hc_data_t		*data;
+	zbx_uint64_t		index;
+	int			values_num = 0, prev;
+
+	zbx_hashset_iter_reset(&cache->shards[0].history_items, &iter);
+
+	while (NULL != (item = (zbx_hc_item_t *)zbx_hashset_iter_next(&iter)))
+	{
+		for (data = item->tail, prev = 0; NULL != data; data = data->next, values_num++)
+		{
+			if (prev >= data->ts.sec)
+				fail_msg("item " ZBX_FS_UI64 " values are not in order", item->itemid);
+
+			prev = data->ts.sec;
+			index = (zbx_uint64_t)(data->ts.sec - HC_TEST_TIMESTAMP);
+
+			zbx_mock_assert_uint64_eq("value item", index % HC_TEST_ITEMS_NUM + 1, item->itemid);
+
+			if (0 == text_size)
+			{
+				zbx_mock_assert_uint64_eq("uint value", index, data->value.ui64);
+				continue;
+			}
+
+			zbx_mock_assert_uint64_eq("text value size", text_size - 1, strlen(data->value.str));
+			zbx_mock_assert_int_eq("text value", 'a' + (int)(index % 26), data->value.str[0]);
+		}
+	}
+
+	return values_num;
+}
+
+static void	*hc_test_occupy(zbx_uint64_t pcnt)
+{
+	if (0 == pcnt)
+		return NULL;
+
+	return __hc_shmem_malloc_func(NULL, (size_t)(hc_mem->total_size / 100 * pcnt));
+}
+
+void	zbx_mock_test_entry(void **state)
+{
+	char		path[] = "/tmp/zbx_hc_spill_XXXXXX";
+	int		fd, i, values_num, wrap_num, cached_num = 0;
+	zbx_uint64_t	garbage_size, index = 0, cache_size = HC_TEST_CACHE_SIZE;
+	size_t		text_size;
+	void		*block;
+	char		*error = NULL;
+
+	ZBX_UNUSED(state);
+
+	get_program_type_cb = get_proxy_program_type;
+
+	if (ZBX_MOCK_SUCCESS == zbx_mock_parameter_exists("in.cache_size"))
+		cache_size = zbx_mock_get_parameter_uint64("in.cache_size");
+
+	if (SUCCEED != zbx_shmem_create(&hc_mem, cache_size, "history cache", "HistoryCacheSize", 1, &error))
+		fail_msg("cannot create history cache: %s", error);
+
+	cache = (ZBX_DC_CACHE *)zbx_malloc(NULL, sizeof(ZBX_DC_CACHE));
+	memset(cache, 0, sizeof(ZBX_DC_CACHE));
+	cache->shards_num = 1;
+
+	zbx_hashset_create(&cache->shards[0].history_items, ZBX_HC_ITEMS_INIT_SIZE, ZBX_DEFAULT_UINT64_HASH_FUNC,
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_binary_heap_create(&cache->shards[0].history_queue, hc_queue_elem_compare_func,
+			ZBX_BINARY_HEAP_OPTION_EMPTY);
+
+	if (-1 == (fd = mkstemp(path)))
+		fail_msg("cannot create spill file: %s", zbx_strerror(errno));
+
+	close(fd);
+
+	spill_size = HC_TEST_SPILL_SIZE;
+	hc_test_spill_open(path);
+
+	/* occupy history cache memory to reach the spill threshold */
+	block = hc_test_occupy(zbx_mock_get_parameter_uint64("in.usage"));
+
+	values_num = (int)zbx_mock_get_parameter_uint64("in.values");
+	text_size = (size_t)zbx_mock_get_parameter_uint64("in.text");
+
+	hc_test_flush_values(values_num, text_size, &index);
+
+	zbx_mock_assert_int_eq("values added to history cache", (int)zbx_mock_get_parameter_uint64("out.added"),
+			cache->shards[0].history_num);
+
+	if (0 != (garbage_size = zbx_mock_get_parameter_uint64("in.garbage")))
+	{
+		char	*garbage;
+
+		/* simulate the last record being partially written before termination */
+		garbage = (char *)zbx_malloc(NULL, (size_t)garbage_size);
+		memset(garbage, 0xff, (size_t)garbage_size);
+
+		if (SUCCEED != hc_spill_write(hc_test_spill_file_size(), garbage, (size_t)garbage_size))
+			fail_msg("cannot write spill file: %s", zbx_strerror(errno));
+
+		zbx_free(garbage);
+	}
+
+	if (SUCCEED == zbx_mock_str_to_return_code(zbx_mock_get_parameter_string("in.restart")))
+	{
+		hc_spill_close();
+		cache->spill_read_offset = 0;
+		cache->spill_write_offset = 0;
+
+		hc_test_spill_open(path);
+
+		zbx_mock_assert_uint64_eq("spill file size after restart", cache->spill_write_offset,
+				hc_test_spill_file_size());
+	}
+
+	__hc_shmem_free_func(block);
+
+	/* history cache usage while replaying, limiting the values replayed at once */
+	block = hc_test_occupy(zbx_mock_get_parameter_uint64("in.replay_usage"));
+
+	/* replay the spilled values partially and spill more to wrap the spill file */
+	if (0 != (wrap_num = (int)zbx_mock_get_parameter_uint64("in.wrap")))
+	{
+		zbx_mock_assert_result_eq("partial replay", SUCCEED, hc_spill_replay());
+
+		if (cache->spill_read_offset == cache->spill_write_offset)
+			fail_msg("all spilled values were replayed at once");
+
+		hc_test_flush_values(wrap_num, text_size, &index);
+		values_num += wrap_num;
+
+		if (0 == cache->spill_wrap_offset)
+			fail_msg("spill file was not wrapped");
+
+		__hc_shmem_free_func(block);
+		block = NULL;
+	}
+
+	while (SUCCEED == hc_spill_replay())
+		;
+
+	if (NULL != block)
+		__hc_shmem_free_func(block);
+
+	for (i = 0; i < cache->shards_num; i++)
+		cached_num += cache->shards[i].history_num;
+
+	zbx_mock_assert_int_eq("values in history cache", values_num, cached_num);
+	zbx_mock_assert_int_eq("values in order", values_num, hc_test_check_cached_values(text_size));
+	zbx_mock_assert_uint64_eq("spill file size", sizeof(zbx_hc_spill_header_t), hc_test_spill_file_size());
+	zbx_mock_assert_uint64_eq("saved read offset", sizeof(zbx_hc_spill_header_t), hc_test_spill_read_offset());
+	zbx_mock_assert_int_eq("replaying", 0, cache->spill_replaying);
+
+	hc_spill_close();
+	unlink(path);
+
+	zbx_hashset_destroy(&cache->shards[0].history_items);
+	zbx_binary_heap_destroy(&cache->shards[0].history_queue);
+	zbx_free(cache);
+	zbx_shmem_destroy(hc_mem);
+}
@@ -21,6 +21,8 @@
 
 #include "valuecache_test.h"
 #include "zbxmocktest.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
 
 void	zbx_vc_set_mode(int mode)
 {
@@ -30,9 +32,10 @@ void	zbx_vc_set_mode(int mode)
 
 int	zbx_vc_get_cached_values(zbx_uint64_t itemid, unsigned char value_type, zbx_vector_history_record_t *values)
 {
-	zbx_vc_item_t	*item;
-	int		i;
-	zbx_vc_chunk_t	*chunk;
+	zbx_vc_item_t			*item;
+	int				i, last;
+	zbx_vc_chunk_t			*chunk;
+	const zbx_history_record_t	*slots;
 
 	if (NULL == (item = zbx_hashset_search(&vc_cache->items, &itemid)))
 		return FAIL;
@@ -42,8 +45,10 @@ int	zbx_vc_get_cached_values(zbx_uint64_t itemid, unsigned char value_type, zbx_
 
 	for (chunk = item->tail; NULL != chunk; chunk = chunk->next)
 	{
-		for (i = chunk->first_value; i <= chunk->last_value; i++)
-			vc_history_record_vector_append(values, value_type, &chunk->slots[i]);
+		slots = vch_chunk_get_values(chunk, &last);
+
+		for (i = 0; i <= last; i++)
+			vc_history_record_vector_append(values, value_type, &slots[i]);
 	}
 
 	return SUCCEED;
@@ -64,9 +69,9 @@ int	zbx_vc_precache_values(zbx_uint64_t itemid, int value_type, int seconds, int
 
 	/* perform request to cache values */
 	zbx_history_record_vector_create(&values);
-	RDLOCK_CACHE;
+	vc_lock_items(VC_ITEM_LOCK_INDEX(itemid), ZBX_VC_LOCK_ITEM_READ);
 	ret = vch_item_get_values(item, &values, seconds, count, ts);
-	UNLOCK_CACHE;
+	vc_unlock();
 	zbx_vc_flush_stats();
 	zbx_history_record_vector_destroy(&values, value_type);
 
@@ -96,6 +101,32 @@ int	zbx_vc_get_item_state(zbx_uint64_t itemid, int *status, int *active_range, i
 	return ret;
 }
 
+int	zbx_vc_add_item(zbx_uint64_t itemid, unsigned char value_type, int active_range, int daily_range,
+		int db_cached_from, const zbx_vector_history_record_t *values)
+{
+	zbx_vc_item_t	new_item, *item;
+
+	memset(&new_item, 0, sizeof(new_item));
+	new_item.itemid = itemid;
+	new_item.value_type = value_type;
+	new_item.active_range = active_range;
+	new_item.daily_range = daily_range;
+	new_item.db_cached_from = db_cached_from;
+
+	if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item, sizeof(new_item))))
+		return FAIL;
+
+	if (0 == values->values_num)
+		return SUCCEED;
+
+	return vch_item_add_values_at_tail(item, values->values, values->values_num);
+}
+
+const zbx_hashset_t	*zbx_vc_get_items(void)
+{
+	return NULL == vc_cache ? NULL : &vc_cache->items;
+}
+
 int	zbx_vc_get_cache_state(int *mode, zbx_uint64_t *hits, zbx_uint64_t *misses)
 {
 	if (NULL == vc_cache)
@@ -108,6 +139,50 @@ int	zbx_vc_get_cache_state(int *mode, zbx_uint64_t *hits, zbx_uint64_t *misses)
 	return SUCCEED;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks items saved in value cache warm-up file                    *
+ *                                                                            *
+ * Parameters: path - [IN] the warm-up file path                              *
+ *             key  - [IN] the expected items in test data                    *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vcmock_check_warmup_items(const char *path, const char *key)
+{
+	zbx_vector_vc_warmup_item_t	items;
+	zbx_mock_handle_t		hitems, hitem;
+	zbx_mock_error_t		err;
+	int				i = 0;
+
+	zbx_vector_vc_warmup_item_create(&items);
+
+	zbx_mock_assert_result_eq("reading warm-up file", SUCCEED, vc_warmup_read_items(path, &items));
+	zbx_vector_vc_warmup_item_sort(&items, vc_warmup_itemid_compare_func);
+
+	hitems = zbx_mock_get_parameter_handle(key);
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hitems, &hitem))))
+	{
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read saved item: %s", zbx_mock_error_string(err));
+
+		if (i >= items.values_num)
+			fail_msg("too few items in warm-up file");
+
+		zbx_mock_assert_uint64_eq("saved itemid", zbx_mock_get_object_member_uint64(hitem, "itemid"),
+				items.values[i].itemid);
+		zbx_mock_assert_int_eq("saved range", zbx_mock_get_object_member_int(hitem, "range"),
+				items.values[i].range);
+		zbx_mock_assert_int_eq("saved value type", zbx_mock_str_to_value_type(
+				zbx_mock_get_object_member_string(hitem, "value_type")), items.values[i].value_type);
+		i++;
+	}
+
+	zbx_mock_assert_int_eq("saved items", i, items.values_num);
+
+	zbx_vector_vc_warmup_item_destroy(&items);
+}
+
 /*
  * cache working mode handling
  */
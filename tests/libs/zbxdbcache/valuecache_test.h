@@ -27,9 +27,13 @@ int	zbx_vc_get_cached_values(zbx_uint64_t itemid, unsigned char value_type, zbx_
 int	zbx_vc_precache_values(zbx_uint64_t itemid, int value_type, int seconds, int count, const zbx_timespec_t *ts);
 int	zbx_vc_get_item_state(zbx_uint64_t itemid, int *status, int *active_range, int *values_total,
 		int *db_cached_from);
+int	zbx_vc_add_item(zbx_uint64_t itemid, unsigned char value_type, int active_range, int daily_range,
+		int db_cached_from, const zbx_vector_history_record_t *values);
+const zbx_hashset_t	*zbx_vc_get_items(void);
 int	zbx_vc_get_cache_state(int *mode, zbx_uint64_t *hits, zbx_uint64_t *misses);
 
 void	zbx_vcmock_set_mode(zbx_mock_handle_t hitem, const char *key);
 int	zbx_vcmock_str_to_cache_mode(const char *mode);
+void	zbx_vcmock_check_warmup_items(const char *path, const char *key);
 
 #endif
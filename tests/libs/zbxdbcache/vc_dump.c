@@ -0,0 +1,120 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#include "zbxcachevalue.h"
+#include "zbxmutexs.h"
+#include "zbxdb.h"
+#include "valuecache_test.h"
+#include "vc_warmup_test.h"
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds items with their values to value cache                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_add_items(void)
+{
+	zbx_mock_handle_t		hitems, hitem, hvalues, hvalue;
+	zbx_mock_error_t		err;
+	zbx_vector_history_record_t	values;
+
+	zbx_history_record_vector_create(&values);
+
+	hitems = zbx_mock_get_parameter_handle("in.items");
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hitems, &hitem))))
+	{
+		zbx_uint64_t	itemid;
+		unsigned char	value_type;
+
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read item: %s", zbx_mock_error_string(err));
+
+		itemid = zbx_mock_get_object_member_uint64(hitem, "itemid");
+		value_type = (unsigned char)zbx_mock_str_to_value_type(zbx_mock_get_object_member_string(hitem,
+				"value_type"));
+
+		hvalues = zbx_mock_get_object_member_handle(hitem, "values");
+
+		while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hvalues, &hvalue))))
+		{
+			zbx_history_record_t	record;
+
+			if (ZBX_MOCK_SUCCESS != err)
+				fail_msg("cannot read item value: %s", zbx_mock_error_string(err));
+
+			zbx_vcmock_read_value(hvalue, value_type, &record);
+			zbx_vector_history_record_append_ptr(&values, &record);
+		}
+
+		if (SUCCEED != zbx_vc_add_item(itemid, value_type, zbx_mock_get_object_member_int(hitem, "active_range"),
+				zbx_mock_get_object_member_int(hitem, "daily_range"),
+				zbx_mock_get_object_member_int(hitem, "db_cached_from"), &values))
+		{
+			fail_msg("cannot add item " ZBX_FS_UI64 " to value cache", itemid);
+		}
+
+		zbx_history_record_vector_clean(&values, value_type);
+	}
+
+	zbx_vector_history_record_destroy(&values);
+}
+
+void	zbx_mock_test_entry(void **state)
+{
+	char	path[] = "/tmp/zbx_vc_dump_XXXXXX";
+	char	*error = NULL;
+	int	fd;
+
+	ZBX_UNUSED(state);
+
+	if (SUCCEED != zbx_locks_create(&error))
+		fail_msg("cannot create locks: %s", error);
+
+	if (SUCCEED != zbx_vc_init(ZBX_MEBIBYTE, &error))
+		fail_msg("cannot initialize value cache: %s", error);
+
+	zbx_vc_enable();
+
+	if (-1 == (fd = mkstemp(path)))
+		fail_msg("cannot create dump file: %s", zbx_strerror(errno));
+
+	close(fd);
+
+	vc_test_add_items();
+	zbx_vc_dump(path);
+
+	zbx_vc_reset();
+	zbx_vc_restore(path);
+	zbx_vcmock_check_cached_items("out.restored");
+
+	if (0 == access(path, F_OK))
+		fail_msg("dump file was not removed after restoring");
+
+	zbx_vc_warmup(NULL);
+	zbx_vcmock_check_cached_items("out.cached");
+
+	zbx_vc_reset();
+	zbx_vc_destroy();
+}
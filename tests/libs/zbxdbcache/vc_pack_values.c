@@ -0,0 +1,231 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "../../../src/libs/zbxcachevalue/valuecache.c"
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#define VC_TEST_CACHE_SIZE	(16 * ZBX_MEBIBYTE)
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads history values from test data                               *
+ *                                                                            *
+ * Comments: Values are either listed in 'values' vector or generated by      *
+ *           'generate' parameters. Values can be also specified by their     *
+ *           hexadecimal binary representation in 'bits' member.              *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_read_values(unsigned char value_type, zbx_vector_history_record_t *values)
+{
+	zbx_mock_handle_t	hvalues, hvalue, hbits;
+	zbx_mock_error_t	err;
+	zbx_history_record_t	record;
+
+	if (ZBX_MOCK_SUCCESS == zbx_mock_parameter("in.values", &hvalues))
+	{
+		while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hvalues, &hvalue))))
+		{
+			if (ZBX_MOCK_SUCCESS != err)
+				fail_msg("cannot read value: %s", zbx_mock_error_string(err));
+
+			record.timestamp.sec = zbx_mock_get_object_member_int(hvalue, "clock");
+			record.timestamp.ns = zbx_mock_get_object_member_int(hvalue, "ns");
+
+			if (ZBX_MOCK_SUCCESS == zbx_mock_object_member(hvalue, "bits", &hbits))
+			{
+				if (1 != sscanf(zbx_mock_get_object_member_string(hvalue, "bits"), ZBX_FS_UX64,
+						&record.value.ui64))
+				{
+					fail_msg("cannot read value binary representation");
+				}
+			}
+			else if (ITEM_VALUE_TYPE_FLOAT == value_type)
+				record.value.dbl = atof(zbx_mock_get_object_member_string(hvalue, "value"));
+			else
+				record.value.ui64 = zbx_mock_get_object_member_uint64(hvalue, "value");
+
+			zbx_vector_history_record_append_ptr(values, &record);
+		}
+	}
+
+	if (ZBX_MOCK_SUCCESS == zbx_mock_parameter("in.generate", &hvalue))
+	{
+		int	i, num, interval;
+
+		record.timestamp.sec = zbx_mock_get_object_member_int(hvalue, "clock");
+		record.timestamp.ns = 0;
+		interval = zbx_mock_get_object_member_int(hvalue, "interval");
+		num = zbx_mock_get_object_member_int(hvalue, "num");
+
+		/* generate values with varying intervals, nanoseconds and values */
+		for (i = 0; i < num; i++)
+		{
+			record.timestamp.sec += interval + i % 3;
+			record.timestamp.ns = (0 == i % 5 ? i * 1000 : record.timestamp.ns);
+
+			if (ITEM_VALUE_TYPE_FLOAT == value_type)
+				record.value.dbl = (double)(i % 7) * 0.25 - (double)(i % 11);
+			else
+				record.value.ui64 = (zbx_uint64_t)(i % 13) << (i % 50);
+
+			zbx_vector_history_record_append_ptr(values, &record);
+		}
+	}
+}
+
+static void	vc_test_assert_record_eq(int index, const zbx_history_record_t *expected,
+		const zbx_history_record_t *returned)
+{
+	char	msg[64];
+
+	zbx_snprintf(msg, sizeof(msg), "value #%d seconds", index);
+	zbx_mock_assert_int_eq(msg, expected->timestamp.sec, returned->timestamp.sec);
+
+	zbx_snprintf(msg, sizeof(msg), "value #%d nanoseconds", index);
+	zbx_mock_assert_int_eq(msg, expected->timestamp.ns, returned->timestamp.ns);
+
+	/* compare binary representation to check NaN and signed zero floating point values */
+	zbx_snprintf(msg, sizeof(msg), "value #%d", index);
+	zbx_mock_assert_uint64_eq(msg, expected->value.ui64, returned->value.ui64);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compresses values and decompresses them back                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_pack_values(const zbx_vector_history_record_t *values)
+{
+	zbx_vc_bitbuf_t		buf = {0};
+	zbx_vc_pack_state_t	state = {0};
+	zbx_mock_handle_t	hbits;
+	size_t			offset = 0;
+	int			i;
+
+	for (i = 0; i < values->values_num; i++)
+		vc_pack_value(&buf, &state, &values->values[i], 0 == i);
+
+	if (ZBX_MOCK_SUCCESS == zbx_mock_parameter("out.bits", &hbits))
+	{
+		zbx_mock_assert_uint64_eq("compressed size in bits", zbx_mock_get_parameter_uint64("out.bits"),
+				buf.offset);
+	}
+
+	memset(&state, 0, sizeof(state));
+
+	for (i = 0; i < values->values_num; i++)
+	{
+		zbx_history_record_t	record;
+
+		vc_unpack_value(buf.data, &offset, &state, &record, 0 == i);
+		vc_test_assert_record_eq(i, &values->values[i], &record);
+	}
+
+	zbx_mock_assert_uint64_eq("decompressed size in bits", buf.offset, offset);
+
+	zbx_free(buf.data);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds values to item cache and checks values read from its chunks  *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_cache_values(unsigned char value_type, const zbx_vector_history_record_t *values)
+{
+	zbx_vc_item_t		item;
+	zbx_vc_chunk_t		*chunk;
+	int			i, index = 0, packed_num = 0;
+	char			*error = NULL;
+
+	if (SUCCEED != zbx_shmem_create(&vc_mem, VC_TEST_CACHE_SIZE, "value cache size", "ValueCacheSize", 1, &error))
+		fail_msg("cannot create value cache: %s", error);
+
+	memset(&item, 0, sizeof(item));
+	item.itemid = 1;
+	item.value_type = value_type;
+
+	for (i = 0; i < values->values_num; i++)
+	{
+		if (SUCCEED != vch_item_add_value_at_head(&item, &values->values[i]))
+			fail_msg("cannot add value #%d to cache", i);
+	}
+
+	for (chunk = item.tail; NULL != chunk; chunk = chunk->next)
+	{
+		const zbx_history_record_t	*chunk_values;
+		int				j, last;
+
+		chunk_values = vch_chunk_get_values(chunk, &last);
+
+		if (0 != chunk->packed_num)
+		{
+			zbx_mock_assert_ptr_ne("compressed head chunk", item.head, chunk);
+
+			/* the first and last values of compressed chunk are kept uncompressed */
+			vc_test_assert_record_eq(index, &chunk_values[0], &chunk->slots[0]);
+			vc_test_assert_record_eq(index + last, &chunk_values[last], &chunk->slots[1]);
+			packed_num++;
+		}
+
+		for (j = 0; j <= last; j++, index++)
+		{
+			if (index >= values->values_num)
+				fail_msg("more values cached than added");
+
+			vc_test_assert_record_eq(index, &values->values[index], &chunk_values[j]);
+		}
+	}
+
+	zbx_mock_assert_int_eq("cached values", values->values_num, index);
+
+	if (SUCCEED == zbx_mock_str_to_return_code(zbx_mock_get_parameter_string("out.packed")))
+	{
+		if (0 == packed_num)
+			fail_msg("no chunks were compressed");
+	}
+	else
+		zbx_mock_assert_int_eq("compressed chunks", 0, packed_num);
+
+	vch_item_free_cache(&item);
+	zbx_shmem_destroy(vc_mem);
+	vc_mem = NULL;
+}
+
+void	zbx_mock_test_entry(void **state)
+{
+	zbx_vector_history_record_t	values;
+	unsigned char			value_type;
+
+	ZBX_UNUSED(state);
+
+	zbx_history_record_vector_create(&values);
+
+	value_type = zbx_mock_str_to_value_type(zbx_mock_get_parameter_string("in.value_type"));
+	vc_test_read_values(value_type, &values);
+
+	vc_test_pack_values(&values);
+	vc_test_cache_values(value_type, &values);
+
+	zbx_vector_history_record_destroy(&values);
+}
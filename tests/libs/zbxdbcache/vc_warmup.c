@@ -0,0 +1,222 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#include "zbxcachevalue.h"
+#include "zbxmutexs.h"
+#include "zbxdb.h"
+#include "valuecache_test.h"
+#include "vc_warmup_test.h"
+
+int	__wrap_zbx_db_connect(int flag);
+void	__wrap_zbx_db_close(void);
+void	__wrap_zbx_db_thread_deinit_basic(void);
+void	*__real_zbx_hashset_insert(zbx_hashset_t *hs, const void *data, size_t size);
+void	*__wrap_zbx_hashset_insert(zbx_hashset_t *hs, const void *data, size_t size);
+
+/* when helper threads cannot connect, batches are read by the main process in order */
+static int			vc_test_connect = ZBX_DB_DOWN;
+
+/* the order of items added to value cache */
+static zbx_vector_uint64_t	vc_test_added;
+static int			vc_test_record_added = 0;
+
+int	__wrap_zbx_db_connect(int flag)
+{
+	ZBX_UNUSED(flag);
+
+	return vc_test_connect;
+}
+
+void	__wrap_zbx_db_close(void)
+{
+}
+
+void	__wrap_zbx_db_thread_deinit_basic(void)
+{
+}
+
+void	*__wrap_zbx_hashset_insert(zbx_hashset_t *hs, const void *data, size_t size)
+{
+	if (0 != vc_test_record_added && zbx_vc_get_items() == hs)
+		zbx_vector_uint64_append(&vc_test_added, *(const zbx_uint64_t *)data);
+
+	return __real_zbx_hashset_insert(hs, data, size);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds items with their request ranges to value cache               *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_add_items(void)
+{
+	zbx_mock_handle_t		hitems, hitem;
+	zbx_mock_error_t		err;
+	zbx_vector_history_record_t	values;
+
+	zbx_history_record_vector_create(&values);
+
+	hitems = zbx_mock_get_parameter_handle("in.items");
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hitems, &hitem))))
+	{
+		zbx_uint64_t	itemid;
+
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read item: %s", zbx_mock_error_string(err));
+
+		itemid = zbx_mock_get_object_member_uint64(hitem, "itemid");
+
+		if (SUCCEED != zbx_vc_add_item(itemid, (unsigned char)zbx_mock_str_to_value_type(
+				zbx_mock_get_object_member_string(hitem, "value_type")),
+				zbx_mock_get_object_member_int(hitem, "active_range"),
+				zbx_mock_get_object_member_int(hitem, "daily_range"), 0, &values))
+		{
+			fail_msg("cannot add item " ZBX_FS_UI64 " to value cache", itemid);
+		}
+	}
+
+	zbx_vector_history_record_destroy(&values);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds generated items to value cache                               *
+ *                                                                            *
+ * Comments: Item ranges grow with itemids, so warm-up batches are formed of  *
+ *           consecutive itemids.                                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_generate_items(int items_num)
+{
+	zbx_vector_history_record_t	values;
+	int				i;
+
+	zbx_history_record_vector_create(&values);
+
+	for (i = 1; i <= items_num; i++)
+	{
+		if (SUCCEED != zbx_vc_add_item((zbx_uint64_t)i, ITEM_VALUE_TYPE_FLOAT, SEC_PER_MIN + i, 0, 0, &values))
+			fail_msg("cannot add item %d to value cache", i);
+	}
+
+	zbx_vector_history_record_destroy(&values);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks generated items loaded into cache by warm-up               *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_check_generated_items(int items_num)
+{
+	zbx_vector_history_record_t	values;
+	zbx_uint64_t			cached_num, values_num;
+	int				i, mode;
+
+	zbx_vc_get_diag_stats(&cached_num, &values_num, &mode);
+	zbx_mock_assert_uint64_eq("cached items", (zbx_uint64_t)items_num, cached_num);
+	zbx_mock_assert_int_eq("added items", items_num, vc_test_added.values_num);
+
+	zbx_history_record_vector_create(&values);
+
+	for (i = 0; i < items_num; i++)
+	{
+		zbx_uint64_t	itemid = (zbx_uint64_t)i + 1;
+
+		/* batches are added in order even when later batches are read first */
+		zbx_mock_assert_uint64_eq("added item", itemid, vc_test_added.values[i]);
+
+		if (SUCCEED != zbx_vc_get_cached_values(itemid, ITEM_VALUE_TYPE_FLOAT, &values))
+			fail_msg("item " ZBX_FS_UI64 " is not cached", itemid);
+
+		zbx_mock_assert_int_eq("cached values", 1, values.values_num);
+		zbx_mock_assert_double_eq("cached value", (double)itemid, values.values[0].value.dbl);
+
+		zbx_history_record_vector_clean(&values, ITEM_VALUE_TYPE_FLOAT);
+	}
+
+	zbx_history_record_vector_destroy(&values, ITEM_VALUE_TYPE_FLOAT);
+}
+
+void	zbx_mock_test_entry(void **state)
+{
+	char	path[] = "/tmp/zbx_vc_warmup_XXXXXX";
+	char	*error = NULL;
+	int	fd;
+
+	ZBX_UNUSED(state);
+
+	if (SUCCEED == zbx_mock_str_to_return_code(zbx_mock_get_parameter_string("in.threads")))
+		vc_test_connect = ZBX_DB_OK;
+
+	if (SUCCEED != zbx_locks_create(&error))
+		fail_msg("cannot create locks: %s", error);
+
+	if (SUCCEED != zbx_vc_init(16 * ZBX_MEBIBYTE, &error))
+		fail_msg("cannot initialize value cache: %s", error);
+
+	zbx_vc_enable();
+
+	if (-1 == (fd = mkstemp(path)))
+		fail_msg("cannot create warm-up file: %s", zbx_strerror(errno));
+
+	close(fd);
+
+	if (ZBX_MOCK_SUCCESS == zbx_mock_parameter_exists("in.items_num"))
+	{
+		int	items_num = (int)zbx_mock_get_parameter_uint64("in.items_num");
+
+		zbx_vector_uint64_create(&vc_test_added);
+
+		vc_test_generate_items(items_num);
+		zbx_vc_save_items(path);
+
+		zbx_vc_reset();
+
+		zbx_vcmock_set_history_items(items_num, (int)time(NULL) - 1);
+		vc_test_record_added = 1;
+		zbx_vc_warmup(path);
+		vc_test_record_added = 0;
+
+		vc_test_check_generated_items(items_num);
+
+		zbx_vector_uint64_destroy(&vc_test_added);
+	}
+	else
+	{
+		vc_test_add_items();
+		zbx_vc_save_items(path);
+		zbx_vcmock_check_warmup_items(path, "out.saved");
+
+		zbx_vc_reset();
+		zbx_vc_warmup(path);
+		zbx_vcmock_check_cached_items("out.cached");
+	}
+
+	unlink(path);
+
+	zbx_vc_reset();
+	zbx_vc_destroy();
+}
@@ -0,0 +1,269 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "vc_warmup_test.h"
+
+#include "zbxmocktest.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#include "zbxnum.h"
+#include "zbxcachevalue.h"
+#include "valuecache_test.h"
+
+time_t	__wrap_time(time_t *ptr);
+int	__wrap_zbx_history_get_values_multi(const zbx_vector_uint64_t *itemids, int value_type, int start, int end,
+		zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values);
+
+/* test data is accessed by warm-up helper threads too */
+static pthread_mutex_t	vc_mock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the number of generated items, their values are returned without reading test data */
+static int		vc_mock_items_num = 0;
+static int		vc_mock_clock;
+
+time_t	__wrap_time(time_t *ptr)
+{
+	time_t	now;
+
+	pthread_mutex_lock(&vc_mock_lock);
+	now = (time_t)zbx_mock_get_parameter_uint64("in.now");
+	pthread_mutex_unlock(&vc_mock_lock);
+
+	if (NULL != ptr)
+		*ptr = now;
+
+	return now;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: makes history mock return generated values instead of test data  *
+ *                                                                            *
+ * Parameters: items_num - [IN] the number of generated items, 0 to read test *
+ *                              data                                          *
+ *             clock     - [IN] the generated value timestamp                 *
+ *                                                                            *
+ * Comments: Item with itemid N has single float value N. The first batches   *
+ *           take longest to read, so helper threads finish them last.        *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vcmock_set_history_items(int items_num, int clock)
+{
+	vc_mock_items_num = items_num;
+	vc_mock_clock = clock;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads history value from test data                                *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vcmock_read_value(zbx_mock_handle_t hvalue, unsigned char value_type, zbx_history_record_t *record)
+{
+	const char	*value;
+
+	record->timestamp.sec = zbx_mock_get_object_member_int(hvalue, "clock");
+	record->timestamp.ns = zbx_mock_get_object_member_int(hvalue, "ns");
+	value = zbx_mock_get_object_member_string(hvalue, "value");
+
+	switch (value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+			record->value.dbl = atof(value);
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			if (SUCCEED != zbx_is_uint64(value, &record->value.ui64))
+				fail_msg("invalid unsigned value \"%s\"", value);
+			break;
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			record->value.str = zbx_strdup(NULL, value);
+			break;
+		default:
+			fail_msg("unsupported value type %d", value_type);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns history rows of the requested items like the multi item   *
+ *          SQL query does - ordered by itemid only                           *
+ *                                                                            *
+ ******************************************************************************/
+int	__wrap_zbx_history_get_values_multi(const zbx_vector_uint64_t *itemids, int value_type, int start, int end,
+		zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values)
+{
+	zbx_mock_handle_t	hrows, hrow;
+	zbx_mock_error_t	err;
+	int			i;
+
+	if (0 != vc_mock_items_num)
+	{
+		usleep((useconds_t)(vc_mock_items_num - (int)itemids->values[0]) * 10);
+
+		for (i = 0; i < itemids->values_num; i++)
+		{
+			zbx_history_record_t	record;
+
+			record.timestamp.sec = vc_mock_clock;
+			record.timestamp.ns = 0;
+			record.value.dbl = (double)itemids->values[i];
+
+			zbx_vector_uint64_append(value_itemids, itemids->values[i]);
+			zbx_vector_history_record_append_ptr(values, &record);
+		}
+
+		return SUCCEED;
+	}
+
+	pthread_mutex_lock(&vc_mock_lock);
+
+	hrows = zbx_mock_get_parameter_handle("in.history");
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hrows, &hrow))))
+	{
+		zbx_history_record_t	record;
+		zbx_uint64_t		itemid;
+		int			clock;
+
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read history row: %s", zbx_mock_error_string(err));
+
+		itemid = zbx_mock_get_object_member_uint64(hrow, "itemid");
+		clock = zbx_mock_get_object_member_int(hrow, "clock");
+
+		if (FAIL == zbx_vector_uint64_bsearch(itemids, itemid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+			continue;
+
+		if (clock <= start || clock > end)
+			continue;
+
+		if (value_type != zbx_mock_str_to_value_type(zbx_mock_get_object_member_string(hrow, "value_type")))
+			fail_msg("item " ZBX_FS_UI64 " values are requested with wrong value type", itemid);
+
+		zbx_vcmock_read_value(hrow, (unsigned char)value_type, &record);
+		zbx_vector_uint64_append(value_itemids, itemid);
+		zbx_vector_history_record_append_ptr(values, &record);
+	}
+
+	pthread_mutex_unlock(&vc_mock_lock);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks values of cached item                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_mock_check_item_values(zbx_mock_handle_t hvalues, zbx_uint64_t itemid, unsigned char value_type)
+{
+	zbx_mock_handle_t		hvalue;
+	zbx_mock_error_t		err;
+	zbx_vector_history_record_t	values;
+	int				i = 0;
+
+	zbx_history_record_vector_create(&values);
+
+	if (SUCCEED != zbx_vc_get_cached_values(itemid, value_type, &values))
+		fail_msg("item " ZBX_FS_UI64 " is not cached", itemid);
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hvalues, &hvalue))))
+	{
+		zbx_history_record_t	expected;
+
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read cached value: %s", zbx_mock_error_string(err));
+
+		if (i >= values.values_num)
+			fail_msg("too few values cached for item " ZBX_FS_UI64, itemid);
+
+		zbx_vcmock_read_value(hvalue, value_type, &expected);
+
+		zbx_mock_assert_timespec_eq("cached value timestamp", &expected.timestamp, &values.values[i].timestamp);
+
+		switch (value_type)
+		{
+			case ITEM_VALUE_TYPE_FLOAT:
+				zbx_mock_assert_double_eq("cached value", expected.value.dbl, values.values[i].value.dbl);
+				break;
+			case ITEM_VALUE_TYPE_UINT64:
+				zbx_mock_assert_uint64_eq("cached value", expected.value.ui64,
+						values.values[i].value.ui64);
+				break;
+			default:
+				zbx_mock_assert_str_eq("cached value", expected.value.str, values.values[i].value.str);
+				zbx_free(expected.value.str);
+		}
+
+		i++;
+	}
+
+	if (i != values.values_num)
+		fail_msg("too many values cached for item " ZBX_FS_UI64, itemid);
+
+	zbx_history_record_vector_destroy(&values, value_type);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks items and their values in value cache                      *
+ *                                                                            *
+ * Parameters: key - [IN] the expected items in test data                     *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vcmock_check_cached_items(const char *key)
+{
+	zbx_mock_handle_t	hitems, hitem;
+	zbx_mock_error_t	err;
+	zbx_uint64_t		items_num = 0, cached_num, values_num;
+	int			mode;
+
+	hitems = zbx_mock_get_parameter_handle(key);
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hitems, &hitem))))
+	{
+		zbx_uint64_t	itemid;
+		unsigned char	value_type;
+		int		status, active_range, values_total, db_cached_from;
+
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read cached item: %s", zbx_mock_error_string(err));
+
+		itemid = zbx_mock_get_object_member_uint64(hitem, "itemid");
+		value_type = (unsigned char)zbx_mock_str_to_value_type(zbx_mock_get_object_member_string(hitem,
+				"value_type"));
+
+		if (SUCCEED != zbx_vc_get_item_state(itemid, &status, &active_range, &values_total, &db_cached_from))
+			fail_msg("item " ZBX_FS_UI64 " is not cached", itemid);
+
+		zbx_mock_assert_int_eq("active range", zbx_mock_get_object_member_int(hitem, "active_range"),
+				active_range);
+		zbx_mock_assert_int_eq("cached from", zbx_mock_get_object_member_int(hitem, "db_cached_from"),
+				db_cached_from);
+
+		vc_mock_check_item_values(zbx_mock_get_object_member_handle(hitem, "values"), itemid, value_type);
+
+		items_num++;
+	}
+
+	zbx_vc_get_diag_stats(&cached_num, &values_num, &mode);
+	zbx_mock_assert_uint64_eq("cached items", items_num, cached_num);
+}
@@ -0,0 +1,30 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_VC_WARMUP_TEST_H
+#define ZABBIX_VC_WARMUP_TEST_H
+
+#include "zbxhistory.h"
+#include "zbxmockdata.h"
+
+void	zbx_vcmock_set_history_items(int items_num, int clock);
+void	zbx_vcmock_read_value(zbx_mock_handle_t hvalue, unsigned char value_type, zbx_history_record_t *record);
+void	zbx_vcmock_check_cached_items(const char *key);
+
+#endif
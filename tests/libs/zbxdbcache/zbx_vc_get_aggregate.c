@@ -0,0 +1,284 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#include "zbxnum.h"
+#include "zbxmutexs.h"
+#include "zbxcachevalue.h"
+#include "valuecache_test.h"
+#include "mocks/valuecache/valuecache_mock.h"
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds values to history and value cache                            *
+ *                                                                            *
+ * Comments: Values are either listed in 'values' vector or generated by      *
+ *           'generate' parameters - the first timestamp, interval between    *
+ *           values in seconds, the number of values, the first value,        *
+ *           increment and optional modulo of the generated values.           *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_add_values(zbx_mock_handle_t hstep, zbx_uint64_t itemid, unsigned char value_type)
+{
+	zbx_vector_ptr_t	history;
+	zbx_mock_handle_t	hgen, hvalues, hvalue;
+	zbx_mock_error_t	err;
+	int			ret_flush;
+
+	zbx_vector_ptr_create(&history);
+
+	if (ZBX_MOCK_SUCCESS == zbx_mock_object_member(hstep, "values", &hvalues))
+	{
+		while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hvalues, &hvalue))))
+		{
+			zbx_dc_history_t	*h;
+
+			if (ZBX_MOCK_SUCCESS != err)
+				fail_msg("cannot read value: %s", zbx_mock_error_string(err));
+
+			h = (zbx_dc_history_t *)zbx_malloc(NULL, sizeof(zbx_dc_history_t));
+			memset(h, 0, sizeof(zbx_dc_history_t));
+			h->itemid = itemid;
+			h->value_type = value_type;
+
+			if (ITEM_VALUE_TYPE_FLOAT == value_type)
+				h->value.dbl = atof(zbx_mock_get_object_member_string(hvalue, "value"));
+			else
+				h->value.ui64 = zbx_mock_get_object_member_uint64(hvalue, "value");
+
+			if (ZBX_MOCK_SUCCESS != zbx_strtime_to_timespec(zbx_mock_get_object_member_string(hvalue,
+					"ts"), &h->ts))
+			{
+				fail_msg("cannot read value timestamp");
+			}
+
+			zbx_vector_ptr_append(&history, h);
+		}
+	}
+
+	if (ZBX_MOCK_SUCCESS == zbx_mock_object_member(hstep, "generate", &hgen))
+	{
+		zbx_timespec_t	ts;
+		zbx_uint64_t	modulo = 0;
+		zbx_mock_handle_t	hmodulo;
+		int		i, interval, num;
+		double		value, delta;
+
+		if (ZBX_MOCK_SUCCESS != zbx_strtime_to_timespec(zbx_mock_get_object_member_string(hgen, "start"), &ts))
+			fail_msg("cannot read generated values start timestamp");
+
+		interval = zbx_mock_get_object_member_int(hgen, "interval");
+		num = zbx_mock_get_object_member_int(hgen, "num");
+		value = atof(zbx_mock_get_object_member_string(hgen, "value"));
+		delta = atof(zbx_mock_get_object_member_string(hgen, "delta"));
+
+		if (ZBX_MOCK_SUCCESS == zbx_mock_object_member(hgen, "modulo", &hmodulo))
+			modulo = zbx_mock_get_object_member_uint64(hgen, "modulo");
+
+		for (i = 0; i < num; i++, ts.sec += interval, value += delta)
+		{
+			zbx_dc_history_t	*h;
+
+			h = (zbx_dc_history_t *)zbx_malloc(NULL, sizeof(zbx_dc_history_t));
+			memset(h, 0, sizeof(zbx_dc_history_t));
+			h->itemid = itemid;
+			h->value_type = value_type;
+			h->ts = ts;
+
+			if (ITEM_VALUE_TYPE_FLOAT == value_type)
+				h->value.dbl = (0 != modulo ? fmod(value, (double)modulo) : value);
+			else
+				h->value.ui64 = (0 != modulo ? (zbx_uint64_t)value % modulo : (zbx_uint64_t)value);
+
+			zbx_vector_ptr_append(&history, h);
+		}
+	}
+
+	zbx_vc_add_values(&history, &ret_flush);
+
+	zbx_vector_ptr_clear_ext(&history, zbx_ptr_free);
+	zbx_vector_ptr_destroy(&history);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compares floating point values with relative tolerance            *
+ *                                                                            *
+ * Comments: The running sum is compensated while the expected sum is not,    *
+ *           so they can differ in the last digits.                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_assert_double_eq(const char *msg, double expected, double returned)
+{
+	if (fabs(expected - returned) > fabs(expected) * 1e-12 + zbx_get_double_epsilon())
+		fail_msg("%s: expected value \"%f\" while got \"%f\"", msg, expected, returned);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks running aggregate against aggregate of values returned by  *
+ *          zbx_vc_get_values()                                               *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_test_check_aggregate(int func, unsigned char value_type, const zbx_history_value_t *value,
+		int values_num, const zbx_vector_history_record_t *values)
+{
+	zbx_history_value_t	expected;
+	double			sum_dbl = 0;
+	zbx_uint64_t		sum_ui64 = 0;
+	int			i;
+	char			msg[64];
+
+	zbx_snprintf(msg, sizeof(msg), "function %d number of values", func);
+	zbx_mock_assert_int_eq(msg, values->values_num, values_num);
+
+	if (0 == values->values_num || ZBX_VC_AGGREGATE_COUNT == func)
+		return;
+
+	expected = values->values[0].value;
+
+	for (i = 0; i < values->values_num; i++)
+	{
+		const zbx_history_value_t	*v = &values->values[i].value;
+
+		if (ITEM_VALUE_TYPE_FLOAT == value_type)
+		{
+			sum_dbl += v->dbl;
+
+			if ((ZBX_VC_AGGREGATE_MIN == func && v->dbl < expected.dbl) ||
+					(ZBX_VC_AGGREGATE_MAX == func && v->dbl > expected.dbl))
+			{
+				expected = *v;
+			}
+		}
+		else
+		{
+			sum_ui64 += v->ui64;
+			sum_dbl += (double)v->ui64;
+
+			if ((ZBX_VC_AGGREGATE_MIN == func && v->ui64 < expected.ui64) ||
+					(ZBX_VC_AGGREGATE_MAX == func && v->ui64 > expected.ui64))
+			{
+				expected = *v;
+			}
+		}
+	}
+
+	zbx_snprintf(msg, sizeof(msg), "function %d value", func);
+
+	switch (func)
+	{
+		case ZBX_VC_AGGREGATE_SUM:
+			if (ITEM_VALUE_TYPE_FLOAT == value_type)
+				vc_test_assert_double_eq(msg, sum_dbl, value->dbl);
+			else
+				zbx_mock_assert_uint64_eq(msg, sum_ui64, value->ui64);
+			break;
+		case ZBX_VC_AGGREGATE_AVG:
+			vc_test_assert_double_eq(msg, sum_dbl / values->values_num, value->dbl);
+			break;
+		default:
+			if (ITEM_VALUE_TYPE_FLOAT == value_type)
+				vc_test_assert_double_eq(msg, expected.dbl, value->dbl);
+			else
+				zbx_mock_assert_uint64_eq(msg, expected.ui64, value->ui64);
+	}
+}
+
+void	zbx_mock_test_entry(void **state)
+{
+	static const int		funcs[] = {ZBX_VC_AGGREGATE_SUM, ZBX_VC_AGGREGATE_AVG, ZBX_VC_AGGREGATE_MIN,
+							ZBX_VC_AGGREGATE_MAX, ZBX_VC_AGGREGATE_COUNT};
+	int				err, seconds, count, i;
+	char				*error;
+	zbx_mock_handle_t		hsteps, hstep;
+	zbx_mock_error_t		mock_err;
+	zbx_uint64_t			itemid;
+	unsigned char			value_type;
+	zbx_vector_history_record_t	values;
+
+	ZBX_UNUSED(state);
+
+	err = zbx_locks_create(&error);
+	zbx_mock_assert_result_eq("Lock initialization failed", SUCCEED, err);
+
+	err = zbx_vc_init(ZBX_MEBIBYTE, &error);
+	zbx_mock_assert_result_eq("Value cache initialization failed", SUCCEED, err);
+
+	zbx_vc_enable();
+
+	zbx_vcmock_ds_init();
+	zbx_history_record_vector_create(&values);
+
+	itemid = zbx_mock_get_parameter_uint64("in.itemid");
+	value_type = zbx_mock_str_to_value_type(zbx_mock_get_parameter_string("in.value_type"));
+	seconds = (int)zbx_mock_get_parameter_uint64("in.seconds");
+	count = (int)zbx_mock_get_parameter_uint64("in.count");
+
+	hsteps = zbx_mock_get_parameter_handle("in.steps");
+
+	while (ZBX_MOCK_END_OF_VECTOR != (mock_err = (zbx_mock_vector_element(hsteps, &hstep))))
+	{
+		zbx_timespec_t	ts;
+		int		expected_ret;
+
+		if (ZBX_MOCK_SUCCESS != mock_err)
+			fail_msg("cannot read test step: %s", zbx_mock_error_string(mock_err));
+
+		zbx_vcmock_set_time(hstep, "time");
+		vc_test_add_values(hstep, itemid, value_type);
+
+		if (ZBX_MOCK_SUCCESS != zbx_strtime_to_timespec(zbx_mock_get_object_member_string(hstep, "end"), &ts))
+			fail_msg("cannot read request end timestamp");
+
+		expected_ret = zbx_mock_str_to_return_code(zbx_mock_get_object_member_string(hstep, "aggregate"));
+
+		for (i = 0; i < (int)ARRSIZE(funcs); i++)
+		{
+			zbx_history_value_t	value;
+			int			values_num;
+
+			err = zbx_vc_get_aggregate(itemid, value_type, funcs[i], seconds, count, &ts, &value,
+					&values_num);
+			zbx_mock_assert_result_eq("zbx_vc_get_aggregate() return value", expected_ret, err);
+
+			/* the fallback path of aggregate functions */
+			err = zbx_vc_get_values(itemid, value_type, &values, seconds, count, &ts);
+			zbx_mock_assert_result_eq("zbx_vc_get_values() return value", SUCCEED, err);
+
+			if (SUCCEED == expected_ret)
+				vc_test_check_aggregate(funcs[i], value_type, &value, values_num, &values);
+
+			zbx_history_record_vector_clean(&values, value_type);
+		}
+
+		zbx_vc_flush_stats();
+	}
+
+	zbx_vector_history_record_destroy(&values);
+
+	zbx_vcmock_ds_destroy();
+
+	zbx_vc_reset();
+	zbx_vc_destroy();
+}
@@ -0,0 +1,173 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2024 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "../../../src/libs/zbxhistory/history_sql.c"
+
+#include "zbxmocktest.h"
+#include "zbxmockdata.h"
+#include "zbxmockassert.h"
+#include "zbxmockutil.h"
+
+#ifdef HAVE_POSTGRESQL
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads history value of the specified type from test data          *
+ *                                                                            *
+ ******************************************************************************/
+static void	sql_test_read_value(zbx_mock_handle_t hvalue, unsigned char value_type, zbx_dc_history_t *h)
+{
+	memset(h, 0, sizeof(zbx_dc_history_t));
+
+	h->value_type = value_type;
+	h->itemid = zbx_mock_get_object_member_uint64(hvalue, "itemid");
+	h->ts.sec = zbx_mock_get_object_member_int(hvalue, "clock");
+	h->ts.ns = zbx_mock_get_object_member_int(hvalue, "ns");
+
+	switch (value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+			h->value.dbl = atof(zbx_mock_get_object_member_string(hvalue, "value"));
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			h->value.ui64 = zbx_mock_get_object_member_uint64(hvalue, "value");
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			h->value.log = (zbx_log_value_t *)zbx_malloc(NULL, sizeof(zbx_log_value_t));
+			h->value.log->timestamp = zbx_mock_get_object_member_int(hvalue, "timestamp");
+			h->value.log->severity = zbx_mock_get_object_member_int(hvalue, "severity");
+			h->value.log->logeventid = zbx_mock_get_object_member_int(hvalue, "logeventid");
+			h->value.log->value = zbx_strdup(NULL, zbx_mock_get_object_member_string(hvalue, "value"));
+			h->value.log->source = NULL;
+			break;
+		default:
+			h->value.str = zbx_strdup(NULL, zbx_mock_get_object_member_string(hvalue, "value"));
+	}
+}
+
+static void	sql_test_free_value(zbx_dc_history_t *h)
+{
+	switch (h->value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+		case ITEM_VALUE_TYPE_UINT64:
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			zbx_free(h->value.log->value);
+			zbx_free(h->value.log);
+			break;
+		default:
+			zbx_free(h->value.str);
+	}
+
+	zbx_free(h);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: removes whitespace and comments up to the end of line from        *
+ *          expected hexadecimal data                                         *
+ *                                                                            *
+ ******************************************************************************/
+static char	*sql_test_strip_hex(const char *hex)
+{
+	char	*out, *ptr;
+
+	ptr = out = zbx_strdup(NULL, hex);
+
+	for (; '\0' != *hex; hex++)
+	{
+		if ('#' == *hex)
+		{
+			while ('\0' != hex[1] && '\n' != hex[1])
+				hex++;
+
+			continue;
+		}
+
+		if (0 == isspace((unsigned char)*hex))
+			*ptr++ = *hex;
+	}
+
+	*ptr = '\0';
+
+	return out;
+}
+#endif
+
+void	zbx_mock_test_entry(void **state)
+{
+#ifdef HAVE_POSTGRESQL
+	zbx_mock_handle_t	hvalues, hvalue;
+	zbx_mock_error_t	err;
+	zbx_vector_ptr_t	history;
+	unsigned char		value_type;
+	const zbx_sql_copy_t	*copy;
+	char			*expected, *returned;
+	size_t			i;
+
+	ZBX_UNUSED(state);
+
+	zbx_vector_ptr_create(&history);
+
+	value_type = zbx_mock_str_to_value_type(zbx_mock_get_parameter_string("in.value_type"));
+	hvalues = zbx_mock_get_parameter_handle("in.values");
+
+	while (ZBX_MOCK_END_OF_VECTOR != (err = (zbx_mock_vector_element(hvalues, &hvalue))))
+	{
+		zbx_dc_history_t	*h;
+
+		if (ZBX_MOCK_SUCCESS != err)
+			fail_msg("cannot read history value: %s", zbx_mock_error_string(err));
+
+		h = (zbx_dc_history_t *)zbx_malloc(NULL, sizeof(zbx_dc_history_t));
+		sql_test_read_value(hvalue, value_type, h);
+		zbx_vector_ptr_append(&history, h);
+	}
+
+	copy_history_funcs[value_type](&history);
+
+	zbx_mock_assert_int_eq("binary copies", 1, writer.dbcopies.values_num);
+	copy = (const zbx_sql_copy_t *)writer.dbcopies.values[0];
+
+	zbx_mock_assert_int_eq("copy value type", value_type, copy->value_type);
+	zbx_mock_assert_str_eq("copy table", zbx_mock_get_parameter_string("out.table"), copy->table);
+
+	returned = (char *)zbx_malloc(NULL, copy->data_offset * 2 + 1);
+
+	for (i = 0; i < copy->data_offset; i++)
+		zbx_snprintf(returned + i * 2, 3, "%02x", (unsigned char)copy->data[i]);
+
+	returned[copy->data_offset * 2] = '\0';
+
+	expected = sql_test_strip_hex(zbx_mock_get_parameter_string("out.data"));
+	zbx_mock_assert_str_eq("binary copy data", expected, returned);
+
+	zbx_free(expected);
+	zbx_free(returned);
+
+	sql_writer_release();
+
+	zbx_vector_ptr_clear_ext(&history, (zbx_clean_func_t)sql_test_free_value);
+	zbx_vector_ptr_destroy(&history);
+#else
+	ZBX_UNUSED(state);
+
+	skip();
+#endif
+}
@@ -198,7 +198,7 @@ class CTask extends CApiService {
 			'request' =>		['type' => API_MULTIPLE, 'flags' => API_REQUIRED, 'rules' => [
 									['if' => ['field' => 'type', 'in' => ZBX_TM_DATA_TYPE_DIAGINFO], 'type' => API_OBJECT, 'fields' => [
 										'historycache' =>	['type' => API_OBJECT, 'fields' => [
-											'stats' =>			['type' => API_OUTPUT, 'in' => implode(',', ['items', 'values', 'memory', 'memory.data', 'memory.index']), 'default' => API_OUTPUT_EXTEND],
+											'stats' =>			['type' => API_OUTPUT, 'in' => implode(',', ['items', 'values', 'memory', 'memory.data', 'memory.index', 'memory.slabs']), 'default' => API_OUTPUT_EXTEND],
 											'top' =>			['type' => API_OBJECT, 'fields' => [
 												'values' =>			['type' => API_INT32]
 											]]